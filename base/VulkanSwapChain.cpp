@@ -193,6 +193,20 @@ void VulkanSwapChain::initSurface(screen_context_t screen_context, screen_window
 	colorSpace = selectedFormat.colorSpace;
 }
 
+/**
+* Render to images owned by the swap chain class instead of a surface, for headless rendering without a window
+* Image acquisition and presentation are no-ops that cycle through the images
+*
+* @param queueNodeIndex Index of the graphics queue family used for rendering
+*/
+void VulkanSwapChain::initOffscreen(uint32_t queueNodeIndex)
+{
+	offscreen = true;
+	this->queueNodeIndex = queueNodeIndex;
+	colorFormat = VK_FORMAT_B8G8R8A8_UNORM;
+	colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+}
+
 /**
 * Set instance, physical and logical device to use for the swapchain and get all required function pointers
 * 
@@ -217,6 +231,12 @@ void VulkanSwapChain::connect(VkInstance instance, VkPhysicalDevice physicalDevi
 */
 void VulkanSwapChain::create(uint32_t *width, uint32_t *height, bool vsync, bool fullscreen)
 {
+	if (offscreen)
+	{
+		createOffscreen(*width, *height);
+		return;
+	}
+
 	// Store the current swap chain handle so we can use it later on to ease up recreation
 	VkSwapchainKHR oldSwapchain = swapChain;
 
@@ -340,7 +360,8 @@ void VulkanSwapChain::create(uint32_t *width, uint32_t *height, bool vsync, bool
 	swapchainCI.compositeAlpha = compositeAlpha;
 
 	// Enable transfer source on swap chain images if supported
-	if (surfCaps.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) {
+	transferSource = (surfCaps.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != 0;
+	if (transferSource) {
 		swapchainCI.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 	}
 
@@ -409,6 +430,13 @@ void VulkanSwapChain::create(uint32_t *width, uint32_t *height, bool vsync, bool
 */
 VkResult VulkanSwapChain::acquireNextImage(VkSemaphore presentCompleteSemaphore, uint32_t *imageIndex)
 {
+	if (offscreen)
+	{
+		// Nothing to wait for, the caller does not wait on the semaphore in offscreen mode
+		*imageIndex = offscreenImageIndex;
+		offscreenImageIndex = (offscreenImageIndex + 1) % imageCount;
+		return VK_SUCCESS;
+	}
 	// By setting timeout to UINT64_MAX we will always wait until the next image has been acquired or an actual error is thrown
 	// With that we don't have to handle VK_NOT_READY
 	return vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, presentCompleteSemaphore, (VkFence)nullptr, imageIndex);
@@ -425,6 +453,10 @@ VkResult VulkanSwapChain::acquireNextImage(VkSemaphore presentCompleteSemaphore,
 */
 VkResult VulkanSwapChain::queuePresent(VkQueue queue, uint32_t imageIndex, VkSemaphore waitSemaphore)
 {
+	if (offscreen)
+	{
+		return VK_SUCCESS;
+	}
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	presentInfo.pNext = NULL;
@@ -446,6 +478,11 @@ VkResult VulkanSwapChain::queuePresent(VkQueue queue, uint32_t imageIndex, VkSem
 */
 void VulkanSwapChain::cleanup()
 {
+	if (offscreen)
+	{
+		destroyOffscreen();
+		return;
+	}
 	if (swapChain != VK_NULL_HANDLE)
 	{
 		for (uint32_t i = 0; i < imageCount; i++)
@@ -462,6 +499,126 @@ void VulkanSwapChain::cleanup()
 	swapChain = VK_NULL_HANDLE;
 }
 
+/**
+* Create (or re-create) the offscreen images and views with the given size
+*/
+void VulkanSwapChain::createOffscreen(uint32_t width, uint32_t height)
+{
+	destroyOffscreen();
+
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	// Double buffered, matches the number of command buffers an example records for a swapchain
+	imageCount = 2;
+	images.resize(imageCount);
+	buffers.resize(imageCount);
+	offscreenMemory.resize(imageCount);
+	for (uint32_t i = 0; i < imageCount; i++)
+	{
+		VkImageCreateInfo imageCI = {};
+		imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = colorFormat;
+		imageCI.extent = { width, height, 1 };
+		imageCI.mipLevels = 1;
+		imageCI.arrayLayers = 1;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &images[i]));
+
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device, images[i], &memReqs);
+		VkMemoryAllocateInfo memAlloc = {};
+		memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = UINT32_MAX;
+		for (uint32_t j = 0; j < memoryProperties.memoryTypeCount; j++)
+		{
+			if ((memReqs.memoryTypeBits & (1 << j)) && (memoryProperties.memoryTypes[j].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+			{
+				memAlloc.memoryTypeIndex = j;
+				break;
+			}
+		}
+		if (memAlloc.memoryTypeIndex == UINT32_MAX)
+		{
+			vks::tools::exitFatal("Could not find a memory type for the offscreen images!", -1);
+		}
+		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &offscreenMemory[i]));
+		VK_CHECK_RESULT(vkBindImageMemory(device, images[i], offscreenMemory[i], 0));
+
+		VkImageViewCreateInfo colorAttachmentView = {};
+		colorAttachmentView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		colorAttachmentView.format = colorFormat;
+		colorAttachmentView.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		colorAttachmentView.subresourceRange.baseMipLevel = 0;
+		colorAttachmentView.subresourceRange.levelCount = 1;
+		colorAttachmentView.subresourceRange.baseArrayLayer = 0;
+		colorAttachmentView.subresourceRange.layerCount = 1;
+		colorAttachmentView.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		colorAttachmentView.image = images[i];
+		buffers[i].image = images[i];
+		VK_CHECK_RESULT(vkCreateImageView(device, &colorAttachmentView, nullptr, &buffers[i].view));
+	}
+
+	// Render passes load the images in presentLayout(), so they start out in it as swapchain images do after a frame
+	VkQueue queue;
+	vkGetDeviceQueue(device, queueNodeIndex, 0, &queue);
+	VkCommandPoolCreateInfo cmdPoolInfo = {};
+	cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	cmdPoolInfo.queueFamilyIndex = queueNodeIndex;
+	VkCommandPool cmdPool;
+	VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &cmdPool));
+	VkCommandBufferAllocateInfo cmdBufAllocateInfo = {};
+	cmdBufAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	cmdBufAllocateInfo.commandPool = cmdPool;
+	cmdBufAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cmdBufAllocateInfo.commandBufferCount = 1;
+	VkCommandBuffer cmdBuffer;
+	VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &cmdBuffer));
+	VkCommandBufferBeginInfo cmdBufInfo = {};
+	cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuffer, &cmdBufInfo));
+	for (uint32_t i = 0; i < imageCount; i++)
+	{
+		vks::tools::setImageLayout(cmdBuffer, images[i], VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, presentLayout());
+	}
+	VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuffer));
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &cmdBuffer;
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	VkFence fence;
+	VK_CHECK_RESULT(vkCreateFence(device, &fenceInfo, nullptr, &fence));
+	VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+	VK_CHECK_RESULT(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX));
+	vkDestroyFence(device, fence, nullptr);
+	vkDestroyCommandPool(device, cmdPool, nullptr);
+
+	offscreenImageIndex = 0;
+	transferSource = true;
+}
+
+void VulkanSwapChain::destroyOffscreen()
+{
+	for (size_t i = 0; i < offscreenMemory.size(); i++)
+	{
+		vkDestroyImageView(device, buffers[i].view, nullptr);
+		vkDestroyImage(device, images[i], nullptr);
+		vkFreeMemory(device, offscreenMemory[i], nullptr);
+	}
+	offscreenMemory.clear();
+	images.clear();
+	buffers.clear();
+}
+
 #if defined(_DIRECT2DISPLAY)
 /**
 * Create direct to display surface
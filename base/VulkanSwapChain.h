@@ -38,7 +38,12 @@ private:
 	VkInstance instance;
 	VkDevice device;
 	VkPhysicalDevice physicalDevice;
-	VkSurfaceKHR surface;
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
+	// Offscreen (headless) images, used instead of a surface and swapchain
+	std::vector<VkDeviceMemory> offscreenMemory;
+	uint32_t offscreenImageIndex = 0;
+	void createOffscreen(uint32_t width, uint32_t height);
+	void destroyOffscreen();
 public:
 	VkFormat colorFormat;
 	VkColorSpaceKHR colorSpace;
@@ -47,6 +52,13 @@ public:
 	std::vector<VkImage> images;
 	std::vector<SwapChainBuffer> buffers;
 	uint32_t queueNodeIndex = UINT32_MAX;
+	bool offscreen = false;
+	// The images can be copied from, always true for offscreen images, for a swapchain if the surface supports it
+	bool transferSource = false;
+
+	// Layout the color attachment is left in after a frame. Offscreen images are never presented and the swapchain
+	// extension may not be enabled for them, they are left ready for readback instead
+	VkImageLayout presentLayout() const { return offscreen ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; }
 
 #if defined(VK_USE_PLATFORM_WIN32_KHR)
 	void initSurface(void* platformHandle, void* platformWindow);
@@ -68,6 +80,7 @@ public:
 #elif defined(VK_USE_PLATFORM_SCREEN_QNX)
 	void initSurface(screen_context_t screen_context, screen_window_t screen_window);
 #endif
+	void initOffscreen(uint32_t queueNodeIndex);
 	void connect(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device);
 	void create(uint32_t* width, uint32_t* height, bool vsync = false, bool fullscreen = false);
 	VkResult acquireNextImage(VkSemaphore presentCompleteSemaphore, uint32_t* imageIndex);
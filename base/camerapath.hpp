@@ -0,0 +1,135 @@
+/*
+* Camera path class
+*
+* Keyframed camera positions and rotations loaded from a text file, sampled at a
+* fixed frame rate so a path replays the exact same views on every run.
+*
+* File format, one keyframe per line, '#' starts a comment:
+*   time(s) posX posY posZ pitch yaw roll
+* An optional line "interpolation linear|catmullrom" selects how keyframes are blended (default linear).
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	class CameraPath {
+	public:
+		struct Keyframe {
+			float time = 0.0f;
+			glm::vec3 position = glm::vec3(0.0f);
+			glm::vec3 rotation = glm::vec3(0.0f); // degrees, as used by Camera::setRotation
+		};
+
+		enum class Interpolation { Linear, CatmullRom };
+
+		std::vector<Keyframe> keyframes;
+		Interpolation interpolation = Interpolation::Linear;
+		// Frames per second of path time, independent of the actual frame rate
+		float fps = 60.0f;
+
+		bool loadFromFile(const std::string& filename)
+		{
+			std::ifstream file(filename);
+			if (!file.is_open()) {
+				std::cerr << "Could not open camera path " << filename << "\n";
+				return false;
+			}
+			keyframes.clear();
+			interpolation = Interpolation::Linear;
+			std::string line;
+			while (std::getline(file, line)) {
+				line = line.substr(0, line.find('#'));
+				std::istringstream stream(line);
+				if (line.find("interpolation") != std::string::npos) {
+					std::string keyword, mode;
+					stream >> keyword >> mode;
+					if (mode == "catmullrom") {
+						interpolation = Interpolation::CatmullRom;
+					} else if (mode == "linear") {
+						interpolation = Interpolation::Linear;
+					} else {
+						std::cerr << "Unknown camera path interpolation " << mode << ", using linear\n";
+					}
+					continue;
+				}
+				Keyframe keyframe;
+				if (stream >> keyframe.time >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z
+					>> keyframe.rotation.x >> keyframe.rotation.y >> keyframe.rotation.z) {
+					keyframes.push_back(keyframe);
+				}
+			}
+			std::stable_sort(keyframes.begin(), keyframes.end(), [](const Keyframe& a, const Keyframe& b) { return a.time < b.time; });
+			return !keyframes.empty();
+		}
+
+		bool empty() const { return keyframes.empty(); }
+
+		float duration() const
+		{
+			return keyframes.empty() ? 0.0f : keyframes.back().time;
+		}
+
+		uint32_t frameCount() const
+		{
+			return static_cast<uint32_t>(duration() * fps) + 1;
+		}
+
+		// Uniform Catmull-Rom spline through p1 and p2, p0 and p3 are the neighbouring keyframes
+		static glm::vec3 catmullRom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float t)
+		{
+			float t2 = t * t;
+			float t3 = t2 * t;
+			return 0.5f * ((2.0f * p1) + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+		}
+
+		// Interpolates between the surrounding keyframes, clamped at both ends
+		Keyframe sample(float time) const
+		{
+			if (keyframes.empty()) {
+				return Keyframe();
+			}
+			if (time <= keyframes.front().time) {
+				return keyframes.front();
+			}
+			if (time >= keyframes.back().time) {
+				return keyframes.back();
+			}
+			size_t next = 1;
+			while (keyframes[next].time < time) {
+				next++;
+			}
+			const Keyframe& k0 = keyframes[next - 1];
+			const Keyframe& k1 = keyframes[next];
+			float t = (k1.time > k0.time) ? (time - k0.time) / (k1.time - k0.time) : 0.0f;
+			Keyframe result;
+			result.time = time;
+			if (interpolation == Interpolation::CatmullRom) {
+				// End segments reuse the first/last keyframe as their outer control point
+				const Keyframe& kPrev = keyframes[next > 1 ? next - 2 : next - 1];
+				const Keyframe& kNext = keyframes[next + 1 < keyframes.size() ? next + 1 : next];
+				result.position = catmullRom(kPrev.position, k0.position, k1.position, kNext.position, t);
+				result.rotation = catmullRom(kPrev.rotation, k0.rotation, k1.rotation, kNext.rotation, t);
+			} else {
+				result.position = glm::mix(k0.position, k1.position, t);
+				result.rotation = glm::mix(k0.rotation, k1.rotation, t);
+			}
+			return result;
+		}
+
+		Keyframe sampleFrame(uint32_t frame) const
+		{
+			return sample(static_cast<float>(frame) / fps);
+		}
+	};
+}
@@ -0,0 +1,224 @@
+/*
+* GPU profiler class
+*
+* Per pass timestamps and GPU written counters, read back through a ring of
+* query pool ranges and host visible buffers so the CPU never waits on the GPU.
+* One ring slot per command buffer that is reused between frames. Passes a
+* command buffer doesn't record keep their queries unavailable and report -1,
+* the slot is complete once the timestamp of endFrame() is available.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+#include <json/json.hpp>
+
+namespace vks
+{
+	class GpuProfiler {
+	public:
+		struct FrameStats {
+			uint64_t frame = 0;
+			std::vector<double> passTimes; // ms, negative if the pass was not recorded
+			std::vector<uint32_t> counters;
+		};
+
+	private:
+		vks::VulkanDevice* device = nullptr;
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		VkBuffer counterBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory counterMemory = VK_NULL_HANDLE;
+		uint32_t* counterMapped = nullptr;
+		uint32_t ringSize = 0;
+		float timestampPeriod = 1.0f;
+		std::vector<bool> slotPending;
+		std::vector<uint64_t> slotFrame;
+		std::vector<uint64_t> timestamps; // Value and availability of every query of a slot
+
+		// Begin and end of every pass, then the end of the frame
+		uint32_t queriesPerSlot() const { return static_cast<uint32_t>(passNames.size()) * 2 + 1; }
+
+	public:
+		// Devices without timestamp support on the graphics/compute queue only get counters
+		bool timestampsSupported = true;
+		std::vector<std::string> passNames;
+		std::vector<std::string> counterNames;
+		FrameStats latest;
+		// Completed frames in order of completion, cleared by the owner when it likes
+		std::vector<FrameStats> history;
+		size_t maxHistory = 100000;
+
+		void create(vks::VulkanDevice* device, uint32_t ringSize, const std::vector<std::string>& passNames, const std::vector<std::string>& counterNames)
+		{
+			this->device = device;
+			this->ringSize = ringSize;
+			this->passNames = passNames;
+			this->counterNames = counterNames;
+			timestampPeriod = device->properties.limits.timestampPeriod;
+			timestampsSupported = device->properties.limits.timestampComputeAndGraphics;
+			slotPending.assign(ringSize, false);
+			slotFrame.assign(ringSize, 0);
+			timestamps.resize(queriesPerSlot() * 2);
+
+			VkQueryPoolCreateInfo queryPoolInfo{};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolInfo.queryCount = ringSize * queriesPerSlot();
+			VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolInfo, nullptr, &queryPool));
+
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				std::max<VkDeviceSize>(1, ringSize * counterNames.size()) * sizeof(uint32_t),
+				&counterBuffer,
+				&counterMemory,
+				nullptr));
+			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, counterMemory, 0, VK_WHOLE_SIZE, 0, (void**)&counterMapped));
+		}
+
+		void destroy()
+		{
+			if (!device) return;
+			vkDestroyQueryPool(device->logicalDevice, queryPool, nullptr);
+			vkUnmapMemory(device->logicalDevice, counterMemory);
+			vkDestroyBuffer(device->logicalDevice, counterBuffer, nullptr);
+			vkFreeMemory(device->logicalDevice, counterMemory, nullptr);
+			device = nullptr;
+		}
+
+		// Record at the start of the command buffer of a slot, outside of render passes
+		void reset(VkCommandBuffer commandBuffer, uint32_t slot)
+		{
+			vkCmdResetQueryPool(commandBuffer, queryPool, slot * queriesPerSlot(), queriesPerSlot());
+		}
+
+		void beginPass(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t pass)
+		{
+			if (!timestampsSupported) return;
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, slot * queriesPerSlot() + pass * 2);
+		}
+
+		void endPass(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t pass)
+		{
+			if (!timestampsSupported) return;
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, slot * queriesPerSlot() + pass * 2 + 1);
+		}
+
+		// Record at the end of the command buffer of a slot, after every pass
+		void endFrame(VkCommandBuffer commandBuffer, uint32_t slot)
+		{
+			if (!timestampsSupported) return;
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, (slot + 1) * queriesPerSlot() - 1);
+		}
+
+		// Copy `count` GPU written uint32 counters starting at `srcOffset` into the readback ring.
+		// The caller makes the writes visible to the transfer stage.
+		void copyCounters(VkCommandBuffer commandBuffer, uint32_t slot, VkBuffer src, VkDeviceSize srcOffset, uint32_t firstCounter, uint32_t count)
+		{
+			VkBufferCopy copyRegion = {};
+			copyRegion.srcOffset = srcOffset;
+			copyRegion.dstOffset = (slot * counterNames.size() + firstCounter) * sizeof(uint32_t);
+			copyRegion.size = count * sizeof(uint32_t);
+			vkCmdCopyBuffer(commandBuffer, src, counterBuffer, 1, &copyRegion);
+		}
+
+		// Call right before submitting the command buffer of a slot
+		void submitted(uint32_t slot, uint64_t frame)
+		{
+			slotPending[slot] = true;
+			slotFrame[slot] = frame;
+		}
+
+		// Non blocking, picks up the results of a slot once its last submission finished.
+		// Returns true if a new frame was added to the history.
+		bool collect(uint32_t slot)
+		{
+			if (!slotPending[slot]) return false;
+			auto available = [&](uint32_t query) { return timestamps[query * 2 + 1] != 0; };
+			if (timestampsSupported) {
+				uint32_t queryCount = queriesPerSlot();
+				// VK_NOT_READY as long as a query is unavailable, which the passes that were not recorded always are
+				VkResult result = vkGetQueryPoolResults(device->logicalDevice, queryPool, slot * queryCount, queryCount,
+					timestamps.size() * sizeof(uint64_t), timestamps.data(), 2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+				if (result != VK_NOT_READY) VK_CHECK_RESULT(result);
+				if (!available(queryCount - 1)) return false;
+			}
+			slotPending[slot] = false;
+
+			FrameStats stats;
+			stats.frame = slotFrame[slot];
+			stats.passTimes.resize(passNames.size());
+			for (uint32_t i = 0; i < passNames.size(); i++) {
+				bool recorded = timestampsSupported && available(i * 2) && available(i * 2 + 1);
+				uint64_t begin = timestamps[i * 2 * 2], end = timestamps[(i * 2 + 1) * 2];
+				stats.passTimes[i] = (recorded && end >= begin) ? double(end - begin) * timestampPeriod / 1e6 : -1.0;
+			}
+			stats.counters.assign(counterMapped + slot * counterNames.size(), counterMapped + (slot + 1) * counterNames.size());
+			latest = stats;
+			if (history.size() < maxHistory) {
+				history.push_back(stats);
+			}
+			return true;
+		}
+
+		double totalTime(const FrameStats& stats) const
+		{
+			double total = 0.0;
+			for (double t : stats.passTimes) {
+				if (t > 0.0) total += t;
+			}
+			return total;
+		}
+
+		void saveCSV(const std::string& filename) const
+		{
+			std::ofstream result(filename, std::ios::out);
+			if (!result.is_open()) {
+				std::cerr << "Could not write " << filename << "\n";
+				return;
+			}
+			result << std::fixed << std::setprecision(4);
+			result << "frame";
+			for (auto& name : passNames) result << "," << name << " (ms)";
+			for (auto& name : counterNames) result << "," << name;
+			result << "\n";
+			for (auto& stats : history) {
+				result << stats.frame;
+				for (double t : stats.passTimes) result << "," << t;
+				for (uint32_t c : stats.counters) result << "," << c;
+				result << "\n";
+			}
+		}
+
+		void saveJSON(const std::string& filename) const
+		{
+			nlohmann::json j;
+			j["passes"] = passNames;
+			j["counters"] = counterNames;
+			j["frames"] = nlohmann::json::array();
+			for (auto& stats : history) {
+				nlohmann::json frame;
+				frame["frame"] = stats.frame;
+				frame["passTimes"] = stats.passTimes;
+				frame["counters"] = stats.counters;
+				j["frames"].push_back(frame);
+			}
+			std::ofstream result(filename, std::ios::out);
+			if (!result.is_open()) {
+				std::cerr << "Could not write " << filename << "\n";
+				return;
+			}
+			result << j.dump(4);
+		}
+	};
+}
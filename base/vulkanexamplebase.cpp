@@ -31,30 +31,33 @@ VkResult VulkanExampleBase::createInstance(bool enableValidation)
 	appInfo.pEngineName = name.c_str();
 	appInfo.apiVersion = apiVersion;
 
-	std::vector<const char*> instanceExtensions = { VK_KHR_SURFACE_EXTENSION_NAME };
+	std::vector<const char*> instanceExtensions;
 
-	// Enable surface extensions depending on os
+	// Enable surface extensions depending on os, offscreen rendering does not need any
+	if (!settings.offscreen) {
+		instanceExtensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
 #if defined(_WIN32)
-	instanceExtensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
 #elif defined(VK_USE_PLATFORM_ANDROID_KHR)
-	instanceExtensions.push_back(VK_KHR_ANDROID_SURFACE_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_KHR_ANDROID_SURFACE_EXTENSION_NAME);
 #elif defined(_DIRECT2DISPLAY)
-	instanceExtensions.push_back(VK_KHR_DISPLAY_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_KHR_DISPLAY_EXTENSION_NAME);
 #elif defined(VK_USE_PLATFORM_DIRECTFB_EXT)
-	instanceExtensions.push_back(VK_EXT_DIRECTFB_SURFACE_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_EXT_DIRECTFB_SURFACE_EXTENSION_NAME);
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
-	instanceExtensions.push_back(VK_KHR_WAYLAND_SURFACE_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_KHR_WAYLAND_SURFACE_EXTENSION_NAME);
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
-	instanceExtensions.push_back(VK_KHR_XCB_SURFACE_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_KHR_XCB_SURFACE_EXTENSION_NAME);
 #elif defined(VK_USE_PLATFORM_IOS_MVK)
-	instanceExtensions.push_back(VK_MVK_IOS_SURFACE_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_MVK_IOS_SURFACE_EXTENSION_NAME);
 #elif defined(VK_USE_PLATFORM_MACOS_MVK)
-	instanceExtensions.push_back(VK_MVK_MACOS_SURFACE_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_MVK_MACOS_SURFACE_EXTENSION_NAME);
 #elif defined(VK_USE_PLATFORM_HEADLESS_EXT)
-	instanceExtensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
 #elif defined(VK_USE_PLATFORM_SCREEN_QNX)
-	instanceExtensions.push_back(VK_QNX_SCREEN_SURFACE_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_QNX_SCREEN_SURFACE_EXTENSION_NAME);
 #endif
+	}
 	
 	// Get extensions supported by the instance and store for later use
 	uint32_t extCount = 0;
@@ -303,17 +306,20 @@ void VulkanExampleBase::renderLoop()
 #if !(defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK))
 	if (benchmark.active) {
 #if defined(VK_USE_PLATFORM_WAYLAND_KHR)
-		while (!configured)
+		while (!settings.offscreen && !configured)
 			wl_display_dispatch(display);
-		while (wl_display_prepare_read(display) != 0)
+		while (!settings.offscreen && wl_display_prepare_read(display) != 0)
 			wl_display_dispatch_pending(display);
-		wl_display_flush(display);
-		wl_display_read_events(display);
-		wl_display_dispatch_pending(display);
+		if (!settings.offscreen) {
+			wl_display_flush(display);
+			wl_display_read_events(display);
+			wl_display_dispatch_pending(display);
+		}
 #endif
 
 		benchmark.run([=] { render(); }, vulkanDevice->properties);
 		vkDeviceWaitIdle(device);
+		benchmarkFinished();
 		if (benchmark.filename != "") {
 			benchmark.saveResults();
 		}
@@ -815,6 +821,7 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 	commandLineParser.add("benchmarkresultfile", { "-bf", "--benchfilename" }, 1, "Set file name for benchmark results");
 	commandLineParser.add("benchmarkresultframes", { "-bt", "--benchframetimes" }, 0, "Save frame times to benchmark results file");
 	commandLineParser.add("benchmarkframes", { "-bfs", "--benchmarkframes" }, 1, "Only render the given number of frames");
+	commandLineParser.add("offscreen", { "-os", "--offscreen" }, 0, "Render offscreen without a window (headless), implies benchmark mode");
 
 	commandLineParser.parse(args);
 	if (commandLineParser.isSet("help")) {
@@ -868,6 +875,11 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 	if (commandLineParser.isSet("benchmarkframes")) {
 		benchmark.outputFrames = commandLineParser.getValueAsInt("benchmarkframes", benchmark.outputFrames);
 	}
+	if (commandLineParser.isSet("offscreen")) {
+		settings.offscreen = true;
+		benchmark.active = true;
+		vks::tools::errorModeSilent = true;
+	}
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	// Vulkan library is loaded dynamically on Android
@@ -876,9 +888,13 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 #elif defined(_DIRECT2DISPLAY)
 
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
-	initWaylandConnection();
+	if (!settings.offscreen) {
+		initWaylandConnection();
+	}
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
-	initxcbConnection();
+	if (!settings.offscreen) {
+		initxcbConnection();
+	}
 #endif
 
 #if defined(_WIN32)
@@ -954,6 +970,9 @@ VulkanExampleBase::~VulkanExampleBase()
 	if (dfb)
 		dfb->Release(dfb);
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
+	if (settings.offscreen) {
+		return;
+	}
 	xdg_toplevel_destroy(xdg_toplevel);
 	xdg_surface_destroy(xdg_surface);
 	wl_surface_destroy(surface);
@@ -970,8 +989,10 @@ VulkanExampleBase::~VulkanExampleBase()
 #elif defined(VK_USE_PLATFORM_ANDROID_KHR)
 	// todo : android cleanup (if required)
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
-	xcb_destroy_window(connection, window);
-	xcb_disconnect(connection);
+	if (!settings.offscreen) {
+		xcb_destroy_window(connection, window);
+		xcb_disconnect(connection);
+	}
 #elif defined(VK_USE_PLATFORM_SCREEN_QNX)
 	screen_destroy_event(screen_event);
 	screen_destroy_window(screen_window);
@@ -1062,7 +1083,9 @@ bool VulkanExampleBase::initVulkan()
 	// Derived examples can enable extensions based on the list of supported extensions read from the physical device
 	getEnabledDeviceExtensions();
 
-	VkResult res = vulkanDevice->createLogicalDevice(enabledFeatures, enabledDeviceExtensions, deviceCreatepNextChain);
+	// Offscreen render passes end in VulkanSwapChain::presentLayout(), a core layout, so they don't need the swapchain extension
+	bool useSwapChain = !settings.offscreen;
+	VkResult res = vulkanDevice->createLogicalDevice(enabledFeatures, enabledDeviceExtensions, deviceCreatepNextChain, useSwapChain);
 	if (res != VK_SUCCESS) {
 		vks::tools::exitFatal("Could not create Vulkan device: \n" + vks::tools::errorString(res), res);
 		return false;
@@ -1102,6 +1125,11 @@ bool VulkanExampleBase::initVulkan()
 	submitInfo.pWaitSemaphores = &semaphores.presentComplete;
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = &semaphores.renderComplete;
+	// Offscreen images are neither acquired nor presented, so there is nothing to wait for or signal
+	if (settings.offscreen) {
+		submitInfo.waitSemaphoreCount = 0;
+		submitInfo.signalSemaphoreCount = 0;
+	}
 
 	return true;
 }
@@ -3073,7 +3101,7 @@ void VulkanExampleBase::setupRenderPass()
 	attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	attachments[0].finalLayout = swapChain.presentLayout();
 	// Depth attachment
 	attachments[1].format = depthFormat;
 	attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
@@ -3235,6 +3263,10 @@ void VulkanExampleBase::windowResized() {}
 
 void VulkanExampleBase::initSwapchain()
 {
+	if (settings.offscreen) {
+		swapChain.initOffscreen(vulkanDevice->queueFamilyIndices.graphics);
+		return;
+	}
 #if defined(_WIN32)
 	swapChain.initSurface(windowInstance, window);
 #elif defined(VK_USE_PLATFORM_ANDROID_KHR)
@@ -3259,6 +3291,8 @@ void VulkanExampleBase::setupSwapChain()
 	swapChain.create(&width, &height, settings.vsync, settings.fullscreen);
 }
 
+void VulkanExampleBase::benchmarkFinished() {}
+
 void VulkanExampleBase::OnUpdateUIOverlay(vks::UIOverlay *overlay) {}
 
 #if defined(_WIN32)
@@ -16,7 +16,13 @@
 #include "NaniteMesh.h"
 #include "Instance.h"
 #include "NaniteScene.h"
+#include "SceneFile.h"
+#include "CutStatistics.h"
+#include "PagePool.h"
+#include "LODController.h"
 #include "VulkanDescriptorSetManager.h"
+#include "gpuprofiler.hpp"
+#include "camerapath.hpp"
 
 #define ENABLE_VALIDATION true
 
@@ -88,12 +94,18 @@ public:
 	VkPipelineLayout bvhTraversalPipelineLayout;
 	VkPipeline bvhTraversalPipeline;
 
+	VkPipelineLayout instanceCullingPipelineLayout;
+	VkPipeline instanceCullingPipeline;
+
 	VkPipelineLayout cullingPipelineLayout;
 	VkPipeline cullingPipeline;
 
 	VkPipelineLayout errorProjPipelineLayout;
 	VkPipeline errorProjPipeline;
 
+	VkPipelineLayout cutBudgetPipelineLayout;
+	VkPipeline cutBudgetPipeline;
+
 	VkPipelineLayout shadingPipelineLayout;
 	VkPipeline shadingPipeline;
 
@@ -109,6 +121,13 @@ public:
 	VkPipelineLayout clearImagePipelineLayout;
 	VkPipeline clearImagePipeline;
 
+	VkPipelineLayout appendBenchPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline appendBenchPipelines[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE }; // 0: one atomic per invocation, 1: subgroup aggregated
+
+	// Specialization constant USE_SUBGROUP_APPEND of the compaction shaders (include/append.glsl). Without subgroup
+	// support their variants compiled with NO_SUBGROUP_APPEND are loaded, see appendShaderPath()
+	VkBool32 useSubgroupAppend = VK_FALSE;
+
 	VkSampler depthStencilSampler;
 
 	uint32_t workgroupX = 8, workgroupY = 8;
@@ -118,9 +137,23 @@ public:
 		vkglTF::Model object;
 		vkglTF::Model cube;
 	} models;
+	std::unique_ptr<vkglTF::Model> bunnyModel; // Only for the scenes with a bunny, a model has to be loaded to be destroyed
 
 	MeshHandler reducedModel;
 	NaniteMesh naniteMesh;
+	NaniteMesh naniteMesh2; // Bunny of scenes 3 to 5
+	// Nanite meshes are built or loaded on background threads, frames only show their progress until all of them finished
+	std::vector<std::unique_ptr<NaniteLoadTask>> naniteLoadTasks;
+	bool naniteReady = false;
+	// Coarsest level of every load task once it is ready (NaniteProgress::coarsestLODReady), drawn until naniteReady
+	struct PlaceholderMesh {
+		vks::Buffer vertices; // Position and normal, interleaved
+		vks::Buffer indices;
+		uint32_t indexCount = 0;
+	};
+	std::vector<PlaceholderMesh> placeholderMeshes;
+	VkPipelineLayout placeholderPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline placeholderPipeline = VK_NULL_HANDLE;
 	//Instance instance1;
 	NaniteScene scene;
 
@@ -206,12 +239,11 @@ public:
 
 	struct BVHTraversalPushConstants {
 		alignas(8) glm::vec2 screenSize;
-		alignas(4) float threshold;
+		alignas(4) uint32_t level;
 	} bvhTraversalPushConstants;
 
 	struct CullingPushConstants {
 		int numClusters;
-		float threshold;
 		alignas(4) bool useFrustrumOcclusionCulling = true;
 		alignas(4) bool useSoftwareRasterization = true;
 	} cullingPushConstants;
@@ -220,6 +252,90 @@ public:
 		int vis_clusters = 0;
 	} renderingPushConstants;
 
+	struct AppendBenchPushConstants {
+		uint32_t numInvocations = 1 << 20;
+		uint32_t maxAppendCount = 4;
+		uint32_t capacity;
+	} appendBenchPushConstants;
+	float appendBenchTimes[2] = { 0.0f, 0.0f }; // ms
+
+	// Per pass GPU timings and culling counters, BVH traversal levels are appended after the fixed passes
+	enum ProfilerPass : uint32_t { PASS_ERROR_PROJ = 0, PASS_CULLING, PASS_SW_RASTER, PASS_HW_RASTER, PASS_MERGE, PASS_SHADING, PASS_DEPTH_COPY, PASS_HIZ_BUILD, PASS_INSTANCE_CULLING, PASS_CUT_BUDGET, PASS_BVH_LEVEL0 };
+	enum ProfilerCounter : uint32_t { COUNTER_VISIBLE_CLUSTERS = 0, COUNTER_FRUSTUM_CULLED, COUNTER_OCCLUSION_CULLED, COUNTER_ERROR_CULLED, COUNTER_HW_INDICES, COUNTER_SW_INDICES, COUNTER_VIEW_CLUSTERS };
+	vks::GpuProfiler profiler;
+	uint64_t profiledFrames = 0;
+
+	// Command line driven runs (see constructor)
+	int sceneIndex = 2;
+	// Scene read from a file instead of createScene1..4, its meshes are loaded next to the built-in ones
+	SceneFile sceneFile;
+	bool useSceneFile = false;
+	std::vector<std::unique_ptr<vkglTF::Model>> sceneFileModels;
+	std::vector<std::string> sceneFileModelPaths;
+	std::vector<NaniteMesh> sceneFileMeshes;
+	std::string exportSceneFilename;
+	// Asset relative path of every scene mesh, by name, for exported scene files
+	std::map<std::string, std::string> sceneMeshPaths = { { "dragon", "models/dragon.gltf" }, { "bunny", "models/bunny.gltf" } };
+	vks::CameraPath cameraPath;
+	uint32_t cameraPathFrame = 0;
+	std::string saveImagesPrefix;
+	// CPU reference of the LOD cut for every replayed frame, see CutStatistics.h
+	CutStatistics cutStatistics;
+	std::string cutStatisticsFilename;
+	bool cpuReplay = false; // Only evaluate the cut on the CPU, nothing is submitted to the GPU after loading
+	uint32_t chunkTriangleBudget = 0; // Out-of-core nanite build, 0 builds in core
+	BuildWorkerOptions buildWorkers; // Worker processes building the chunks of the out-of-core build
+	// Cluster streaming, the cut is constrained to the pages resident within the budget. The renderer streams into a
+	// GPU page pool that replaces the scene vertex and index buffers (PagePool.h), CPU replays only simulate it
+	bool streaming = false;
+	StreamingOptions streamingOptions;
+	ResidencyManager residency;
+	PagePool pagePool;
+	vks::Buffer clusterStatesBuffer; // ResidencyManager::clusterState() by cluster, every bit set without streaming
+	vks::Buffer streamingRequestsBuffer; // Count, capacity, then the clusters of the cut culling.comp requests pages for
+	std::vector<uint32_t> streamingRequests;
+	// Moves and respawns instances every frame through the dynamic instance API of NaniteScene
+	bool dynamicInstances = false;
+	std::vector<glm::mat4> dynamicBaseTransforms;
+	uint64_t dynamicFrame = 0;
+	// Cull whole instances before the BVH traversal, instances that only need their coarsest LOD skip it (instanceculling.comp)
+	bool instanceCulling = false;
+	// Cap the LOD cut at a number of clusters and/or triangles by raising the error threshold (CutBudget.h), 0: no limit
+	uint32_t clusterBudget = 0;
+	uint32_t triangleBudget = 0;
+	// Update the CPU reference cut incrementally from last frame's cut and compare it to the full traversal (CutFrontier)
+	bool temporalCut = false;
+	// Views of the multi view cut: the camera, then the faces of a cube map around it. The GPU passes share one traversal
+	// with a view mask per node (cullviews.glsl), CutStatistics::evaluateViews() is the CPU reference
+	uint32_t cutViews = 0;
+	static constexpr uint32_t maxCullViews = 8; // MAX_CULL_VIEWS of cullviews.glsl
+	struct UBOCullViews {
+		glm::mat4 viewProj[maxCullViews];
+		glm::mat4 view[maxCullViews];
+		glm::mat4 proj[maxCullViews];
+		glm::vec4 screenSize[maxCullViews];
+		uint32_t viewCount = 1;
+		uint32_t viewClusterCapacity = 0;
+	} uboCullViews;
+	vks::Buffer cullViewsBuffer; // Host visible UBOCullViews, see updateCullViews()
+	vks::Buffer currNodeViewMasksBuffer; // View masks of the traversal queues, indexed like their entries
+	vks::Buffer nextNodeViewMasksBuffer;
+	vks::Buffer clusterViewMasksBuffer; // View masks of the candidate clusters
+	vks::Buffer viewClustersBuffer; // Counts, then the visible (cluster, object) list of every view but the camera
+	// Moves the threshold to hold a GPU frame time or triangle target, fed with the profiler results as they arrive
+	LODController lodController;
+	bool lodFeedbackPending = false;
+	// Sizes the scene buffers were created with (createSceneSizedBuffers()), grown with headroom when the scene outgrows them
+	struct {
+		size_t objects = 0;
+		size_t roots = 0;
+		size_t instances = 0;
+		size_t depths = 0;
+		size_t depthNodes = 0;
+		size_t clusters = 0;
+		size_t indices = 0;
+	} sceneCapacity;
+
 	vks::Buffer HWRIndicesBuffer;
 	//vks::Buffer culledObjectIndicesBuffer;
 	vks::Buffer HWRIDBuffer;
@@ -233,9 +349,16 @@ public:
 	vks::Buffer sortedClusterIndicesBuffer; // Cluster indices sorted by BVH
 	vks::Buffer culledClusterIndicesBuffer; // Cluster indices after BVH culling
 	vks::Buffer culledClusterObjectIndicesBuffer;
+	vks::Buffer instanceEntriesBuffer;
+	vks::Buffer blockCullInfosBuffer;
+	vks::Buffer coarseCutClustersBuffer;
+	// Indirect dispatch args written by the producing stage: [0] error projection & culling, [j + 1] BVH traversal level j
+	vks::Buffer cullingDispatchIndirectBuffer;
+	std::vector<VkDispatchIndirectCommand> cullingDispatchInit;
 
 	vks::Buffer culledIndicesBuffer;
 	vks::Buffer modelMatsBuffer;
+	vks::Buffer lodBiasBuffer; // NaniteScene::lodBiases
 	vks::Buffer clustersInfoBuffer;
 	vks::Buffer cullingUniformBuffer;
 	vks::Buffer hwrDrawIndexedIndirectBuffer;
@@ -252,11 +375,17 @@ public:
 	struct ErrorPushConstants {
 		alignas(4) int numClusters;
 		alignas(8) glm::vec2 screenSize;
+		alignas(4) uint32_t useCutBudget = 0;
 	} errorPushConstants;
 
 	vks::Buffer errorInfoBuffer;
 	vks::Buffer projectedErrorBuffer;
 	vks::Buffer errorUniformBuffer;
+	vks::Buffer cutBudgetBuffer; // CutBudgetHeader and the cut size bins, see CutBudget.h
+	vks::Buffer cutBudgetHeaderBuffer; // Host visible CutBudgetHeader the frame starts from, see writeCutBudgetHeader()
+
+	vks::Buffer appendBenchCounterBuffer;
+	vks::Buffer appendBenchOutBuffer;
 
 	VkPipelineLayout pipelineLayout;
 
@@ -273,6 +402,8 @@ public:
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		title = "Vulkanite: A dynamic LOD rendering pipeline";
+		// Subgroup operations in the culling shaders need Vulkan 1.1
+		apiVersion = VK_API_VERSION_1_1;
 
 		camera.type = Camera::CameraType::firstperson;
 		camera.movementSpeed = 4.0f;
@@ -281,14 +412,137 @@ public:
 
 		camera.setRotation({ -7.75f, 150.25f, 0.0f });
 		camera.setPosition({ 0.7f, 0.1f, 1.7f });
+
+		// Example specific command line arguments, mostly for offscreen benchmark runs
+		commandLineParser.add("scene", { "-sc", "--scene" }, 1, "Select scene (1: dragon grid, 2: two dragons, 3: dragon and bunny, 4: dragon and bunny grid, 5: grid of nested dragon and bunny prefabs)");
+		commandLineParser.add("camerapath", { "-cp", "--camerapath" }, 1, "Replay a camera path file, one frame per 1/60 s of path time");
+		commandLineParser.add("saveimages", { "-si", "--saveimages" }, 1, "Save final color, depth and visibility images with the given file prefix after a benchmark run");
+		commandLineParser.add("cutstats", { "-cs", "--cutstats" }, 1, "Write per frame LOD cut statistics (CPU reference) to the given csv file, plus <file>.json with error histograms");
+		commandLineParser.add("cpureplay", { "-cr", "--cpureplay" }, 0, "Evaluate the LOD cut on the CPU only, without rendering, implies benchmark mode (combine with --offscreen)");
+		commandLineParser.add("chunkbudget", { "-cb", "--chunkbudget" }, 1, "Build missing nanite caches out of core, in spatial chunks of at most the given number of triangles");
+		commandLineParser.add("buildworkers", { "-nw", "--buildworkers" }, 1, "Build the chunks of the out-of-core build in up to the given number of worker processes");
+		commandLineParser.add("workercommand", { "-wc", "--workercommand" }, 1, "Command that builds one chunk job, {job} is replaced by the job file (default: naniteBuildWorker {job})");
+		commandLineParser.add("workertimeout", { "-wt", "--workertimeout" }, 1, "Seconds to wait for chunk results after the worker commands returned (for farm submission commands)");
+		commandLineParser.add("streambudget", { "-sb", "--streambudget" }, 1, "Stream clusters into a GPU page pool of the given size in MiB, simulated in CPU replays");
+		commandLineParser.add("streampreload", { "-sp", "--streampreload" }, 1, "MiB of whole LOD levels read up front when streaming, coarsest first over all meshes");
+		commandLineParser.add("streamreads", { "-sr", "--streamreads" }, 1, "Page reads started per frame when streaming (default: 32)");
+		commandLineParser.add("scenefile", { "-sf", "--scenefile" }, 1, "Load the scene from a scene file (see SceneFile.h) instead of --scene");
+		commandLineParser.add("exportscene", { "-es", "--exportscene" }, 1, "Write the loaded scene to the given scene file");
+		commandLineParser.add("preparedscene", { "-ps", "--preparedscene" }, 1, "Read the built scene info from the given file when it matches the scene, write it otherwise");
+		commandLineParser.add("dynamicinstances", { "-di", "--dynamicinstances" }, 0, "Move every fourth instance and respawn one instance every 64 frames, with incremental scene uploads");
+		commandLineParser.add("instanceculling", { "-ic", "--instanceculling" }, 0, "Cull whole instances before the BVH traversal, distant instances take their coarsest LOD without traversal");
+		commandLineParser.add("clusterbudget", { "-cbu", "--clusterbudget" }, 1, "Coarsen the LOD cut until it has at most the given number of clusters (the threshold is the finest allowed cut)");
+		commandLineParser.add("lodtargetms", { "-ltm", "--lodtargetms" }, 1, "Adjust the threshold every frame to hold the given GPU frame time in ms");
+		commandLineParser.add("lodtargettriangles", { "-ltt", "--lodtargettriangles" }, 1, "Adjust the threshold every frame to hold the given number of triangles (also in CPU replays)");
+		commandLineParser.add("cutviews", { "-cv", "--cutviews" }, 1, "Also evaluate the CPU reference cut of the camera and up to 6 cube faces around it in one traversal (2-7 views)");
+		commandLineParser.add("temporalcut", { "-tc", "--temporalcut" }, 0, "Update the CPU reference cut incrementally from the previous frame, the cut statistics count the nodes it evaluates");
+		commandLineParser.add("trianglebudget", { "-tbu", "--trianglebudget" }, 1, "Coarsen the LOD cut until it has at most the given number of triangles (the threshold is the finest allowed cut)");
+		commandLineParser.parse(args);
+		if (commandLineParser.isSet("cutstats")) {
+			cutStatisticsFilename = commandLineParser.getValueAsString("cutstats", "");
+		}
+		if (commandLineParser.isSet("cpureplay")) {
+			cpuReplay = true;
+			benchmark.active = true;
+		}
+		if (commandLineParser.isSet("chunkbudget")) {
+			chunkTriangleBudget = commandLineParser.getValueAsInt("chunkbudget", 0);
+		}
+		if (commandLineParser.isSet("buildworkers")) {
+			buildWorkers.maxWorkers = commandLineParser.getValueAsInt("buildworkers", 0);
+		}
+		if (commandLineParser.isSet("workercommand")) {
+			buildWorkers.command = commandLineParser.getValueAsString("workercommand", "");
+		}
+		if (commandLineParser.isSet("workertimeout")) {
+			buildWorkers.resultTimeoutSeconds = commandLineParser.getValueAsInt("workertimeout", 0);
+		}
+		if (commandLineParser.isSet("streambudget")) {
+			streaming = true;
+			streamingOptions.memoryBudget = static_cast<uint64_t>(commandLineParser.getValueAsInt("streambudget", 256)) << 20;
+		}
+		if (commandLineParser.isSet("streampreload")) {
+			streamingOptions.preloadBytes = static_cast<uint64_t>(commandLineParser.getValueAsInt("streampreload", 0)) << 20;
+		}
+		if (commandLineParser.isSet("streamreads")) {
+			streamingOptions.maxReadsPerFrame = commandLineParser.getValueAsInt("streamreads", streamingOptions.maxReadsPerFrame);
+		}
+		if (commandLineParser.isSet("dynamicinstances")) {
+			dynamicInstances = true;
+		}
+		if (commandLineParser.isSet("instanceculling")) {
+			instanceCulling = true;
+		}
+		if (commandLineParser.isSet("clusterbudget")) {
+			clusterBudget = commandLineParser.getValueAsInt("clusterbudget", 0);
+		}
+		if (commandLineParser.isSet("trianglebudget")) {
+			triangleBudget = commandLineParser.getValueAsInt("trianglebudget", 0);
+		}
+		if (commandLineParser.isSet("cutviews")) {
+			cutViews = std::min(std::max(commandLineParser.getValueAsInt("cutviews", 0), 0), 7);
+		}
+		if (commandLineParser.isSet("temporalcut")) {
+			temporalCut = true;
+		}
+		if (commandLineParser.isSet("lodtargetms")) {
+			lodController.options.targetFrameMs = std::stof(commandLineParser.getValueAsString("lodtargetms", "0"));
+		}
+		if (commandLineParser.isSet("lodtargettriangles")) {
+			lodController.options.targetTriangles = commandLineParser.getValueAsInt("lodtargettriangles", 0);
+		}
+		lodController.reset(static_cast<float>(thresholdInt / thresholdIntDiv));
+		if (commandLineParser.isSet("scene")) {
+			sceneIndex = commandLineParser.getValueAsInt("scene", sceneIndex);
+		}
+		if (commandLineParser.isSet("scenefile")) {
+			std::string filename = commandLineParser.getValueAsString("scenefile", "");
+			ASSERT(sceneFile.read(filename), "Failed to read scene file " << filename);
+			useSceneFile = true;
+		}
+		if (commandLineParser.isSet("exportscene")) {
+			exportSceneFilename = commandLineParser.getValueAsString("exportscene", "");
+		}
+		if (commandLineParser.isSet("preparedscene")) {
+			scene.preparedSceneFile = commandLineParser.getValueAsString("preparedscene", "");
+		}
+		if (commandLineParser.isSet("camerapath")) {
+			std::string filename = commandLineParser.getValueAsString("camerapath", "");
+			if (cameraPath.loadFromFile(filename) && benchmark.active && benchmark.outputFrames == -1) {
+				// Replay the whole path exactly once unless a frame count was given
+				benchmark.outputFrames = cameraPath.frameCount();
+			}
+			// Warm up frames would advance the path, every replay starts at the first keyframe
+			benchmark.warmup = 0;
+		}
+		if (commandLineParser.isSet("saveimages")) {
+			saveImagesPrefix = commandLineParser.getValueAsString("saveimages", "");
+		}
 	}
 
 	~VulkanExample()
 	{
-		vkDestroyPipeline(device, pipelines.skybox, nullptr);
-		vkDestroyPipeline(device, pipelines.pbr, nullptr);
-
-		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+		naniteLoadTasks.clear(); // Cancels builds that are still running
+		destroyPlaceholders();
+		if (naniteReady) {
+			vkDestroyPipeline(device, pipelines.skybox, nullptr);
+			vkDestroyPipeline(device, pipelines.pbr, nullptr);
+			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+			for (VkPipeline pipeline : appendBenchPipelines) {
+				vkDestroyPipeline(device, pipeline, nullptr);
+			}
+			vkDestroyPipelineLayout(device, appendBenchPipelineLayout, nullptr);
+			// Created through the raw createBuffer() overload, without a device to destroy() them with
+			vkDestroyBuffer(device, appendBenchCounterBuffer.buffer, nullptr);
+			vkFreeMemory(device, appendBenchCounterBuffer.memory, nullptr);
+			vkDestroyBuffer(device, appendBenchOutBuffer.buffer, nullptr);
+			vkFreeMemory(device, appendBenchOutBuffer.memory, nullptr);
+			cutBudgetHeaderBuffer.destroy();
+			cullViewsBuffer.destroy();
+			clusterStatesBuffer.destroy();
+			streamingRequestsBuffer.destroy();
+			destroySceneSizedBuffers();
+		}
 		VulkanDescriptorSetManager::getManager()->destory();
 		//vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
@@ -297,17 +551,22 @@ public:
 		uniformBuffers.params.destroy();
 		uniformBuffers.topCube.destroy();
 		uniformBuffers.topSkybox.destroy();
-		modelMatsBuffer.destroy();
 
 		textures.environmentCube.destroy();
-		textures.irradianceCube.destroy();
-		textures.prefilteredCube.destroy();
-		textures.lutBrdf.destroy();
+		if (!cpuReplay) {
+			textures.irradianceCube.destroy();
+			textures.prefilteredCube.destroy();
+			textures.lutBrdf.destroy();
+		}
 		textures.albedoMap.destroy();
 		textures.normalMap.destroy();
 		textures.aoMap.destroy();
 		textures.metallicMap.destroy();
 		textures.roughnessMap.destroy();
+
+		if (naniteReady) {
+			profiler.destroy();
+		}
 	}
 
 	virtual void getEnabledFeatures()
@@ -330,6 +589,15 @@ public:
 		if (deviceFeatures.fragmentStoresAndAtomics) {
 			enabledFeatures.fragmentStoresAndAtomics = VK_TRUE;
 		}
+
+		VkPhysicalDeviceSubgroupProperties subgroupProperties{};
+		subgroupProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+		VkPhysicalDeviceProperties2 deviceProperties2{};
+		deviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		deviceProperties2.pNext = &subgroupProperties;
+		vkGetPhysicalDeviceProperties2(physicalDevice, &deviceProperties2);
+		const VkSubgroupFeatureFlags appendOperations = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+		useSubgroupAppend = (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) && (subgroupProperties.supportedOperations & appendOperations) == appendOperations;
 	}
 
 	virtual void getEnabledInstanceExtensions()
@@ -349,8 +617,15 @@ public:
 
 	void buildCommandBuffers()
 	{
+		if (!naniteReady) {
+			buildLoadingCommandBuffers();
+			return;
+		}
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 		auto descManager = VulkanDescriptorSetManager::getManager();
+		// All roots are traversed from level 0 on, unless instance culling picks them and grows the group count itself
+		cullingDispatchInit[1].x = instanceCulling ? 0 : (scene.initNodeInfoIndices[0].x + 31) / 32;
+		const bool useCutBudget = clusterBudget > 0 || triangleBudget > 0;
 
 		VkClearValue clearValues[2];
 		clearValues[0].color = { { 0.1f, 0.1f, 0.1f, 1.0f } };
@@ -371,6 +646,7 @@ public:
 			renderPassBeginInfo.framebuffer = frameBuffers[i];
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+			profiler.reset(drawCmdBuffers[i], i);
 
 			/*
 			* Naive BVH Traversal
@@ -389,16 +665,22 @@ public:
 			imageMemBarrier.subresourceRange.layerCount = 1;
 			vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, 0, 0, 0, 1, &imageMemBarrier);
 			
-			VkBufferCopy copyRegion = {};
-			copyRegion.size = scene.initNodeInfoIndices.size() * sizeof(uint32_t);
-			copyRegion.srcOffset = 0;
-			copyRegion.dstOffset = 0;
-			vkCmdCopyBuffer(drawCmdBuffers[i], initNodeInfosBuffer.buffer, currNodeInfosBuffer.buffer, 1, &copyRegion);
+			if (instanceCulling) {
+				// Level 0 is appended to by instance culling
+				vkCmdFillBuffer(drawCmdBuffers[i], currNodeInfosBuffer.buffer, 0, sizeof(uint32_t), 0);
+			}
+			else {
+				VkBufferCopy copyRegion = {};
+				copyRegion.size = scene.initNodeInfoIndices.size() * sizeof(glm::uvec2);
+				copyRegion.srcOffset = 0;
+				copyRegion.dstOffset = 0;
+				vkCmdCopyBuffer(drawCmdBuffers[i], initNodeInfosBuffer.buffer, currNodeInfosBuffer.buffer, 1, &copyRegion);
+			}
 			
 			VkBufferMemoryBarrier bufferBarrier = {};
 			bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
 			bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
 			bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 			bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 			bufferBarrier.buffer = currNodeInfosBuffer.buffer;
@@ -407,6 +689,27 @@ public:
 			vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
 			
 			vkCmdFillBuffer(drawCmdBuffers[i], culledClusterIndicesBuffer.buffer, 0, 5 * sizeof(uint32_t), 0); // save the first 5 uint32_t for atomic counters
+			// Only the first traversal level is known on CPU, every other group count is grown by its producer
+			vkCmdUpdateBuffer(drawCmdBuffers[i], cullingDispatchIndirectBuffer.buffer, 0, cullingDispatchInit.size() * sizeof(VkDispatchIndirectCommand), cullingDispatchInit.data());
+			VkDispatchIndirectCommand emptyDispatch = { 0, 1, 1 };
+			vkCmdUpdateBuffer(drawCmdBuffers[i], swrIndirectDispatchBuffer.buffer, 0, sizeof(VkDispatchIndirectCommand), &emptyDispatch);
+			// Traversal and culling read the cut threshold from the budget buffer, the bins are only filled under a budget
+			VkBufferCopy headerCopy = { 0, 0, sizeof(CutBudgetHeader) };
+			vkCmdCopyBuffer(drawCmdBuffers[i], cutBudgetHeaderBuffer.buffer, cutBudgetBuffer.buffer, 1, &headerCopy);
+			if (useCutBudget) {
+				vkCmdFillBuffer(drawCmdBuffers[i], cutBudgetBuffer.buffer, sizeof(CutBudgetHeader), 2 * cutBudgetBins * sizeof(uint32_t), 0);
+			}
+			// The roots are traversed for every view, instance culling writes the masks of the entries it appends
+			vkCmdFillBuffer(drawCmdBuffers[i], viewClustersBuffer.buffer, 0, maxCullViews * sizeof(uint32_t), 0);
+			if (!instanceCulling && scene.initNodeInfoIndices[0].x > 0) {
+				vkCmdFillBuffer(drawCmdBuffers[i], currNodeViewMasksBuffer.buffer, 0, scene.initNodeInfoIndices[0].x * sizeof(uint32_t), (1u << std::max(cutViews, 1u)) - 1);
+			}
+			{
+				VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+				memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+				vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			}
 			bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
 			bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 			bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
@@ -417,6 +720,24 @@ public:
 			bufferBarrier.size = VK_WHOLE_SIZE;
 			vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
 			//vkDeviceWaitIdle(device);
+			// Without instance culling its timestamps stay unwritten and the profiler reports the pass as -1
+			if (instanceCulling)
+			{
+				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, instanceCullingPipeline);
+				bvhTraversalPushConstants.screenSize = glm::vec2(width, height);
+				bvhTraversalPushConstants.level = 0;
+				vkCmdPushConstants(drawCmdBuffers[i], instanceCullingPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BVHTraversalPushConstants), &bvhTraversalPushConstants);
+				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, instanceCullingPipelineLayout, 0, 1, &descManager->getSet("instanceCulling", 0), 0, 0);
+				profiler.beginPass(drawCmdBuffers[i], i, PASS_INSTANCE_CULLING);
+				vkCmdDispatch(drawCmdBuffers[i], (scene.instanceEntries[0].x + 31) / 32, 1, 1);
+				profiler.endPass(drawCmdBuffers[i], i, PASS_INSTANCE_CULLING);
+
+				// Level 0 roots, coarse cut clusters and the group counts grown for them
+				VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+				memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+				vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			}
 			for (size_t j = 0; j < scene.depthCounts.size(); j++)
 			{
 				// Refresh dst buffer
@@ -434,11 +755,13 @@ public:
 				vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
 				
 				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, bvhTraversalPipeline);
-				bvhTraversalPushConstants.threshold = thresholdInt / thresholdIntDiv;
 				bvhTraversalPushConstants.screenSize = glm::vec2(width, height);
+				bvhTraversalPushConstants.level = static_cast<uint32_t>(j);
 				vkCmdPushConstants(drawCmdBuffers[i], bvhTraversalPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BVHTraversalPushConstants), &bvhTraversalPushConstants);
 				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, bvhTraversalPipelineLayout, 0, 1, &descManager->getSet("bvhTraversal", j & 1), 0, 0);
-				vkCmdDispatch(drawCmdBuffers[i], (scene.depthCounts[j] + 31) / 32, 1, 1);
+				profiler.beginPass(drawCmdBuffers[i], i, static_cast<uint32_t>(PASS_BVH_LEVEL0 + j));
+				vkCmdDispatchIndirect(drawCmdBuffers[i], cullingDispatchIndirectBuffer.buffer, (j + 1) * sizeof(VkDispatchIndirectCommand));
+				profiler.endPass(drawCmdBuffers[i], i, static_cast<uint32_t>(PASS_BVH_LEVEL0 + j));
 				
 				// Add barrier for next src buffer
 				// TODO: Consider how to launch the compute shader
@@ -462,7 +785,12 @@ public:
 				bufferBarrier.offset = 0;
 				bufferBarrier.size = VK_WHOLE_SIZE;
 				vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
-			
+
+				// Group count of the next level (and of the cluster passes) was grown by this level
+				bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				bufferBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+				bufferBarrier.buffer = cullingDispatchIndirectBuffer.buffer;
+				vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
 			}
 			
 			bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
@@ -505,11 +833,30 @@ public:
 			//errorPushConstants.numClusters = clusterinfos.size();
 			errorPushConstants.numClusters = scene.maxClusterNum;
 			errorPushConstants.screenSize = glm::vec2(width, height);
+			errorPushConstants.useCutBudget = useCutBudget ? 1 : 0;
 			vkCmdPushConstants(drawCmdBuffers[i], errorProjPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ErrorPushConstants), &errorPushConstants);
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, errorProjPipelineLayout, 0, 1, &descManager->getSet("errorProj", 0), 0, 0);
 			//vkDeviceWaitIdle(device);
 
-			vkCmdDispatch(drawCmdBuffers[i], (errorPushConstants.numClusters + 31) / 32, 1, 1);
+			profiler.beginPass(drawCmdBuffers[i], i, PASS_ERROR_PROJ);
+			vkCmdDispatchIndirect(drawCmdBuffers[i], cullingDispatchIndirectBuffer.buffer, 0);
+			profiler.endPass(drawCmdBuffers[i], i, PASS_ERROR_PROJ);
+
+			// Without a budget the pass is not recorded and the profiler reports it as -1
+			if (useCutBudget)
+			{
+				// Pick the threshold from the cut sizes error projection collected
+				VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+				memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+				vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, cutBudgetPipeline);
+				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, cutBudgetPipelineLayout, 0, 1, &descManager->getSet("cutBudget", 0), 0, 0);
+				profiler.beginPass(drawCmdBuffers[i], i, PASS_CUT_BUDGET);
+				vkCmdDispatch(drawCmdBuffers[i], 1, 1, 1);
+				profiler.endPass(drawCmdBuffers[i], i, PASS_CUT_BUDGET);
+				vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			}
 
 			bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
 			bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
@@ -543,13 +890,28 @@ public:
 			*/
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, cullingPipeline);
 			//cullingPushConstants.numClusters = naniteMesh.meshes[0].clusters.size();
-			cullingPushConstants.threshold = thresholdInt / thresholdIntDiv;
 			cullingPushConstants.numClusters = scene.maxClusterNum;
 			vkCmdPushConstants(drawCmdBuffers[i], cullingPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullingPushConstants), &cullingPushConstants);
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, cullingPipelineLayout, 0, 1, &descManager->getSet("culling", 0), 0, 0);
 			//vkDeviceWaitIdle(device);
 			//std::cout << "333" << std::endl;
-			vkCmdDispatch(drawCmdBuffers[i], (cullingPushConstants.numClusters + 31) / 32, 1, 1);
+			profiler.beginPass(drawCmdBuffers[i], i, PASS_CULLING);
+			vkCmdDispatchIndirect(drawCmdBuffers[i], cullingDispatchIndirectBuffer.buffer, 0);
+			profiler.endPass(drawCmdBuffers[i], i, PASS_CULLING);
+
+			// Read back the traversal and culling counters through the profiler ring
+			{
+				VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+				memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+				vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+				profiler.copyCounters(drawCmdBuffers[i], i, culledClusterIndicesBuffer.buffer, 0, COUNTER_VISIBLE_CLUSTERS, 4);
+				profiler.copyCounters(drawCmdBuffers[i], i, hwrDrawIndexedIndirectBuffer.buffer, 0, COUNTER_HW_INDICES, 1);
+				profiler.copyCounters(drawCmdBuffers[i], i, swrNumVerticesBuffer.buffer, 0, COUNTER_SW_INDICES, 1);
+				if (cutViews > 1) {
+					profiler.copyCounters(drawCmdBuffers[i], i, viewClustersBuffer.buffer, sizeof(uint32_t), COUNTER_VIEW_CLUSTERS, cutViews - 1);
+				}
+			}
 
 			imageMemBarrier.image = textures.hizbuffer.image;
 			imageMemBarrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
@@ -627,6 +989,7 @@ public:
 			*  Software Rasterize
 			*
 			*/
+			profiler.beginPass(drawCmdBuffers[i], i, PASS_SW_RASTER);
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, clearImagePipeline);
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, clearImagePipelineLayout, 0, 1, &descManager->getSet("clearImage", 0), 0, 0);
 			vkCmdDispatch(drawCmdBuffers[i], (width + workgroupX - 1) / workgroupX, (height + workgroupY - 1) / workgroupY, 1);
@@ -657,6 +1020,7 @@ public:
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, swrComputePipelineLayout, 0, 1, &descManager->getSet("swRast", 0), 0, 0);
 			vkCmdDispatchIndirect(drawCmdBuffers[i], swrIndirectDispatchBuffer.buffer, 0);
 			//vkCmdDispatch(drawCmdBuffers[i], (scene.visibleIndicesCount / 3 + 31) / 32, 1, 1);
+			profiler.endPass(drawCmdBuffers[i], i, PASS_SW_RASTER);
 
 			imageMemBarrier.image = SWRBuffer.image;
 			imageMemBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
@@ -693,6 +1057,7 @@ public:
 			renderPassBeginInfo1.renderArea.extent.height = height;
 			renderPassBeginInfo1.clearValueCount = 2;
 			renderPassBeginInfo1.pClearValues = clearValues1;
+			profiler.beginPass(drawCmdBuffers[i], i, PASS_HW_RASTER);
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo1, VK_SUBPASS_CONTENTS_INLINE);
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, hwrastPipeline);
 			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
@@ -703,6 +1068,7 @@ public:
 			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &scene.vertices.buffer, offsets);
 			vkCmdDrawIndexedIndirect(drawCmdBuffers[i], hwrDrawIndexedIndirectBuffer.buffer, 0, 1, 0);
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
+			profiler.endPass(drawCmdBuffers[i], i, PASS_HW_RASTER);
 
 			bufferBarrier.srcAccessMask = VK_ACCESS_INDEX_READ_BIT;
 			bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
@@ -754,7 +1120,9 @@ public:
 			vkCmdPushConstants(drawCmdBuffers[i], mergeRastPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(RenderingPushConstants), &renderingPushConstants);
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, mergeRastPipeline);
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, mergeRastPipelineLayout, 0, 1, &descManager->getSet("mergeRast", 0), 0, NULL);
+			profiler.beginPass(drawCmdBuffers[i], i, PASS_MERGE);
 			vkCmdDispatch(drawCmdBuffers[i], (width + workgroupX - 1) / workgroupX, (height + workgroupY - 1) / workgroupY, 1);
+			profiler.endPass(drawCmdBuffers[i], i, PASS_MERGE);
 
 			imageMemBarrier.image = HWRZBuffer.image;
 			imageMemBarrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
@@ -812,6 +1180,7 @@ public:
 			*  Shading
 			*
 			*/
+			profiler.beginPass(drawCmdBuffers[i], i, PASS_SHADING);
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
 			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
@@ -860,6 +1229,7 @@ public:
 			//models.cube.draw(drawCmdBuffers[i]);
 			drawUI(drawCmdBuffers[i]);
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
+			profiler.endPass(drawCmdBuffers[i], i, PASS_SHADING);
 
 			imageMemBarrier.image = FinalZBuffer.image;
 			imageMemBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
@@ -910,7 +1280,9 @@ public:
 			///vkDeviceWaitIdle(device);
 			///std::cout << "444" << std::endl;
 			///ASSERT(depthStencil.view != VK_NULL_HANDLE, "test");
+			profiler.beginPass(drawCmdBuffers[i], i, PASS_DEPTH_COPY);
 			vkCmdDispatch(drawCmdBuffers[i], (width + workgroupX - 1) / workgroupX, (height + workgroupY - 1) / workgroupY, 1);
+			profiler.endPass(drawCmdBuffers[i], i, PASS_DEPTH_COPY);
 			//std::cout << "45" << std::endl;
 
 			imageMemBarriers[0] = vks::initializers::imageMemoryBarrier();
@@ -984,6 +1356,7 @@ public:
 			//vkDeviceWaitIdle(device);
 			//std::cout << "555" << std::endl;
 
+			profiler.beginPass(drawCmdBuffers[i], i, PASS_HIZ_BUILD);
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, hizComputePipeline);
 			for (int j = 0; j < textures.hizbuffer.mipLevels - 1; j++)
 			{
@@ -1002,6 +1375,7 @@ public:
 				imageMemBarrier.subresourceRange.layerCount = 1;
 				vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, 0, 0, 0, 1, &imageMemBarrier);
 			}
+			profiler.endPass(drawCmdBuffers[i], i, PASS_HIZ_BUILD);
 
 			/*
 			*  HZB view
@@ -1044,12 +1418,13 @@ public:
 				vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, 0, 0, 0, 1, &imageMemBarrier);
 			}
 
+			profiler.endFrame(drawCmdBuffers[i], i);
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 		}
 		//ASSERT(false, "debug interrupt");
 	}
 
-	void createScene1()
+	void createScene1(uint32_t dragon)
 	{
 		// performance test scene
 		modelMats.clear();
@@ -1057,80 +1432,81 @@ public:
 		{
 			for (int j = -17; j <= 17; j++) 
 			{
-				auto& modelMat = glm::translate(glm::mat4(1.0f), glm::vec3(i * 3, 1.2f, j * 3));
-				auto& instance = Instance(&naniteMesh, modelMat);
+				auto modelMat = glm::translate(glm::mat4(1.0f), glm::vec3(i * 3, 1.2f, j * 3));
 				modelMats.emplace_back(modelMat);
-				scene.naniteObjects.emplace_back(instance);
+				scene.addInstance(dragon, modelMat);
 			}
 		}
 	}
 
-	void createScene2()
+	void createScene2(uint32_t dragon)
 	{
 		// normal scene
-		auto & instance1 = Instance(&naniteMesh, modelMats[0]);
-		auto & instance2 = Instance(&naniteMesh, modelMats[1]);
-		//auto & instance3 = Instance(&naniteMesh, modelMats[2]);
-		scene.naniteObjects.push_back(instance1);
-		scene.naniteObjects.push_back(instance2);
-		//scene.naniteObjects.push_back(instance3);
+		scene.addInstance(dragon, modelMats[0]);
+		scene.addInstance(dragon, modelMats[1]);
+		//scene.addInstance(dragon, modelMats[2]);
 	}
 
-	void createScene3()
+	void createScene3(uint32_t dragon)
 	{
 		// normal multi-mesh scene
-		auto & instance1 = Instance(&naniteMesh, modelMats[0]);
-		scene.naniteObjects.push_back(instance1);
-		NaniteMesh naniteMesh2;
-		naniteMesh2.setModelPath((getAssetPath() + "models/bunny/").c_str());
-		naniteMesh2.loadvkglTFModel(models.object);
-		naniteMesh2.initNaniteInfo(getAssetPath() + "models/bunny.gltf", true);
-		for (int i = 0; i < naniteMesh2.meshes.size(); i++)
-		{
-			naniteMesh2.meshes[i].initUniqueVertexBuffer();
-			naniteMesh2.meshes[i].initVertexBuffer();
-			naniteMesh2.meshes[i].createVertexBuffer(vulkanDevice, queue);
-		}
-		scene.naniteMeshes.push_back(naniteMesh2);
-		auto& instance2 = Instance(&naniteMesh2, modelMats[1]);
-		scene.naniteObjects.push_back(instance2);
+		scene.addInstance(dragon, modelMats[0]);
+		// Loaded in the background by loadAssets()
+		uint32_t bunny = scene.addNaniteMesh("bunny", std::move(naniteMesh2));
+		scene.addInstance(bunny, modelMats[1]);
 	}
 
-	void createScene4()
+	void createScene4(uint32_t dragon)
 	{
 		// performance test multi-mesh scene
-		NaniteMesh naniteMesh2;
-		naniteMesh2.setModelPath((getAssetPath() + "models/bunny/").c_str());
-		naniteMesh2.loadvkglTFModel(models.object);
-		naniteMesh2.initNaniteInfo(getAssetPath() + "models/bunny.gltf", true);
-		for (int i = 0; i < naniteMesh2.meshes.size(); i++)
-		{
-			naniteMesh2.meshes[i].initUniqueVertexBuffer();
-			naniteMesh2.meshes[i].initVertexBuffer();
-			naniteMesh2.meshes[i].createVertexBuffer(vulkanDevice, queue);
-		}
-		scene.naniteMeshes.push_back(naniteMesh2);
+		// Loaded in the background by loadAssets()
+		uint32_t bunny = scene.addNaniteMesh("bunny", std::move(naniteMesh2));
 		
 		modelMats.clear();
 		for (int i = -2; i <= 2; i++)
 		{
 			for (int j = -2; j <= 2; j++) 
 			{
-				auto& modelMat = glm::translate(glm::mat4(1.0f), glm::vec3(i * 3, j * 3, 0.0f));
-				if (i % 2) {
-					auto& instance = Instance(&naniteMesh, modelMat);
-					scene.naniteObjects.push_back(instance);
-				}
-				else{
-					auto& instance = Instance(&naniteMesh2, modelMat);
-					scene.naniteObjects.push_back(instance);
-				}
+				auto modelMat = glm::translate(glm::mat4(1.0f), glm::vec3(i * 3, j * 3, 0.0f));
+				scene.addInstance(i % 2 ? dragon : bunny, modelMat);
 				modelMats.push_back(modelMat);
 		
 			}
 		}
 	}
 
+	void createScene5(uint32_t dragon)
+	{
+		// prefab scene, a dragon and bunny pair, four pairs per block and a grid of blocks
+		// Loaded in the background by loadAssets()
+		uint32_t bunny = scene.addNaniteMesh("bunny", std::move(naniteMesh2));
+		PrefabMember dragonMember, bunnyMember;
+		dragonMember.meshHandle = dragon;
+		bunnyMember.meshHandle = bunny;
+		bunnyMember.transform = glm::translate(glm::mat4(1.0f), glm::vec3(1.5f, 0.0f, 0.0f));
+		uint32_t pair = scene.addPrefab("pair", { dragonMember, bunnyMember });
+
+		std::vector<PrefabMember> blockMembers(4);
+		for (int k = 0; k < 4; k++)
+		{
+			blockMembers[k].prefabHandle = pair;
+			blockMembers[k].transform = glm::translate(glm::mat4(1.0f), glm::vec3((k & 1) * 3.0f, 0.0f, (k >> 1) * 3.0f))
+				* glm::rotate(glm::mat4(1.0f), glm::radians(90.0f * k), glm::vec3(0.0f, 1.0f, 0.0f));
+		}
+		uint32_t block = scene.addPrefab("block", blockMembers);
+
+		modelMats.clear();
+		for (int i = -5; i < 5; i++)
+		{
+			for (int j = -5; j < 5; j++)
+			{
+				auto modelMat = glm::translate(glm::mat4(1.0f), glm::vec3(i * 7, 1.2f, j * 7));
+				scene.addPrefabInstance(block, modelMat);
+				modelMats.push_back(modelMat);
+			}
+		}
+	}
+
 	void loadAssets()
 	{
 		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY;
@@ -1139,21 +1515,41 @@ public:
 		//reducedModel.generateClusterInfos(models.object, vulkanDevice, queue);
 		
 		models.object.loadFromFile(getAssetPath() + "models/dragon.gltf", vulkanDevice, queue, glTFLoadingFlags);
-		naniteMesh.setModelPath((getAssetPath() + "models/dragon/").c_str());
-		naniteMesh.loadvkglTFModel(models.object);
-		naniteMesh.initNaniteInfo(getAssetPath() + "models/dragon.gltf", true);
-
-		for (int i = 0; i < naniteMesh.meshes.size(); i++)
-		{
-			naniteMesh.meshes[i].initUniqueVertexBuffer();
-			naniteMesh.meshes[i].initVertexBuffer();
-			naniteMesh.meshes[i].createVertexBuffer(vulkanDevice, queue);
+		if (useSceneFile) {
+			// Every mesh of the file gets its own glTF model, they are built and cached like the built-in ones
+			sceneFileModels.resize(sceneFile.meshes.size());
+			sceneFileModelPaths.resize(sceneFile.meshes.size());
+			sceneFileMeshes.resize(sceneFile.meshes.size());
+			for (size_t i = 0; i < sceneFile.meshes.size(); i++)
+			{
+				const auto& meshPath = sceneFile.meshes[i].path;
+				sceneMeshPaths[sceneFile.meshes[i].name] = meshPath;
+				sceneFileModels[i] = std::make_unique<vkglTF::Model>();
+				sceneFileModels[i]->loadFromFile(getAssetPath() + meshPath, vulkanDevice, queue, glTFLoadingFlags);
+				sceneFileModelPaths[i] = getAssetPath() + meshPath.substr(0, meshPath.find_last_of('.')) + "/";
+				sceneFileMeshes[i].setModelPath(sceneFileModelPaths[i].c_str());
+				sceneFileMeshes[i].loadvkglTFModel(*sceneFileModels[i]);
+				sceneFileMeshes[i].chunkTriangleBudget = chunkTriangleBudget;
+				sceneFileMeshes[i].buildWorkers = buildWorkers;
+				naniteLoadTasks.push_back(std::make_unique<NaniteLoadTask>(sceneFileMeshes[i], getAssetPath() + meshPath, true));
+			}
+		}
+		else {
+			naniteMesh.setModelPath((getAssetPath() + "models/dragon/").c_str());
+			naniteMesh.loadvkglTFModel(models.object);
+			naniteMesh.chunkTriangleBudget = chunkTriangleBudget;
+			naniteMesh.buildWorkers = buildWorkers;
+			naniteLoadTasks.push_back(std::make_unique<NaniteLoadTask>(naniteMesh, getAssetPath() + "models/dragon.gltf", true));
+			if (sceneIndex >= 3 && sceneIndex <= 5) {
+				bunnyModel = std::make_unique<vkglTF::Model>();
+				bunnyModel->loadFromFile(getAssetPath() + "models/bunny.gltf", vulkanDevice, queue, glTFLoadingFlags);
+				naniteMesh2.setModelPath((getAssetPath() + "models/bunny/").c_str());
+				naniteMesh2.loadvkglTFModel(*bunnyModel);
+				naniteMesh2.chunkTriangleBudget = chunkTriangleBudget;
+				naniteMesh2.buildWorkers = buildWorkers;
+				naniteLoadTasks.push_back(std::make_unique<NaniteLoadTask>(naniteMesh2, getAssetPath() + "models/bunny.gltf", true));
+			}
 		}
-		scene.naniteMeshes.emplace_back(naniteMesh);
-		
-		createScene2();
-		
-		scene.createNaniteSceneInfo(vulkanDevice, queue);
 		//reducedModel.simplifyModel(vulkanDevice, queue);
 		textures.environmentCube.loadFromFile(getAssetPath() + "textures/hdr/gcanyon_cube.ktx", VK_FORMAT_R16G16B16A16_SFLOAT, vulkanDevice, queue);
 		textures.albedoMap.loadFromFile(getAssetPath() + "models/cerberus/albedo.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
@@ -1165,6 +1561,65 @@ public:
 		models.cube.loadFromFile(getAssetPath() + "models/cube.gltf", vulkanDevice, queue, glTFLoadingFlags);
 	}
 
+	bool naniteLoadFinished() const
+	{
+		for (const auto& task : naniteLoadTasks)
+		{
+			if (!task->finished()) return false;
+		}
+		return true;
+	}
+
+	// Scene assembly once every NaniteLoadTask finished, the buffers created after it are sized by the scene
+	void loadNaniteScene()
+	{
+		for (auto& task : naniteLoadTasks)
+		{
+			task->wait();
+			ASSERT(task->succeeded(), "Nanite mesh was not loaded");
+		}
+		naniteLoadTasks.clear();
+
+		// The scene owns the meshes from here on
+		if (useSceneFile) {
+			for (size_t i = 0; i < sceneFile.meshes.size(); i++)
+			{
+				scene.addNaniteMesh(sceneFile.meshes[i].name, std::move(sceneFileMeshes[i]));
+			}
+			sceneFileMeshes.clear();
+			sceneFile.addInstances(scene);
+			std::cout << "Scene file: " << sceneFile.instances.size() << " instances of " << sceneFile.meshes.size() << " meshes" << std::endl;
+		}
+		else {
+			uint32_t dragon = scene.addNaniteMesh("dragon", std::move(naniteMesh));
+			switch (sceneIndex)
+			{
+			case 1: createScene1(dragon); break;
+			case 3: createScene3(dragon); break;
+			case 4: createScene4(dragon); break;
+			case 5: createScene5(dragon); break;
+			default: createScene2(dragon); break;
+			}
+		}
+		if (!exportSceneFilename.empty()) {
+			ASSERT(SceneFile::fromScene(scene, sceneMeshPaths).write(exportSceneFilename), "Failed to write scene file " << exportSceneFilename);
+		}
+
+		// Streamed scenes get their vertices page by page, see preparePagePool()
+		scene.streamed = streaming && !cpuReplay;
+		for (auto& sceneMesh : scene.naniteMeshes)
+		{
+			for (int i = 0; i < sceneMesh.meshes.size() && !scene.streamed; i++)
+			{
+				sceneMesh.meshes[i].initUniqueVertexBuffer();
+				sceneMesh.meshes[i].initVertexBuffer();
+				sceneMesh.meshes[i].createVertexBuffer(vulkanDevice, queue);
+			}
+		}
+		
+		scene.createNaniteSceneInfo(vulkanDevice, queue);
+	}
+
 	void setupDescriptors()
 	{
 		
@@ -1213,9 +1668,37 @@ public:
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 6),
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 7),
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 8),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 9),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 10),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 11),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 12),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 13),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 14),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 15),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 16),
 		};
 		manager->addSetLayout("bvhTraversal", setLayoutBindings, 2);
 
+		setLayoutBindings = {
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 5),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 6),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 7),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 8),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 9),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 10),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 11),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 12),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 13),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 14),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 15),
+		};
+		manager->addSetLayout("instanceCulling", setLayoutBindings, 1);
+
 		setLayoutBindings = {
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
@@ -1231,9 +1714,24 @@ public:
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 11),
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 12),
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 13),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 14),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 15),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 16),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 17),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 18),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 19),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 20),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 21),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 22),
 		};
 		manager->addSetLayout("culling", setLayoutBindings, 1);
 
+		setLayoutBindings = {
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+		};
+		manager->addSetLayout("appendBench", setLayoutBindings, 1);
+
 		setLayoutBindings = {
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
@@ -1241,9 +1739,18 @@ public:
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 5),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 6),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 7),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 8),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 9),
 		};
 		manager->addSetLayout("errorProj", setLayoutBindings, 1);
 
+		setLayoutBindings = {
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+		};
+		manager->addSetLayout("cutBudget", setLayoutBindings, 1);
+
 		setLayoutBindings = {
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_GEOMETRY_BIT, 0),
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_GEOMETRY_BIT, 1),
@@ -1264,8 +1771,6 @@ public:
 
 		setLayoutBindings = {
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 0),
-			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
-			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
 		};
 		manager->addSetLayout("clearImage", setLayoutBindings, 1);
 
@@ -1294,7 +1799,13 @@ public:
 		manager->addSetLayout("shading", setLayoutBindings, 1);
 
 		manager->createLayoutsAndSets(device);
+		writeDescriptorSets();
+	}
 
+	// Again after buffers were recreated, see growSceneBuffers()
+	void writeDescriptorSets()
+	{
+		auto manager = VulkanDescriptorSetManager::getManager();
 
 		//culledObjectIndicesBuffer.setupDescriptor();
 		modelMatsBuffer.setupDescriptor();
@@ -1400,6 +1911,8 @@ public:
 		errorUniformBuffer.setupDescriptor();
 		culledClusterObjectIndicesBuffer.setupDescriptor();
 		sortedClusterIndicesBuffer.setupDescriptor();
+		cullingDispatchIndirectBuffer.setupDescriptor();
+		cutBudgetBuffer.setupDescriptor();
 		manager->writeToSet("bvhTraversal", 0, 0, &bvhNodeInfosBuffer.descriptor);
 		manager->writeToSet("bvhTraversal", 0, 1, &currNodeInfosBuffer.descriptor);
 		manager->writeToSet("bvhTraversal", 0, 2, &nextNodeInfosBuffer.descriptor);
@@ -1409,6 +1922,19 @@ public:
 		manager->writeToSet("bvhTraversal", 0, 6, &errorUniformBuffer.descriptor);
 		manager->writeToSet("bvhTraversal", 0, 7, &culledClusterObjectIndicesBuffer.descriptor);
 		manager->writeToSet("bvhTraversal", 0, 8, &sortedClusterIndicesBuffer.descriptor);
+		manager->writeToSet("bvhTraversal", 0, 9, &cullingDispatchIndirectBuffer.descriptor);
+		manager->writeToSet("bvhTraversal", 0, 10, &modelMatsBuffer.descriptor);
+		lodBiasBuffer.setupDescriptor();
+		manager->writeToSet("bvhTraversal", 0, 11, &lodBiasBuffer.descriptor);
+		manager->writeToSet("bvhTraversal", 0, 12, &cutBudgetBuffer.descriptor);
+		currNodeViewMasksBuffer.setupDescriptor();
+		nextNodeViewMasksBuffer.setupDescriptor();
+		clusterViewMasksBuffer.setupDescriptor();
+		cullViewsBuffer.setupDescriptor();
+		manager->writeToSet("bvhTraversal", 0, 13, &currNodeViewMasksBuffer.descriptor);
+		manager->writeToSet("bvhTraversal", 0, 14, &nextNodeViewMasksBuffer.descriptor);
+		manager->writeToSet("bvhTraversal", 0, 15, &clusterViewMasksBuffer.descriptor);
+		manager->writeToSet("bvhTraversal", 0, 16, &cullViewsBuffer.descriptor);
 		
 		manager->writeToSet("bvhTraversal", 1, 0, &bvhNodeInfosBuffer.descriptor);
 		manager->writeToSet("bvhTraversal", 1, 1, &nextNodeInfosBuffer.descriptor);
@@ -1419,6 +1945,35 @@ public:
 		manager->writeToSet("bvhTraversal", 1, 6, &errorUniformBuffer.descriptor);
 		manager->writeToSet("bvhTraversal", 1, 7, &culledClusterObjectIndicesBuffer.descriptor);
 		manager->writeToSet("bvhTraversal", 1, 8, &sortedClusterIndicesBuffer.descriptor);
+		manager->writeToSet("bvhTraversal", 1, 9, &cullingDispatchIndirectBuffer.descriptor);
+		manager->writeToSet("bvhTraversal", 1, 10, &modelMatsBuffer.descriptor);
+		manager->writeToSet("bvhTraversal", 1, 11, &lodBiasBuffer.descriptor);
+		manager->writeToSet("bvhTraversal", 1, 12, &cutBudgetBuffer.descriptor);
+		manager->writeToSet("bvhTraversal", 1, 13, &nextNodeViewMasksBuffer.descriptor);
+		manager->writeToSet("bvhTraversal", 1, 14, &currNodeViewMasksBuffer.descriptor);
+		manager->writeToSet("bvhTraversal", 1, 15, &clusterViewMasksBuffer.descriptor);
+		manager->writeToSet("bvhTraversal", 1, 16, &cullViewsBuffer.descriptor);
+
+		//Instance Culling, writes level 0 of the traversal
+		instanceEntriesBuffer.setupDescriptor();
+		blockCullInfosBuffer.setupDescriptor();
+		coarseCutClustersBuffer.setupDescriptor();
+		manager->writeToSet("instanceCulling", 0, 0, &instanceEntriesBuffer.descriptor);
+		manager->writeToSet("instanceCulling", 0, 1, &blockCullInfosBuffer.descriptor);
+		manager->writeToSet("instanceCulling", 0, 2, &currNodeInfosBuffer.descriptor);
+		manager->writeToSet("instanceCulling", 0, 3, &culledClusterIndicesBuffer.descriptor);
+		manager->writeToSet("instanceCulling", 0, 4, &cullingUniformBuffer.descriptor);
+		manager->writeToSet("instanceCulling", 0, 5, &textures.hizbuffer.descriptor);
+		manager->writeToSet("instanceCulling", 0, 6, &errorUniformBuffer.descriptor);
+		manager->writeToSet("instanceCulling", 0, 7, &culledClusterObjectIndicesBuffer.descriptor);
+		manager->writeToSet("instanceCulling", 0, 8, &coarseCutClustersBuffer.descriptor);
+		manager->writeToSet("instanceCulling", 0, 9, &cullingDispatchIndirectBuffer.descriptor);
+		manager->writeToSet("instanceCulling", 0, 10, &modelMatsBuffer.descriptor);
+		manager->writeToSet("instanceCulling", 0, 11, &lodBiasBuffer.descriptor);
+		manager->writeToSet("instanceCulling", 0, 12, &cutBudgetBuffer.descriptor);
+		manager->writeToSet("instanceCulling", 0, 13, &currNodeViewMasksBuffer.descriptor);
+		manager->writeToSet("instanceCulling", 0, 14, &clusterViewMasksBuffer.descriptor);
+		manager->writeToSet("instanceCulling", 0, 15, &cullViewsBuffer.descriptor);
 
 		//Culling
 		clustersInfoBuffer.setupDescriptor();
@@ -1451,6 +2006,26 @@ public:
 		manager->writeToSet("culling", 0, 11, &culledClusterIndicesBuffer.descriptor);
 		manager->writeToSet("culling", 0, 12, &culledClusterObjectIndicesBuffer.descriptor);
 		manager->writeToSet("culling", 0, 13, &modelMatsBuffer.descriptor);
+		swrIndirectDispatchBuffer.setupDescriptor();
+		manager->writeToSet("culling", 0, 14, &swrIndirectDispatchBuffer.descriptor);
+		manager->writeToSet("culling", 0, 15, &cutBudgetBuffer.descriptor);
+		clusterStatesBuffer.setupDescriptor();
+		manager->writeToSet("culling", 0, 16, &clusterStatesBuffer.descriptor);
+		streamingRequestsBuffer.setupDescriptor();
+		manager->writeToSet("culling", 0, 17, &streamingRequestsBuffer.descriptor);
+		viewClustersBuffer.setupDescriptor();
+		errorInfoBuffer.setupDescriptor();
+		manager->writeToSet("culling", 0, 18, &clusterViewMasksBuffer.descriptor);
+		manager->writeToSet("culling", 0, 19, &cullViewsBuffer.descriptor);
+		manager->writeToSet("culling", 0, 20, &viewClustersBuffer.descriptor);
+		manager->writeToSet("culling", 0, 21, &errorInfoBuffer.descriptor);
+		manager->writeToSet("culling", 0, 22, &lodBiasBuffer.descriptor);
+
+		//Append benchmark
+		appendBenchCounterBuffer.setupDescriptor();
+		appendBenchOutBuffer.setupDescriptor();
+		manager->writeToSet("appendBench", 0, 0, &appendBenchCounterBuffer.descriptor);
+		manager->writeToSet("appendBench", 0, 1, &appendBenchOutBuffer.descriptor);
 
 		//Error projection
 		errorInfoBuffer.setupDescriptor();
@@ -1464,6 +2039,13 @@ public:
 		manager->writeToSet("errorProj", 0, 3, &culledClusterIndicesBuffer.descriptor);
 		manager->writeToSet("errorProj", 0, 4, &culledClusterObjectIndicesBuffer.descriptor);
 		manager->writeToSet("errorProj", 0, 5, &modelMatsBuffer.descriptor);
+		manager->writeToSet("errorProj", 0, 6, &clustersInfoBuffer.descriptor);
+		manager->writeToSet("errorProj", 0, 7, &cutBudgetBuffer.descriptor);
+		manager->writeToSet("errorProj", 0, 8, &lodBiasBuffer.descriptor);
+		manager->writeToSet("errorProj", 0, 9, &clusterViewMasksBuffer.descriptor);
+
+		//Cut budget
+		manager->writeToSet("cutBudget", 0, 0, &cutBudgetBuffer.descriptor);
 
 		//Hardware Rasterization
 		manager->writeToSet("hwRast", 0, 0, &modelMatsBuffer.descriptor);
@@ -1488,8 +2070,6 @@ public:
 
 		//Clear image
 		manager->writeToSet("clearImage", 0, 0, &SWRImageInfo);
-		manager->writeToSet("clearImage", 0, 1, &swrNumVerticesBuffer.descriptor);
-		manager->writeToSet("clearImage", 0, 2, &swrIndirectDispatchBuffer.descriptor);
 
 		//Merge Rasterization Result
 		VkDescriptorImageInfo HWRImageInfo = {};
@@ -1536,6 +2116,13 @@ public:
 		//ASSERT(false, "debug");
 	}
 
+	// SPIR-V of a shader on include/append.glsl. The subgroup extensions make a module declare the subgroup
+	// capabilities even when the specialization constant turns them off, so other devices load a variant without them
+	std::string appendShaderPath(const std::string& name) const
+	{
+		return getShadersPath() + "pbrtexture/" + name + (useSubgroupAppend ? ".spv" : ".nosubgroup.spv");
+	}
+
 	void preparePipelines()
 	{
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
@@ -1552,6 +2139,9 @@ public:
 
 
 		auto descManager = VulkanDescriptorSetManager::getManager();
+		// Selects the append path of include/append.glsl
+		VkSpecializationMapEntry appendSpecializationEntry = vks::initializers::specializationMapEntry(0, 0, sizeof(VkBool32));
+		VkSpecializationInfo appendSpecializationInfo = vks::initializers::specializationInfo(1, &appendSpecializationEntry, sizeof(VkBool32), &useSubgroupAppend);
 		// Pipeline layout
 		VkPushConstantRange push_constant{};
 		push_constant.size = sizeof(RenderingPushConstants);
@@ -1734,7 +2324,8 @@ public:
 
 		{
 			// BVH Traversal pipeline
-			VkPipelineShaderStageCreateInfo computeShaderStage = loadShader(getShadersPath() + "pbrtexture/bvhtraversal.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+			VkPipelineShaderStageCreateInfo computeShaderStage = loadShader(appendShaderPath("bvhtraversal.comp"), VK_SHADER_STAGE_COMPUTE_BIT);
+			computeShaderStage.pSpecializationInfo = &appendSpecializationInfo;
 			VkPushConstantRange push_constant2{};
 			push_constant2.size = sizeof(BVHTraversalPushConstants);
 			push_constant2.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
@@ -1750,9 +2341,29 @@ public:
 			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &bvhTraversalPipeline));
 		}
 
+		{
+			// Instance culling pipeline, same push constants as the BVH traversal
+			VkPipelineShaderStageCreateInfo computeShaderStage = loadShader(appendShaderPath("instanceculling.comp"), VK_SHADER_STAGE_COMPUTE_BIT);
+			computeShaderStage.pSpecializationInfo = &appendSpecializationInfo;
+			VkPushConstantRange push_constant{};
+			push_constant.size = sizeof(BVHTraversalPushConstants);
+			push_constant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descManager->getSetLayout("instanceCulling"), 1);
+			pipelineLayoutCreateInfo.pPushConstantRanges = &push_constant;
+			pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &instanceCullingPipelineLayout));
+
+			VkComputePipelineCreateInfo pipelineCreateInfo = {};
+			pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+			pipelineCreateInfo.stage = computeShaderStage;
+			pipelineCreateInfo.layout = instanceCullingPipelineLayout;
+			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &instanceCullingPipeline));
+		}
+
 		{
 			// Culling pipeline
-			VkPipelineShaderStageCreateInfo computeShaderStage = loadShader(getShadersPath() + "pbrtexture/culling.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+			VkPipelineShaderStageCreateInfo computeShaderStage = loadShader(appendShaderPath("culling.comp"), VK_SHADER_STAGE_COMPUTE_BIT);
+			computeShaderStage.pSpecializationInfo = &appendSpecializationInfo;
 			VkPushConstantRange push_constant{};
 			push_constant.size = sizeof(CullingPushConstants);
 			push_constant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
@@ -1786,6 +2397,19 @@ public:
 			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &errorProjPipeline));
 		}
 
+		{
+			// Cut budget threshold selection
+			VkPipelineShaderStageCreateInfo computeShaderStage = loadShader(getShadersPath() + "pbrtexture/budget.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+			pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descManager->getSetLayout("cutBudget"), 1);
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &cutBudgetPipelineLayout));
+
+			VkComputePipelineCreateInfo pipelineCreateInfo = {};
+			pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+			pipelineCreateInfo.stage = computeShaderStage;
+			pipelineCreateInfo.layout = cutBudgetPipelineLayout;
+			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &cutBudgetPipeline));
+		}
+
 		{
 			// Merge Rasterize result
 			VkPipelineShaderStageCreateInfo computeShaderStage = loadShader(getShadersPath() + "pbrtexture/merger.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
@@ -1803,6 +2427,31 @@ public:
 			pipelineCreateInfo.layout = mergeRastPipelineLayout;
 			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &mergeRastPipeline));
 		}
+
+		{
+			// Append micro benchmark, one pipeline per append path
+			VkPushConstantRange push_constant{};
+			push_constant.size = sizeof(AppendBenchPushConstants);
+			push_constant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descManager->getSetLayout("appendBench"), 1);
+			pipelineLayoutCreateInfo.pPushConstantRanges = &push_constant;
+			pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &appendBenchPipelineLayout));
+
+			for (uint32_t i = 0; i < 2; i++)
+			{
+				VkBool32 subgroupAppend = (i == 1) ? useSubgroupAppend : VK_FALSE;
+				VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(1, &appendSpecializationEntry, sizeof(VkBool32), &subgroupAppend);
+				VkPipelineShaderStageCreateInfo computeShaderStage = loadShader(appendShaderPath("appendbench.comp"), VK_SHADER_STAGE_COMPUTE_BIT);
+				computeShaderStage.pSpecializationInfo = &specializationInfo;
+
+				VkComputePipelineCreateInfo pipelineCreateInfo = {};
+				pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+				pipelineCreateInfo.stage = computeShaderStage;
+				pipelineCreateInfo.layout = appendBenchPipelineLayout;
+				VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &appendBenchPipelines[i]));
+			}
+		}
 		//ASSERT(false, "debug");
 	}
 
@@ -2813,50 +3462,6 @@ public:
 			//ASSERT(0, "Stop");
 		}
 
-		{
-
-			vks::Buffer initNodeInfosStaging;
-			//std::cout << "size of clusterInfo:" << sizeof(ClusterInfo) << std::endl;
-
-			VK_CHECK_RESULT(vulkanDevice->createBuffer(
-				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				scene.initNodeInfoIndices.size() * sizeof(uint32_t),
-				&initNodeInfosStaging.buffer,
-				&initNodeInfosStaging.memory,
-				scene.initNodeInfoIndices.data()));
-
-			VK_CHECK_RESULT(vulkanDevice->createBuffer(
-				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-				scene.initNodeInfoIndices.size() * sizeof(uint32_t),
-				&initNodeInfosBuffer.buffer,
-				&initNodeInfosBuffer.memory,
-				nullptr));
-			VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-			VkBufferCopy copyRegion = {};
-
-			copyRegion.size = scene.initNodeInfoIndices.size() * sizeof(uint32_t);
-			vkCmdCopyBuffer(copyCmd, initNodeInfosStaging.buffer, initNodeInfosBuffer.buffer, 1, &copyRegion);
-
-			vulkanDevice->flushCommandBuffer(copyCmd, queue, true);//TODO: get transfer queue here
-
-			vkDestroyBuffer(vulkanDevice->logicalDevice, initNodeInfosStaging.buffer, nullptr);
-			vkFreeMemory(vulkanDevice->logicalDevice, initNodeInfosStaging.memory, nullptr);
-		}
-
-		std::cout << "scene.maxDepthCounts: " << scene.maxDepthCounts << std::endl;
-		std::cout << scene.maxDepthCounts * sizeof(uint32_t) << std::endl;
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			scene.maxDepthCounts * 2 * sizeof(uint32_t),
-			//10000 * sizeof(uint32_t),
-			&currNodeInfosBuffer.buffer,
-			&currNodeInfosBuffer.memory,
-			nullptr));
-
 		{
 
 			vks::Buffer sortedClusterIndicesStaging;
@@ -2889,74 +3494,10 @@ public:
 			vkDestroyBuffer(vulkanDevice->logicalDevice, sortedClusterIndicesStaging.buffer, nullptr);
 			vkFreeMemory(vulkanDevice->logicalDevice, sortedClusterIndicesStaging.memory, nullptr);
 		}
-
-		//VkMemoryRequirements memoryRequirements;
-		//vkGetBufferMemoryRequirements(device, currNodeInfosBuffer.buffer, &memoryRequirements);
-		//std::cout << memoryRequirements.alignment << std::endl;
-		//std::cout << memoryRequirements.size << std::endl;
-
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			scene.maxDepthCounts * 2 * sizeof(uint32_t),
-			//10000 * sizeof(uint32_t),
-			&nextNodeInfosBuffer.buffer,
-			&nextNodeInfosBuffer.memory,
-			nullptr));
-
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			(scene.maxClusterNum + 5) * sizeof(uint32_t), // reserve 5 for atomic counter
-			&culledClusterIndicesBuffer.buffer,
-			&culledClusterIndicesBuffer.memory,
-			nullptr));
-
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			scene.maxClusterNum * sizeof(uint32_t),
-			//scene.sceneIndicesCount * sizeof(uint16_t),
-			//width * height * CLUSTER_MAX_SIZE * sizeof(uint32_t), // TODO: Should consider using a buffer relative with screen size
-			&culledClusterObjectIndicesBuffer.buffer,
-			&culledClusterObjectIndicesBuffer.memory,
-			nullptr));
 	}
 
 	void createCullingBuffers()
 	{
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			scene.sceneIndicesCount / 8 * sizeof(uint32_t),
-			&HWRIndicesBuffer.buffer,
-			&HWRIndicesBuffer.memory,
-			nullptr));
-
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			scene.sceneIndicesCount / 8 / 3 * sizeof(glm::uvec3),
-			&HWRIDBuffer.buffer,
-			&HWRIDBuffer.memory,
-			nullptr));
-
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			scene.sceneIndicesCount / 8 * sizeof(uint32_t),
-			&SWRIndicesBuffer.buffer,
-			&SWRIndicesBuffer.memory,
-			nullptr));
-
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			scene.sceneIndicesCount / 8 / 3 * sizeof(glm::uvec3),
-			&SWRIDBuffer.buffer,
-			&SWRIDBuffer.memory,
-			nullptr));
-		
 		for (auto& ci:scene.clusterInfo)
 		{
 			assert(ci.triangleIndicesEnd >= 0 && ci.triangleIndicesEnd <= scene.indices.count / 3);
@@ -3020,7 +3561,7 @@ public:
 		hwrDrawIndexedIndirect.vertexOffset = 0;
 
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 			sizeof(DrawIndexedIndirect),
 			&hwrDrawIndexedIndirectBuffer.buffer,
@@ -3032,7 +3573,7 @@ public:
 
 
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			sizeof(SWRIndirectBuffer),
 			&swrIndirectDispatchBuffer.buffer,
@@ -3042,7 +3583,7 @@ public:
 
 		uint32_t num_verts = 0;
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 			sizeof(uint32_t),
 			&swrNumVerticesBuffer.buffer,
@@ -3055,17 +3596,144 @@ public:
 		//ASSERT(false, "debug");
 	}
 
-	void createErrorProjectionBuffer()
+	// The scene vertex and index buffers become the page pool, the residency manager uploads the root pages right away
+	void preparePagePool()
+	{
+		pagePool.init(vulkanDevice, scene);
+		streamingOptions.slotBytes = pagePool.slotBytes();
+		residency.init(scene, streamingOptions, [this](uint32_t slot, uint32_t clusterOffset, const std::vector<char>& data) {
+			pagePool.upload(slot, clusterOffset, data);
+		});
+		// The residency manager grows the pool when the budget does not fit the root pages
+		pagePool.createBuffers(residency.slotCount());
+		std::cout << "Page pool: " << pagePool.slotCount() << " slots of " << pagePool.slotVertices() << " vertices and "
+			<< pagePool.slotTriangles() << " triangles for " << residency.pageCount() << " pages" << std::endl;
+	}
+
+	// Needs the cluster infos on the GPU, the page pool writes the triangle ranges of the resident clusters into them
+	void createStreamingBuffers()
 	{
+		const uint32_t clusterCount = static_cast<uint32_t>(scene.clusterInfo.size());
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			//scene.errorInfo.size() * sizeof(glm::vec2),
-			scene.maxClusterNum * sizeof(glm::vec2),
-			&projectedErrorBuffer.buffer,
-			&projectedErrorBuffer.memory,
-			nullptr));
-
+			&clusterStatesBuffer,
+			clusterCount * sizeof(uint32_t)));
+		// At most one request per culled cluster
+		const uint32_t requestCapacity = scene.streamed ? scene.maxClusterNum : 0;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&streamingRequestsBuffer,
+			(2 + requestCapacity) * sizeof(uint32_t)));
+		VK_CHECK_RESULT(streamingRequestsBuffer.map());
+		uint32_t header[2] = { 0, requestCapacity };
+		memcpy(streamingRequestsBuffer.mapped, header, sizeof(header));
+
+		if (scene.streamed) {
+			pagePool.flush(queue, clustersInfoBuffer.buffer, clusterStatesBuffer.buffer, residency);
+		}
+		else {
+			VkCommandBuffer fillCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			vkCmdFillBuffer(fillCmd, clusterStatesBuffer.buffer, 0, VK_WHOLE_SIZE, ResidencyManager::CLUSTER_FULLY_RESIDENT);
+			vulkanDevice->flushCommandBuffer(fillCmd, queue, true);
+		}
+	}
+
+	// Pages of the clusters culling.comp requested this frame, they are drawn from the next frame on
+	void updateStreaming(uint64_t frame)
+	{
+		const uint32_t* requests = static_cast<const uint32_t*>(streamingRequestsBuffer.mapped);
+		const uint32_t requestCount = std::min(requests[0], requests[1]);
+		streamingRequests.assign(requests + 2, requests + 2 + requestCount);
+		residency.update(streamingRequests, frame);
+		pagePool.flush(queue, clustersInfoBuffer.buffer, clusterStatesBuffer.buffer, residency);
+	}
+
+	// Written every frame from the command buffer, see buildCommandBuffers()
+	void createCutBudgetBuffer()
+	{
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			sizeof(CutBudgetHeader) + 2 * cutBudgetBins * sizeof(uint32_t),
+			&cutBudgetBuffer.buffer,
+			&cutBudgetBuffer.memory,
+			nullptr));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&cutBudgetHeaderBuffer,
+			sizeof(CutBudgetHeader)));
+		VK_CHECK_RESULT(cutBudgetHeaderBuffer.map());
+		writeCutBudgetHeader();
+	}
+
+	// The threshold and budgets of the next submission. submitFrame() waits for the queue, so the header is never in use
+	// here and the command buffers don't have to be rebuilt when the threshold moves
+	void writeCutBudgetHeader()
+	{
+		CutBudgetHeader header;
+		header.threshold = static_cast<float>(thresholdInt / thresholdIntDiv);
+		header.maxClusters = clusterBudget;
+		header.maxTriangles = triangleBudget;
+		memcpy(cutBudgetHeaderBuffer.mapped, &header, sizeof(header));
+	}
+
+	// Rewritten every frame like the cut budget header, see updateCullViews()
+	void createCullViewsBuffer()
+	{
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&cullViewsBuffer,
+			sizeof(UBOCullViews)));
+		VK_CHECK_RESULT(cullViewsBuffer.map());
+		updateCullViews();
+	}
+
+	// The camera and the cube faces around it, the same views for the GPU passes and the CPU reference
+	std::vector<CutView> multiViewCutViews(const CutView& cameraView) const
+	{
+		std::vector<CutView> views(1, cameraView);
+		const glm::vec3 eye = glm::vec3(glm::inverse(cameraView.view)[3]);
+		const glm::vec3 faceDirections[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+		const glm::vec3 faceUps[6] = { { 0, 1, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, 1, 0 }, { 0, 1, 0 } };
+		for (uint32_t face = 0; face + 1 < cutViews; face++) {
+			CutView faceView = cameraView;
+			faceView.view = glm::lookAt(eye, eye + faceDirections[face], faceUps[face]);
+			faceView.proj = glm::perspective(glm::radians(90.0f), 1.0f, camera.getNearClip(), camera.getFarClip());
+			faceView.lastView = faceView.view;
+			faceView.lastProj = faceView.proj;
+			faceView.screenSize = glm::vec2(static_cast<float>(height));
+			faceView.hzbSize = faceView.screenSize;
+			views.push_back(faceView);
+		}
+		return views;
+	}
+
+	// Views of the next submission, view 0 is the camera the other culling uniforms already hold
+	void updateCullViews()
+	{
+		CutView cameraView;
+		cameraView.view = camera.matrices.view;
+		cameraView.proj = camera.matrices.perspective;
+		cameraView.screenSize = glm::vec2(width, height);
+		const std::vector<CutView> views = multiViewCutViews(cameraView);
+		ASSERT(views.size() <= maxCullViews, "too many cull views");
+		uboCullViews.viewCount = static_cast<uint32_t>(views.size());
+		uboCullViews.viewClusterCapacity = static_cast<uint32_t>(sceneCapacity.clusters);
+		for (size_t v = 0; v < views.size(); v++) {
+			uboCullViews.viewProj[v] = views[v].proj * views[v].view;
+			uboCullViews.view[v] = views[v].view;
+			uboCullViews.proj[v] = views[v].proj;
+			uboCullViews.screenSize[v] = glm::vec4(views[v].screenSize, 0.0f, 0.0f);
+		}
+		memcpy(cullViewsBuffer.mapped, &uboCullViews, sizeof(uboCullViews));
+	}
+
+	void createErrorProjectionBuffer()
+	{
 		for (auto& ei : scene.errorInfo)
 		{
 			errorinfos.emplace_back(ei);
@@ -3232,7 +3900,7 @@ public:
 		imageCI.arrayLayers = 1;
 		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
 		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 
 		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &FinalVisBuffer.image));
 		vkGetImageMemoryRequirements(device, FinalVisBuffer.image, &memReqs);
@@ -3278,7 +3946,7 @@ public:
 		imageCI.arrayLayers = 1;
 		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
 		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT;
+		imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 
 		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &FinalZBuffer.image));
 		vkGetImageMemoryRequirements(device, FinalZBuffer.image, &memReqs);
@@ -3392,6 +4060,8 @@ public:
 		imageCI.extent.height = height;
 		imageCI.extent.depth = 1;
 		imageCI.mipLevels = mipLevels;
+		textures.hizbuffer.width = width;
+		textures.hizbuffer.height = height;
 		imageCI.arrayLayers = 1;
 		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
 		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
@@ -3470,37 +4140,171 @@ public:
 		vkDeviceWaitIdle(device);
 	}
 
-	void createModelMatsBuffer()
+	// Instance entries, cull infos and coarse cuts of the node blocks, see NaniteScene::instanceEntries
+	void createInstanceCullingBuffers()
 	{
-		vks::Buffer modelMatsStaging;
-		//std::cout << "size of clusterInfo:" << sizeof(ClusterInfo) << std::endl;
+		auto createDeviceBuffer = [&](vks::Buffer& buffer, const void* data, VkDeviceSize size) {
+			vks::Buffer staging;
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				size,
+				&staging.buffer,
+				&staging.memory,
+				const_cast<void*>(data)));
 
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				size,
+				&buffer.buffer,
+				&buffer.memory,
+				nullptr));
+			VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			VkBufferCopy copyRegion = {};
+			copyRegion.size = size;
+			vkCmdCopyBuffer(copyCmd, staging.buffer, buffer.buffer, 1, &copyRegion);
+			vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
+
+			vkDestroyBuffer(vulkanDevice->logicalDevice, staging.buffer, nullptr);
+			vkFreeMemory(vulkanDevice->logicalDevice, staging.memory, nullptr);
+		};
+		createDeviceBuffer(blockCullInfosBuffer, scene.blockCullInfos.data(), scene.blockCullInfos.size() * sizeof(BlockCullInfo));
+		// Not empty, a block without coarse clusters still needs a valid buffer
+		std::vector<glm::uvec2> coarseCutClusters = scene.coarseCutClusters;
+		if (coarseCutClusters.empty()) coarseCutClusters.emplace_back(0);
+		createDeviceBuffer(coarseCutClustersBuffer, coarseCutClusters.data(), coarseCutClusters.size() * sizeof(glm::uvec2));
+	}
+
+	// Buffers sized by sceneCapacity, growSceneBuffers() recreates them larger. The scene arrays among them are filled by
+	// uploadSceneChanges(), the others are written by the passes every frame
+	void createSceneSizedBuffers()
+	{
+		auto createDeviceBuffer = [&](vks::Buffer& buffer, VkBufferUsageFlags usage, VkDeviceSize size) {
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffer, size));
+		};
+		const VkBufferUsageFlags storageDst = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		createDeviceBuffer(modelMatsBuffer, storageDst | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, sceneCapacity.objects * sizeof(glm::mat4));
+		// LOD biases, indexed like the model matrices
+		createDeviceBuffer(lodBiasBuffer, storageDst, sceneCapacity.objects * sizeof(float));
+		createDeviceBuffer(initNodeInfosBuffer, storageDst | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, sceneCapacity.roots * sizeof(glm::uvec2));
+		createDeviceBuffer(instanceEntriesBuffer, storageDst, sceneCapacity.instances * sizeof(glm::uvec2));
+
+		// (node, first object) entries after the size
+		createDeviceBuffer(currNodeInfosBuffer, storageDst, (sceneCapacity.depthNodes * 2 + 1) * sizeof(glm::uvec2));
+		createDeviceBuffer(nextNodeInfosBuffer, storageDst, (sceneCapacity.depthNodes * 2 + 1) * sizeof(glm::uvec2));
+		cullingDispatchInit.assign(sceneCapacity.depths + 2, { 0, 1, 1 });
+		createDeviceBuffer(cullingDispatchIndirectBuffer, storageDst | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			cullingDispatchInit.size() * sizeof(VkDispatchIndirectCommand));
+
+		// reserve 5 for atomic counter
+		createDeviceBuffer(culledClusterIndicesBuffer, storageDst | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, (sceneCapacity.clusters + 5) * sizeof(uint32_t));
+		createDeviceBuffer(culledClusterObjectIndicesBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sceneCapacity.clusters * sizeof(uint32_t));
+		createDeviceBuffer(projectedErrorBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sceneCapacity.clusters * sizeof(glm::vec2));
+
+		// Multi view culling, the masks are indexed like the queue entries and the candidates
+		createDeviceBuffer(currNodeViewMasksBuffer, storageDst, (sceneCapacity.depthNodes * 2 + 1) * sizeof(uint32_t));
+		createDeviceBuffer(nextNodeViewMasksBuffer, storageDst, (sceneCapacity.depthNodes * 2 + 1) * sizeof(uint32_t));
+		createDeviceBuffer(clusterViewMasksBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sceneCapacity.clusters * sizeof(uint32_t));
+		const uint32_t listedViews = std::max(cutViews, 1u) - 1;
+		createDeviceBuffer(viewClustersBuffer, storageDst | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			maxCullViews * sizeof(uint32_t) + std::max<size_t>(listedViews * sceneCapacity.clusters, 1) * sizeof(glm::uvec2));
+
+		createDeviceBuffer(HWRIndicesBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, sceneCapacity.indices / 8 * sizeof(uint32_t));
+		createDeviceBuffer(HWRIDBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sceneCapacity.indices / 8 / 3 * sizeof(glm::uvec3));
+		createDeviceBuffer(SWRIndicesBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, sceneCapacity.indices / 8 * sizeof(uint32_t));
+		createDeviceBuffer(SWRIDBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sceneCapacity.indices / 8 / 3 * sizeof(glm::uvec3));
+	}
+
+	void destroySceneSizedBuffers()
+	{
+		for (vks::Buffer* buffer : { &modelMatsBuffer, &lodBiasBuffer, &initNodeInfosBuffer, &instanceEntriesBuffer, &currNodeInfosBuffer,
+			&nextNodeInfosBuffer, &cullingDispatchIndirectBuffer, &culledClusterIndicesBuffer, &culledClusterObjectIndicesBuffer,
+			&projectedErrorBuffer, &currNodeViewMasksBuffer, &nextNodeViewMasksBuffer, &clusterViewMasksBuffer, &viewClustersBuffer,
+			&HWRIndicesBuffer, &HWRIDBuffer, &SWRIndicesBuffer, &SWRIDBuffer })
+		{
+			buffer->destroy();
+			*buffer = vks::Buffer();
+		}
+	}
+
+	// Marks the scene arrays as changed as a whole, for buffers that were just created
+	void markSceneArraysDirty()
+	{
+		scene.dirty.objects.add(0, static_cast<uint32_t>(scene.modelMats.size()));
+		scene.dirty.roots.add(0, static_cast<uint32_t>(scene.initNodeInfoIndices.size()));
+		scene.dirty.instanceEntries.add(0, static_cast<uint32_t>(scene.instanceEntries.size()));
+	}
+
+	void createAppendBenchBuffers()
+	{
+		appendBenchPushConstants.capacity = appendBenchPushConstants.numInvocations * appendBenchPushConstants.maxAppendCount;
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			modelMats.size() * sizeof(glm::mat4),
-			&modelMatsStaging.buffer,
-			&modelMatsStaging.memory,
-			modelMats.data()));
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			sizeof(uint32_t),
+			&appendBenchCounterBuffer.buffer,
+			&appendBenchCounterBuffer.memory,
+			nullptr));
 
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			modelMats.size() * sizeof(glm::mat4),
-			&modelMatsBuffer.buffer,
-			&modelMatsBuffer.memory,
+			appendBenchPushConstants.capacity * sizeof(uint32_t),
+			&appendBenchOutBuffer.buffer,
+			&appendBenchOutBuffer.memory,
 			nullptr));
-		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	}
 
-		VkBufferCopy copyRegion = {};
+	// Time the same append workload with one atomic per invocation and with subgroup aggregation
+	void runAppendBenchmark()
+	{
+		const uint32_t iterations = 16;
+		auto descManager = VulkanDescriptorSetManager::getManager();
 
-		copyRegion.size = modelMats.size() * sizeof(glm::mat4);
-		vkCmdCopyBuffer(copyCmd, modelMatsStaging.buffer, modelMatsBuffer.buffer, 1, &copyRegion);
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = 4;
+		VkQueryPool queryPool;
+		VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool));
+
+		VkCommandBuffer cmdBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		vkCmdResetQueryPool(cmdBuffer, queryPool, 0, 4);
+		vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, appendBenchPipelineLayout, 0, 1, &descManager->getSet("appendBench", 0), 0, 0);
+		vkCmdPushConstants(cmdBuffer, appendBenchPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(AppendBenchPushConstants), &appendBenchPushConstants);
+
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		for (uint32_t mode = 0; mode < 2; mode++)
+		{
+			vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, appendBenchPipelines[mode]);
+			vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, mode * 2);
+			for (uint32_t i = 0; i < iterations; i++)
+			{
+				vkCmdFillBuffer(cmdBuffer, appendBenchCounterBuffer.buffer, 0, sizeof(uint32_t), 0);
+				vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+				vkCmdDispatch(cmdBuffer, (appendBenchPushConstants.numInvocations + 31) / 32, 1, 1);
+				vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			}
+			vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, mode * 2 + 1);
+		}
+		vulkanDevice->flushCommandBuffer(cmdBuffer, queue, true);
 
-		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);//TODO: get transfer queue here
+		uint64_t timestamps[4];
+		VK_CHECK_RESULT(vkGetQueryPoolResults(device, queryPool, 0, 4, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+		vkDestroyQueryPool(device, queryPool, nullptr);
 
-		vkDestroyBuffer(vulkanDevice->logicalDevice, modelMatsStaging.buffer, nullptr);
-		vkFreeMemory(vulkanDevice->logicalDevice, modelMatsStaging.memory, nullptr);
+		const float timestampPeriod = vulkanDevice->properties.limits.timestampPeriod;
+		for (uint32_t mode = 0; mode < 2; mode++)
+		{
+			appendBenchTimes[mode] = float(timestamps[mode * 2 + 1] - timestamps[mode * 2]) * timestampPeriod / 1e6f / iterations;
+		}
+		std::cout << "Append benchmark (" << appendBenchPushConstants.numInvocations << " invocations, up to " << appendBenchPushConstants.maxAppendCount << " items each):" << std::endl;
+		std::cout << "  atomic per invocation: " << appendBenchTimes[0] << " ms" << std::endl;
+		std::cout << "  subgroup aggregated:   " << appendBenchTimes[1] << " ms" << (useSubgroupAppend ? "" : " (subgroup ops unsupported, same path)") << std::endl;
 	}
 
 	// Prepare and initialize uniform buffer containing shader uniforms
@@ -3625,6 +4429,19 @@ public:
 		memcpy(uniformBuffers.params.mapped, &uboParams, sizeof(uboParams));
 	}
 
+	void createProfiler()
+	{
+		std::vector<std::string> passNames = { "error projection", "culling", "sw raster", "hw raster", "merge", "shading", "depth copy", "hiz build", "instance culling", "cut budget" };
+		for (size_t j = 0; j < scene.depthCounts.size(); j++) {
+			passNames.push_back("bvh level " + std::to_string(j));
+		}
+		std::vector<std::string> counterNames = { "visible clusters", "frustum culled nodes", "occlusion culled nodes", "error culled nodes", "hw indices", "sw indices" };
+		for (uint32_t view = 1; view < cutViews; view++) {
+			counterNames.push_back("view " + std::to_string(view) + " clusters");
+		}
+		profiler.create(vulkanDevice, static_cast<uint32_t>(drawCmdBuffers.size()), passNames, counterNames);
+	}
+
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
@@ -3641,11 +4458,24 @@ public:
 			swrNumVerticesBuffer.flush();
 			vkDeviceWaitIdle(device);
 		}
+		if (scene.streamed)
+		{
+			uint32_t zero = 0;
+			memcpy(streamingRequestsBuffer.mapped, &zero, sizeof(uint32_t));
+		}
 
 		uboCullingMatrices.currView = camera.matrices.view;
 		uboCullingMatrices.currProj = camera.matrices.perspective;
 		memcpy(cullingUniformBuffer.mapped, &uboCullingMatrices, sizeof(uboCullingMatrices));
 		cullingUniformBuffer.flush();
+		writeCutBudgetHeader();
+		updateCullViews();
+
+		// Results of the previous submission of this command buffer, never blocks
+		if (profiler.collect(currentBuffer) && lodController.active()) {
+			lodFeedbackPending = true;
+		}
+		profiler.submitted(currentBuffer, profiledFrames++);
 
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
@@ -3670,8 +4500,8 @@ public:
 		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 		attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		attachments[0].initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-		attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		attachments[0].initialLayout = swapChain.presentLayout();
+		attachments[0].finalLayout = swapChain.presentLayout();
 		// Depth attachment
 		attachments[1].format = depthFormat;
 		attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
@@ -3890,43 +4720,583 @@ public:
 		enabledDeviceExtensions.push_back(VK_EXT_SHADER_IMAGE_ATOMIC_INT64_EXTENSION_NAME);
 		enabledInstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 		VulkanExampleBase::prepare();
+		if (cpuReplay) {
+			// The cut only needs the scene
+			loadAssets();
+			loadNaniteScene();
+			if (streaming) {
+				residency.init(scene, streamingOptions);
+			}
+			naniteReady = true;
+			uboCullingMatrices.lastView = camera.matrices.view;
+			uboCullingMatrices.lastProj = camera.matrices.perspective;
+			prepared = true;
+			return;
+		}
 		createRasterizeBuffer();
 		loadAssets();
 		generateBRDFLUT();
 		generateIrradianceCube();
 		generatePrefilteredCube();
+		if (benchmark.active) {
+			// Benchmarks measure the full renderer from their first frame on
+			prepareNaniteRendering();
+		}
+		else {
+			buildCommandBuffers();
+		}
+		prepared = true;
+	}
+
+	// Everything that depends on the nanite scene, runs once the background loads finished
+	void prepareNaniteRendering()
+	{
+		destroyPlaceholders();
+		loadNaniteScene();
+		if (scene.streamed) {
+			preparePagePool();
+		}
+		sceneCapacity.objects = scene.modelMats.size();
+		sceneCapacity.roots = scene.initNodeInfoIndices.size();
+		sceneCapacity.instances = scene.instanceEntries.size();
+		sceneCapacity.depths = scene.depthCounts.size();
+		sceneCapacity.depthNodes = scene.maxDepthCounts;
+		sceneCapacity.clusters = scene.maxClusterNum;
+		sceneCapacity.indices = scene.sceneIndicesCount;
+		createSceneSizedBuffers();
 		createBVHTraversalBuffers();
+		createInstanceCullingBuffers();
 		createCullingBuffers();
+		createStreamingBuffers();
 		createErrorProjectionBuffer();
+		createCutBudgetBuffer();
+		createCullViewsBuffer();
 		
 		createHiZBuffer();
-		createModelMatsBuffer();
+		createAppendBenchBuffers();
+		createProfiler();
 		createHWRasterizeFramebuffer();
 		prepareUniformBuffers();
 		setupDescriptors();
 		preparePipelines();
+		// The command buffers are recorded below
+		scene.dirty = SceneDirtyRanges();
+		markSceneArraysDirty();
+		uploadSceneChanges();
+		naniteReady = true;
 		buildCommandBuffers();
-		prepared = true;
+	}
+
+	void preparePlaceholderPipeline()
+	{
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
+		VkPipelineRasterizationStateCreateInfo rasterizationState = vks::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+		VkPipelineColorBlendAttachmentState blendAttachmentState = vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE);
+		VkPipelineColorBlendStateCreateInfo colorBlendState = vks::initializers::pipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
+		VkPipelineDepthStencilStateCreateInfo depthStencilState = vks::initializers::pipelineDepthStencilStateCreateInfo(VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS_OR_EQUAL);
+		VkPipelineViewportStateCreateInfo viewportState = vks::initializers::pipelineViewportStateCreateInfo(1, 1);
+		VkPipelineMultisampleStateCreateInfo multisampleState = vks::initializers::pipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT);
+		std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamicState = vks::initializers::pipelineDynamicStateCreateInfo(dynamicStateEnables);
+
+		VkVertexInputBindingDescription vertexBinding = vks::initializers::vertexInputBindingDescription(0, 2 * sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX);
+		std::array<VkVertexInputAttributeDescription, 2> vertexAttributes = {
+			vks::initializers::vertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0),
+			vks::initializers::vertexInputAttributeDescription(0, 1, VK_FORMAT_R32G32B32_SFLOAT, sizeof(glm::vec3))
+		};
+		VkPipelineVertexInputStateCreateInfo vertexInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
+		vertexInputState.vertexBindingDescriptionCount = 1;
+		vertexInputState.pVertexBindingDescriptions = &vertexBinding;
+		vertexInputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexAttributes.size());
+		vertexInputState.pVertexAttributeDescriptions = vertexAttributes.data();
+
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(glm::mat4), 0);
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(nullptr, 0);
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &placeholderPipelineLayout));
+
+		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
+		shaderStages[0] = loadShader(getShadersPath() + "pbrtexture/placeholder.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+		shaderStages[1] = loadShader(getShadersPath() + "pbrtexture/placeholder.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::pipelineCreateInfo(placeholderPipelineLayout, renderPass);
+		pipelineCI.pInputAssemblyState = &inputAssemblyState;
+		pipelineCI.pRasterizationState = &rasterizationState;
+		pipelineCI.pColorBlendState = &colorBlendState;
+		pipelineCI.pMultisampleState = &multisampleState;
+		pipelineCI.pViewportState = &viewportState;
+		pipelineCI.pDepthStencilState = &depthStencilState;
+		pipelineCI.pDynamicState = &dynamicState;
+		pipelineCI.pVertexInputState = &vertexInputState;
+		pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
+		pipelineCI.pStages = shaderStages.data();
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &placeholderPipeline));
+	}
+
+	// Copies the coarsest level of every task that just finished it into host visible buffers, small enough to draw from there
+	void uploadPlaceholderMeshes()
+	{
+		placeholderMeshes.resize(naniteLoadTasks.size());
+		for (size_t i = 0; i < naniteLoadTasks.size(); i++)
+		{
+			const NaniteProgress& progress = naniteLoadTasks[i]->progress;
+			PlaceholderMesh& placeholder = placeholderMeshes[i];
+			if (placeholder.indexCount > 0 || !progress.coarsestLODReady || progress.coarsestIndices.empty()) continue;
+			std::vector<glm::vec3> vertexData;
+			vertexData.reserve(progress.coarsestPositions.size() * 2);
+			for (size_t v = 0; v < progress.coarsestPositions.size(); v++)
+			{
+				vertexData.push_back(progress.coarsestPositions[v]);
+				vertexData.push_back(progress.coarsestNormals[v]);
+			}
+			std::vector<uint32_t> indexData = progress.coarsestIndices;
+			const VkMemoryPropertyFlags memoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, memoryFlags, &placeholder.vertices, vertexData.size() * sizeof(glm::vec3), vertexData.data()));
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, memoryFlags, &placeholder.indices, indexData.size() * sizeof(uint32_t), indexData.data()));
+			placeholder.indexCount = static_cast<uint32_t>(indexData.size());
+		}
+	}
+
+	void destroyPlaceholders()
+	{
+		for (auto& placeholder : placeholderMeshes)
+		{
+			placeholder.vertices.destroy();
+			placeholder.indices.destroy();
+		}
+		placeholderMeshes.clear();
+		if (placeholderPipeline != VK_NULL_HANDLE) {
+			vkDestroyPipeline(device, placeholderPipeline, nullptr);
+			vkDestroyPipelineLayout(device, placeholderPipelineLayout, nullptr);
+			placeholderPipeline = VK_NULL_HANDLE;
+			placeholderPipelineLayout = VK_NULL_HANDLE;
+		}
+	}
+
+	// Shown until prepareNaniteRendering() ran: the coarsest level of every mesh that has one loaded, and the load progress.
+	// Recorded again every frame, as the progress text changes, so the camera is current
+	void buildLoadingCommandBuffers()
+	{
+		if (placeholderPipeline == VK_NULL_HANDLE) {
+			preparePlaceholderPipeline();
+		}
+		uploadPlaceholderMeshes();
+		const glm::mat4 viewProj = camera.matrices.perspective * camera.matrices.view;
+		const VkDeviceSize offsets[1] = { 0 };
+		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+
+		VkClearValue clearValues[2];
+		clearValues[0].color = { { 0.1f, 0.1f, 0.1f, 1.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+		renderPassBeginInfo.renderPass = renderPass;
+		renderPassBeginInfo.renderArea.extent.width = width;
+		renderPassBeginInfo.renderArea.extent.height = height;
+		renderPassBeginInfo.clearValueCount = 2;
+		renderPassBeginInfo.pClearValues = clearValues;
+
+		for (size_t i = 0; i < drawCmdBuffers.size(); ++i)
+		{
+			renderPassBeginInfo.framebuffer = frameBuffers[i];
+			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, placeholderPipeline);
+			vkCmdPushConstants(drawCmdBuffers[i], placeholderPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &viewProj);
+			for (const auto& placeholder : placeholderMeshes)
+			{
+				if (placeholder.indexCount == 0) continue;
+				vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &placeholder.vertices.buffer, offsets);
+				vkCmdBindIndexBuffer(drawCmdBuffers[i], placeholder.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+				vkCmdDrawIndexed(drawCmdBuffers[i], placeholder.indexCount, 1, 0, 0, 0);
+			}
+			drawUI(drawCmdBuffers[i]);
+			vkCmdEndRenderPass(drawCmdBuffers[i]);
+			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+		}
+	}
+
+	// Evaluates the cut of the current camera on the CPU, with the same inputs the culling passes get for this frame
+	void recordCutStatistics(uint64_t frame)
+	{
+		CutView cutView;
+		cutView.view = camera.matrices.view;
+		cutView.proj = camera.matrices.perspective;
+		cutView.lastView = uboCullingMatrices.lastView;
+		cutView.lastProj = uboCullingMatrices.lastProj;
+		cutView.screenSize = glm::vec2(width, height);
+		// A CPU replay creates no HiZ, it would be as large as the window
+		cutView.hzbSize = cpuReplay ? glm::vec2(width, height) : glm::vec2(textures.hizbuffer.width, textures.hizbuffer.height);
+		cutView.threshold = static_cast<float>(thresholdInt / thresholdIntDiv);
+		cutView.useFrustumCulling = cullingPushConstants.useFrustrumOcclusionCulling;
+		cutView.useSoftwareRasterization = cullingPushConstants.useSoftwareRasterization;
+		cutView.instanceCulling = instanceCulling;
+		cutView.clusterBudget = clusterBudget;
+		cutView.triangleBudget = triangleBudget;
+		cutView.temporalCoherence = temporalCut;
+		CutFrameStats stats;
+		if (streaming && cpuReplay) {
+			// Pages of this frame's cut are requested after it, they are used once their reads finished
+			std::vector<uint32_t> desiredClusters;
+			stats = cutStatistics.evaluate(scene, scene.modelMats, cutView, &residency, &desiredClusters);
+			residency.update(desiredClusters, frame);
+			stats.streaming = residency.frameStats;
+		}
+		else if (streaming) {
+			// The renderer requests the pages after drawing the frame, see updateStreaming()
+			stats = cutStatistics.evaluate(scene, scene.modelMats, cutView, &residency);
+			stats.streaming = residency.frameStats;
+		}
+		else {
+			stats = cutStatistics.evaluate(scene, scene.modelMats, cutView);
+		}
+		if (cutViews > 1) {
+			MultiViewCut multiView = cutStatistics.evaluateViews(scene, scene.modelMats, multiViewCutViews(cutView));
+			stats.views = cutViews;
+			stats.multiViewNodes = multiView.sharedNodes;
+			for (const CutFrameStats& viewStats : multiView.views) {
+				stats.multiViewNodeTests += viewStats.visitedNodes;
+				stats.multiViewClusters += viewStats.selectedClusters;
+			}
+		}
+		stats.frame = frame;
+		cutStatistics.history.push_back(stats);
+	}
+
+	// Bobs every fourth instance and respawns one instance every 64 frames in place, so the scene keeps its size
+	void animateInstances()
+	{
+		if (dynamicBaseTransforms.empty()) {
+			for (const auto& naniteObject : scene.naniteObjects)
+			{
+				dynamicBaseTransforms.push_back(naniteObject.rootTransform);
+			}
+		}
+		uint64_t frame = dynamicFrame++;
+		for (uint32_t id = 0; id < dynamicBaseTransforms.size(); id += 4)
+		{
+			if (!scene.instanceAlive(id)) continue;
+			float offset = 0.25f * sinf(frame * 0.05f + id);
+			scene.moveInstance(id, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, offset, 0.0f)) * dynamicBaseTransforms[id]);
+		}
+		if (frame % 64 == 63) {
+			uint32_t id = static_cast<uint32_t>((frame / 64) % dynamicBaseTransforms.size());
+			if (scene.instanceAlive(id)) {
+				uint32_t meshHandle = scene.naniteObjects[id].meshHandle;
+				uint32_t prefabHandle = scene.naniteObjects[id].prefabHandle;
+				scene.removeInstance(id);
+				if (prefabHandle != -1) scene.spawnPrefabInstance(prefabHandle, dynamicBaseTransforms[id]);
+				else scene.spawnInstance(meshHandle, dynamicBaseTransforms[id]);
+			}
+		}
+	}
+
+	// Recreates the scene sized buffers once the scene no longer fits into them. Every size that was outgrown gets half
+	// of it as headroom, so spawning instance after instance reallocates a logarithmic number of times. The host arrays
+	// hold the whole scene, they are uploaded again by uploadSceneChanges()
+	void growSceneBuffers()
+	{
+		bool grown = false;
+		auto grow = [&](size_t& capacity, size_t size) {
+			if (size <= capacity) return;
+			capacity = size + size / 2;
+			grown = true;
+		};
+		grow(sceneCapacity.objects, scene.modelMats.size());
+		grow(sceneCapacity.roots, scene.initNodeInfoIndices.size());
+		grow(sceneCapacity.instances, scene.instanceEntries.size());
+		grow(sceneCapacity.depths, scene.depthCounts.size());
+		grow(sceneCapacity.depthNodes, scene.maxDepthCounts);
+		grow(sceneCapacity.clusters, scene.maxClusterNum);
+		grow(sceneCapacity.indices, scene.sceneIndicesCount);
+		if (!grown) return;
+
+		// Frames in flight still use the old buffers
+		vkDeviceWaitIdle(device);
+		destroySceneSizedBuffers();
+		createSceneSizedBuffers();
+		writeDescriptorSets();
+		markSceneArraysDirty();
+		// The command buffers record the buffers
+		scene.dirty.countsChanged = true;
+	}
+
+	// Copies the changed ranges of the scene arrays into their buffers, in one submission
+	void uploadSceneChanges()
+	{
+		SceneDirtyRanges& dirty = scene.dirty;
+		if (dirty.empty()) return;
+		growSceneBuffers();
+
+		struct Upload {
+			VkBuffer buffer;
+			const char* data;
+			size_t elementSize;
+			std::vector<std::pair<uint32_t, uint32_t>> ranges;
+		};
+		// The node blocks are shared by the instances and never change after the build
+		Upload uploads[4] = {
+			{ modelMatsBuffer.buffer, reinterpret_cast<const char*>(scene.modelMats.data()), sizeof(glm::mat4), dirty.objects.list() },
+			{ lodBiasBuffer.buffer, reinterpret_cast<const char*>(scene.lodBiases.data()), sizeof(float), dirty.objects.list() },
+			{ initNodeInfosBuffer.buffer, reinterpret_cast<const char*>(scene.initNodeInfoIndices.data()), sizeof(glm::uvec2), dirty.roots.list() },
+			{ instanceEntriesBuffer.buffer, reinterpret_cast<const char*>(scene.instanceEntries.data()), sizeof(glm::uvec2), dirty.instanceEntries.list() },
+		};
+		VkDeviceSize stagingSize = 0;
+		for (const auto& upload : uploads)
+		{
+			for (const auto& range : upload.ranges)
+			{
+				stagingSize += (range.second - range.first) * upload.elementSize;
+			}
+		}
+
+		if (stagingSize > 0) {
+			vks::Buffer staging;
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&staging,
+				stagingSize));
+			VK_CHECK_RESULT(staging.map());
+
+			VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			// Frames in flight still read the buffers
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			VkDeviceSize stagingOffset = 0;
+			std::vector<VkBufferCopy> copyRegions;
+			for (const auto& upload : uploads)
+			{
+				copyRegions.clear();
+				for (const auto& range : upload.ranges)
+				{
+					VkBufferCopy copyRegion = {};
+					copyRegion.srcOffset = stagingOffset;
+					copyRegion.dstOffset = range.first * upload.elementSize;
+					copyRegion.size = (range.second - range.first) * upload.elementSize;
+					memcpy(static_cast<char*>(staging.mapped) + stagingOffset, upload.data + copyRegion.dstOffset, copyRegion.size);
+					stagingOffset += copyRegion.size;
+					copyRegions.push_back(copyRegion);
+				}
+				if (!copyRegions.empty()) {
+					vkCmdCopyBuffer(copyCmd, staging.buffer, upload.buffer, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+				}
+			}
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+			vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
+			staging.destroy();
+		}
+
+		if (dirty.countsChanged) {
+			// The root and instance counts are recorded into the command buffers
+			buildCommandBuffers();
+		}
+		dirty = SceneDirtyRanges();
 	}
 
 	virtual void render()
 	{
 		if (!prepared)
 			return;
+		if (!naniteReady)
+		{
+			if (!naniteLoadFinished())
+			{
+				VulkanExampleBase::prepareFrame();
+				submitInfo.commandBufferCount = 1;
+				submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
+				VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+				VulkanExampleBase::submitFrame();
+				return;
+			}
+			vkDeviceWaitIdle(device);
+			prepareNaniteRendering();
+		}
+		if (!cameraPath.empty())
+		{
+			vks::CameraPath::Keyframe keyframe = cameraPath.sampleFrame(cameraPathFrame++);
+			camera.setPosition(keyframe.position);
+			camera.setRotation(keyframe.rotation);
+			if (!cpuReplay) {
+				updateUniformBuffers();
+			}
+		}
+		if (dynamicInstances)
+		{
+			animateInstances();
+			if (!cpuReplay) {
+				uploadSceneChanges();
+			}
+		}
+		if (cpuReplay)
+		{
+			recordCutStatistics(profiledFrames++);
+			if (lodController.active()) {
+				updateLODController(profiledFrames - 1, 0.0, cutStatistics.history.back().triangles);
+			}
+			uboCullingMatrices.lastView = camera.matrices.view;
+			uboCullingMatrices.lastProj = camera.matrices.perspective;
+			return;
+		}
+		if (!cutStatisticsFilename.empty())
+		{
+			// Same frame index as the profiler, so both files can be joined
+			recordCutStatistics(profiledFrames);
+		}
 		draw();
+		if (scene.streamed)
+		{
+			updateStreaming(profiledFrames - 1);
+		}
+		if (lodFeedbackPending)
+		{
+			lodFeedbackPending = false;
+			const vks::GpuProfiler::FrameStats& stats = profiler.latest;
+			updateLODController(stats.frame, profiler.totalTime(stats), (stats.counters[COUNTER_HW_INDICES] + stats.counters[COUNTER_SW_INDICES]) / 3);
+		}
 		if (camera.updated)
 		{
 			updateUniformBuffers();
 		}
 	}
 
+	// Threshold of the next frames, see LODController.h. draw() writes it into the cut budget header, in steps of the
+	// threshold slider
+	void updateLODController(uint64_t frame, double frameMs, uint32_t triangles)
+	{
+		float threshold = lodController.update(frame, frameMs, triangles);
+		thresholdInt = std::max(1, static_cast<int>(std::lround(threshold * thresholdIntDiv)));
+	}
+
 	virtual void viewChanged()
 	{
+		if (cpuReplay || !naniteReady)
+			return;
 		updateUniformBuffers();
 	}
 
+	virtual void benchmarkFinished()
+	{
+		if (!cutStatisticsFilename.empty()) {
+			cutStatistics.saveCSV(cutStatisticsFilename);
+			cutStatistics.saveJSON(cutStatisticsFilename + ".json");
+		}
+		if (lodController.active()) {
+			// The first second of the path is spent approaching the targets
+			LODController::Summary summary = lodController.summary(60);
+			std::cout << "LOD controller: " << summary.frames << " frames, frame time " << summary.meanFrameMs << " ms (stddev " << summary.stddevFrameMs
+				<< ", max " << summary.maxFrameMs << "), triangles " << summary.meanTriangles << " (stddev " << summary.stddevTriangles << "), "
+				<< summary.withinDeadband * 100.0 << "% of frames within the deadband" << std::endl;
+			if (!benchmark.filename.empty()) {
+				lodController.saveCSV(benchmark.filename + ".lod.csv");
+			}
+		}
+		if (cpuReplay) {
+			return;
+		}
+		// The device is idle, every submitted slot completes here
+		for (uint32_t slot = 0; slot < drawCmdBuffers.size(); slot++) {
+			profiler.collect(slot);
+		}
+		if (!benchmark.filename.empty()) {
+			profiler.saveCSV(benchmark.filename + ".passes.csv");
+			profiler.saveJSON(benchmark.filename + ".passes.json");
+		}
+		// A frame the profiler never completes leaves the telemetry and the LOD controller without input
+		if (profiledFrames > 0 && profiler.history.empty()) {
+			std::cerr << "The GPU profiler completed none of the " << profiledFrames << " submitted frames" << std::endl;
+			exit(1);
+		}
+		if (!saveImagesPrefix.empty()) {
+			saveImages(saveImagesPrefix);
+		}
+	}
+
+	// Copies mip 0 of a color image into host memory, the image is returned to `layout` afterwards
+	std::vector<uint8_t> readbackImage(VkImage image, VkImageLayout layout, uint32_t bytesPerPixel)
+	{
+		VkDeviceSize size = (VkDeviceSize)width * height * bytesPerPixel;
+		vks::Buffer readback;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&readback,
+			size));
+
+		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vks::tools::setImageLayout(copyCmd, image, layout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, subresourceRange);
+		VkBufferImageCopy copyRegion = {};
+		copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		copyRegion.imageExtent = { width, height, 1 };
+		vkCmdCopyImageToBuffer(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer, 1, &copyRegion);
+		vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, layout, subresourceRange);
+		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
+
+		VK_CHECK_RESULT(readback.map());
+		std::vector<uint8_t> data((uint8_t*)readback.mapped, (uint8_t*)readback.mapped + size);
+		readback.destroy();
+		return data;
+	}
+
+	// Writes <prefix>_color.ppm, <prefix>_depth.pfm and <prefix>_vis.bin (raw uint32 cluster/triangle ids, row major)
+	// of the last rendered frame
+	void saveImages(const std::string& prefix)
+	{
+		vkDeviceWaitIdle(device);
+
+		// Swapchain images can only be copied from where the surface allows it
+		if (swapChain.transferSource) {
+			std::vector<uint8_t> color = readbackImage(swapChain.images[currentBuffer], swapChain.presentLayout(), 4);
+			const bool colorSwizzle = (swapChain.colorFormat == VK_FORMAT_B8G8R8A8_UNORM) || (swapChain.colorFormat == VK_FORMAT_B8G8R8A8_SRGB);
+			std::ofstream colorFile(prefix + "_color.ppm", std::ios::out | std::ios::binary);
+			colorFile << "P6\n" << width << "\n" << height << "\n" << 255 << "\n";
+			for (size_t i = 0; i < (size_t)width * height; i++) {
+				const uint8_t* pixel = &color[i * 4];
+				char rgb[3] = { (char)pixel[colorSwizzle ? 2 : 0], (char)pixel[1], (char)pixel[colorSwizzle ? 0 : 2] };
+				colorFile.write(rgb, 3);
+			}
+		}
+		else {
+			std::cerr << "The swapchain images can not be copied from, " << prefix << "_color.ppm is skipped (use --offscreen)\n";
+		}
+
+		// PFM stores rows bottom to top
+		std::vector<uint8_t> depth = readbackImage(FinalZBuffer.image, VK_IMAGE_LAYOUT_GENERAL, 4);
+		std::ofstream depthFile(prefix + "_depth.pfm", std::ios::out | std::ios::binary);
+		depthFile << "Pf\n" << width << " " << height << "\n" << -1.0f << "\n";
+		for (int32_t y = (int32_t)height - 1; y >= 0; y--) {
+			depthFile.write((const char*)&depth[(size_t)y * width * 4], (size_t)width * 4);
+		}
+
+		std::vector<uint8_t> vis = readbackImage(FinalVisBuffer.image, VK_IMAGE_LAYOUT_GENERAL, 4);
+		std::ofstream visFile(prefix + "_vis.bin", std::ios::out | std::ios::binary);
+		visFile.write((const char*)vis.data(), vis.size());
+
+		std::cout << "Saved " << (swapChain.transferSource ? prefix + "_color.ppm, " : "") << prefix << "_depth.pfm, " << prefix << "_vis.bin (" << width << "x" << height << ")\n";
+	}
+
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
+		if (!naniteReady) {
+			for (const auto& task : naniteLoadTasks)
+			{
+				const NaniteProgress& progress = task->progress;
+				overlay->text("%s: %.0f%%", progress.stageName(), progress.fraction * 100.0f);
+			}
+			// The text changes every frame, so do the loading command buffers
+			overlay->updated = true;
+			return;
+		}
 		bool rebuildCB = false;
 		std::string s1 = "Num triangles without vulkanite:" + std::to_string(scene.sceneIndicesCount / 3);
 		overlay->text(s1.c_str());
@@ -3959,18 +5329,59 @@ public:
 			if (overlay->checkBox("Frustrum&Occlusion Culling", &cullingPushConstants.useFrustrumOcclusionCulling)) {
 				rebuildCB = true;
 			}
-			if (overlay->sliderInt("Threshold", &thresholdInt, 0, 1000))
-			{
+			if (overlay->checkBox("Instance Culling", &instanceCulling)) {
+				rebuildCB = true;
+			}
+			overlay->sliderInt("Threshold", &thresholdInt, 0, 1000);
+			if (overlay->sliderFloat("Target Frame Time (ms)", &lodController.options.targetFrameMs, 0.0f, 33.0f)) {
+				// Starts from the slider threshold, 0 turns the controller off again
+				lodController.reset(static_cast<float>(thresholdInt / thresholdIntDiv));
+			}
+			int triangleBudgetK = static_cast<int>(triangleBudget / 1000);
+			if (overlay->sliderInt("Triangle Budget (K)", &triangleBudgetK, 0, 10000)) {
+				triangleBudget = static_cast<uint32_t>(triangleBudgetK) * 1000;
 				rebuildCB = true;
 			}
 			if (overlay->sliderInt("Visualize Clusters", &renderingPushConstants.vis_clusters,0,3)) {
 				rebuildCB = true;
 			}
-			if (overlay->sliderInt("LOD level", &vis_clusters_level, 0, naniteMesh.meshes.size() - 1))
+			if (overlay->sliderInt("LOD level", &vis_clusters_level, 0, scene.naniteMeshes.empty() ? 0 : scene.naniteMeshes[0].meshes.size() - 1))
 			{
 				rebuildCB = true;
 			}
 		}
+		if (overlay->header("Append benchmark")) {
+			overlay->text("Subgroup append: %s", useSubgroupAppend ? "on" : "unsupported");
+			if (overlay->button("Run")) {
+				runAppendBenchmark();
+			}
+			overlay->text("Atomic per invocation: %.3f ms", appendBenchTimes[0]);
+			overlay->text("Subgroup aggregated: %.3f ms", appendBenchTimes[1]);
+		}
+		if (overlay->header("Statistics")) {
+			const vks::GpuProfiler::FrameStats& stats = profiler.latest;
+			if (!profiler.timestampsSupported) {
+				overlay->text("Timestamps not supported");
+			}
+			for (size_t j = 0; j < stats.passTimes.size(); j++) {
+				if (stats.passTimes[j] >= 0.0) {
+					overlay->text("%s: %.3f ms", profiler.passNames[j].c_str(), stats.passTimes[j]);
+				}
+			}
+			overlay->text("GPU total: %.3f ms", profiler.totalTime(stats));
+			for (size_t j = 0; j < stats.counters.size(); j++) {
+				overlay->text("%s: %u", profiler.counterNames[j].c_str(), stats.counters[j]);
+			}
+			if (overlay->button("Save CSV")) {
+				profiler.saveCSV("vulkanite_stats.csv");
+			}
+			if (overlay->button("Save JSON")) {
+				profiler.saveJSON("vulkanite_stats.json");
+			}
+			if (overlay->button("Clear history")) {
+				profiler.history.clear();
+			}
+		}
 		if (rebuildCB)
 		{
 			buildCommandBuffers();
@@ -0,0 +1,318 @@
+#include "ChunkJob.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "threadpool.hpp"
+#include "NaniteMesh.h"
+
+namespace {
+    const uint32_t jobMagic = 0x424f4a43; // "CJOB"
+    const uint32_t topMagic = 0x504f5443; // "CTOP"
+    const uint32_t chunkFileVersion = 2;
+
+    template <typename T>
+    void writeArray(std::ofstream& file, const std::vector<T>& data)
+    {
+        uint64_t count = data.size();
+        file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        file.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(T));
+    }
+
+    template <typename T>
+    bool readArray(std::ifstream& file, std::vector<T>& data)
+    {
+        uint64_t count = 0;
+        file.read(reinterpret_cast<char*>(&count), sizeof(count));
+        if (!file) return false;
+        data.resize(count);
+        file.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(T));
+        return bool(file);
+    }
+
+    std::string chunkPrefix(const std::string& directory, uint32_t chunkIndex)
+    {
+        return directory + "chunk_" + std::to_string(chunkIndex);
+    }
+
+    // Results of a job are published by renaming, a reader never sees a partially written file
+    bool writeJsonAtomically(const std::string& filename, const json& j)
+    {
+        std::string tmpFilename = filename + ".tmp";
+        {
+            std::ofstream file(tmpFilename);
+            if (!file.is_open()) return false;
+            file << j.dump();
+            if (!file.good()) return false;
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmpFilename, filename, ec);
+        return !ec;
+    }
+
+    std::string defaultWorkerCommand()
+    {
+#ifdef NANITE_BUILD_WORKER_PATH
+        return std::string("\"") + NANITE_BUILD_WORKER_PATH + "\" {job}";
+#else
+        return "";
+#endif
+    }
+
+    std::string workerCommand(const std::string& command, const std::string& jobFilename)
+    {
+        std::string result = command;
+        std::string quotedJob = "\"" + jobFilename + "\"";
+        for (size_t pos = result.find("{job}"); pos != std::string::npos; pos = result.find("{job}", pos + quotedJob.size()))
+        {
+            result.replace(pos, 5, quotedJob);
+        }
+#if defined(_WIN32)
+        // cmd /c strips the outer quotes of a command that starts with one
+        result = "\"" + result + "\"";
+#endif
+        return result;
+    }
+}
+
+std::string ChunkJob::jobFilename() const
+{
+    return chunkPrefix(directory, chunkIndex) + ".job";
+}
+
+std::string ChunkJob::levelFilename(uint32_t lodLevel, const char* ext) const
+{
+    return chunkPrefix(directory, chunkIndex) + "_LOD_" + std::to_string(lodLevel) + ext;
+}
+
+std::string ChunkJob::topFilename() const
+{
+    return chunkPrefix(directory, chunkIndex) + "_top.bin";
+}
+
+std::string ChunkJob::doneFilename() const
+{
+    return chunkPrefix(directory, chunkIndex) + ".done";
+}
+
+uint64_t ChunkJob::computeCacheKey(uint64_t meshKey) const
+{
+    const uint32_t header[2] = { chunkIndex, chunkLevels };
+    uint64_t hash = hashBytes(header, sizeof(header), meshKey);
+    hash = hashBytes(positions.data(), positions.size() * sizeof(glm::vec3), hash);
+    hash = hashBytes(normals.data(), normals.size() * sizeof(glm::vec3), hash);
+    hash = hashBytes(uvs.data(), uvs.size() * sizeof(glm::vec2), hash);
+    return hashBytes(indices.data(), indices.size() * sizeof(uint32_t), hash);
+}
+
+bool ChunkJob::isDone() const
+{
+    std::ifstream file(doneFilename());
+    if (!file.is_open()) return false;
+    json j = json::parse(file, nullptr, false);
+    return !j.is_discarded() && j.contains("cacheKey") && j["cacheKey"].get<uint64_t>() == cacheKey;
+}
+
+bool ChunkJob::write() const
+{
+    std::ofstream file(jobFilename(), std::ios::binary);
+    if (!file.is_open()) return false;
+    uint32_t header[4] = { jobMagic, chunkFileVersion, chunkIndex, chunkLevels };
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(&cacheKey), sizeof(cacheKey));
+    writeArray(file, positions);
+    writeArray(file, normals);
+    writeArray(file, uvs);
+    writeArray(file, indices);
+    return file.good();
+}
+
+bool ChunkJob::read(const std::string& filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) return false;
+    uint32_t header[4] = {};
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!file || header[0] != jobMagic || header[1] != chunkFileVersion) return false;
+    chunkIndex = header[2];
+    chunkLevels = header[3];
+    file.read(reinterpret_cast<char*>(&cacheKey), sizeof(cacheKey));
+    auto parent = std::filesystem::path(filename).parent_path();
+    directory = parent.empty() ? std::string() : (parent / "").string();
+    return readArray(file, positions) && readArray(file, normals) && readArray(file, uvs) && readArray(file, indices);
+}
+
+void ChunkJob::removeFiles() const
+{
+    std::error_code ec;
+    std::filesystem::remove(jobFilename(), ec);
+    std::filesystem::remove(topFilename(), ec);
+    std::filesystem::remove(doneFilename(), ec);
+    for (uint32_t level = 0; level < chunkLevels; level++)
+    {
+        std::filesystem::remove(levelFilename(level, ".bin"), ec);
+        std::filesystem::remove(levelFilename(level, ".json"), ec);
+    }
+}
+
+bool ChunkTop::write(const std::string& filename) const
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) return false;
+    uint32_t header[2] = { topMagic, chunkFileVersion };
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    writeArray(file, positions);
+    writeArray(file, normals);
+    writeArray(file, uvs);
+    writeArray(file, isBorder);
+    writeArray(file, indices);
+    writeArray(file, clusterGroups);
+    return file.good();
+}
+
+bool ChunkTop::read(const std::string& filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) return false;
+    uint32_t header[2] = {};
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!file || header[0] != topMagic || header[1] != chunkFileVersion) return false;
+    return readArray(file, positions) && readArray(file, normals) && readArray(file, uvs) && readArray(file, isBorder)
+        && readArray(file, indices) && readArray(file, clusterGroups);
+}
+
+bool runChunkJob(const ChunkJob& job)
+{
+    MyMesh chunkMesh;
+    std::vector<MyMesh::VertexHandle> vhandles(job.positions.size());
+    for (size_t i = 0; i < job.positions.size(); i++)
+    {
+        const auto& p = job.positions[i];
+        const auto& n = job.normals[i];
+        const auto& uv = job.uvs[i];
+        vhandles[i] = chunkMesh.add_vertex(MyMesh::Point(p.x, p.y, p.z));
+        chunkMesh.set_normal(vhandles[i], MyMesh::Normal(n.x, n.y, n.z));
+        chunkMesh.set_texcoord2D(vhandles[i], MyMesh::TexCoord2D(uv.x, uv.y));
+    }
+    for (size_t i = 0; i + 3 <= job.indices.size(); i += 3)
+    {
+        chunkMesh.add_face(vhandles[job.indices[i]], vhandles[job.indices[i + 1]], vhandles[job.indices[i + 2]]);
+    }
+    chunkMesh.request_face_status();
+    chunkMesh.request_edge_status();
+    chunkMesh.request_vertex_status();
+    OpenMesh::HPropHandleT<int32_t> propHandle;
+    chunkMesh.add_property(propHandle);
+
+    // Chunks are simplified even when they form a single group, the top of the DAG is built after merging
+    QEMSimplifier simplifier;
+    std::vector<Mesh> levels;
+    levels.reserve(job.chunkLevels);
+    for (uint32_t level = 0; level < job.chunkLevels; level++)
+    {
+        NaniteMesh::buildLevel(levels, chunkMesh, propHandle, simplifier, job.levelFilename(level, ".bin"), true);
+    }
+
+    // Parents of the last level are assigned by the coordinator, every other level is final
+    ChunkJobResult result;
+    for (const auto& meshLOD : levels)
+    {
+        std::ofstream file(job.levelFilename(meshLOD.lodLevel, ".json"));
+        if (!file.is_open()) return false;
+        file << meshLOD.buildStateToJson().dump();
+        result.clusterNums.push_back(meshLOD.clusterNum);
+        result.clusterGroupNums.push_back(meshLOD.clusterGroupNum);
+    }
+
+    ChunkTop top;
+    top.positions.reserve(chunkMesh.n_vertices());
+    for (const auto& vh : chunkMesh.vertices())
+    {
+        const auto& p = chunkMesh.point(vh);
+        const auto& n = chunkMesh.normal(vh);
+        const auto& uv = chunkMesh.texcoord2D(vh);
+        top.positions.emplace_back(p[0], p[1], p[2]);
+        top.normals.emplace_back(n[0], n[1], n[2]);
+        top.uvs.emplace_back(uv[0], uv[1]);
+        top.isBorder.push_back(chunkMesh.is_boundary(vh) ? 1 : 0);
+    }
+    for (const auto& fh : chunkMesh.faces())
+    {
+        for (auto fv_it = chunkMesh.cfv_iter(fh); fv_it.is_valid(); ++fv_it)
+        {
+            top.indices.push_back(fv_it->idx());
+        }
+        top.clusterGroups.push_back(chunkMesh.property(propHandle, chunkMesh.halfedge_handle(fh)) - 1);
+    }
+    if (!top.write(job.topFilename())) return false;
+
+    return writeJsonAtomically(job.doneFilename(), {
+        {"cacheKey", job.cacheKey},
+        {"clusterNums", result.clusterNums},
+        {"clusterGroupNums", result.clusterGroupNums}
+    });
+}
+
+bool readChunkJobResult(const ChunkJob& job, ChunkJobResult& result)
+{
+    std::ifstream file(job.doneFilename());
+    if (!file.is_open()) return false;
+    json j = json::parse(file, nullptr, false);
+    if (j.is_discarded() || !j.contains("cacheKey") || j["cacheKey"].get<uint64_t>() != job.cacheKey) return false;
+    result.clusterNums = j["clusterNums"].get<std::vector<uint32_t>>();
+    result.clusterGroupNums = j["clusterGroupNums"].get<std::vector<uint32_t>>();
+    return result.clusterNums.size() == job.chunkLevels;
+}
+
+void runChunkJobs(const std::vector<ChunkJob>& jobs, const BuildWorkerOptions& options)
+{
+    std::string command = options.command.empty() ? defaultWorkerCommand() : options.command;
+    if (options.maxWorkers > 0 && !command.empty()) {
+        // Every pool thread runs worker processes one after another until no job is left
+        std::atomic<size_t> nextJob = 0;
+        vks::ThreadPool threadPool;
+        threadPool.setThreadCount(std::min<uint32_t>(options.maxWorkers, static_cast<uint32_t>(jobs.size())));
+        for (auto& thread : threadPool.threads)
+        {
+            thread->addJob([&]() {
+                for (size_t i = nextJob++; i < jobs.size(); i = nextJob++)
+                {
+                    int exitCode = std::system(workerCommand(command, jobs[i].jobFilename()).c_str());
+                    if (exitCode != 0) {
+                        LOG("Worker for " << jobs[i].jobFilename() << " exited with " << exitCode);
+                    }
+                }
+            });
+        }
+        threadPool.wait();
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(options.resultTimeoutSeconds);
+        auto allDone = [&]() {
+            for (const auto& job : jobs)
+            {
+                if (!job.isDone()) return false;
+            }
+            return true;
+        };
+        while (!allDone() && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        }
+    }
+
+    for (const auto& job : jobs)
+    {
+        if (job.isDone()) continue;
+        if (options.maxWorkers > 0) {
+            LOG("No result for " << job.jobFilename() << ", building it in this process");
+        }
+        ChunkJob localJob;
+        ASSERT(localJob.read(job.jobFilename()), "Failed to read chunk job");
+        ASSERT(runChunkJob(localJob), "Failed to build chunk job");
+    }
+}
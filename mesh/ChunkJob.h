@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/*
+	One chunk of the out-of-core build (see NaniteMesh::buildChunkLevels), self contained so it can be built by another process.
+	The coordinator writes <directory>chunk_<i>.job with the chunk geometry, runChunkJob() builds chunkLevels levels of it
+	and writes next to the job:
+		chunk_<i>_LOD_<l>.bin   geometry and triangle streams of every level (ClusteredLOD::writeGeometry)
+		chunk_<i>_LOD_<l>.json  build state of every level (Mesh::buildStateToJson)
+		chunk_<i>_top.bin       the chunk simplified into level chunkLevels, welded into the working mesh by the coordinator
+		chunk_<i>.done          cluster counts of every level and the cache key of the job, written last so the coordinator
+		                        only reads finished jobs. Markers with another key are left over from another build and ignored
+	Jobs only communicate through files, so they run in this process, in local worker processes (naniteBuildWorker)
+	or on any machine that shares the cache directory.
+*/
+struct ChunkJob {
+	std::string directory; // Cache directory, with trailing separator
+	uint32_t chunkIndex = 0;
+	uint32_t chunkLevels = 0;
+	uint64_t cacheKey = 0; // Set by computeCacheKey(), carried by the job file into its done marker
+
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> uvs;
+	std::vector<uint32_t> indices;
+
+	std::string jobFilename() const;
+	std::string levelFilename(uint32_t lodLevel, const char* ext) const;
+	std::string topFilename() const;
+	std::string doneFilename() const;
+
+	// Key of the mesh build (NaniteMesh::computeCacheKey()) combined with the chunk geometry and level count
+	uint64_t computeCacheKey(uint64_t meshKey) const;
+	// The done marker exists and was written for this job
+	bool isDone() const;
+
+	bool write() const;
+	// Results are written next to the job file, wherever it was read from
+	bool read(const std::string& filename);
+	void removeFiles() const;
+};
+
+// A chunk after its last level, border vertices are the ones welded with neighbouring chunks
+struct ChunkTop {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> uvs;
+	std::vector<uint8_t> isBorder;
+	std::vector<uint32_t> indices;
+	std::vector<int32_t> clusterGroups; // Cluster group of every triangle in the last chunk level
+
+	bool write(const std::string& filename) const;
+	bool read(const std::string& filename);
+};
+
+// Cluster counts of every level of a finished job, enough to compute the index offsets of the merged levels
+struct ChunkJobResult {
+	std::vector<uint32_t> clusterNums;
+	std::vector<uint32_t> clusterGroupNums;
+};
+
+bool runChunkJob(const ChunkJob& job);
+bool readChunkJobResult(const ChunkJob& job, ChunkJobResult& result);
+
+struct BuildWorkerOptions {
+	uint32_t maxWorkers = 0; // Worker processes running at the same time, 0 builds every job in this process
+	// Command per job, "{job}" is replaced by the quoted job file. Empty runs the naniteBuildWorker built next to this library
+	std::string command;
+	// How long to wait for results after a command returned, for commands that only submit the job to a farm
+	uint32_t resultTimeoutSeconds = 0;
+};
+
+// Jobs without results after the workers are done (or with maxWorkers == 0) are built in this process
+void runChunkJobs(const std::vector<ChunkJob>& jobs, const BuildWorkerOptions& options);
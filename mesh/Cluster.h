@@ -39,6 +39,49 @@ struct Cluster{
         };
     }
 
+    // Everything the builder needs to continue from a level, used by chunk jobs (ChunkJob.h)
+    json toBuildJson() const {
+        return {
+            {"clusterGroupIndex", clusterGroupIndex},
+            {"triangleIndices", triangleIndices},
+            {"parentClusterIndices", parentClusterIndices},
+            {"childClusterIndices", childClusterIndices},
+            {"qemError", qemError},
+            {"lodError", lodError},
+            {"normalizedlodError", normalizedlodError},
+            {"childLODErrorMax", childLODErrorMax},
+            {"parentNormalizedError", parentNormalizedError},
+            {"isLeaf", isLeaf},
+            {"lodLevel", lodLevel},
+            {"surfaceArea", surfaceArea},
+            {"parentSurfaceArea", parentSurfaceArea},
+            {"boundingSphere", {boundingSphereCenter.x, boundingSphereCenter.y, boundingSphereCenter.z, boundingSphereRadius}},
+            {"parentBoundingSphere", {parentBoundingSphereCenter.x, parentBoundingSphereCenter.y, parentBoundingSphereCenter.z, parentBoundingSphereRadius}}
+        };
+    }
+
+    void fromBuildJson(const json& j) {
+        clusterGroupIndex = j["clusterGroupIndex"].get<uint32_t>();
+        triangleIndices = j["triangleIndices"].get<std::vector<uint32_t>>();
+        parentClusterIndices = j["parentClusterIndices"].get<std::vector<uint32_t>>();
+        childClusterIndices = j["childClusterIndices"].get<std::vector<uint32_t>>();
+        qemError = j["qemError"].get<double>();
+        lodError = j["lodError"].get<double>();
+        normalizedlodError = j["normalizedlodError"].get<double>();
+        childLODErrorMax = j["childLODErrorMax"].get<double>();
+        parentNormalizedError = j["parentNormalizedError"].get<double>();
+        isLeaf = j["isLeaf"].get<bool>();
+        lodLevel = j["lodLevel"].get<uint32_t>();
+        surfaceArea = j["surfaceArea"].get<float>();
+        parentSurfaceArea = j["parentSurfaceArea"].get<float>();
+        const auto& sphere = j["boundingSphere"];
+        boundingSphereCenter = glm::vec3(sphere[0].get<float>(), sphere[1].get<float>(), sphere[2].get<float>());
+        boundingSphereRadius = sphere[3].get<float>();
+        const auto& parentSphere = j["parentBoundingSphere"];
+        parentBoundingSphereCenter = glm::vec3(parentSphere[0].get<float>(), parentSphere[1].get<float>(), parentSphere[2].get<float>());
+        parentBoundingSphereRadius = parentSphere[3].get<float>();
+    }
+
     void fromJson(const json& j) {
         ASSERT(j.find("normalizedlodError") != j.end(), "normalizedlodError not found");
         normalizedlodError = j["normalizedlodError"].get<double>();
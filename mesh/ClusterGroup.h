@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
 #include <unordered_set>
+#include <json/json.hpp>
 #include "Common.h"
 #include "Graph.h"
 #include "utils.h"
@@ -56,4 +57,23 @@ struct ClusterGroup {
 		pMin = glm::min(pMin, pMinOther);
 		pMax = glm::max(pMax, pMaxOther);
 	};
+
+	// Summary kept after Mesh::releaseGeometry(), used by chunk jobs (ChunkJob.h)
+	nlohmann::json toBuildJson() const {
+		return {
+			{"clusterIndices", clusterIndices},
+			{"localFaceNum", localFaceNum},
+			{"qemError", qemError},
+			{"pMin", {pMin.x, pMin.y, pMin.z}},
+			{"pMax", {pMax.x, pMax.y, pMax.z}}
+		};
+	}
+
+	void fromBuildJson(const nlohmann::json& j) {
+		clusterIndices = j["clusterIndices"].get<std::vector<uint32_t>>();
+		localFaceNum = j["localFaceNum"].get<uint32_t>();
+		qemError = j["qemError"].get<float>();
+		pMin = glm::vec3(j["pMin"][0].get<float>(), j["pMin"][1].get<float>(), j["pMin"][2].get<float>());
+		pMax = glm::vec3(j["pMax"][0].get<float>(), j["pMax"][1].get<float>(), j["pMax"][2].get<float>());
+	}
 };
\ No newline at end of file
@@ -0,0 +1,334 @@
+#include "ClusteredLOD.h"
+
+#include <array>
+#include <fstream>
+
+const std::vector<glm::vec3> ClusteredLOD::nodeColors =
+{
+    glm::vec3(1.0f, 0.0f, 0.0f), // red
+    glm::vec3(0.0f, 1.0f, 0.0f), // green
+    glm::vec3(0.0f, 0.0f, 1.0f), // blue
+    glm::vec3(1.0f, 1.0f, 0.0f), // yellow
+    glm::vec3(1.0f, 0.0f, 1.0f), // purple
+    glm::vec3(0.0f, 1.0f, 1.0f), // cyan
+    glm::vec3(1.0f, 0.5f, 0.0f), // orange
+    glm::vec3(0.5f, 1.0f, 0.0f), // lime
+};
+
+json ClusteredLOD::toJson() const
+{
+    json result = {
+        {"clusterNum", clusterNum},
+        {"clusterColorAssignment", clusterColorAssignment},
+        {"clusterGroupIndex", clusterGroupIndex}
+    };
+
+    for (size_t i = 0; i < clusters.size(); i++)
+    {
+        result["clusters"].push_back(clusters[i].toJson());
+    }
+    return result;
+}
+
+void ClusteredLOD::fromJson(const json& j)
+{
+    clusterNum = j["clusterNum"].get<int>();
+    clusterColorAssignment = j["clusterColorAssignment"].get<std::unordered_map<int, int>>();
+    clusterGroupIndex = j["clusterGroupIndex"].get<std::vector<int>>();
+    
+    clusters.resize(clusterNum);
+    for (size_t i = 0; i < clusters.size(); i++)
+    {
+        clusters[i].fromJson(j["clusters"][i]);
+    }
+}
+
+namespace {
+    const uint32_t geometryMagic = 0x444f4c56; // "VLOD"
+    const uint32_t geometryVersion = 2;
+
+    template <typename T>
+    void writeArray(std::ofstream& file, const std::vector<T>& data)
+    {
+        file.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(T));
+    }
+
+    template <typename T>
+    void readArray(std::ifstream& file, std::vector<T>& data, size_t count)
+    {
+        data.resize(count);
+        file.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(T));
+    }
+}
+
+bool ClusteredLOD::writeGeometry(const std::string& filename) const
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error exporting mesh to " << filename << std::endl;
+        return false;
+    }
+    ASSERT(triangleClusterIndex.size() == triangleCount() && triangleVertexIndicesSortedByClusterIdx.size() == triangleCount() * 3,
+        "triangle streams do not match");
+    uint32_t header[4] = { geometryMagic, geometryVersion, static_cast<uint32_t>(vertexCount()), static_cast<uint32_t>(triangleCount()) };
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    writeArray(file, positions);
+    writeArray(file, normals);
+    writeArray(file, uvs);
+    writeArray(file, triangleClusterIndex);
+    writeArray(file, triangleIndicesSortedByClusterIdx);
+    writeArray(file, triangleVertexIndicesSortedByClusterIdx);
+    return file.good();
+}
+
+bool ClusteredLOD::readGeometry(const std::string& filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) return false;
+    uint32_t header[4] = {};
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!file || header[0] != geometryMagic || header[1] != geometryVersion) return false;
+    readArray(file, positions, header[2]);
+    readArray(file, normals, header[2]);
+    readArray(file, uvs, header[2]);
+    readArray(file, triangleClusterIndex, header[3]);
+    readArray(file, triangleIndicesSortedByClusterIdx, header[3]);
+    readArray(file, triangleVertexIndicesSortedByClusterIdx, header[3] * 3);
+    return bool(file);
+}
+
+bool ClusteredLOD::mergeGeometry(const std::vector<GeometryPart>& parts, const std::string& filename)
+{
+    std::vector<std::ifstream> files;
+    std::vector<std::array<uint32_t, 4>> headers(parts.size());
+    uint32_t vertexCount = 0, triangleCount = 0;
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+        files.emplace_back(parts[i].filename, std::ios::binary);
+        files[i].read(reinterpret_cast<char*>(headers[i].data()), sizeof(headers[i]));
+        if (!files[i] || headers[i][0] != geometryMagic || headers[i][1] != geometryVersion) {
+            std::cerr << "Invalid geometry part " << parts[i].filename << std::endl;
+            return false;
+        }
+        vertexCount += headers[i][2];
+        triangleCount += headers[i][3];
+    }
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error exporting mesh to " << filename << std::endl;
+        return false;
+    }
+    uint32_t header[4] = { geometryMagic, geometryVersion, vertexCount, triangleCount };
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    // Arrays are stored one after another, so every part is read section by section
+    // shift(part index) is added to index arrays, attributes are copied as they are
+    auto copySection = [&](auto element, auto count, auto shift) {
+        std::vector<decltype(element)> data;
+        for (size_t i = 0; i < parts.size(); i++)
+        {
+            readArray(files[i], data, count(headers[i]));
+            shift(i, data);
+            writeArray(file, data);
+        }
+    };
+    std::vector<uint32_t> vertexOffsets(parts.size(), 0), triangleOffsets(parts.size(), 0);
+    for (size_t i = 1; i < parts.size(); i++)
+    {
+        vertexOffsets[i] = vertexOffsets[i - 1] + headers[i - 1][2];
+        triangleOffsets[i] = triangleOffsets[i - 1] + headers[i - 1][3];
+    }
+    auto vertices = [](const std::array<uint32_t, 4>& h) { return size_t(h[2]); };
+    auto triangles = [](const std::array<uint32_t, 4>& h) { return size_t(h[3]); };
+    auto corners = [](const std::array<uint32_t, 4>& h) { return size_t(h[3]) * 3; };
+    auto keep = [](size_t, auto&) {};
+    auto add = [](uint32_t offset, auto& data) { for (auto& value : data) value += offset; };
+    copySection(glm::vec3(), vertices, keep); // positions
+    copySection(glm::vec3(), vertices, keep); // normals
+    copySection(glm::vec2(), vertices, keep); // uvs
+    copySection(idx_t(), triangles, [&](size_t i, auto& data) { add(parts[i].clusterOffset, data); });
+    copySection(uint32_t(), triangles, [&](size_t i, auto& data) { add(triangleOffsets[i], data); });
+    copySection(uint32_t(), corners, [&](size_t i, auto& data) { add(vertexOffsets[i], data); });
+
+    for (auto& part : files)
+    {
+        if (!part) return false;
+    }
+    return file.good();
+}
+
+void ClusteredLOD::initVertexBuffer(){
+    // One vertex per triangle corner, walked in cluster order
+    for (size_t i = 0; i < triangleIndicesSortedByClusterIdx.size(); ++i) {
+        int clusterId = triangleClusterIndex[triangleIndicesSortedByClusterIdx[i]];
+        for (size_t k = 0; k < 3; ++k) {
+            uint32_t vertex = triangleVertexIndicesSortedByClusterIdx[i * 3 + k];
+            vkglTF::Vertex v;
+            v.pos = positions[vertex];
+            v.normal = normals[vertex];
+            v.uv = uvs[vertex];
+            // TODO: v.tangent not assigned. How to assign?
+            // Assign clusterId and clusterGroupId
+            v.joint0 = glm::vec4(nodeColors[clusterColorAssignment[clusterId]], clusterId);
+            vertexBuffer.push_back(v);
+        }
+    }
+}
+
+
+void ClusteredLOD::initUniqueVertexBuffer() {
+    uniqueVertexBuffer.reserve(positions.size());
+    for (size_t vertex = 0; vertex < positions.size(); ++vertex)
+    {
+        vkglTF::Vertex v;
+        v.pos = positions[vertex];
+        v.normal = normals[vertex];
+        v.uv = uvs[vertex];
+        v.joint0 = glm::vec4(lodLevel);
+        v.weight0 = glm::vec4(0.0f);
+        uniqueVertexBuffer.emplace_back(v);
+    }
+}
+
+
+void ClusteredLOD::createVertexBuffer(vks::VulkanDevice* device, VkQueue transferQueue) {
+    size_t vertexBufferSize = vertexBuffer.size() * sizeof(vkglTF::Vertex);
+    vertices.count = static_cast<uint32_t>(vertexBuffer.size());
+
+    assert(vertexBufferSize > 0);
+
+    struct StagingBuffer {
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+    } vertexStaging;
+
+    // Create staging buffers
+    // Vertex data
+    VK_CHECK_RESULT(device->createBuffer(
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        vertexBufferSize,
+        &vertexStaging.buffer,
+        &vertexStaging.memory,
+        vertexBuffer.data()));
+
+    // Create device local buffers
+    // Vertex buffer
+    VK_CHECK_RESULT(device->createBuffer(
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        vertexBufferSize,
+        &vertices.buffer,
+        &vertices.memory));
+
+    // Copy from staging buffers
+    VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
+    VkBufferCopy copyRegion = {};
+
+    copyRegion.size = vertexBufferSize;
+    vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1, &copyRegion);
+
+    device->flushCommandBuffer(copyCmd, transferQueue, true);
+
+    vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
+    vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
+}
+
+
+void ClusteredLOD::createUniqueVertexBuffer(vks::VulkanDevice* device, VkQueue transferQueue) {
+    size_t vertexBufferSize = uniqueVertexBuffer.size() * sizeof(vkglTF::Vertex);
+    uniqueVertices.count = static_cast<uint32_t>(uniqueVertexBuffer.size());
+
+    assert(vertexBufferSize > 0);
+
+    struct StagingBuffer {
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+    } vertexStaging;
+
+    // Create staging buffers
+    // Vertex data
+    VK_CHECK_RESULT(device->createBuffer(
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        vertexBufferSize,
+        &vertexStaging.buffer,
+        &vertexStaging.memory,
+        uniqueVertexBuffer.data()));
+
+    // Create device local buffers
+    // Vertex buffer
+    VK_CHECK_RESULT(device->createBuffer(
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        vertexBufferSize,
+        &uniqueVertices.buffer,
+        &uniqueVertices.memory));
+
+    // Copy from staging buffers
+    VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
+    VkBufferCopy copyRegion = {};
+
+    copyRegion.size = vertexBufferSize;
+    vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, uniqueVertices.buffer, 1, &copyRegion);
+
+    device->flushCommandBuffer(copyCmd, transferQueue, true);
+
+    vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
+    vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
+}
+
+void ClusteredLOD::createSortedIndexBuffer(vks::VulkanDevice* device, VkQueue transferQueue)
+{
+    size_t indexBufferSize = triangleVertexIndicesSortedByClusterIdx.size() * sizeof(uint32_t);
+    sortedIndices.count = static_cast<uint32_t>(triangleVertexIndicesSortedByClusterIdx.size());
+
+    assert(indexBufferSize > 0);
+
+    struct StagingBuffer {
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+    } indexStaging;
+
+    // Create staging buffers
+    // Vertex data
+    VK_CHECK_RESULT(device->createBuffer(
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        indexBufferSize,
+        &indexStaging.buffer,
+        &indexStaging.memory,
+        triangleVertexIndicesSortedByClusterIdx.data()));
+
+    // Create device local buffers
+    // Vertex buffer
+    VK_CHECK_RESULT(device->createBuffer(
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        indexBufferSize,
+        &sortedIndices.buffer,
+        &sortedIndices.memory));
+
+    // Copy from staging buffers
+    VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
+    VkBufferCopy copyRegion = {};
+
+    copyRegion.size = indexBufferSize;
+    vkCmdCopyBuffer(copyCmd, indexStaging.buffer, sortedIndices.buffer, 1, &copyRegion);
+
+    device->flushCommandBuffer(copyCmd, transferQueue, true);
+
+    vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
+    vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
+}
+
+void ClusteredLOD::draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet) 
+{
+    const VkDeviceSize offsets[1] = { 0 };
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
+    vkCmdDraw(commandBuffer, vertices.count, 1, 0, 0);
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include <string>
+
+#include <metis.h>
+#include <vulkan/vulkan.h>
+#include <json/json.hpp>
+#include <glm/glm.hpp>
+
+#include "VulkanDevice.h"
+#include "VulkanglTFModel.h"
+
+#include "Cluster.h"
+#include "utils.h"
+
+/*
+	Everything a LOD level needs at runtime, without any OpenMesh connectivity.
+	`Mesh` builds a level on top of an OpenMesh working copy, then hands its flattened geometry and
+	cluster table over to a `ClusteredLOD` (see Mesh::flattenGeometry and Mesh::flattenClusterTable).
+	The cache stores exactly this structure, so loading never touches OpenMesh.
+	Per vertex and per triangle data go to LOD_i.bin, the cluster table to LOD_i.json. The builder writes
+	them at different times, the geometry is final long before the parents of the clusters are.
+*/
+struct ClusteredLOD {
+	uint32_t lodLevel = -1;
+
+	// Vertex attributes, in the vertex order of the mesh the level was built from
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> uvs;
+
+	// Cluster table, triangle indices refer to the face order of the level
+	int clusterNum = 0;
+	std::vector<Cluster> clusters;
+	std::vector<idx_t> triangleClusterIndex;
+	std::unordered_map<int, int> clusterColorAssignment;
+	std::vector<idx_t> clusterGroupIndex;
+	std::vector<uint32_t> triangleIndicesSortedByClusterIdx; // face_idx sort by cluster
+	std::vector<uint32_t> triangleVertexIndicesSortedByClusterIdx; // (vert1, vert2, vert3) sort by cluster
+
+	size_t vertexCount() const { return positions.size(); }
+	size_t triangleCount() const { return triangleIndicesSortedByClusterIdx.size(); }
+
+	// Cluster table
+	json toJson() const;
+	void fromJson(const json& j);
+
+	// Vertex attributes and triangle streams as raw arrays
+	bool writeGeometry(const std::string& filename) const;
+	bool readGeometry(const std::string& filename);
+	// Concatenates the geometry files of the chunks of one level (out-of-core build), one array of one chunk in memory at a time
+	// Cluster, triangle and vertex indices of every part are shifted by the sizes of the parts before it
+	struct GeometryPart {
+		std::string filename;
+		uint32_t clusterOffset = 0;
+	};
+	static bool mergeGeometry(const std::vector<GeometryPart>& parts, const std::string& filename);
+
+	static const std::vector<glm::vec3> nodeColors;
+
+	void initVertexBuffer();
+	void initUniqueVertexBuffer();
+	void createVertexBuffer(vks::VulkanDevice* device, VkQueue transferQueue);
+	void createUniqueVertexBuffer(vks::VulkanDevice* device, VkQueue transferQueue);
+	void createSortedIndexBuffer(vks::VulkanDevice* device, VkQueue transferQueue);
+	void draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet);
+
+	vkglTF::Model::Vertices vertices;
+	vkglTF::Model::Vertices uniqueVertices;
+	vkglTF::Model::Indices sortedIndices;
+	std::vector<vkglTF::Vertex> vertexBuffer;
+	std::vector<vkglTF::Vertex> uniqueVertexBuffer;
+};
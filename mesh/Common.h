@@ -49,6 +49,21 @@ struct BVHNodeInfo {
     //alignas(16) int clusterIndices[CLUSTER_GROUP_MAX_SIZE]; // if clusterIndices[0] == -1, then this node is not a leaf node
 };
 
+// Instance level culling data of a node block (NaniteScene::NodeBlock), in the space of the instance
+struct BlockCullInfo {
+    alignas(16) glm::vec3 pMin = glm::vec3(FLT_MAX); // Bounds of the block roots
+    alignas(4) uint32_t firstNode = 0;
+    alignas(16) glm::vec3 pMax = glm::vec3(-FLT_MAX);
+    alignas(4) uint32_t rootCount = 0;
+    // Bounding sphere and largest parent error of the roots finer than the coarsest LOD. Once they are error culled,
+    // the traversal ends in the coarsest cut of the block, which is emitted directly instead
+    alignas(16) glm::vec4 coarseSphere = glm::vec4(0.0f);
+    alignas(4) float coarseError = 0.0f;
+    alignas(4) uint32_t firstCoarseCluster = 0; // Into NaniteScene::coarseCutClusters
+    alignas(4) uint32_t coarseClusterCount = 0;
+};
+static_assert(sizeof(BlockCullInfo) == 64, "BlockCullInfo has to match its std430 layout");
+
 //ClusterInfo for drawing
 struct ClusterInfo {
     alignas(16) glm::vec3 pMinWorld = glm::vec3(FLT_MAX);
@@ -3,4 +3,7 @@
 #define CLUSTER_TARGET_SIZE				56 // How many triangles should a cluster store 
 #define CLUSTER_MAX_SIZE				64 // At most how many tris should a cluster store
 #define CLUSTER_GROUP_TARGET_SIZE		15 // How many clusters should a cluster group store 
-#define CLUSTER_GROUP_MAX_SIZE			32 // At most how many clusters should a cluster group store
\ No newline at end of file
+#define CLUSTER_GROUP_MAX_SIZE			32 // At most how many clusters should a cluster group store
+#define LOD_SIMPLIFY_RATIO				0.5 // Fraction of the faces of a cluster group kept in the next LOD
+#define LOD_TARGET_NUM					6 // How many LODs the DAG is built with
+#define STREAMING_PAGE_SIZE				(256 * 1024) // Bytes per streaming page, large enough for any cluster group
\ No newline at end of file
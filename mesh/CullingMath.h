@@ -0,0 +1,14 @@
+#pragma once
+#include <glm/glm.hpp>
+
+/*
+	Culling math of the compute passes, compiled for the CPU reference (CutStatistics) from the same source,
+	shaders/glsl/pbrtexture/include/cullingmath.glsl. The GLSL types and built-ins it uses come from glm, so a
+	change to the shaders is a change to the CPU reference and the two can not drift apart.
+*/
+namespace CullingMath {
+	using namespace glm;
+#define CULLING_INLINE inline
+#include "../shaders/glsl/pbrtexture/include/cullingmath.glsl"
+#undef CULLING_INLINE
+}
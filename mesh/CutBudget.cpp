@@ -0,0 +1,53 @@
+#include "CutBudget.h"
+
+#include <algorithm>
+#include <cmath>
+
+float cutBudgetBinThreshold(int bin)
+{
+    return std::exp2(static_cast<float>(cutBudgetMinLog2) + static_cast<float>(bin) / cutBudgetBinsPerOctave);
+}
+
+int cutBudgetBinStart(float projectedError)
+{
+    if (!(projectedError > 0.0f)) return 0;
+    float bin = std::ceil((std::log2(projectedError) - cutBudgetMinLog2) * cutBudgetBinsPerOctave);
+    return static_cast<int>(std::min(std::max(bin, 0.0f), static_cast<float>(cutBudgetBins)));
+}
+
+void CutBudgetHistogram::add(float clusterError, float parentError, uint32_t triangles)
+{
+    int begin = cutBudgetBinStart(clusterError);
+    int end = cutBudgetBinStart(parentError);
+    if (begin >= end) return;
+    // Unsigned wrap around, the prefix sums come out right
+    clusterBins[begin] += 1;
+    triangleBins[begin] += triangles;
+    if (end < cutBudgetBins) {
+        clusterBins[end] -= 1;
+        triangleBins[end] -= triangles;
+    }
+}
+
+float CutBudgetHistogram::selectThreshold(float userThreshold, uint32_t maxClusters, uint32_t maxTriangles) const
+{
+    if (maxClusters == 0 && maxTriangles == 0) return userThreshold;
+    std::vector<uint32_t> clusters(cutBudgetBins), triangles(cutBudgetBins);
+    uint32_t clusterSum = 0, triangleSum = 0;
+    for (int bin = 0; bin < cutBudgetBins; bin++)
+    {
+        clusterSum += clusterBins[bin];
+        triangleSum += triangleBins[bin];
+        clusters[bin] = clusterSum;
+        triangles[bin] = triangleSum;
+    }
+    // The coarsest bin is taken even over the budget, there is no coarser cut. The threshold is the one of the bin
+    // that was checked, the user threshold lies below it and its cut may be larger
+    const int firstBin = std::min(cutBudgetBinStart(userThreshold), cutBudgetBins - 1);
+    int bin = cutBudgetBins - 1;
+    while (bin > firstBin && (maxClusters == 0 || clusters[bin - 1] <= maxClusters) && (maxTriangles == 0 || triangles[bin - 1] <= maxTriangles))
+    {
+        bin--;
+    }
+    return std::max(userThreshold, cutBudgetBinThreshold(bin));
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+/*
+	Budget constrained LOD cut. The threshold cut selects the clusters with clusterError <= threshold < parentError,
+	lowering the threshold refines the clusters with the highest projected error first. Under a cluster or triangle
+	budget the cut threshold is the lowest one, but not below the user threshold, whose cut still fits the budget.
+
+	Cut sizes are collected per threshold bin over the candidates of the traversal (error.comp), bins are spaced
+	1 / cutBudgetBinsPerOctave octaves apart. A candidate is counted as a +1 at the first bin its own error fits in and
+	a -1 at the first bin its parent error fits in, prefix sums over the bins give the cut size of every bin threshold.
+	The traversal ran with the user threshold, so the candidates hold every cut at or above it.
+	budget.comp picks the threshold on the GPU, CutBudgetHistogram is the same on the CPU.
+*/
+constexpr int cutBudgetBinsPerOctave = 4;
+constexpr int cutBudgetMinLog2 = -32; // Threshold of bin 0 is 2^cutBudgetMinLog2
+constexpr int cutBudgetBins = 160; // Up to 2^8
+
+// Layout of the budget buffer, followed by the cluster and the triangle bins (uint32_t[cutBudgetBins] each)
+struct CutBudgetHeader {
+	float threshold = 0.0f; // Written by the host with the user threshold, replaced by the budget threshold
+	uint32_t maxClusters = 0; // 0: no limit
+	uint32_t maxTriangles = 0;
+	uint32_t padding = 0;
+};
+
+float cutBudgetBinThreshold(int bin);
+// First bin whose threshold is >= projectedError, cutBudgetBins if there is none
+int cutBudgetBinStart(float projectedError);
+
+struct CutBudgetHistogram {
+	std::vector<uint32_t> clusterBins = std::vector<uint32_t>(cutBudgetBins, 0);
+	std::vector<uint32_t> triangleBins = std::vector<uint32_t>(cutBudgetBins, 0);
+
+	void add(float clusterError, float parentError, uint32_t triangles);
+	// Lowest bin threshold >= userThreshold whose cut fits the budget, scanning from the coarsest bin down. Only past
+	// the last bin the user threshold itself is returned
+	float selectThreshold(float userThreshold, uint32_t maxClusters, uint32_t maxTriangles) const;
+};
@@ -0,0 +1,542 @@
+#include "CutStatistics.h"
+#include "CullingMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+    // Same as frustrumCulling() in bvhtraversal.comp and culling.comp: culled if no corner lands inside clip space
+    bool frustumCulled(const glm::vec3& pMin, const glm::vec3& pMax, const glm::mat4& viewProj)
+    {
+        const float eps = 1e-3f;
+        for (int i = 0; i < 8; i++)
+        {
+            glm::vec4 p((i & 1) ? pMax.x : pMin.x, (i & 2) ? pMax.y : pMin.y, (i & 4) ? pMax.z : pMin.z, 1.0f);
+            glm::vec4 hpos = viewProj * p;
+            if (hpos.w == 0.0f) return false;
+            hpos /= hpos.w;
+            if (hpos.x > -1.0f - eps && hpos.x < 1.0f + eps && hpos.y > -1.0f - eps && hpos.y < 1.0f + eps && hpos.z > 0.0f - eps && hpos.z < 1.0f + eps)
+                return false;
+        }
+        return true;
+    }
+
+    // Pixel area of the screen space AABB in HiZ texels, as computed from last frame's matrices in culling.comp
+    float screenPixelArea(const glm::vec3& pMin, const glm::vec3& pMax, const glm::mat4& lastViewProj, const glm::vec2& hzbSize)
+    {
+        CullingMath::ScreenRect rect = CullingMath::projectAABB(0.5f * (pMin + pMax), 0.5f * (pMax - pMin), lastViewProj);
+        glm::vec2 span = (glm::vec2(rect.uv.z, rect.uv.w) - glm::vec2(rect.uv)) * hzbSize;
+        return span.x * span.y;
+    }
+
+    // getScreenBoundRadiusSq() of error.comp and bvhtraversal.comp
+    float screenBoundRadiusSq(const glm::vec3& center, float radius, const CutView& cutView)
+    {
+        return CullingMath::projectedSphereRadiusSq(glm::vec3(cutView.view * glm::vec4(center, 1.0f)), radius, cutView.proj, cutView.screenSize);
+    }
+
+    // coarseCutTaken() of instanceculling.comp. The projected sphere only bounds the projections of the root spheres
+    // inside it while the camera is outside of it
+    bool coarseCutTaken(const BlockCullInfo& block, const glm::mat4& model, float lodBias, const CutView& cutView)
+    {
+        if (block.coarseError <= 0.0f) return true; // Only the coarsest LOD
+        glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(block.coarseSphere), 1.0f));
+        float radius = glm::length(model * glm::vec4(block.coarseSphere.w, 0.0f, 0.0f, 0.0f));
+        if (glm::length(glm::vec3(cutView.view * glm::vec4(center, 1.0f))) <= radius) return false;
+        return block.coarseError * lodBias * screenBoundRadiusSq(center, radius, cutView) <= cutView.threshold;
+    }
+}
+
+int CutStatistics::errorBin(float projectedError)
+{
+    if (!(projectedError > 0.0f)) return 0;
+    int bin = static_cast<int>(std::floor(std::log2(projectedError))) - errorHistogramMinLog2;
+    return std::min(std::max(bin, 0), errorHistogramBins - 1);
+}
+
+// Frustum and error test of a node in the space of its object, as in bvhtraversal.comp
+CutStatistics::NodeState CutStatistics::evaluateNode(const NaniteScene& scene, const std::vector<glm::mat4>& modelMats, const CutView& cutView,
+    const glm::uvec2& entry, float& nodeError)
+{
+    const BVHNodeInfo& node = scene.bvhNodeInfos[entry.x];
+    const uint32_t objectId = entry.y + node.objectId;
+    const glm::mat4& model = modelMats[objectId];
+    glm::vec3 pMin, pMax;
+    transformAABB(model, node.pMinWorld, node.pMaxWorld, pMin, pMax);
+    if (frustumCulled(pMin, pMax, cutView.proj * cutView.view)) return NodeState::FrustumCulled;
+    glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(node.errorRP), 1.0f));
+    float radius = glm::length(model * glm::vec4(node.errorRP.w, 0.0f, 0.0f, 0.0f));
+    nodeError = node.errorWorld.y * scene.lodBiases[objectId] * screenBoundRadiusSq(center, radius, cutView);
+    return nodeError <= cutView.threshold ? NodeState::ErrorCulled : NodeState::Visible;
+}
+
+// Clusters of a visible leaf, children of a visible inner node
+void CutStatistics::expandNode(const NaniteScene& scene, const glm::uvec2& entry, std::vector<std::pair<uint32_t, uint32_t>>& clusters,
+    std::vector<glm::uvec2>& children)
+{
+    const BVHNodeInfo& node = scene.bvhNodeInfos[entry.x];
+    uint32_t leafClusterSize = node.clusterIntervals.y - node.clusterIntervals.x;
+    for (uint32_t i = 0; i < leafClusterSize; i++)
+    {
+        clusters.emplace_back(scene.sortedClusterIndices[node.clusterIntervals.x + i], entry.y + node.objectId);
+    }
+    if (leafClusterSize == 0)
+    {
+        for (int i = 0; i < 4 && node.childrenNodeIndices[i] != -1; i++)
+        {
+            children.emplace_back(node.childrenNodeIndices[i], entry.y);
+        }
+    }
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> CutStatistics::updateFrontier(const NaniteScene& scene, const std::vector<glm::mat4>& modelMats,
+    const CutView& cutView, CutFrameStats& stats)
+{
+    // Parents of the flattened DAG, a new instance or prefab changes the roots and starts over from them
+    bool reset = frontier.roots != scene.initNodeInfoIndices || frontier.parents.size() != scene.bvhNodeInfos.size();
+    if (reset)
+    {
+        frontier.roots = scene.initNodeInfoIndices;
+        frontier.parents.assign(scene.bvhNodeInfos.size(), -1);
+        for (size_t n = 0; n < scene.bvhNodeInfos.size(); n++)
+        {
+            for (int i = 0; i < 4 && scene.bvhNodeInfos[n].childrenNodeIndices[i] != -1; i++)
+            {
+                frontier.parents[scene.bvhNodeInfos[n].childrenNodeIndices[i]] = static_cast<int32_t>(n);
+            }
+        }
+        frontier.nodes.clear();
+    }
+
+    // Every node is evaluated at most once per frame, siblings share the climb through their parents
+    struct Evaluation {
+        NodeState state;
+        float error;
+    };
+    std::unordered_map<uint64_t, Evaluation> evaluations;
+    auto key = [](const glm::uvec2& entry) { return (static_cast<uint64_t>(entry.x) << 32) | entry.y; };
+    auto passes = [&](const glm::uvec2& entry) {
+        auto it = evaluations.find(key(entry));
+        if (it == evaluations.end())
+        {
+            Evaluation evaluation;
+            evaluation.error = 0.0f;
+            evaluation.state = evaluateNode(scene, modelMats, cutView, entry, evaluation.error);
+            it = evaluations.emplace(key(entry), evaluation).first;
+            stats.incrementalNodes++;
+        }
+        return it->second.state == NodeState::Visible;
+    };
+
+    // Coarsening: a failing frontier node climbs while its parent fails, up to the first node below a passing parent.
+    // A passing node has a passing parent, it is a top without climbing. Tops are only refined if they pass themselves
+    std::vector<glm::uvec2> tops;
+    if (reset)
+    {
+        tops.assign(scene.initNodeInfoIndices.begin() + 1, scene.initNodeInfoIndices.end());
+    }
+    else
+    {
+        std::unordered_set<uint64_t> topKeys;
+        for (const glm::uvec2& node : frontier.nodes)
+        {
+            glm::uvec2 top = node;
+            while (!passes(node) && frontier.parents[top.x] != -1 && !passes(glm::uvec2(frontier.parents[top.x], top.y)))
+            {
+                top.x = frontier.parents[top.x];
+            }
+            if (topKeys.insert(key(top)).second) tops.push_back(top);
+        }
+        // A top below a failing top came in through a passing parent of a failing ancestor, the coarser top wins
+        std::unordered_set<uint64_t> failingTops;
+        for (const glm::uvec2& top : tops)
+        {
+            if (!passes(top)) failingTops.insert(key(top));
+        }
+        tops.erase(std::remove_if(tops.begin(), tops.end(), [&](const glm::uvec2& top) {
+            for (int32_t parent = frontier.parents[top.x]; parent != -1; parent = frontier.parents[parent])
+            {
+                if (failingTops.count(key(glm::uvec2(parent, top.y)))) return true;
+            }
+            return false;
+        }), tops.end());
+    }
+
+    // Refinement: failing tops are the new frontier as they are, passing tops are traversed down to the nodes that fail
+    // or to their leaves
+    std::vector<std::pair<uint32_t, uint32_t>> candidates;
+    std::vector<glm::uvec2> currNodes;
+    std::vector<glm::uvec2> nextNodes;
+    frontier.nodes.clear();
+    for (const glm::uvec2& top : tops)
+    {
+        currNodes.assign(1, top);
+        while (!currNodes.empty())
+        {
+            nextNodes.clear();
+            for (const glm::uvec2& entry : currNodes)
+            {
+                if (!passes(entry))
+                {
+                    frontier.nodes.push_back(entry);
+                    continue;
+                }
+                size_t children = nextNodes.size();
+                expandNode(scene, entry, candidates, nextNodes);
+                if (nextNodes.size() == children) frontier.nodes.push_back(entry); // Leaf
+            }
+            std::swap(currNodes, nextNodes);
+        }
+    }
+    return candidates;
+}
+
+CutFrameStats CutStatistics::evaluate(const NaniteScene& scene, const std::vector<glm::mat4>& modelMats, const CutView& cutView,
+    const ResidencyManager* residency, std::vector<uint32_t>* desiredClusters)
+{
+    CutFrameStats stats;
+    stats.nodeErrorHistogram.assign(errorHistogramBins, 0);
+    stats.clusterErrorHistogram.assign(errorHistogramBins, 0);
+    const glm::mat4 viewProj = cutView.proj * cutView.view;
+
+    // BVH traversal, level by level like the ping-ponged node buffers on the GPU. Entries are (node, first object of
+    // the instance), nodes are in the space of object entry.y + objectId
+    std::vector<glm::uvec2> currNodes;
+    std::vector<glm::uvec2> nextNodes;
+    std::vector<std::pair<uint32_t, uint32_t>> candidates; // cluster index, object index
+    if (cutView.instanceCulling)
+    {
+        // Instance culling seeds the traversal with the roots of the instances that are neither culled nor coarse
+        for (size_t e = 1; e < scene.instanceEntries.size(); e++)
+        {
+            const glm::uvec2& entry = scene.instanceEntries[e];
+            const BlockCullInfo& block = scene.blockCullInfos[entry.x];
+            const glm::mat4& model = modelMats[entry.y];
+            stats.visitedInstances++;
+            glm::vec3 pMin, pMax;
+            transformAABB(model, block.pMin, block.pMax, pMin, pMax);
+            if (frustumCulled(pMin, pMax, viewProj))
+            {
+                stats.frustumCulledInstances++;
+                continue;
+            }
+            if (coarseCutTaken(block, model, scene.lodBiases[entry.y], cutView))
+            {
+                stats.coarseInstances++;
+                for (uint32_t k = 0; k < block.coarseClusterCount; k++)
+                {
+                    const glm::uvec2& coarseCluster = scene.coarseCutClusters[block.firstCoarseCluster + k];
+                    candidates.emplace_back(coarseCluster.x, entry.y + coarseCluster.y);
+                }
+                continue;
+            }
+            for (uint32_t k = 0; k < block.rootCount; k++)
+            {
+                currNodes.emplace_back(block.firstNode + k, entry.y);
+            }
+        }
+    }
+    else
+    {
+        currNodes.assign(scene.initNodeInfoIndices.begin() + 1, scene.initNodeInfoIndices.end());
+    }
+    while (!currNodes.empty())
+    {
+        nextNodes.clear();
+        for (const glm::uvec2& entry : currNodes)
+        {
+            stats.visitedNodes++;
+            float nodeError = 0.0f;
+            NodeState state = evaluateNode(scene, modelMats, cutView, entry, nodeError);
+            if (state == NodeState::FrustumCulled)
+            {
+                stats.frustumCulledNodes++;
+                continue;
+            }
+            stats.nodeErrorHistogram[errorBin(nodeError)]++;
+            if (state == NodeState::ErrorCulled)
+            {
+                stats.errorCulledNodes++;
+                continue;
+            }
+            stats.visibleNodes++;
+            expandNode(scene, entry, candidates, nextNodes);
+        }
+        std::swap(currNodes, nextNodes);
+    }
+
+    if (cutView.temporalCoherence && !cutView.instanceCulling)
+    {
+        // The full traversal above is the reference, the rest of the frame uses the incremental cut
+        std::vector<std::pair<uint32_t, uint32_t>> incrementalCandidates = updateFrontier(scene, modelMats, cutView, stats);
+        std::vector<std::pair<uint32_t, uint32_t>> reference = candidates;
+        std::sort(reference.begin(), reference.end());
+        std::sort(incrementalCandidates.begin(), incrementalCandidates.end());
+        std::vector<std::pair<uint32_t, uint32_t>> difference;
+        std::set_symmetric_difference(reference.begin(), reference.end(), incrementalCandidates.begin(), incrementalCandidates.end(), std::back_inserter(difference));
+        stats.incrementalCutDifference = static_cast<uint32_t>(difference.size());
+        candidates = std::move(incrementalCandidates);
+    }
+    else
+    {
+        frontier = CutFrontier();
+    }
+
+    selectClusters(scene, modelMats, cutView, candidates, residency, desiredClusters, stats, nullptr);
+    return stats;
+}
+
+MultiViewCut CutStatistics::evaluateViews(const NaniteScene& scene, const std::vector<glm::mat4>& modelMats, const std::vector<CutView>& views) const
+{
+    ASSERT(!views.empty() && views.size() <= maxViews, "Multi view cuts take 1 to " << maxViews << " views, got " << views.size());
+    MultiViewCut cut;
+    cut.views.resize(views.size());
+    cut.visibleClusters.resize(views.size());
+    for (CutFrameStats& stats : cut.views)
+    {
+        stats.nodeErrorHistogram.assign(errorHistogramBins, 0);
+        stats.clusterErrorHistogram.assign(errorHistogramBins, 0);
+    }
+
+    // One traversal for all views. Entries are (node, first object of the instance, mask of the views that reached
+    // the node), a node is fetched once and tested for every view in its mask, its children inherit the views it passed
+    std::vector<glm::uvec3> currNodes;
+    std::vector<glm::uvec3> nextNodes;
+    const uint32_t allViews = views.size() == maxViews ? ~0u : (1u << views.size()) - 1;
+    for (size_t r = 1; r < scene.initNodeInfoIndices.size(); r++)
+    {
+        currNodes.emplace_back(scene.initNodeInfoIndices[r], allViews);
+    }
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> candidates(views.size());
+    std::vector<std::pair<uint32_t, uint32_t>> clusters;
+    std::vector<glm::uvec2> children;
+    while (!currNodes.empty())
+    {
+        nextNodes.clear();
+        for (const glm::uvec3& entry : currNodes)
+        {
+            const glm::uvec2 node(entry);
+            cut.sharedNodes++;
+            uint32_t visibleViews = 0;
+            for (uint32_t v = 0; v < views.size(); v++)
+            {
+                if (!(entry.z & (1u << v))) continue;
+                CutFrameStats& stats = cut.views[v];
+                stats.visitedNodes++;
+                float nodeError = 0.0f;
+                NodeState state = evaluateNode(scene, modelMats, views[v], node, nodeError);
+                if (state == NodeState::FrustumCulled)
+                {
+                    stats.frustumCulledNodes++;
+                    continue;
+                }
+                stats.nodeErrorHistogram[errorBin(nodeError)]++;
+                if (state == NodeState::ErrorCulled)
+                {
+                    stats.errorCulledNodes++;
+                    continue;
+                }
+                stats.visibleNodes++;
+                visibleViews |= 1u << v;
+            }
+            if (visibleViews == 0) continue;
+            clusters.clear();
+            children.clear();
+            expandNode(scene, node, clusters, children);
+            for (const glm::uvec2& child : children)
+            {
+                nextNodes.emplace_back(child, visibleViews);
+            }
+            for (uint32_t v = 0; v < views.size(); v++)
+            {
+                if (visibleViews & (1u << v)) candidates[v].insert(candidates[v].end(), clusters.begin(), clusters.end());
+            }
+        }
+        std::swap(currNodes, nextNodes);
+    }
+
+    for (uint32_t v = 0; v < views.size(); v++)
+    {
+        selectClusters(scene, modelMats, views[v], candidates[v], nullptr, nullptr, cut.views[v], &cut.visibleClusters[v]);
+    }
+    return cut;
+}
+
+// Error projection, cut budget and cluster culling of the candidates of the traversal, as in error.comp, budget.comp and culling.comp
+void CutStatistics::selectClusters(const NaniteScene& scene, const std::vector<glm::mat4>& modelMats, const CutView& cutView,
+    const std::vector<std::pair<uint32_t, uint32_t>>& candidates, const ResidencyManager* residency, std::vector<uint32_t>* desiredClusters,
+    CutFrameStats& stats, std::vector<glm::uvec2>* selectedClusters)
+{
+    const glm::mat4 viewProj = cutView.proj * cutView.view;
+    const glm::mat4 lastViewProj = cutView.lastProj * cutView.lastView;
+    stats.candidateClusters = static_cast<uint32_t>(candidates.size());
+
+    // Error projection
+    std::vector<glm::vec2> projectedErrors(candidates.size());
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        const ErrorInfo& error = scene.errorInfo[candidates[i].first];
+        const glm::mat4& model = modelMats[candidates[i].second];
+        const float lodBias = scene.lodBiases[candidates[i].second];
+        glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(error.centerR), 1.0f));
+        float radius = glm::length(model * glm::vec4(error.centerR.w, 0.0f, 0.0f, 0.0f));
+        projectedErrors[i].x = error.errorWorld.x * lodBias * screenBoundRadiusSq(center, radius, cutView);
+        center = glm::vec3(model * glm::vec4(glm::vec3(error.centerRP), 1.0f));
+        radius = glm::length(model * glm::vec4(error.centerRP.w, 0.0f, 0.0f, 0.0f));
+        projectedErrors[i].y = error.errorWorld.y * lodBias * screenBoundRadiusSq(center, radius, cutView);
+    }
+
+    // Under a budget the cut threshold is chosen from the cut sizes of all candidates, before cluster culling (budget.comp)
+    float threshold = cutView.threshold;
+    if (cutView.clusterBudget > 0 || cutView.triangleBudget > 0)
+    {
+        CutBudgetHistogram histogram;
+        for (size_t i = 0; i < candidates.size(); i++)
+        {
+            const ClusterInfo& cluster = scene.clusterInfo[candidates[i].first];
+            histogram.add(projectedErrors[i].x, projectedErrors[i].y, cluster.triangleIndicesEnd - cluster.triangleIndicesStart);
+        }
+        threshold = histogram.selectThreshold(cutView.threshold, cutView.clusterBudget, cutView.triangleBudget);
+    }
+    stats.cutThreshold = threshold;
+
+    // Cluster culling
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        const uint32_t clusterIndex = candidates[i].first;
+        const ClusterInfo& cluster = scene.clusterInfo[clusterIndex];
+        const glm::mat4& model = modelMats[candidates[i].second];
+        const float clusterError = projectedErrors[i].x;
+        const float parentError = projectedErrors[i].y;
+
+        glm::vec3 pMin = glm::vec3(model * glm::vec4(cluster.pMinWorld, 1.0f));
+        glm::vec3 pMax = glm::vec3(model * glm::vec4(cluster.pMaxWorld, 1.0f));
+        if (cutView.useFrustumCulling && frustumCulled(pMin, pMax, viewProj))
+        {
+            stats.frustumCulledClusters++;
+            continue;
+        }
+        bool desired = parentError > threshold && clusterError <= threshold;
+        if (desired)
+        {
+            stats.desiredClusters++;
+            if (desiredClusters) desiredClusters->push_back(clusterIndex);
+        }
+        bool selected = desired;
+        if (residency)
+        {
+            // A resident cluster replaces its parents once all their children are resident,
+            // and stays in the cut above the error threshold while any of its own children is missing
+            selected = parentError > threshold && residency->isResident(clusterIndex) && residency->parentsRefined(clusterIndex)
+                && (clusterError <= threshold || !residency->childrenResident(clusterIndex));
+            if (selected && !desired) stats.fallbackClusters++;
+        }
+        if (!selected)
+        {
+            continue;
+        }
+        uint32_t triangles = cluster.triangleIndicesEnd - cluster.triangleIndicesStart;
+        bool useSWR = cutView.useSoftwareRasterization && screenPixelArea(pMin, pMax, lastViewProj, cutView.hzbSize) < 256.0f;
+        stats.selectedClusters++;
+        stats.triangles += triangles;
+        if (useSWR)
+        {
+            stats.swClusters++;
+            stats.swTriangles += triangles;
+        }
+        else
+        {
+            stats.hwClusters++;
+            stats.hwTriangles += triangles;
+        }
+        if (selectedClusters) selectedClusters->emplace_back(clusterIndex, candidates[i].second);
+        stats.clusterErrorHistogram[errorBin(clusterError)]++;
+    }
+}
+
+void CutStatistics::saveCSV(const std::string& filename) const
+{
+    std::ofstream result(filename, std::ios::out);
+    if (!result.is_open()) {
+        std::cerr << "Could not write " << filename << "\n";
+        return;
+    }
+    result << "frame,cut threshold,visited instances,frustum culled instances,coarse instances,visited nodes,visible nodes,frustum culled nodes,error culled nodes,incremental nodes,incremental cut difference,views,multi view nodes,multi view node tests,multi view clusters,candidate clusters,frustum culled clusters,"
+        << "selected clusters,hw clusters,sw clusters,triangles,hw triangles,sw triangles,"
+        << "desired clusters,fallback clusters,requested pages,missing pages,pending pages,loaded pages,evicted pages,resident pages,resident bytes";
+    for (int i = 0; i < errorHistogramBins; i++) result << ",node error 2^" << i + errorHistogramMinLog2;
+    for (int i = 0; i < errorHistogramBins; i++) result << ",cluster error 2^" << i + errorHistogramMinLog2;
+    result << "\n";
+    for (auto& stats : history) {
+        result << stats.frame << "," << stats.cutThreshold << "," << stats.visitedInstances << "," << stats.frustumCulledInstances << "," << stats.coarseInstances << ","
+            << stats.visitedNodes << "," << stats.visibleNodes << "," << stats.frustumCulledNodes << ","
+            << stats.errorCulledNodes << "," << stats.incrementalNodes << "," << stats.incrementalCutDifference << ","
+            << stats.views << "," << stats.multiViewNodes << "," << stats.multiViewNodeTests << "," << stats.multiViewClusters << "," << stats.candidateClusters << "," << stats.frustumCulledClusters << ","
+            << stats.selectedClusters << "," << stats.hwClusters << "," << stats.swClusters << ","
+            << stats.triangles << "," << stats.hwTriangles << "," << stats.swTriangles << ","
+            << stats.desiredClusters << "," << stats.fallbackClusters << "," << stats.streaming.requestedPages << ","
+            << stats.streaming.missingPages << "," << stats.streaming.pendingPages << "," << stats.streaming.loadedPages << ","
+            << stats.streaming.evictedPages << "," << stats.streaming.residentPages << "," << stats.streaming.residentBytes;
+        for (uint32_t c : stats.nodeErrorHistogram) result << "," << c;
+        for (uint32_t c : stats.clusterErrorHistogram) result << "," << c;
+        result << "\n";
+    }
+}
+
+void CutStatistics::saveJSON(const std::string& filename) const
+{
+    json j;
+    j["errorHistogramMinLog2"] = errorHistogramMinLog2;
+    j["frames"] = json::array();
+    for (auto& stats : history) {
+        j["frames"].push_back({
+            {"frame", stats.frame},
+            {"cutThreshold", stats.cutThreshold},
+            {"visitedInstances", stats.visitedInstances},
+            {"frustumCulledInstances", stats.frustumCulledInstances},
+            {"coarseInstances", stats.coarseInstances},
+            {"visitedNodes", stats.visitedNodes},
+            {"visibleNodes", stats.visibleNodes},
+            {"frustumCulledNodes", stats.frustumCulledNodes},
+            {"errorCulledNodes", stats.errorCulledNodes},
+            {"incrementalNodes", stats.incrementalNodes},
+            {"incrementalCutDifference", stats.incrementalCutDifference},
+            {"views", stats.views},
+            {"multiViewNodes", stats.multiViewNodes},
+            {"multiViewNodeTests", stats.multiViewNodeTests},
+            {"multiViewClusters", stats.multiViewClusters},
+            {"candidateClusters", stats.candidateClusters},
+            {"frustumCulledClusters", stats.frustumCulledClusters},
+            {"selectedClusters", stats.selectedClusters},
+            {"hwClusters", stats.hwClusters},
+            {"swClusters", stats.swClusters},
+            {"triangles", stats.triangles},
+            {"hwTriangles", stats.hwTriangles},
+            {"swTriangles", stats.swTriangles},
+            {"desiredClusters", stats.desiredClusters},
+            {"fallbackClusters", stats.fallbackClusters},
+            {"streaming", {
+                {"requestedPages", stats.streaming.requestedPages},
+                {"missingPages", stats.streaming.missingPages},
+                {"pendingPages", stats.streaming.pendingPages},
+                {"loadedPages", stats.streaming.loadedPages},
+                {"evictedPages", stats.streaming.evictedPages},
+                {"residentPages", stats.streaming.residentPages},
+                {"residentBytes", stats.streaming.residentBytes}
+            }},
+            {"nodeErrorHistogram", stats.nodeErrorHistogram},
+            {"clusterErrorHistogram", stats.clusterErrorHistogram}
+        });
+    }
+    std::ofstream result(filename, std::ios::out);
+    if (!result.is_open()) {
+        std::cerr << "Could not write " << filename << "\n";
+        return;
+    }
+    result << j.dump(4);
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <glm/glm.hpp>
+
+#include "CutBudget.h"
+#include "NaniteScene.h"
+#include "ResidencyManager.h"
+
+/*
+	CPU reference of the GPU LOD cut (bvhtraversal.comp -> error.comp -> culling.comp)
+	Evaluates the same frustum, error and HW/SW raster decisions on the host, so that cut statistics
+	of a camera path can be compared across builds, with or without a GPU.
+	Occlusion culling needs last frame's HiZ buffer and is not reproduced, nothing is occlusion culled here.
+*/
+
+// Everything the culling passes read from their uniform buffers and push constants
+struct CutView {
+	glm::mat4 view;
+	glm::mat4 proj;
+	glm::mat4 lastView; // Screen space AABBs (HW/SW split) use last frame's matrices, as on the GPU
+	glm::mat4 lastProj;
+	glm::vec2 screenSize;
+	glm::vec2 hzbSize; // Extent of the HiZ, culling.comp measures the pixel areas of the HW/SW split in its texels
+	float threshold;
+	bool useFrustumCulling = true;
+	bool useSoftwareRasterization = true;
+	bool instanceCulling = false; // Whole instances are culled or take their coarse cut before the traversal
+	// Cut budget, see CutBudget.h. 0: no limit
+	uint32_t clusterBudget = 0;
+	uint32_t triangleBudget = 0;
+	bool temporalCoherence = false; // Incremental cut from last frame's frontier, see CutFrontier. Not with instance culling
+};
+
+struct CutFrameStats {
+	uint64_t frame = 0;
+	float cutThreshold = 0.0f; // Error threshold of the cut, above CutView::threshold when the cut budget lowered the detail
+	// Instance culling, only with CutView::instanceCulling
+	uint32_t visitedInstances = 0;
+	uint32_t frustumCulledInstances = 0;
+	uint32_t coarseInstances = 0; // Instances that emitted their coarse cut without traversal
+	uint32_t visitedNodes = 0; // BVH nodes evaluated over all levels
+	uint32_t visibleNodes = 0; // BVH nodes that passed culling
+	uint32_t frustumCulledNodes = 0;
+	uint32_t errorCulledNodes = 0;
+	// Temporal coherence, only with CutView::temporalCoherence
+	uint32_t incrementalNodes = 0; // BVH nodes evaluated by the incremental cut, compare to visitedNodes
+	uint32_t incrementalCutDifference = 0; // Candidate clusters in only one of the incremental and the full cut
+	uint32_t candidateClusters = 0; // Clusters emitted by the BVH traversal
+	uint32_t frustumCulledClusters = 0;
+	uint32_t selectedClusters = 0; // Clusters in the final cut
+	uint32_t hwClusters = 0;
+	uint32_t swClusters = 0;
+	uint32_t triangles = 0;
+	uint32_t hwTriangles = 0;
+	uint32_t swTriangles = 0;
+	// Streaming, only with a ResidencyManager
+	uint32_t desiredClusters = 0; // Clusters of the cut without residency constraints
+	uint32_t fallbackClusters = 0; // Selected in place of finer clusters that are not resident
+	StreamingFrameStats streaming;
+	// log2 histograms of projected errors, see CutStatistics::errorBin
+	std::vector<uint32_t> nodeErrorHistogram; // parent error of every node that passed frustum culling
+	std::vector<uint32_t> clusterErrorHistogram; // own error of every selected cluster
+	// Multi view cut of the same frame, see CutStatistics::evaluateViews(). 0 views: not evaluated
+	uint32_t views = 0;
+	uint32_t multiViewNodes = 0; // BVH nodes fetched by the shared traversal
+	uint32_t multiViewNodeTests = 0; // Node tests of all views, the nodes separate traversals would visit
+	uint32_t multiViewClusters = 0; // Clusters selected over all views
+};
+
+// Cuts of several views from one traversal
+struct MultiViewCut {
+	std::vector<CutFrameStats> views; // visitedNodes counts the tests of the view in the shared traversal
+	std::vector<std::vector<glm::uvec2>> visibleClusters; // (cluster, object) selected for each view
+	uint32_t sharedNodes = 0;
+};
+
+/*
+	Last frame's cut of the BVH, the nodes where the traversal stopped: culled nodes and leaves that emitted their clusters.
+	The next frame starts from these nodes instead of the roots, coarsens by climbing from frontier nodes while their
+	parents fail the frustum or error test and refines by traversing down from frontier nodes that pass now.
+	Only nodes around the frontier are evaluated, under a slowly moving camera far fewer than by a full traversal.
+	The climb stops at the first passing parent and assumes its ancestors still pass, which holds as long as the
+	tests are monotone along the DAG, CutFrameStats::incrementalCutDifference counts where they are not.
+*/
+struct CutFrontier {
+	std::vector<glm::uvec2> nodes; // (node, first object of the instance), as the entries of the traversal
+	std::vector<glm::uvec2> roots; // NaniteScene::initNodeInfoIndices the frontier was built for
+	std::vector<int32_t> parents; // Parent of every BVH node, -1 for roots
+};
+
+class CutStatistics {
+public:
+	static constexpr int errorHistogramBins = 40;
+	static constexpr int errorHistogramMinLog2 = -32; // bin 0 holds everything below 2^-31, the last bin everything above
+	static constexpr size_t maxViews = 32; // Bits of the view masks of evaluateViews()
+
+	std::vector<CutFrameStats> history;
+
+	// With residency, the cut only uses resident clusters and falls back to coarser ones where finer pages are missing.
+	// desiredClusters receives the clusters of the unconstrained cut, the page requests of ResidencyManager::update()
+	CutFrameStats evaluate(const NaniteScene& scene, const std::vector<glm::mat4>& modelMats, const CutView& cutView,
+		const ResidencyManager* residency = nullptr, std::vector<uint32_t>* desiredClusters = nullptr);
+	// Cut of every view (shadow cascades, cube faces, stereo eyes) with a single traversal: every node is fetched once,
+	// carries a mask of the views that reached it and is tested for each of them, so the upper levels the views share
+	// are fetched once instead of once per view. Each view gets its own candidates, cut budget and visible clusters.
+	// Without residency, instance culling and temporal coherence, the views start from the roots
+	MultiViewCut evaluateViews(const NaniteScene& scene, const std::vector<glm::mat4>& modelMats, const std::vector<CutView>& views) const;
+
+	static int errorBin(float projectedError);
+
+	void saveCSV(const std::string& filename) const;
+	void saveJSON(const std::string& filename) const;
+
+private:
+	enum class NodeState { FrustumCulled, ErrorCulled, Visible };
+
+	CutFrontier frontier;
+
+	static NodeState evaluateNode(const NaniteScene& scene, const std::vector<glm::mat4>& modelMats, const CutView& cutView,
+		const glm::uvec2& entry, float& nodeError);
+	static void expandNode(const NaniteScene& scene, const glm::uvec2& entry, std::vector<std::pair<uint32_t, uint32_t>>& clusters,
+		std::vector<glm::uvec2>& children);
+	// Incremental cut of CutView::temporalCoherence, returns the candidate clusters and moves the frontier to this frame
+	std::vector<std::pair<uint32_t, uint32_t>> updateFrontier(const NaniteScene& scene, const std::vector<glm::mat4>& modelMats,
+		const CutView& cutView, CutFrameStats& stats);
+	static void selectClusters(const NaniteScene& scene, const std::vector<glm::mat4>& modelMats, const CutView& cutView,
+		const std::vector<std::pair<uint32_t, uint32_t>>& candidates, const ResidencyManager* residency, std::vector<uint32_t>* desiredClusters,
+		CutFrameStats& stats, std::vector<glm::uvec2>* selectedClusters);
+};
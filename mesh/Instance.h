@@ -9,6 +9,8 @@
 
 struct Instance {
 	NaniteMesh* referenceMesh;
+	uint32_t meshHandle = -1; // Into NaniteScene::naniteMeshes
+	uint32_t prefabHandle = -1; // Into NaniteScene::prefabs, the instance places a prefab instead of a mesh
 	glm::mat4 rootTransform;
 	std::vector<ClusterInfo> clusterInfo;
     std::vector<ErrorInfo> errorInfo;
@@ -147,34 +149,15 @@ struct Instance {
         size_t currClusterNum = 0, currTriangleNum = 0;
         for (int i = 0; i < referenceMesh->meshes.size(); i++)
         {
-            auto& mesh = referenceMesh->meshes[i].mesh;
-            for (MyMesh::FaceIter face_it = mesh.faces_begin(); face_it != mesh.faces_end(); ++face_it) {
-                MyMesh::FaceHandle fh = *face_it;
-                auto clusterIdx = referenceMesh->meshes[i].triangleClusterIndex[fh.idx()] + currClusterNum;
+            const auto& meshLOD = referenceMesh->meshes[i];
+            for (size_t j = 0; j < meshLOD.triangleIndicesSortedByClusterIdx.size(); j++) {
+                auto clusterIdx = meshLOD.triangleClusterIndex[meshLOD.triangleIndicesSortedByClusterIdx[j]] + currClusterNum;
                 auto& clusterI = clusterInfo[clusterIdx];
 
                 glm::vec3 pMinWorld, pMaxWorld;
-                glm::vec3 p0, p1, p2;
-                MyMesh::FaceVertexIter fv_it = mesh.fv_iter(fh);
-
-                // Get the positions of the three vertices
-                auto point0 = mesh.point(*fv_it);
-                ++fv_it;
-                auto point1 = mesh.point(*fv_it);
-                ++fv_it;
-                auto point2 = mesh.point(*fv_it);
-
-                p0[0] = point0[0];
-                p0[1] = point0[1];
-                p0[2] = point0[2];
-
-                p1[0] = point1[0];
-                p1[1] = point1[1];
-                p1[2] = point1[2];
-
-                p2[0] = point2[0];
-                p2[1] = point2[1];
-                p2[2] = point2[2];
+                glm::vec3 p0 = meshLOD.positions[meshLOD.triangleVertexIndicesSortedByClusterIdx[j * 3]];
+                glm::vec3 p1 = meshLOD.positions[meshLOD.triangleVertexIndicesSortedByClusterIdx[j * 3 + 1]];
+                glm::vec3 p2 = meshLOD.positions[meshLOD.triangleVertexIndicesSortedByClusterIdx[j * 3 + 2]];
 
                 p0 = glm::vec3(rootTransform * glm::vec4(p0, 1.0f));
                 p1 = glm::vec3(rootTransform * glm::vec4(p1, 1.0f));
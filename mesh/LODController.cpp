@@ -0,0 +1,98 @@
+#include "LODController.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+void LODController::reset(float threshold)
+{
+    log2Threshold = std::log2(std::min(std::max(threshold, options.minThreshold), options.maxThreshold));
+    lastError = 0.0f;
+    holding = true;
+}
+
+float LODController::threshold() const
+{
+    return std::exp2(log2Threshold);
+}
+
+float LODController::error(double frameMs, uint32_t triangles) const
+{
+    float result = -INFINITY;
+    if (options.targetFrameMs > 0.0f && frameMs > 0.0)
+        result = std::max(result, static_cast<float>(std::log2(frameMs / options.targetFrameMs)));
+    if (options.targetTriangles > 0)
+        result = std::max(result, std::log2(static_cast<float>(std::max(triangles, 1u)) / options.targetTriangles));
+    return std::isfinite(result) ? result : 0.0f;
+}
+
+float LODController::update(uint64_t frame, double frameMs, uint32_t triangles)
+{
+    Sample sample;
+    sample.frame = frame;
+    sample.threshold = threshold();
+    sample.frameMs = frameMs;
+    sample.triangles = triangles;
+    history.push_back(sample);
+
+    // Hysteresis, log2 of the relative deadband
+    const float e = error(frameMs, triangles);
+    const float enter = std::log2(1.0f + options.deadband);
+    if (holding && std::abs(e) > enter) holding = false;
+    else if (!holding && std::abs(e) < 0.5f * enter) holding = true;
+    if (holding)
+    {
+        lastError = 0.0f;
+        return threshold();
+    }
+
+    // Incremental form, clamping the output is the anti windup
+    log2Threshold += options.kp * (e - lastError) + options.ki * e;
+    log2Threshold = std::min(std::max(log2Threshold, std::log2(options.minThreshold)), std::log2(options.maxThreshold));
+    lastError = e;
+    return threshold();
+}
+
+LODController::Summary LODController::summary(size_t settleFrames) const
+{
+    Summary result;
+    if (history.size() <= settleFrames) return result;
+    const float deadband = 1.0f + options.deadband;
+    size_t within = 0;
+    for (size_t i = settleFrames; i < history.size(); i++)
+    {
+        const Sample& sample = history[i];
+        result.meanFrameMs += sample.frameMs;
+        result.maxFrameMs = std::max(result.maxFrameMs, sample.frameMs);
+        result.meanTriangles += sample.triangles;
+        bool frameWithin = options.targetFrameMs <= 0.0f || (sample.frameMs <= options.targetFrameMs * deadband && sample.frameMs * deadband >= options.targetFrameMs);
+        bool trianglesWithin = options.targetTriangles == 0 || (sample.triangles <= options.targetTriangles * deadband && sample.triangles * deadband >= options.targetTriangles);
+        if (frameWithin && trianglesWithin) within++;
+    }
+    result.frames = history.size() - settleFrames;
+    result.meanFrameMs /= result.frames;
+    result.meanTriangles /= result.frames;
+    for (size_t i = settleFrames; i < history.size(); i++)
+    {
+        result.stddevFrameMs += (history[i].frameMs - result.meanFrameMs) * (history[i].frameMs - result.meanFrameMs);
+        result.stddevTriangles += (history[i].triangles - result.meanTriangles) * (history[i].triangles - result.meanTriangles);
+    }
+    result.stddevFrameMs = std::sqrt(result.stddevFrameMs / result.frames);
+    result.stddevTriangles = std::sqrt(result.stddevTriangles / result.frames);
+    result.withinDeadband = static_cast<double>(within) / result.frames;
+    return result;
+}
+
+void LODController::saveCSV(const std::string& filename) const
+{
+    std::ofstream result(filename, std::ios::out);
+    if (!result.is_open()) {
+        std::cerr << "Could not write " << filename << "\n";
+        return;
+    }
+    result << "frame,threshold,frame ms,triangles\n";
+    for (auto& sample : history) {
+        result << sample.frame << "," << sample.threshold << "," << sample.frameMs << "," << sample.triangles << "\n";
+    }
+}
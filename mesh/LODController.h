@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+	Feedback control of the LOD error threshold, holds a GPU frame time and/or a triangle target instead of a fixed threshold.
+	The controller is PI in log2 of the threshold, the cost of a cut roughly follows a power of the threshold, so equal
+	relative errors ask for equal steps at any threshold. The error of a frame is log2(measured / target), the larger one
+	when both targets are set. Within the deadband the threshold is held, it is left once the error exceeds the deadband
+	and entered again below half of it, so measurement noise around the target does not make the cut flicker.
+	Per instance LOD biases (NaniteScene::setInstanceLODBias()) scale the projected errors on top of the threshold.
+*/
+struct LODControllerOptions {
+	float targetFrameMs = 0.0f; // GPU time of all profiled passes, 0: no frame time target
+	uint32_t targetTriangles = 0; // Triangles of the cut, 0: no triangle target
+	float kp = 0.5f; // log2 threshold per log2 error, applied to changes of the error
+	float ki = 0.15f; // log2 threshold per log2 error and frame
+	float deadband = 0.05f; // Relative error around the target within which the threshold is held
+	float minThreshold = 1e-6f;
+	float maxThreshold = 1e-1f;
+};
+
+class LODController {
+public:
+	struct Sample {
+		uint64_t frame = 0;
+		float threshold = 0.0f; // Threshold when the measurement arrived, the frame itself may be a few frames older
+		double frameMs = 0.0;
+		uint32_t triangles = 0;
+	};
+
+	LODControllerOptions options;
+	std::vector<Sample> history;
+
+	bool active() const { return options.targetFrameMs > 0.0f || options.targetTriangles > 0; }
+	void reset(float threshold);
+	float threshold() const;
+	// Measurements of a frame rendered with threshold(), frameMs <= 0 if it was not timed. Returns the next threshold
+	float update(uint64_t frame, double frameMs, uint32_t triangles);
+
+	// Frame time and triangle spread of the history, relative to the targets
+	struct Summary {
+		size_t frames = 0;
+		double meanFrameMs = 0.0, stddevFrameMs = 0.0, maxFrameMs = 0.0;
+		double meanTriangles = 0.0, stddevTriangles = 0.0;
+		double withinDeadband = 0.0; // Fraction of frames with both measurements within the deadband of their targets
+	};
+	// Skips the first `settleFrames` frames, in which the threshold still approaches the targets
+	Summary summary(size_t settleFrames = 0) const;
+	void saveCSV(const std::string& filename) const;
+
+private:
+	float log2Threshold = 0.0f;
+	float lastError = 0.0f;
+	bool holding = true;
+
+	float error(double frameMs, uint32_t triangles) const;
+};
@@ -306,7 +306,96 @@ void Mesh::colorClusterGraph()
     }
 }
 
-void Mesh::simplifyMesh(MyMesh & mymesh)
+void Mesh::simplifyMesh(MyMesh & mymesh, QEMSimplifier & simplifier)
+{
+    size_t original_faces = mymesh.n_faces();
+    std::cout << "NUM FACES BEFORE: " << original_faces << std::endl;
+    const double percentage = LOD_SIMPLIFY_RATIO;
+
+    // Flatten the mesh, the cluster group of a face is stored on its halfedges
+    std::vector<float> points(mymesh.n_vertices() * 3);
+    std::vector<MyMesh::Normal> normals(mymesh.n_vertices());
+    std::vector<MyMesh::TexCoord2D> texcoords(mymesh.n_vertices());
+    for (const auto& vh : mymesh.vertices())
+    {
+        const auto& p = mymesh.point(vh);
+        points[vh.idx() * 3] = p[0];
+        points[vh.idx() * 3 + 1] = p[1];
+        points[vh.idx() * 3 + 2] = p[2];
+        normals[vh.idx()] = mymesh.normal(vh);
+        texcoords[vh.idx()] = mymesh.texcoord2D(vh);
+    }
+    std::vector<uint32_t> indices(mymesh.n_faces() * 3);
+    std::vector<int> triangleGroups(mymesh.n_faces());
+    for (const auto& fh : mymesh.faces())
+    {
+        auto fv_it = mymesh.cfv_iter(fh);
+        for (int k = 0; k < 3; ++k, ++fv_it)
+            indices[fh.idx() * 3 + k] = fv_it->idx();
+        triangleGroups[fh.idx()] = mymesh.property(clusterGroupIndexPropHandle, mymesh.halfedge_handle(fh)) - 1;
+    }
+
+    simplifier.setMesh(points.data(), static_cast<uint32_t>(mymesh.n_vertices()), indices.data(), static_cast<uint32_t>(mymesh.n_faces()));
+    simplifier.setTriangleGroups(triangleGroups, static_cast<uint32_t>(clusterGroups.size()));
+    for (uint32_t i = 0; i < clusterGroups.size(); ++i)
+    {
+        size_t currTargetFaceNum = simplifier.liveTriangleCount() - static_cast<uint32_t>(clusterGroups[i].localFaceNum) * (1.0f - percentage);
+#if SIMPLIFICATION_DEBUG
+        std::cout << "Cluster group: " << i << " Face num: " << currTargetFaceNum << std::endl;
+#endif
+        clusterGroups[i].qemError = simplifier.simplifyGroup(i, currTargetFaceNum);
+#if SIMPLIFICATION_DEBUG
+        std::cout << "Total error: " << clusterGroups[i].qemError << std::endl;
+        std::cout << "NUM FACES AFTER: " << simplifier.liveTriangleCount() << std::endl;
+#endif
+    }
+
+    // Rebuild in place, clean() keeps the cluster group property and the status attributes
+    std::vector<uint32_t> vertexRemap;
+    simplifier.compact(vertexRemap, indices, triangleGroups);
+    mymesh.clean();
+    mymesh.reserve(vertexRemap.size(), indices.size() / 2, indices.size() / 3);
+    for (uint32_t oldIdx : vertexRemap)
+    {
+        auto vh = mymesh.add_vertex(MyMesh::Point(points[oldIdx * 3], points[oldIdx * 3 + 1], points[oldIdx * 3 + 2]));
+        mymesh.set_normal(vh, normals[oldIdx]);
+        mymesh.set_texcoord2D(vh, texcoords[oldIdx]);
+    }
+    size_t splitFaces = 0, droppedFaces = 0;
+    for (size_t t = 0; t < triangleGroups.size(); ++t)
+    {
+        std::vector<MyMesh::VertexHandle> faceVertices = {
+            mymesh.vertex_handle(indices[t * 3]), mymesh.vertex_handle(indices[t * 3 + 1]), mymesh.vertex_handle(indices[t * 3 + 2])
+        };
+        auto fh = mymesh.add_face(faceVertices);
+        if (!fh.is_valid())
+        {
+            // The collapses only approximate OpenMesh's legality test, keep a face that would make a complex edge on
+            // its own vertices as the chunk weld does (NaniteMesh::buildChunkLevels())
+            for (auto& vh : faceVertices)
+            {
+                auto copy = mymesh.add_vertex(mymesh.point(vh));
+                mymesh.set_normal(copy, mymesh.normal(vh));
+                mymesh.set_texcoord2D(copy, mymesh.texcoord2D(vh));
+                vh = copy;
+            }
+            fh = mymesh.add_face(faceVertices);
+            splitFaces++;
+        }
+        if (!fh.is_valid())
+        {
+            droppedFaces++;
+            continue;
+        }
+        for (auto fh_it = mymesh.fh_iter(fh); fh_it.is_valid(); ++fh_it)
+            mymesh.property(clusterGroupIndexPropHandle, *fh_it) = triangleGroups[t] + 1;
+    }
+    if (splitFaces > 0)
+        std::cout << "Simplified mesh: " << splitFaces << " non-manifold faces split off, " << droppedFaces << " dropped" << std::endl;
+    std::cout << "NUM FACES AFTER: " << mymesh.n_faces() << std::endl;
+}
+
+void Mesh::simplifyMeshOpenMesh(MyMesh & mymesh)
 {
     OpenMesh::Decimater::DecimaterT<MyMesh> decimater(mymesh);
     OpenMesh::Decimater::MyModQuadricT<MyMesh>::Handle hModQuadric;
@@ -317,7 +406,7 @@ void Mesh::simplifyMesh(MyMesh & mymesh)
 
     size_t original_faces = mymesh.n_faces();
     std::cout << "NUM FACES BEFORE: " << original_faces << std::endl;
-    const double percentage = 0.5;
+    const double percentage = LOD_SIMPLIFY_RATIO;
 
     auto currTargetFaceNum = mymesh.n_faces();
     for (uint32_t i = 0; i < clusterGroups.size(); ++i)
@@ -552,41 +641,6 @@ void Mesh::calcSurfaceArea(Cluster& cluster)
 	}
 }
 
-json Mesh::toJson()
-{
-    json result = {
-        {"clusterNum", clusterNum},
-        {"triangleClusterIndex", triangleClusterIndex},
-        {"clusterColorAssignment", clusterColorAssignment},
-        {"clusterGroupIndex", clusterGroupIndex},
-        {"triangleIndicesSortedByClusterIdx", triangleIndicesSortedByClusterIdx},
-        {"triangleVertexIndicesSortedByClusterIdx", triangleVertexIndicesSortedByClusterIdx}
-    };
-
-    for (size_t i = 0; i < clusters.size(); i++)
-    {
-        result["clusters"].push_back(clusters[i].toJson());
-    }
-    return result;
-}
-
-void Mesh::fromJson(const json& j)
-{
-    clusterNum = j["clusterNum"].get<int>();
-    clusterColorAssignment = j["clusterColorAssignment"].get<std::unordered_map<int, int>>();
-    triangleClusterIndex = j["triangleClusterIndex"].get<std::vector<int>>();
-    clusterGroupIndex = j["clusterGroupIndex"].get<std::vector<int>>();
-    triangleIndicesSortedByClusterIdx = j["triangleIndicesSortedByClusterIdx"].get<std::vector<uint32_t>>();
-    triangleVertexIndicesSortedByClusterIdx = j["triangleVertexIndicesSortedByClusterIdx"].get<std::vector<uint32_t>>();
-    
-    clusters.resize(clusterNum);
-    for (size_t i = 0; i < clusters.size(); i++)
-    {
-        clusters[i].fromJson(j["clusters"][i]);
-    }
-}
-
-
 void Mesh::generateClusterGroup()
 {
     MetisGraph clusterMetisGraph;
@@ -681,185 +735,6 @@ void Mesh::generateClusterGroup()
 
 }
 
-void Mesh::initVertexBuffer(){
-    for (MyMesh::FaceIter f_it = mesh.faces_begin(); f_it != mesh.faces_end(); ++f_it) {
-        MyMesh::FaceHandle face = *f_it;
-        for (MyMesh::FaceVertexIter fv_it = mesh.cfv_iter(face); fv_it.is_valid(); ++fv_it) {
-            MyMesh::VertexHandle vertex = *fv_it;
-            vkglTF::Vertex v;
-            v.pos = glm::vec3(mesh.point(vertex)[0], mesh.point(vertex)[1], mesh.point(vertex)[2]);
-            v.normal = glm::vec3(mesh.normal(vertex)[0], mesh.normal(vertex)[1], mesh.normal(vertex)[2]);
-            v.uv = glm::vec2(mesh.texcoord2D(vertex)[0], mesh.texcoord2D(vertex)[1]);
-            // TODO: v.tangent not assigned. How to assign?
-            // Assign clusterId and clusterGroupId
-            int clusterId = triangleClusterIndex[face.idx()];
-            v.joint0 = glm::vec4(nodeColors[clusterColorAssignment[clusterId]], clusterId);
-            
-            //int clusterGroupId = clusterGroupIndex[clusterId];
-            //// Skip coloring clusterGroupGraph for now, it requires extra work. Modulo seems fine for graph coloring
-            //v.weight0 = glm::vec4(nodeColors[clusterGroupId % nodeColors.size()], clusterGroupId);
-            //v.weight0 = glm::vec4(nodeColors[face.idx() % nodeColors.size()], clusterGroupId);
-            vertexBuffer.push_back(v);
-        }
-    }
-}
-
-
-void Mesh::initUniqueVertexBuffer() {
-    for (const auto & vertex: mesh.vertices())
-    {
-        vkglTF::Vertex v;
-        v.pos = glm::vec3(mesh.point(vertex)[0], mesh.point(vertex)[1], mesh.point(vertex)[2]);
-        v.normal = glm::vec3(mesh.normal(vertex)[0], mesh.normal(vertex)[1], mesh.normal(vertex)[2]);
-        v.uv = glm::vec2(mesh.texcoord2D(vertex)[0], mesh.texcoord2D(vertex)[1]);
-        v.joint0 = glm::vec4(lodLevel);
-        v.weight0 = glm::vec4(0.0f);
-        uniqueVertexBuffer.emplace_back(v);
-    }
-}
-
-
-void Mesh::createVertexBuffer(vks::VulkanDevice* device, VkQueue transferQueue) {
-    size_t vertexBufferSize = vertexBuffer.size() * sizeof(vkglTF::Vertex);
-    vertices.count = static_cast<uint32_t>(vertexBuffer.size());
-
-    assert(vertexBufferSize > 0);
-
-    struct StagingBuffer {
-        VkBuffer buffer;
-        VkDeviceMemory memory;
-    } vertexStaging;
-
-    // Create staging buffers
-    // Vertex data
-    VK_CHECK_RESULT(device->createBuffer(
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        vertexBufferSize,
-        &vertexStaging.buffer,
-        &vertexStaging.memory,
-        vertexBuffer.data()));
-
-    // Create device local buffers
-    // Vertex buffer
-    VK_CHECK_RESULT(device->createBuffer(
-        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        vertexBufferSize,
-        &vertices.buffer,
-        &vertices.memory));
-
-    // Copy from staging buffers
-    VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-    VkBufferCopy copyRegion = {};
-
-    copyRegion.size = vertexBufferSize;
-    vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1, &copyRegion);
-
-    device->flushCommandBuffer(copyCmd, transferQueue, true);
-
-    vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-    vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
-}
-
-
-void Mesh::createUniqueVertexBuffer(vks::VulkanDevice* device, VkQueue transferQueue) {
-    size_t vertexBufferSize = uniqueVertexBuffer.size() * sizeof(vkglTF::Vertex);
-    uniqueVertices.count = static_cast<uint32_t>(uniqueVertexBuffer.size());
-
-    assert(vertexBufferSize > 0);
-
-    struct StagingBuffer {
-        VkBuffer buffer;
-        VkDeviceMemory memory;
-    } vertexStaging;
-
-    // Create staging buffers
-    // Vertex data
-    VK_CHECK_RESULT(device->createBuffer(
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        vertexBufferSize,
-        &vertexStaging.buffer,
-        &vertexStaging.memory,
-        uniqueVertexBuffer.data()));
-
-    // Create device local buffers
-    // Vertex buffer
-    VK_CHECK_RESULT(device->createBuffer(
-        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        vertexBufferSize,
-        &uniqueVertices.buffer,
-        &uniqueVertices.memory));
-
-    // Copy from staging buffers
-    VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-    VkBufferCopy copyRegion = {};
-
-    copyRegion.size = vertexBufferSize;
-    vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, uniqueVertices.buffer, 1, &copyRegion);
-
-    device->flushCommandBuffer(copyCmd, transferQueue, true);
-
-    vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-    vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
-}
-
-void Mesh::createSortedIndexBuffer(vks::VulkanDevice* device, VkQueue transferQueue)
-{
-    size_t indexBufferSize = triangleVertexIndicesSortedByClusterIdx.size() * sizeof(uint32_t);
-    sortedIndices.count = static_cast<uint32_t>(triangleVertexIndicesSortedByClusterIdx.size());
-
-    assert(indexBufferSize > 0);
-
-    struct StagingBuffer {
-        VkBuffer buffer;
-        VkDeviceMemory memory;
-    } indexStaging;
-
-    // Create staging buffers
-    // Vertex data
-    VK_CHECK_RESULT(device->createBuffer(
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        indexBufferSize,
-        &indexStaging.buffer,
-        &indexStaging.memory,
-        triangleVertexIndicesSortedByClusterIdx.data()));
-
-    // Create device local buffers
-    // Vertex buffer
-    VK_CHECK_RESULT(device->createBuffer(
-        VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        indexBufferSize,
-        &sortedIndices.buffer,
-        &sortedIndices.memory));
-
-    // Copy from staging buffers
-    VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-    VkBufferCopy copyRegion = {};
-
-    copyRegion.size = indexBufferSize;
-    vkCmdCopyBuffer(copyCmd, indexStaging.buffer, sortedIndices.buffer, 1, &copyRegion);
-
-    device->flushCommandBuffer(copyCmd, transferQueue, true);
-
-    vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
-    vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
-}
-
-void Mesh::draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet) 
-{
-    const VkDeviceSize offsets[1] = { 0 };
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
-    vkCmdDraw(commandBuffer, vertices.count, 1, 0, 0);
-}
-
 void Mesh::createBVH()
 {
     buildBVH();
@@ -890,12 +765,12 @@ void Mesh::buildBVH()
 
     //std::vector<uint32_t> originalClusterGroupIndex;
     std::vector<uint32_t> clusterGroupIndex;
+    // Cluster group AABBs come from computeClusterGroupAABBs(), the geometry is gone by now
     for (int i = 0; i < clusterGroups.size(); ++i)
     {
         //originalClusterGroupIndex.push_back(i);
         clusterGroupIndex.push_back(i);
         auto& clusterGroup = clusterGroups[i];
-        getClusterGroupAABB(clusterGroup);
         //std::cout << "clusterGroupIndex: " << i << 
         //    " clusterGroup.pMin: " << clusterGroup.pMin.x << " " << clusterGroup.pMin.y << " " << clusterGroup.pMin.z <<
         //    " clusterGroup.pMax: " << clusterGroup.pMax.x << " " << clusterGroup.pMax.y << " " << clusterGroup.pMax.z <<
@@ -1220,44 +1095,163 @@ void Mesh::traverseBVH()
 	}
 }
 
-void Mesh::getClusterGroupAABB(ClusterGroup& clusterGroup)
+void Mesh::computeClusterGroupAABBs()
 {
-    glm::vec3 min = glm::vec3(FLT_MAX);
-	glm::vec3 max = glm::vec3(-FLT_MAX);
-    for (MyMesh::FaceIter face_it = mesh.faces_begin(); face_it != mesh.faces_end(); ++face_it) {
-        MyMesh::FaceHandle fh = *face_it;
-        auto clusterIdx = triangleClusterIndex[fh.idx()];
+    // Runs on the flattened geometry, `mesh` may already hold the next level
+    const auto& lod = clusteredLOD;
+    for (size_t i = 0; i < lod.triangleIndicesSortedByClusterIdx.size(); i++) {
+        auto clusterIdx = lod.triangleClusterIndex[lod.triangleIndicesSortedByClusterIdx[i]];
         auto clusterGroupIdx = clusterGroupIndex[clusterIdx];
 
         glm::vec3 pMinWorld, pMaxWorld;
-        glm::vec3 p0, p1, p2;
-        MyMesh::FaceVertexIter fv_it = mesh.fv_iter(fh);
+        const glm::vec3& p0 = lod.positions[lod.triangleVertexIndicesSortedByClusterIdx[i * 3]];
+        const glm::vec3& p1 = lod.positions[lod.triangleVertexIndicesSortedByClusterIdx[i * 3 + 1]];
+        const glm::vec3& p2 = lod.positions[lod.triangleVertexIndicesSortedByClusterIdx[i * 3 + 2]];
 
-        // Get the positions of the three vertices
-        auto point0 = mesh.point(*fv_it);
-        ++fv_it;
-        auto point1 = mesh.point(*fv_it);
-        ++fv_it;
-        auto point2 = mesh.point(*fv_it);
+        getTriangleAABB(p0, p1, p2, pMinWorld, pMaxWorld);
+
+        clusterGroups[clusterGroupIdx].mergeAABB(pMinWorld, pMaxWorld);
+    }
+}
+
+void Mesh::flattenGeometry()
+{
+    auto& lod = clusteredLOD;
+    lod.lodLevel = lodLevel;
+    lod.positions.resize(mesh.n_vertices());
+    lod.normals.resize(mesh.n_vertices());
+    lod.uvs.resize(mesh.n_vertices());
+    for (const auto& vh : mesh.vertices())
+    {
+        const auto& p = mesh.point(vh);
+        const auto& n = mesh.normal(vh);
+        const auto& uv = mesh.texcoord2D(vh);
+        lod.positions[vh.idx()] = glm::vec3(p[0], p[1], p[2]);
+        lod.normals[vh.idx()] = glm::vec3(n[0], n[1], n[2]);
+        lod.uvs[vh.idx()] = glm::vec2(uv[0], uv[1]);
+    }
+    lod.triangleClusterIndex = std::move(triangleClusterIndex);
+    lod.triangleIndicesSortedByClusterIdx = std::move(triangleIndicesSortedByClusterIdx);
+    lod.triangleVertexIndicesSortedByClusterIdx = std::move(triangleVertexIndicesSortedByClusterIdx);
+    vertexCount = static_cast<uint32_t>(lod.vertexCount());
+    triangleCount = static_cast<uint32_t>(lod.triangleCount());
+}
+
+void Mesh::releaseGeometry()
+{
+    clusteredLOD = ClusteredLOD();
+    triangleGraph = Graph();
+    clusterGraph = Graph();
+    std::vector<ClusterGroup>().swap(oldClusterGroups);
+    std::vector<bool>().swap(isEdgeVertices);
+    std::vector<bool>().swap(isLastLODEdgeVertices);
+    for (auto& clusterGroup : clusterGroups)
+    {
+        // Keep clusterIndices, qemError and the AABB, the next level and the BVH only need those
+        std::unordered_set<MyMesh::FaceHandle>().swap(clusterGroup.clusterGroupFaces);
+        std::vector<MyMesh::HalfedgeHandle>().swap(clusterGroup.clusterGroupHalfedges);
+        std::vector<idx_t>().swap(clusterGroup.localTriangleClusterIndices);
+        clusterGroup.localTriangleGraph = Graph();
+        std::vector<uint32_t>().swap(clusterGroup.triangleIndicesLocalGlobalMap);
+        std::unordered_map<uint32_t, uint32_t>().swap(clusterGroup.triangleIndicesGlobalLocalMap);
+    }
+}
 
-        p0[0] = point0[0];
-        p0[1] = point0[1];
-        p0[2] = point0[2];
+void Mesh::flattenClusterTable()
+{
+    auto& lod = clusteredLOD;
+    lod.lodLevel = lodLevel;
+    lod.clusterNum = clusterNum;
+    lod.clusters = std::move(clusters);
+    lod.clusterColorAssignment = std::move(clusterColorAssignment);
+    lod.clusterGroupIndex = std::move(clusterGroupIndex);
+}
 
-        p1[0] = point1[0];
-        p1[1] = point1[1];
-        p1[2] = point1[2];
+void Mesh::releaseClusterTable()
+{
+    // Only rootBVHNode and clusterNum are left for NaniteMesh::flattenBVH
+    clusteredLOD = ClusteredLOD();
+    std::vector<ClusterGroup>().swap(clusterGroups);
+    std::unordered_map<int, int>().swap(clusterGroupColorAssignment);
+}
 
-        p2[0] = point2[0];
-        p2[1] = point2[1];
-        p2[2] = point2[2];
+void Mesh::appendChunk(Mesh& chunkLOD, uint32_t parentClusterOffset, uint32_t childClusterOffset)
+{
+    const uint32_t clusterOffset = clusterNum;
+    const uint32_t clusterGroupOffset = clusterGroupNum;
+    const uint32_t triangleOffset = triangleCount;
 
-        p0 = glm::vec3(glm::vec4(p0, 1.0f));
-        p1 = glm::vec3(glm::vec4(p1, 1.0f));
-        p2 = glm::vec3(glm::vec4(p2, 1.0f));
+    for (auto& cluster : chunkLOD.clusters)
+    {
+        cluster.clusterGroupIndex += clusterGroupOffset;
+        for (auto& idx : cluster.triangleIndices) idx += triangleOffset;
+        for (auto& idx : cluster.parentClusterIndices) idx += parentClusterOffset;
+        for (auto& idx : cluster.childClusterIndices) idx += childClusterOffset;
+        clusters.emplace_back(std::move(cluster));
+    }
+    for (auto& clusterGroup : chunkLOD.clusterGroups)
+    {
+        for (auto& idx : clusterGroup.clusterIndices) idx += clusterOffset;
+        clusterGroups.emplace_back(std::move(clusterGroup));
+    }
+    for (auto idx : chunkLOD.clusterGroupIndex)
+    {
+        clusterGroupIndex.push_back(idx + clusterGroupOffset);
+    }
+    for (const auto& [clusterIdx, color] : chunkLOD.clusterColorAssignment)
+    {
+        clusterColorAssignment[clusterIdx + clusterOffset] = color;
+    }
 
-        getTriangleAABB(p0, p1, p2, pMinWorld, pMaxWorld);
+    clusterNum = clusterOffset + chunkLOD.clusterNum;
+    clusterGroupNum = clusterGroupOffset + chunkLOD.clusterGroupNum;
+    vertexCount += chunkLOD.vertexCount;
+    triangleCount += chunkLOD.triangleCount;
+    chunkLOD.releaseClusterTable();
+    std::vector<Cluster>().swap(chunkLOD.clusters);
+}
 
-        clusterGroups[clusterGroupIdx].mergeAABB(pMinWorld, pMaxWorld);
+json Mesh::buildStateToJson() const
+{
+    json result = {
+        {"lodLevel", lodLevel},
+        {"clusterNum", clusterNum},
+        {"clusterGroupNum", clusterGroupNum},
+        {"vertexCount", vertexCount},
+        {"triangleCount", triangleCount},
+        {"clusterColorAssignment", clusterColorAssignment},
+        {"clusterGroupIndex", clusterGroupIndex},
+        {"clusters", json::array()},
+        {"clusterGroups", json::array()}
+    };
+    for (const auto& cluster : clusters)
+    {
+        result["clusters"].push_back(cluster.toBuildJson());
     }
-}
\ No newline at end of file
+    for (const auto& clusterGroup : clusterGroups)
+    {
+        result["clusterGroups"].push_back(clusterGroup.toBuildJson());
+    }
+    return result;
+}
+
+void Mesh::buildStateFromJson(const json& j)
+{
+    lodLevel = j["lodLevel"].get<uint32_t>();
+    clusterNum = j["clusterNum"].get<int>();
+    clusterGroupNum = j["clusterGroupNum"].get<int>();
+    vertexCount = j["vertexCount"].get<uint32_t>();
+    triangleCount = j["triangleCount"].get<uint32_t>();
+    clusterColorAssignment = j["clusterColorAssignment"].get<std::unordered_map<int, int>>();
+    clusterGroupIndex = j["clusterGroupIndex"].get<std::vector<idx_t>>();
+    clusters.resize(j["clusters"].size());
+    for (size_t i = 0; i < clusters.size(); i++)
+    {
+        clusters[i].fromBuildJson(j["clusters"][i]);
+    }
+    clusterGroups.resize(j["clusterGroups"].size());
+    for (size_t i = 0; i < clusterGroups.size(); i++)
+    {
+        clusterGroups[i].fromBuildJson(j["clusterGroups"][i]);
+    }
+}
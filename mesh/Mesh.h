@@ -23,14 +23,21 @@
 #include "ClusterGroup.h"
 #include "NaniteBVH.h"
 #include "utils.h"
+#include "QEMSimplifier.h"
+#include "ClusteredLOD.h"
 
 #define SIMPLIFICATION_DEBUG 0
 
+/*
+	Build-time state of one LOD level. It works on the builder's OpenMesh copy, which is simplified in place
+	into the next level once flattenGeometry() has captured this level, so no mesh is ever copied between levels.
+	The level is written to the cache through clusteredLOD in two steps, geometry first and the cluster table
+	once its parents are known, and released after each step.
+*/
 struct Mesh {
 
 public:
-	//Mesh();
-	//Mesh(const char* filename);
+	explicit Mesh(MyMesh& mesh) : mesh(mesh) {}
 	void assignTriangleClusterGroup(Mesh& lastLOD);
 	std::vector<ClusterGroup> oldClusterGroups;
 
@@ -43,16 +50,33 @@ public:
 	void colorClusterGraph();
 	void colorClusterGroupGraph();
 
-	void simplifyMesh(MyMesh& mymesh);
+	void simplifyMesh(MyMesh& mymesh, QEMSimplifier& simplifier);
+	// Reference DecimaterT path, kept to compare against QEMSimplifier
+	void simplifyMeshOpenMesh(MyMesh& mymesh);
 
 	void getBoundingSphere(Cluster & cluster);
 	void calcBoundingSphereFromChildren(Cluster& cluster, Mesh& lastLOD);
 	void calcSurfaceArea(Cluster& cluster);
 
-	json toJson();
-	void fromJson(const json& j);
-
-	MyMesh mesh;
+	// Streaming build, see NaniteMesh::generateNaniteInfo()
+	// Copies vertex attributes and moves the triangle streams into clusteredLOD, `mesh` may be simplified into the next level afterwards
+	void flattenGeometry();
+	// Frees geometry, graphs and per face data once clusteredLOD is written, clusters and cluster group summaries stay
+	void releaseGeometry();
+	// Moves the cluster table into clusteredLOD, only valid once the next level has assigned parents and the BVH is built
+	void flattenClusterTable();
+	void releaseClusterTable();
+	ClusteredLOD clusteredLOD;
+	uint32_t vertexCount = 0, triangleCount = 0; // Size of the level, kept after releaseGeometry()
+
+	// Out-of-core build: appends the cluster table and cluster groups of the same level of a chunk, see NaniteMesh::buildChunkLevels()
+	// Offsets are the sizes of the chunks appended before, parent and child offsets those of the levels above and below
+	void appendChunk(Mesh& chunkLOD, uint32_t parentClusterOffset, uint32_t childClusterOffset);
+	// Level state after releaseGeometry(), chunk jobs hand it from the worker to the coordinator (ChunkJob.h)
+	json buildStateToJson() const;
+	void buildStateFromJson(const json& j);
+
+	MyMesh& mesh;
 	OpenMesh::HPropHandleT<int32_t> clusterGroupIndexPropHandle;
 	glm::mat4 modelMatrix;
 
@@ -62,14 +86,14 @@ public:
 	
 	uint32_t lodLevel = -1;
 	Graph triangleGraph;
-	int clusterNum;
+	int clusterNum = 0;
 	const int targetClusterSize = CLUSTER_TARGET_SIZE;
 	std::vector<idx_t> triangleClusterIndex;
 	std::unordered_map<int, int> clusterColorAssignment;
 	std::vector<Cluster> clusters;
 
 	Graph clusterGraph;
-	int clusterGroupNum;
+	int clusterGroupNum = 0;
 	const int targetClusterGroupSize = CLUSTER_GROUP_TARGET_SIZE;
 	std::vector<idx_t> clusterGroupIndex;
 	std::unordered_map<int, int> clusterGroupColorAssignment;
@@ -78,48 +102,17 @@ public:
 	std::vector<bool> isEdgeVertices;
 	std::vector<bool> isLastLODEdgeVertices;
 
-	const std::vector<glm::vec3> nodeColors =
-	{
-		glm::vec3(1.0f, 0.0f, 0.0f), // red
-		glm::vec3(0.0f, 1.0f, 0.0f), // green
-		glm::vec3(0.0f, 0.0f, 1.0f), // blue
-		glm::vec3(1.0f, 1.0f, 0.0f), // yellow
-		glm::vec3(1.0f, 0.0f, 1.0f), // purple
-		glm::vec3(0.0f, 1.0f, 1.0f), // cyan
-		glm::vec3(1.0f, 0.5f, 0.0f), // orange
-		glm::vec3(0.5f, 1.0f, 0.0f), // lime
-	};
-
-	void initVertexBuffer();
-	void initUniqueVertexBuffer();
-	void createVertexBuffer(vks::VulkanDevice* device, VkQueue transferQueue);
-	void createUniqueVertexBuffer(vks::VulkanDevice* device, VkQueue transferQueue);
-	void createSortedIndexBuffer(vks::VulkanDevice* device, VkQueue transferQueue);
-	void draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet);
-	std::vector<glm::vec3> positions;
-
 	std::shared_ptr<NaniteBVHNode> rootBVHNode;
 	void createBVH();
 	void buildBVH();
 	void updateBVHError();
 	void updateBVHErrorCore(std::shared_ptr<NaniteBVHNode> currNode, float& currNodeError, glm::vec4& currNodeBoundingSphere);
 	void traverseBVH();
-	void getClusterGroupAABB(ClusterGroup & clusterGroup);
+	void computeClusterGroupAABBs();
 	void flattenBVH();
 
 	std::vector<NaniteBVHNodeInfo> flattenedBVHNodes;
 	std::vector<uint32_t> levelCounts; // Store the counts of nodes in each level
-
-
-	vks::VulkanDevice* device;
-	const vkglTF::Model* model;
-	vkglTF::Model::Vertices vertices;
-	vkglTF::Model::Vertices uniqueVertices;
-	vkglTF::Model::Indices sortedIndices;
-	std::vector<uint32_t> indexBuffer;
-	std::vector<vkglTF::Vertex> vertexBuffer;
-	std::vector<vkglTF::Vertex> uniqueVertexBuffer;
-	std::vector<vkglTF::Primitive> primitives;
 };
 
 
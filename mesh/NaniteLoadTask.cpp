@@ -0,0 +1,40 @@
+#include "NaniteLoadTask.h"
+
+#include "NaniteMesh.h"
+
+const char* NaniteProgress::stageName() const
+{
+    switch (stage.load())
+    {
+    case STAGE_WAITING: return "Waiting for cache";
+    case STAGE_BUILDING: return "Building";
+    case STAGE_LOADING: return "Loading";
+    case STAGE_DONE: return "Done";
+    case STAGE_CANCELLED: return "Cancelled";
+    }
+    return "";
+}
+
+NaniteLoadTask::NaniteLoadTask(NaniteMesh& naniteMesh, const std::string& filepath, bool useCache)
+    : naniteMesh(naniteMesh)
+{
+    naniteMesh.progress = &progress;
+    thread = std::thread([this, filepath, useCache]() {
+        bool initialized = this->naniteMesh.initNaniteInfo(filepath, useCache);
+        progress.stage = initialized ? NaniteProgress::STAGE_DONE : NaniteProgress::STAGE_CANCELLED;
+    });
+}
+
+NaniteLoadTask::~NaniteLoadTask()
+{
+    cancel();
+    wait();
+}
+
+void NaniteLoadTask::wait()
+{
+    if (thread.joinable()) {
+        thread.join();
+        naniteMesh.progress = nullptr;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+struct NaniteMesh;
+
+// What NaniteMesh::initNaniteInfo() is doing, written by the thread that runs it and read by anyone else
+struct NaniteProgress {
+	enum Stage { STAGE_WAITING, STAGE_BUILDING, STAGE_LOADING, STAGE_DONE, STAGE_CANCELLED };
+	std::atomic<int> stage = STAGE_WAITING;
+	std::atomic<float> fraction = 0.0f; // Of the current stage
+	// The levels are loaded coarsest first, the coarsest one is copied here before coarsestLODReady is set and
+	// never changed afterwards, so it can be drawn while the task still owns the mesh
+	std::vector<glm::vec3> coarsestPositions;
+	std::vector<glm::vec3> coarsestNormals;
+	std::vector<uint32_t> coarsestIndices;
+	std::atomic<bool> coarsestLODReady = false;
+	std::atomic<bool> cancelRequested = false;
+
+	const char* stageName() const;
+};
+
+/*
+	Runs NaniteMesh::initNaniteInfo() on a background thread, so the caller can keep presenting frames while a cache
+	is built or loaded. Until finished() the mesh belongs to the task, only the copy of its coarsest level in progress
+	can be read once progress.coarsestLODReady is set, to draw it as a placeholder.
+	A cancelled build leaves no cache behind and the mesh empty.
+*/
+class NaniteLoadTask {
+public:
+	NaniteLoadTask(NaniteMesh& naniteMesh, const std::string& filepath, bool useCache = true);
+	~NaniteLoadTask(); // Cancels and waits for the thread
+	NaniteLoadTask(const NaniteLoadTask&) = delete;
+	NaniteLoadTask& operator=(const NaniteLoadTask&) = delete;
+
+	void cancel() { progress.cancelRequested = true; }
+	void wait();
+	bool finished() const { return progress.stage == NaniteProgress::STAGE_DONE || progress.stage == NaniteProgress::STAGE_CANCELLED; }
+	bool succeeded() const { return progress.stage == NaniteProgress::STAGE_DONE; }
+
+	NaniteProgress progress;
+
+private:
+	NaniteMesh& naniteMesh;
+	std::thread thread;
+};
@@ -81,11 +81,11 @@ void NaniteMesh::flattenDAG()
 	}
 }
 
-void NaniteMesh::flattenBVH()
+void NaniteMesh::flattenBVH(const std::vector<Mesh>& buildLODs)
 {
 	virtualBVHRootNode = std::make_shared<NaniteBVHNode>();
 	virtualBVHRootNode->nodeStatus = NaniteBVHNodeStatus::VIRTUAL_NODE;
-	for (const auto & mesh: meshes)
+	for (const auto & mesh: buildLODs)
 	{
 		virtualBVHRootNode->children.push_back(mesh.rootBVHNode);
 	}
@@ -150,9 +150,9 @@ void NaniteMesh::flattenBVH()
 	//}
 
 	uint32_t totalClusterNum = 0;
-	for (size_t i = 0; i < meshes.size(); i++)
+	for (size_t i = 0; i < buildLODs.size(); i++)
 	{
-		totalClusterNum += meshes[i].clusterNum;
+		totalClusterNum += buildLODs[i].clusterNum;
 	}
 	std::unordered_set<uint32_t> clusterIndexSet;
 	for (size_t i = 0; i < totalClusterNum; i++)
@@ -233,130 +233,383 @@ void NaniteMesh::flattenBVH()
 	ASSERT(clusterIndexSet.size() == 0, "Some cluster indices are not assigned to any node!");
 }
 
-void NaniteMesh::generateNaniteInfo() {
+namespace {
+	std::string lodFilename(const std::string& filepath, size_t lodLevel, const char* ext)
+	{
+		return filepath + "LOD_" + std::to_string(lodLevel) + ext;
+	}
+
+	void createCacheDirectory(const std::string& filepath)
+	{
+		std::filesystem::path directoryPath(filepath);
+
+		try {
+			if (std::filesystem::create_directory(directoryPath)) {
+				std::cout << "Directory created successfully." << std::endl;
+			}
+			else {
+				std::cout << "Failed to create directory or it already exists. Dir:" << filepath << std::endl;
+			}
+		}
+		catch (const std::filesystem::filesystem_error& e) {
+			ASSERT(0, "Error creating directory");
+		}
+	}
+
+	void logMemory(const std::string& label)
+	{
+		const double mb = 1.0 / (1024.0 * 1024.0);
+		std::cout << label << ": RSS " << std::fixed << std::setprecision(1) << getCurrentRSS() * mb
+			<< " MB, peak RSS " << getPeakRSS() * mb << " MB" << std::endl;
+	}
+}
+
+void NaniteMesh::finishLOD(Mesh& meshLOD, const std::string& cachePath)
+{
+	// Parent clusters are assigned, errors and bounding spheres of the level are final
+	meshLOD.createBVH();
+	meshLOD.flattenClusterTable();
+	std::string output_filename = lodFilename(cachePath, meshLOD.lodLevel, ".json");
+	std::ofstream file(output_filename);
+	ASSERT(file.is_open(), "Error opening file for serialization");
+	file << meshLOD.clusteredLOD.toJson().dump();
+	file.close();
+	meshLOD.releaseClusterTable();
+}
+
+Mesh& NaniteMesh::buildLevel(std::vector<Mesh>& levels, MyMesh& mymesh, OpenMesh::HPropHandleT<int32_t> propHandle,
+	QEMSimplifier& simplifier, const std::string& geometryFilename, bool alwaysSimplify)
+{
+	Mesh& meshLOD = levels.emplace_back(mymesh);
+	meshLOD.lodLevel = levels.size() - 1;
+	meshLOD.clusterGroupIndexPropHandle = propHandle;
+	if (levels.size() > 1) {
+		auto& lastMeshLOD = levels[levels.size() - 2];
+		meshLOD.oldClusterGroups.resize(lastMeshLOD.clusterGroupNum);
+		meshLOD.assignTriangleClusterGroup(lastMeshLOD);
+	}
+	else {
+		meshLOD.buildTriangleGraph();
+		meshLOD.generateCluster();
+	}
+	// Generate cluster group by partitioning cluster graph
+	meshLOD.buildClusterGraph();
+	meshLOD.colorClusterGraph(); // Cluster graph is needed to assign adjacent cluster different colors
+	meshLOD.generateClusterGroup();
+
+	// Keep the geometry of this level before mymesh is simplified into the next one
+	meshLOD.flattenGeometry();
+	meshLOD.computeClusterGroupAABBs();
+	if (alwaysSimplify || meshLOD.clusterGroupNum > 1) 
+	{
+		meshLOD.simplifyMesh(mymesh, simplifier);
+	}
+	ASSERT(meshLOD.clusteredLOD.writeGeometry(geometryFilename), "Error exporting mesh");
+	meshLOD.releaseGeometry();
+	return meshLOD;
+}
+
+bool NaniteMesh::generateNaniteInfo(const std::string& cachePath) {
+	/*
+		Streaming build, each level is written to the cache as soon as its data is final:
+			- geometry and triangle streams (LOD_i.bin) right after the level is simplified into the next one
+			- the cluster table (LOD_i.json) and the BVH once the next level has assigned parent clusters
+		Between the two only the clusters and cluster group summaries are kept, so peak memory is about
+		the working mesh plus two levels instead of every level of the DAG.
+		With chunkTriangleBudget set the lower levels are built chunk by chunk first, see buildChunkLevels().
+	*/
+	createCacheDirectory(cachePath);
+
+	// The only OpenMesh instance of the build, every LOD is built on it and then simplified in place into the next one
 	MyMesh mymesh;
-	vkglTFMeshToOpenMesh(mymesh, *vkglTFMesh);
-	int clusterGroupNum = -1;
-	int target = 6;
-	int currFaceNum = -1;
+	int target = LOD_TARGET_NUM;
 	/*if (!OpenMesh::IO::read_mesh(mymesh, "D:\\AndrewChen\\CIS565\\Vulcanite\\assets\\models\\bunny.obj")) {
 		ASSERT(0, "failed to load mesh");
 	}*/
 	// Add a customized property to store clusterGroupIndex of last level of detail
 	mymesh.add_property(clusterGroupIndexPropHandle);
+	QEMSimplifier simplifier; // Scratch buffers are reused by every LOD
+	std::vector<Mesh> buildLODs; // Build time state of each LOD, shrinks to the BVH once the level is written
+	buildLODs.reserve(target);
+
+	std::vector<std::vector<uint32_t>> chunks;
+	if (chunkTriangleBudget > 0) {
+		splitIntoChunks(chunks);
+	}
+	if (chunks.size() > 1) {
+		// Halve until the whole level fits the budget again, at least one level is built in core on the merged mesh
+		size_t totalTriangleNum = 0;
+		for (const auto& chunk : chunks) totalTriangleNum += chunk.size();
+		uint32_t chunkLevels = 1;
+		while ((totalTriangleNum >> chunkLevels) > chunkTriangleBudget && chunkLevels + 1 < target) chunkLevels++;
+		buildChunkLevels(chunks, chunkLevels, mymesh, buildLODs, cachePath);
+		target -= chunkLevels;
+		if (isCancelled()) return false;
+	}
+	else {
+		vkglTFMeshToOpenMesh(mymesh, *vkglTFMesh);
+		logMemory("Input mesh loaded");
+	}
+
+	int clusterGroupNum = -1;
 	do
 	{
 		// For each lod mesh
-		Mesh meshLOD;
-		meshLOD.mesh = mymesh;
-		meshLOD.lodLevel = lodNums;
-		meshLOD.clusterGroupIndexPropHandle = clusterGroupIndexPropHandle;
-		if (clusterGroupNum > 0) {
-			meshLOD.oldClusterGroups.resize(clusterGroupNum);
-			meshLOD.assignTriangleClusterGroup(meshes.back()); 
-		}
-		else {
-			meshLOD.buildTriangleGraph();
-			meshLOD.generateCluster();
-		}
-		if (meshes.size() > 0) {
-			auto& lastMeshLOD = meshes[meshes.size() - 1];
-			// Maintain DAG
-
-		}
-		// Generate cluster group by partitioning cluster graph
-		meshLOD.buildClusterGraph();
-		meshLOD.colorClusterGraph(); // Cluster graph is needed to assign adjacent cluster different colors
-		meshLOD.generateClusterGroup();
-		currFaceNum = meshLOD.mesh.n_faces();
+		Mesh& meshLOD = buildLevel(buildLODs, mymesh, clusterGroupIndexPropHandle, simplifier, lodFilename(cachePath, buildLODs.size(), ".bin"), false);
 		clusterGroupNum = meshLOD.clusterGroupNum;
-
-		mymesh = meshLOD.mesh;
-		if (clusterGroupNum > 1) 
-		{
-			meshLOD.simplifyMesh(mymesh); 
-			// Save LOD mesh for debugging
-			//{
-			//	std::string output_filename = "meshLOD_" + std::to_string(lodNums) + ".obj";
-			//
-			//	// Export the mesh to the specified file
-			//	if (!OpenMesh::IO::write_mesh(mymesh, output_filename)) {
-			//		std::cerr << "Error exporting mesh to " << output_filename << std::endl;
-			//	}
-			//}
+		if (buildLODs.size() > 1) {
+			finishLOD(buildLODs[buildLODs.size() - 2], cachePath);
 		}
-		meshes.emplace_back(meshLOD);
-		std::cout << "LOD " << lodNums++ << " generated" << std::endl;
-
+		logMemory("LOD " + std::to_string(lodNums++) + " generated");
+		reportProgress(NaniteProgress::STAGE_BUILDING, static_cast<float>(lodNums) / LOD_TARGET_NUM);
+		if (isCancelled()) return false;
 	} 
 	//while (clusterGroupNum != 1 &&
 	//  mymesh.n_faces() != currFaceNum // Decimation no longer decrease faces
 	//); 
 	while (--target); // Only do one time for testing
+	finishLOD(buildLODs.back(), cachePath);
 	// Linearize DAG
 	
 	//flattenDAG();
-	clusterIndexOffset.resize(meshes.size(), 0);
-	for (size_t i = 0; i < meshes.size(); i++)
+	clusterIndexOffset.resize(buildLODs.size(), 0);
+	for (size_t i = 1; i < buildLODs.size(); i++)
 	{
-		if (i != 0) {
-			clusterIndexOffset[i] = clusterIndexOffset[i - 1] + meshes[i - 1].clusterNum;
-		}
-		meshes[i].createBVH();
+		clusterIndexOffset[i] = clusterIndexOffset[i - 1] + buildLODs[i - 1].clusterNum;
 	}
 	// Linearize BVH
-	flattenBVH();
-	
-	// Save mesh for debugging
-	//{
-	//	std::string output_filename = "output.obj";
-	//
-	//	// Export the mesh to the specified file
-	//	if (!OpenMesh::IO::write_mesh(mymesh, output_filename)) {
-	//		std::cerr << "Error exporting mesh to " << output_filename << std::endl;
-	//	}
-	//}
+	flattenBVH(buildLODs);
+	logMemory("BVH generated");
+	return true;
 }
 
-void NaniteMesh::serialize(const std::string& filepath)
+void NaniteMesh::splitIntoChunks(std::vector<std::vector<uint32_t>>& chunks)
 {
-	std::filesystem::path directoryPath(filepath);
+	const auto& indexBuffer = vkglTFModel->indexBuffer;
+	const auto& vertexBuffer = vkglTFModel->vertexBuffer;
+	std::vector<uint32_t> triangles; // First index of every triangle in vkglTFModel->indexBuffer
+	std::vector<glm::vec3> centroids;
+	for (auto& prim : vkglTFMesh->primitives)
+	{
+		for (uint32_t i = prim->firstIndex; i + 3 <= prim->firstIndex + prim->indexCount; i += 3)
+		{
+			triangles.push_back(i);
+			centroids.push_back((vertexBuffer[indexBuffer[i]].pos + vertexBuffer[indexBuffer[i + 1]].pos + vertexBuffer[indexBuffer[i + 2]].pos) / 3.0f);
+		}
+	}
+	std::vector<uint32_t> order(triangles.size());
+	for (size_t i = 0; i < order.size(); i++) order[i] = i;
 
-	try {
-		if (std::filesystem::create_directory(directoryPath)) {
-			std::cout << "Directory created successfully." << std::endl;
+	// Median splits along the longest axis of the centroid bounds until every chunk fits the budget
+	std::stack<std::pair<size_t, size_t>> ranges;
+	ranges.push({ 0, order.size() });
+	while (!ranges.empty())
+	{
+		auto [begin, end] = ranges.top();
+		ranges.pop();
+		if (end - begin <= chunkTriangleBudget) {
+			auto& chunk = chunks.emplace_back();
+			chunk.reserve(end - begin);
+			for (size_t i = begin; i < end; i++) chunk.push_back(triangles[order[i]]);
+			continue;
 		}
-		else {
-			std::cout << "Failed to create directory or it already exists. Dir:" << filepath << std::endl;
+		glm::vec3 pMin(FLT_MAX), pMax(-FLT_MAX);
+		for (size_t i = begin; i < end; i++)
+		{
+			pMin = glm::min(pMin, centroids[order[i]]);
+			pMax = glm::max(pMax, centroids[order[i]]);
+		}
+		glm::vec3 extent = pMax - pMin;
+		int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+		size_t mid = begin + (end - begin) / 2;
+		std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](uint32_t a, uint32_t b) {
+			return centroids[a][axis] < centroids[b][axis];
+			});
+		ranges.push({ mid, end });
+		ranges.push({ begin, mid });
+	}
+	std::cout << "Split " << triangles.size() << " triangles into " << chunks.size() << " chunks" << std::endl;
+}
+
+void NaniteMesh::chunkToJob(ChunkJob& job, const std::vector<uint32_t>& chunkTriangles)
+{
+	// Same vertices as vkglTFPrimitiveToOpenMesh(), but only the ones referenced by the chunk
+	std::unordered_map<uint32_t, uint32_t> vertexRemap;
+	job.indices.reserve(chunkTriangles.size() * 3);
+	for (uint32_t firstIndex : chunkTriangles)
+	{
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			uint32_t vertexIndex = vkglTFModel->indexBuffer[firstIndex + k];
+			auto it = vertexRemap.find(vertexIndex);
+			if (it == vertexRemap.end()) {
+				auto& vert = vkglTFModel->vertexBuffer[vertexIndex];
+				job.positions.push_back(vert.pos);
+				job.normals.push_back(vert.normal);
+				job.uvs.push_back(vert.uv);
+				it = vertexRemap.emplace(vertexIndex, static_cast<uint32_t>(job.positions.size() - 1)).first;
+			}
+			job.indices.push_back(it->second);
 		}
 	}
-	catch (const std::filesystem::filesystem_error& e) {
-		ASSERT(0, "Error creating directory");
+}
+
+void NaniteMesh::buildChunkLevels(const std::vector<std::vector<uint32_t>>& chunks, uint32_t chunkLevels, MyMesh& mymesh,
+	std::vector<Mesh>& buildLODs, const std::string& cachePath)
+{
+	/*
+		Out-of-core build of the lower levels:
+			1. every chunk is written as a job (ChunkJob.h) and built on its own for chunkLevels levels, in this process or
+			   in worker processes (buildWorkers). Its border is a mesh boundary and therefore locked by the simplifier,
+			   so neighbouring chunks still match after simplification
+			2. the levels of all chunks are concatenated into the global levels (cluster tables in memory, geometry
+			   file by file), cluster and cluster group indices are shifted by the chunks before
+			3. the simplified chunks are welded along their borders into mymesh, which continues in core
+		The coordinator only holds one chunk at a time, jobs hand their results over through files in the cache directory.
+	*/
+	std::vector<ChunkJob> jobs(chunks.size());
+	for (size_t c = 0; c < chunks.size(); c++)
+	{
+		ChunkJob& job = jobs[c];
+		job.directory = cachePath;
+		job.chunkIndex = c;
+		job.chunkLevels = chunkLevels;
+		chunkToJob(job, chunks[c]);
+		job.cacheKey = job.computeCacheKey(contentHash);
+		ASSERT(job.write(), "Error writing chunk job");
+		// Only the file names are needed from here on
+		std::vector<glm::vec3>().swap(job.positions);
+		std::vector<glm::vec3>().swap(job.normals);
+		std::vector<glm::vec2>().swap(job.uvs);
+		std::vector<uint32_t>().swap(job.indices);
 	}
+	runChunkJobs(jobs, buildWorkers);
+	std::vector<ChunkJobResult> results(chunks.size());
+	for (size_t c = 0; c < chunks.size(); c++)
+	{
+		ASSERT(readChunkJobResult(jobs[c], results[c]), "Missing chunk job result");
+	}
+	logMemory(std::to_string(chunks.size()) + " chunks built");
 
-	for (size_t i = 0; i < meshes.size(); i++)
+	// Concatenate the chunks level by level
+	std::vector<uint32_t> lastClusterOffsets(chunks.size(), 0);
+	for (uint32_t level = 0; level < chunkLevels; level++)
 	{
-		auto& mesh = meshes[i];
-		std::string output_filename = std::string(filepath) + "LOD_" + std::to_string(i) + ".obj";
-		// Export the mesh to the specified file
-		if (!OpenMesh::IO::write_mesh(mesh.mesh, output_filename, OpenMesh::IO::Options::VertexNormal  | OpenMesh::IO::Options::VertexTexCoord)) {
-			std::cerr << "Error exporting mesh to " << output_filename << std::endl;
+		std::vector<uint32_t> clusterOffsets(chunks.size(), 0), parentClusterOffsets(chunks.size(), 0);
+		for (size_t c = 1; c < chunks.size(); c++)
+		{
+			clusterOffsets[c] = clusterOffsets[c - 1] + results[c - 1].clusterNums[level];
+			if (level + 1 < chunkLevels) {
+				parentClusterOffsets[c] = parentClusterOffsets[c - 1] + results[c - 1].clusterNums[level + 1];
+			}
+		}
+
+		Mesh& meshLOD = buildLODs.emplace_back(mymesh);
+		meshLOD.lodLevel = level;
+		meshLOD.clusterGroupIndexPropHandle = clusterGroupIndexPropHandle;
+		std::vector<ClusteredLOD::GeometryPart> parts;
+		for (size_t c = 0; c < chunks.size(); c++)
+		{
+			std::ifstream file(jobs[c].levelFilename(level, ".json"));
+			ASSERT(file.is_open(), "Error opening chunk level");
+			json j;
+			file >> j;
+			Mesh chunkLOD(mymesh);
+			chunkLOD.buildStateFromJson(j);
+			meshLOD.appendChunk(chunkLOD, parentClusterOffsets[c], lastClusterOffsets[c]);
+			parts.push_back({ jobs[c].levelFilename(level, ".bin"), clusterOffsets[c] });
 		}
+		ASSERT(ClusteredLOD::mergeGeometry(parts, lodFilename(cachePath, level, ".bin")), "Error merging chunk geometry");
+		lastClusterOffsets = clusterOffsets;
+
+		// Parents of every level but the last chunk level were assigned inside the chunks
+		if (level + 1 < chunkLevels) {
+			finishLOD(meshLOD, cachePath);
+		}
+		logMemory("LOD " + std::to_string(lodNums++) + " generated");
+		reportProgress(NaniteProgress::STAGE_BUILDING, static_cast<float>(lodNums) / LOD_TARGET_NUM);
 	}
 
-	json result;
-	for (size_t i = 0; i < meshes.size(); i++)
+	// Weld the chunks into the working mesh, vertices on chunk borders were locked and match exactly
+	std::map<std::array<float, 8>, MyMesh::VertexHandle> borderVertices;
+	uint32_t clusterGroupOffset = 0;
+	for (size_t c = 0; c < chunks.size(); c++)
 	{
-		result["mesh"][i] = meshes[i].toJson();
+		ChunkTop top;
+		ASSERT(top.read(jobs[c].topFilename()), "Error reading chunk top level");
+		std::vector<MyMesh::VertexHandle> vhandles(top.positions.size());
+		for (size_t v = 0; v < top.positions.size(); v++)
+		{
+			const auto& p = top.positions[v];
+			const auto& n = top.normals[v];
+			const auto& uv = top.uvs[v];
+			auto addVertex = [&]() {
+				auto vhandle = mymesh.add_vertex(MyMesh::Point(p.x, p.y, p.z));
+				mymesh.set_normal(vhandle, MyMesh::Normal(n.x, n.y, n.z));
+				mymesh.set_texcoord2D(vhandle, MyMesh::TexCoord2D(uv.x, uv.y));
+				return vhandle;
+			};
+			if (top.isBorder[v]) {
+				std::array<float, 8> key = { p.x, p.y, p.z, n.x, n.y, n.z, uv.x, uv.y };
+				auto it = borderVertices.find(key);
+				vhandles[v] = it != borderVertices.end() ? it->second : (borderVertices[key] = addVertex());
+			}
+			else {
+				vhandles[v] = addVertex();
+			}
+		}
+		for (size_t f = 0; f < top.clusterGroups.size(); f++)
+		{
+			std::vector<MyMesh::VertexHandle> face_vhandles = {
+				vhandles[top.indices[3 * f]], vhandles[top.indices[3 * f + 1]], vhandles[top.indices[3 * f + 2]]
+			};
+			auto newFace = mymesh.add_face(face_vhandles);
+			if (!newFace.is_valid()) {
+				// Welding would create a complex edge, keep this face on its own vertices
+				for (auto& vhandle : face_vhandles)
+				{
+					auto copy = mymesh.add_vertex(mymesh.point(vhandle));
+					mymesh.set_normal(copy, mymesh.normal(vhandle));
+					mymesh.set_texcoord2D(copy, mymesh.texcoord2D(vhandle));
+					vhandle = copy;
+				}
+				newFace = mymesh.add_face(face_vhandles);
+			}
+			for (auto fh_it = mymesh.fh_iter(newFace); fh_it.is_valid(); ++fh_it)
+			{
+				mymesh.property(clusterGroupIndexPropHandle, *fh_it) = top.clusterGroups[f] + clusterGroupOffset + 1;
+			}
+		}
+		clusterGroupOffset += results[c].clusterGroupNums.back();
+		jobs[c].removeFiles();
 	}
+	mymesh.request_face_status();
+	mymesh.request_edge_status();
+	mymesh.request_vertex_status();
+	std::cout << "Merged chunks into " << mymesh.n_faces() << " faces" << std::endl;
+}
+
+void NaniteMesh::serialize(const std::string& filepath, const std::string& cacheKey)
+{
+	// The levels were written by generateNaniteInfo(), only the BVH is left
+	createCacheDirectory(filepath);
+
+	json result;
 	for (size_t i = 0; i < flattenedBVHNodeInfos.size(); i++)
 	{
 		result["flattenedBVHNodeInfos"][i] = flattenedBVHNodeInfos[i].toJson();
 	}
 	result["flattenedBVHNodeCounts"] = flattenedBVHNodeInfos.size();
 	result[cache_time_key] = std::time(nullptr);
+	result[cache_version_key] = cacheVersion;
+	result[cache_key_key] = cacheKey;
 	result["lodNums"] = lodNums;
 	result["sortedClusterIndices"] = sortedClusterIndices;
+	result["streamingPages"] = json::array();
+	for (const auto& page : streamingPages)
+	{
+		result["streamingPages"].push_back(page.toJson());
+	}
 
 	// Save the JSON data to a file
 	std::ofstream file(std::string(filepath) + "nanite_info.json");
@@ -369,26 +622,187 @@ void NaniteMesh::serialize(const std::string& filepath)
 	}
 }
 
-void NaniteMesh::deserialize(const std::string & filepath)
+bool NaniteMesh::loadLOD(ClusteredLOD& meshLOD, const std::string& filepath, uint32_t lodLevel)
 {
-	std::ifstream inputFile(std::string(filepath) + "nanite_info.json");
-
-	ASSERT(inputFile.is_open(), "Error opening file for deserialization");
+	std::ifstream inputFile(lodFilename(filepath, lodLevel, ".json"));
+	if (!inputFile.is_open()) return false;
 	json loadedJson;
 	inputFile >> loadedJson;
-		
-	lodNums = loadedJson["lodNums"].get<uint32_t>();
+	meshLOD.fromJson(loadedJson);
+	meshLOD.lodLevel = lodLevel;
+	return meshLOD.readGeometry(lodFilename(filepath, lodLevel, ".bin"));
+}
+
+bool NaniteMesh::loadLODs(const std::string& filepath)
+{
+	meshes.clear();
 	meshes.resize(lodNums);
-	for (int i = 0; i < lodNums; ++i) {
-		auto& meshLOD = meshes[i];
-		meshLOD.fromJson(loadedJson["mesh"][i]);
+	// Coarsest first, it is enough to draw something while the finer levels load
+	for (uint32_t loaded = 0; loaded < lodNums; loaded++)
+	{
+		uint32_t i = lodNums - 1 - loaded;
+		if (isCancelled()) return false;
+		if (!loadLOD(meshes[i], filepath, i)) {
+			std::cerr << "Failed to load " << lodFilename(filepath, i, "") << ", need to rebuild" << std::endl;
+			return false;
+		}
+		if (progress && !progress->coarsestLODReady) {
+			progress->coarsestPositions = meshes[i].positions;
+			progress->coarsestNormals = meshes[i].normals;
+			progress->coarsestIndices = meshes[i].triangleVertexIndicesSortedByClusterIdx;
+			progress->coarsestLODReady = true;
+		}
+		reportProgress(NaniteProgress::STAGE_LOADING, static_cast<float>(loaded + 1) / lodNums);
 
-		float percentage = static_cast<float>(i+1) / lodNums * 100.0;
 		std::cout << "\r";
-		std::cout << "[Loading] Mesh Info: " << std::fixed << std::setw(6) << std::setprecision(2) << percentage << "%";
+		float percentage = static_cast<float>(loaded + 1) / lodNums * 100.0;
+		std::cout << "[Loading] Mesh LOD: " << std::fixed << std::setw(6) << std::setprecision(2) << percentage << "%";
 		std::cout.flush();
 	}
 	std::cout << std::endl;
+	return true;
+}
+
+bool NaniteMesh::writeStreamingPages(const std::string& cachePath)
+{
+	streamingPages.clear();
+	std::ofstream file(cachePath + "pages.bin", std::ios::binary);
+	if (!file.is_open()) return false;
+	// The header is written again once the ranges are known
+	cacheLevels.assign(lodNums, CacheLevelRange());
+	CacheLevelRange::writeHeader(file, cacheLevels);
+
+	// Sorted triangle range of every mesh cluster, clusters of a level are contiguous in the sorted triangle stream
+	std::vector<uint32_t> lodClusterOffsets(lodNums + 1, 0);
+	for (uint32_t i = 0; i < lodNums; i++) lodClusterOffsets[i + 1] = lodClusterOffsets[i] + meshes[i].clusterNum;
+	std::vector<uint32_t> clusterTriangleStart(lodClusterOffsets.back(), 0);
+	std::vector<uint32_t> clusterTriangleCount(lodClusterOffsets.back(), 0);
+	for (uint32_t i = 0; i < lodNums; i++)
+	{
+		const auto& meshLOD = meshes[i];
+		for (uint32_t j = 0; j < meshLOD.triangleCount(); j++)
+		{
+			uint32_t clusterIdx = lodClusterOffsets[i] + meshLOD.triangleClusterIndex[meshLOD.triangleIndicesSortedByClusterIdx[j]];
+			if (clusterTriangleCount[clusterIdx]++ == 0) clusterTriangleStart[clusterIdx] = j;
+		}
+	}
+
+	StreamingPage page;
+	std::vector<uint32_t> pageVertices; // Vertices of the level, in page order
+	std::unordered_map<uint32_t, uint32_t> pageVertexMap;
+	uint32_t pageTriangles = 0;
+	uint64_t offset = CacheLevelRange::headerSize(lodNums);
+	auto flushPage = [&]() {
+		if (page.clusters.empty()) return;
+		const auto& meshLOD = meshes[page.lodLevel];
+		page.offset = offset;
+		page.size = StreamingPage::payloadSize(page.clusters.size(), pageVertices.size(), pageTriangles);
+		ASSERT(page.size <= STREAMING_PAGE_SIZE, "Streaming page overflow");
+
+		std::vector<uint32_t> words = { static_cast<uint32_t>(page.clusters.size()), static_cast<uint32_t>(pageVertices.size()), pageTriangles };
+		words.insert(words.end(), page.clusters.begin(), page.clusters.end());
+		uint32_t triangleOffset = 0;
+		for (uint32_t clusterIdx : page.clusters)
+		{
+			words.push_back(triangleOffset);
+			triangleOffset += clusterTriangleCount[clusterIdx];
+		}
+		words.push_back(triangleOffset);
+		file.write(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(uint32_t));
+		for (uint32_t v : pageVertices) file.write(reinterpret_cast<const char*>(&meshLOD.positions[v]), sizeof(glm::vec3));
+		for (uint32_t v : pageVertices) file.write(reinterpret_cast<const char*>(&meshLOD.normals[v]), sizeof(glm::vec3));
+		for (uint32_t v : pageVertices) file.write(reinterpret_cast<const char*>(&meshLOD.uvs[v]), sizeof(glm::vec2));
+		words.clear();
+		for (uint32_t clusterIdx : page.clusters)
+		{
+			uint32_t start = clusterTriangleStart[clusterIdx];
+			for (uint32_t j = start * 3; j < (start + clusterTriangleCount[clusterIdx]) * 3; j++)
+			{
+				words.push_back(pageVertexMap[meshLOD.triangleVertexIndicesSortedByClusterIdx[j]]);
+			}
+		}
+		file.write(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(uint32_t));
+
+		offset += page.size;
+		streamingPages.push_back(page);
+		page.clusters.clear();
+		pageVertices.clear();
+		pageVertexMap.clear();
+		pageTriangles = 0;
+	};
+
+	// Coarsest level first, the pages every cut needs are at the start of the file
+	for (int level = static_cast<int>(lodNums) - 1; level >= 0; level--)
+	{
+		const auto& meshLOD = meshes[level];
+		auto& levelRange = cacheLevels[lodNums - 1 - level];
+		levelRange.lodLevel = level;
+		levelRange.firstPage = static_cast<uint32_t>(streamingPages.size());
+		levelRange.pageOffset = offset;
+		levelRange.lodBytes = std::filesystem::file_size(lodFilename(cachePath, level, ".bin")) + std::filesystem::file_size(lodFilename(cachePath, level, ".json"));
+		for (const auto& node : flattenedBVHNodeInfos)
+		{
+			if (node.nodeStatus != NaniteBVHNodeStatus::LEAF || node.lodLevel != level) continue;
+			std::unordered_set<uint32_t> groupVertices;
+			uint32_t newVertices = 0, groupTriangles = 0;
+			for (int k = node.start; k < node.end; k++)
+			{
+				uint32_t clusterIdx = sortedClusterIndices[k];
+				uint32_t start = clusterTriangleStart[clusterIdx];
+				groupTriangles += clusterTriangleCount[clusterIdx];
+				for (uint32_t j = start * 3; j < (start + clusterTriangleCount[clusterIdx]) * 3; j++)
+				{
+					uint32_t v = meshLOD.triangleVertexIndicesSortedByClusterIdx[j];
+					if (groupVertices.insert(v).second && !pageVertexMap.count(v)) newVertices++;
+				}
+			}
+			uint32_t groupClusters = node.end - node.start;
+			if (page.lodLevel != static_cast<uint32_t>(level) || StreamingPage::payloadSize(page.clusters.size() + groupClusters,
+				pageVertices.size() + newVertices, pageTriangles + groupTriangles) > STREAMING_PAGE_SIZE) {
+				flushPage();
+			}
+			page.lodLevel = level;
+			for (int k = node.start; k < node.end; k++)
+			{
+				uint32_t clusterIdx = sortedClusterIndices[k];
+				uint32_t start = clusterTriangleStart[clusterIdx];
+				page.clusters.push_back(clusterIdx);
+				pageTriangles += clusterTriangleCount[clusterIdx];
+				for (uint32_t j = start * 3; j < (start + clusterTriangleCount[clusterIdx]) * 3; j++)
+				{
+					uint32_t v = meshLOD.triangleVertexIndicesSortedByClusterIdx[j];
+					if (pageVertexMap.emplace(v, static_cast<uint32_t>(pageVertices.size())).second) pageVertices.push_back(v);
+				}
+			}
+		}
+		flushPage();
+		levelRange.pageCount = static_cast<uint32_t>(streamingPages.size()) - levelRange.firstPage;
+		levelRange.pageBytes = offset - levelRange.pageOffset;
+	}
+	file.seekp(0);
+	CacheLevelRange::writeHeader(file, cacheLevels);
+	std::cout << "Packed " << lodClusterOffsets.back() << " clusters into " << streamingPages.size() << " streaming pages" << std::endl;
+	return file.good();
+}
+
+bool NaniteMesh::deserialize(const std::string & filepath, const std::string& cacheKey)
+{
+	std::ifstream inputFile(std::string(filepath) + "nanite_info.json");
+
+	ASSERT(inputFile.is_open(), "Error opening file for deserialization");
+	json loadedJson;
+	inputFile >> loadedJson;
+
+	if (!loadedJson.contains(cache_version_key) || loadedJson[cache_version_key].get<uint32_t>() != cacheVersion) {
+		std::cerr << "Cache version mismatch, need to rebuild" << std::endl;
+		return false;
+	}
+	if (!loadedJson.contains(cache_key_key) || loadedJson[cache_key_key].get<std::string>() != cacheKey) {
+		std::cerr << "Cache key mismatch, need to rebuild" << std::endl;
+		return false;
+	}
+		
+	lodNums = loadedJson["lodNums"].get<uint32_t>();
 
 	int flattenedBVHNodeCounts = loadedJson["flattenedBVHNodeCounts"].get<uint32_t>();
 	flattenedBVHNodeInfos.resize(flattenedBVHNodeCounts, NaniteBVHNodeInfo());
@@ -415,83 +829,220 @@ void NaniteMesh::deserialize(const std::string & filepath)
 		sortedClusterIndices.push_back(loadedJson["sortedClusterIndices"][i].get<uint32_t>());
 	}
 
-	for (size_t i = 0; i < lodNums; i++)
+	if (!CacheLevelRange::readHeader(filepath + "pages.bin", cacheLevels) || cacheLevels.size() != lodNums) {
+		std::cerr << "Invalid pages.bin header, need to rebuild" << std::endl;
+		return false;
+	}
+	streamingPages.resize(loadedJson["streamingPages"].size());
+	for (size_t i = 0; i < streamingPages.size(); i++)
 	{
-		std::string output_filename = std::string(filepath) + "LOD_" + std::to_string(i) + ".obj";
-		meshes[i].mesh.request_vertex_normals();
-		meshes[i].mesh.request_vertex_texcoords2D();
-		OpenMesh::IO::Options opt = OpenMesh::IO::Options::VertexNormal | OpenMesh::IO::Options::VertexTexCoord;
-		if (!OpenMesh::IO::read_mesh(meshes[i].mesh, output_filename, opt)) {
-			ASSERT(0, "failed to load mesh");
-		}
-		ASSERT(meshes[i].mesh.has_vertex_normals(), "mesh has no normals");
-		meshes[i].lodLevel = i;
-
-		std::cout << "\r";
-		float percentage = static_cast<float>(i+1) / lodNums * 100.0;
-		std::cout << "[Loading] Mesh LOD: " << std::fixed << std::setw(6) << std::setprecision(2) << percentage << "%";
-		std::cout.flush();
+		streamingPages[i].fromJson(loadedJson["streamingPages"][i]);
 	}
-	std::cout << std::endl;
+	cacheDirectory = filepath;
+
+	return loadLODs(filepath);
 }
 
-void NaniteMesh::initNaniteInfo(const std::string & filepath, bool useCache) {
-	bool hasCache = false;
-	bool hasInitialized = false;
-	std::string cachePath;
-	if (filepath.find_last_of(".") != std::string::npos) {
-		cachePath = filepath.substr(0, filepath.find_last_of('.')) + "_naniteCache\\";
-	}
-	else {
-		ASSERT(0, "Invalid file path, no ext");
+uint64_t NaniteMesh::computeCacheKey() const
+{
+	// Every vertex the mesh references, in index order, so other meshes sharing the glTF buffers do not change the key
+	uint64_t hash = hashBytes(nullptr, 0);
+	for (auto& prim : vkglTFMesh->primitives)
+	{
+		for (uint32_t i = prim->firstIndex; i < prim->firstIndex + prim->indexCount; i++)
+		{
+			const auto& vert = vkglTFModel->vertexBuffer[vkglTFModel->indexBuffer[i]];
+			hash = hashBytes(&vert.pos, sizeof(vert.pos), hash);
+			hash = hashBytes(&vert.normal, sizeof(vert.normal), hash);
+			hash = hashBytes(&vert.uv, sizeof(vert.uv), hash);
+		}
 	}
+	// Everything else that changes the output of the build
+	const double parameters[] = {
+		double(cacheVersion),
+		double(CLUSTER_TARGET_SIZE), double(CLUSTER_MAX_SIZE),
+		double(CLUSTER_GROUP_TARGET_SIZE), double(CLUSTER_GROUP_MAX_SIZE),
+		double(LOD_SIMPLIFY_RATIO), double(LOD_TARGET_NUM),
+		double(chunkTriangleBudget)
+	};
+	return hashBytes(parameters, sizeof(parameters), hash);
+}
+
+void NaniteMesh::reportProgress(int stage, float fraction)
+{
+	if (!progress) return;
+	progress->stage = stage;
+	progress->fraction = fraction;
+}
 
-	if (useCache) {
-		std::ifstream inputFile(cachePath + "nanite_info.json");
-		// TODO: Check cache time to see if cache needs to be rebuilt
-		if (inputFile.is_open()) {
-			deserialize(cachePath);
-			hasInitialized = true;
+bool NaniteMesh::isCancelled() const
+{
+	return progress && progress->cancelRequested;
+}
+
+namespace {
+	// Touches a held build lock from its own thread, so a build that spends hours in a single level or in chunk jobs
+	// is never mistaken for a crashed one
+	class BuildLockHeartbeat {
+	public:
+		BuildLockHeartbeat(const std::filesystem::path& lockPath, uint32_t staleLockSeconds)
+		{
+			auto interval = std::chrono::seconds(std::max<uint32_t>(staleLockSeconds / 4, 1));
+			thread = std::thread([this, lockPath, interval]() {
+				std::unique_lock<std::mutex> lock(mutex);
+				while (!stopped) {
+					std::error_code ec;
+					std::filesystem::last_write_time(lockPath, std::filesystem::file_time_type::clock::now(), ec);
+					stopCondition.wait_for(lock, interval, [this]() { return stopped; });
+				}
+			});
 		}
-		else {
-			std::cerr << "No cache, need to initialize from now" << std::endl;
+		~BuildLockHeartbeat()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopped = true;
+			}
+			stopCondition.notify_one();
+			thread.join();
 		}
-	}	
+	private:
+		std::mutex mutex;
+		std::condition_variable stopCondition;
+		bool stopped = false;
+		std::thread thread;
+	};
 
-	if (!hasInitialized) {
-		std::cerr << "Start building..." << std::endl;
-		generateNaniteInfo();
-		serialize(cachePath);
-		std::cout << cachePath << "nanite_info.json" << " generated" << std::endl;
-		//checkDeserializationResult(cachePath);
+	// Moves a stale lock out of the way under a name of its own. Only one of the processes that found it stale
+	// wins the rename, and the lock is put back if it was refreshed in between (taken over and held by someone else)
+	bool takeOverStaleLock(const std::filesystem::path& lockPath, uint32_t staleLockSeconds)
+	{
+		std::error_code ec;
+		auto now = std::filesystem::file_time_type::clock::now();
+		std::filesystem::path stalePath = lockPath;
+		stalePath += ".stale." + std::to_string(std::random_device()()) + std::to_string(now.time_since_epoch().count());
+		std::filesystem::rename(lockPath, stalePath, ec);
+		if (ec) return false;
+		auto age = now - std::filesystem::last_write_time(stalePath, ec);
+		if (ec || age <= std::chrono::seconds(staleLockSeconds)) {
+			std::filesystem::rename(stalePath, lockPath, ec);
+			return false;
+		}
+		std::filesystem::remove_all(stalePath, ec);
+		return true;
 	}
 }
 
-void NaniteMesh::checkDeserializationResult(const std::string& filepath)
-{
-	std::ifstream inputFile(std::string(filepath) + "nanite_info.json");
+bool NaniteMesh::initNaniteInfo(const std::string & filepath, bool useCache) {
+	/*
+		Caches live in <model>_naniteCache/<key>/, key being the hash of the mesh and the build parameters (computeCacheKey()),
+		so a cache is never used for a different mesh or configuration.
+		Only one process builds a key at a time, it holds <key>.lock (a directory, created atomically) and builds into
+		<key>.tmp/, which is renamed to <key>/ once nanite_info.json is written. Everyone else waits for the lock and loads
+		the published cache. The holder refreshes the lock from a heartbeat thread, a lock that was not refreshed for
+		staleLockSeconds belongs to a crashed build and is taken over.
+		Returns false only when cancelled through progress (NaniteLoadTask), the mesh is then left empty.
+	*/
+	ASSERT(filepath.find_last_of(".") != std::string::npos, "Invalid file path, no ext");
+	std::filesystem::path cacheRoot = filepath.substr(0, filepath.find_last_of('.')) + "_naniteCache";
+	char keyString[17];
+	contentHash = computeCacheKey();
+	std::snprintf(keyString, sizeof(keyString), "%016llx", static_cast<unsigned long long>(contentHash));
+	const std::string cacheKey = keyString;
+	const std::string cachePath = (cacheRoot / cacheKey / "").string();
+	const std::string buildPath = (cacheRoot / (cacheKey + ".tmp") / "").string();
+	const std::filesystem::path lockPath = cacheRoot / (cacheKey + ".lock");
+	std::filesystem::create_directories(cacheRoot);
 
-	ASSERT(inputFile.is_open(), "Error opening file for deserialization");
-	json loadedJson;
-	inputFile >> loadedJson;
+	auto resetInfo = [&]() {
+		lodNums = 0;
+		meshes.clear();
+		flattenedBVHNodeInfos.clear();
+		sortedClusterIndices.clear();
+		streamingPages.clear();
+		cacheLevels.clear();
+		cacheDirectory.clear();
+	};
+	auto loadCache = [&]() {
+		if (!std::filesystem::exists(cachePath + "nanite_info.json")) return false;
+		reportProgress(NaniteProgress::STAGE_LOADING, 0.0f);
+		if (deserialize(cachePath, cacheKey)) return true;
+		resetInfo();
+		return false;
+	};
 
-	lodNums = loadedJson["lodNums"].get<uint32_t>();
-	debugMeshes.resize(lodNums);
-	for (int i = 0; i < lodNums; ++i) {
-		auto& meshLOD = debugMeshes[i];
-		meshLOD.fromJson(loadedJson["mesh"][i]);
+	bool hasInitialized = useCache && loadCache();
+	if (!hasInitialized && useCache && !isCancelled()) {
+		std::cerr << "No cache for key " << cacheKey << ", need to initialize from now" << std::endl;
 	}
+	while (!hasInitialized) {
+		if (isCancelled()) return false;
+		std::error_code ec;
+		if (!std::filesystem::create_directory(lockPath, ec)) {
+			auto age = std::filesystem::file_time_type::clock::now() - std::filesystem::last_write_time(lockPath, ec);
+			if (!ec && age > std::chrono::seconds(staleLockSeconds)) {
+				if (takeOverStaleLock(lockPath, staleLockSeconds)) {
+					std::cerr << "Removed stale lock " << lockPath.string() << std::endl;
+				}
+				continue;
+			}
+			// Another process is building this key, its result is loaded once it lets go of the lock
+			reportProgress(NaniteProgress::STAGE_WAITING, 0.0f);
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+			if (!std::filesystem::exists(lockPath)) {
+				hasInitialized = loadCache();
+			}
+			continue;
+		}
 
-	for (size_t i = 0; i < lodNums; i++)
-	{
-		std::string output_filename = std::string(filepath) + "LOD_" + std::to_string(i) + ".obj";
-		debugMeshes[i].mesh.request_vertex_normals();
-		OpenMesh::IO::Options opt = OpenMesh::IO::Options::VertexNormal;
-		if (!OpenMesh::IO::read_mesh(debugMeshes[i].mesh, output_filename, opt)) {
-			ASSERT(0, "failed to load mesh");
+		{
+			BuildLockHeartbeat heartbeat(lockPath, staleLockSeconds);
+			// The cache may have been published while this process waited for the lock
+			hasInitialized = useCache && loadCache();
+			if (!hasInitialized && !isCancelled()) {
+				std::cerr << "Start building..." << std::endl;
+				reportProgress(NaniteProgress::STAGE_BUILDING, 0.0f);
+				std::filesystem::remove_all(buildPath, ec); // Left over by a crashed build
+				// The build released every level after writing it, the runtime levels come from the cache.
+				// Streaming pages are cut from the runtime levels, so they are written before publishing
+				bool built = generateNaniteInfo(buildPath);
+				if (built) {
+					reportProgress(NaniteProgress::STAGE_LOADING, 0.0f);
+					built = loadLODs(buildPath);
+					ASSERT(built || isCancelled(), "Failed to load the levels that were just built");
+				}
+				if (built) {
+					ASSERT(writeStreamingPages(buildPath), "Error writing streaming pages");
+					serialize(buildPath, cacheKey);
+					// Publish, a reader either sees no cache or a complete one
+					std::filesystem::remove_all(cachePath, ec);
+					std::filesystem::rename(buildPath, cachePath);
+					std::cout << cachePath << "nanite_info.json" << " generated" << std::endl;
+					cacheDirectory = cachePath;
+					hasInitialized = true;
+					//checkDeserializationResult(cachePath);
+				}
+				else {
+					std::filesystem::remove_all(buildPath, ec);
+				}
+			}
+		}
+		std::filesystem::remove_all(lockPath, ec);
+		if (!hasInitialized) {
+			resetInfo();
+			return false;
 		}
-		ASSERT(debugMeshes[i].mesh.has_vertex_normals(), "mesh has no normals");
-		debugMeshes[i].lodLevel = i;
+	}
+	return true;
+}
+
+void NaniteMesh::checkDeserializationResult(const std::string& filepath)
+{
+	debugMeshes.clear();
+	debugMeshes.resize(lodNums);
+	for (uint32_t i = 0; i < lodNums; i++)
+	{
+		ASSERT(loadLOD(debugMeshes[i], filepath, i), "failed to load mesh");
 	}
 
 	for (size_t i = 0; i < lodNums; i++)
@@ -508,16 +1059,14 @@ void NaniteMesh::checkDeserializationResult(const std::string& filepath)
 			TEST(cluster.boundingSphereCenter == debugCluster.boundingSphereCenter, "boundingSphereCenter match");
 			TEST(cluster.boundingSphereRadius == debugCluster.boundingSphereRadius, "boundingSphereRadius match");
 		}
-		TEST(mesh.mesh.n_faces() == debugMesh.mesh.n_faces(), "face size match");
-		TEST(mesh.mesh.n_vertices() == debugMesh.mesh.n_vertices(), "vertex size match");
-		for (const auto & vhandle: mesh.mesh.vertices())
+		TEST(mesh.triangleCount() == debugMesh.triangleCount(), "face size match");
+		TEST(mesh.vertexCount() == debugMesh.vertexCount(), "vertex size match");
+		TEST(mesh.triangleVertexIndicesSortedByClusterIdx == debugMesh.triangleVertexIndicesSortedByClusterIdx, "index stream match");
+		for (size_t v = 0; v < mesh.vertexCount(); v++)
 		{
-			auto& debugVhandle = debugMesh.mesh.vertex_handle(vhandle.idx());
-			//std::cout << "mesh normal: " << mesh.mesh.normal(vhandle)[0] << " " << mesh.mesh.normal(vhandle)[1] << " " << mesh.mesh.normal(vhandle)[2] << std::endl;
-			//std::cout << "debug normal: " << debugMesh.mesh.normal(debugVhandle)[0] << " " << debugMesh.mesh.normal(debugVhandle)[1] << " " << debugMesh.mesh.normal(debugVhandle)[2] << std::endl;
-			TEST((mesh.mesh.point(vhandle) - debugMesh.mesh.point(debugVhandle)).length() < 1e-5f, "vertex position match");
-			TEST((mesh.mesh.normal(vhandle) - debugMesh.mesh.normal(debugVhandle)).length() < 1e-5f, "vertex normal match");
-			//ASSERT((mesh.mesh.texcoord2D(vhandle) - debugMesh.mesh.texcoord2D(debugVhandle)).length() < 1e-5f, "vertex texcoord not match");
+			TEST(glm::length(mesh.positions[v] - debugMesh.positions[v]) < 1e-5f, "vertex position match");
+			TEST(glm::length(mesh.normals[v] - debugMesh.normals[v]) < 1e-5f, "vertex normal match");
+			TEST(glm::length(mesh.uvs[v] - debugMesh.uvs[v]) < 1e-5f, "vertex texcoord match");
 		}
 
 	}
@@ -539,38 +1088,16 @@ void NaniteMesh::buildClusterInfo()
 	size_t currClusterNum = 0, currTriangleNum = 0;
 	for (int i = 0; i < meshes.size(); i++)
 	{
-		auto& mesh = meshes[i].mesh;
-		for (MyMesh::FaceIter face_it = mesh.faces_begin(); face_it != mesh.faces_end(); ++face_it) {
-			MyMesh::FaceHandle fh = *face_it;
-			auto clusterIdx = meshes[i].triangleClusterIndex[fh.idx()] + currClusterNum;
+		const auto& positions = meshes[i].positions;
+		const auto& sortedVertexIndices = meshes[i].triangleVertexIndicesSortedByClusterIdx;
+		for (size_t j = 0; j < meshes[i].triangleIndicesSortedByClusterIdx.size(); j++) {
+			auto clusterIdx = meshes[i].triangleClusterIndex[meshes[i].triangleIndicesSortedByClusterIdx[j]] + currClusterNum;
 			auto& clusterI = clusterInfo[clusterIdx];
 
 			glm::vec3 pMinWorld, pMaxWorld;
-			glm::vec3 p0, p1, p2;
-			MyMesh::FaceVertexIter fv_it = mesh.fv_iter(fh);
-
-			// Get the positions of the three vertices
-			auto point0 = mesh.point(*fv_it);
-			++fv_it;
-			auto point1 = mesh.point(*fv_it);
-			++fv_it;
-			auto point2 = mesh.point(*fv_it);
-
-			p0[0] = point0[0];
-			p0[1] = point0[1];
-			p0[2] = point0[2];
-
-			p1[0] = point1[0];
-			p1[1] = point1[1];
-			p1[2] = point1[2];
-
-			p2[0] = point2[0];
-			p2[1] = point2[1];
-			p2[2] = point2[2];
-
-			p0 = glm::vec3(glm::vec4(p0, 1.0f));
-			p1 = glm::vec3(glm::vec4(p1, 1.0f));
-			p2 = glm::vec3(glm::vec4(p2, 1.0f));
+			glm::vec3 p0 = positions[sortedVertexIndices[j * 3]];
+			glm::vec3 p1 = positions[sortedVertexIndices[j * 3 + 1]];
+			glm::vec3 p2 = positions[sortedVertexIndices[j * 3 + 2]];
 
 			getTriangleAABB(p0, p1, p2, pMinWorld, pMaxWorld);
 
@@ -4,15 +4,28 @@
 #include <OpenMesh/Core/Mesh/TriMesh_ArrayKernelT.hh>
 #include <tinygltf/tiny_gltf.h>
 
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
 #include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_set>
 
 #include "Common.h"
 #include "Mesh.h"
+#include "ChunkJob.h"
+#include "NaniteLoadTask.h"
+#include "StreamingPage.h"
 
 struct NaniteMesh {
 	uint32_t lodNums = 0;
 	glm::mat4 modelMatrix;
-	std::vector<Mesh> meshes;
+	std::vector<ClusteredLOD> meshes; // Runtime representation of every LOD, OpenMesh is only used while building
 	OpenMesh::HPropHandleT<int32_t> clusterGroupIndexPropHandle;
 
 	/************ Load Mesh *************/
@@ -36,10 +49,25 @@ struct NaniteMesh {
 	/************ Flatten BVH *************/
 	std::shared_ptr<NaniteBVHNode> virtualBVHRootNode;
 	std::vector<NaniteBVHNodeInfo> flattenedBVHNodeInfos;
-	void flattenBVH();
+	void flattenBVH(const std::vector<Mesh>& buildLODs);
 
 	/************ Build Info *************/
-	void generateNaniteInfo();
+	// Writes every level to cachePath while building, see the comment in the implementation
+	bool generateNaniteInfo(const std::string& cachePath); // Returns false when cancelled
+	void finishLOD(Mesh& meshLOD, const std::string& cachePath);
+	static Mesh& buildLevel(std::vector<Mesh>& levels, MyMesh& mymesh, OpenMesh::HPropHandleT<int32_t> propHandle,
+		QEMSimplifier& simplifier, const std::string& geometryFilename, bool alwaysSimplify);
+
+	/************ Out-of-core Build *************/
+	// 0 builds in core. Otherwise the input is split into spatial chunks of at most this many triangles,
+	// the lower levels are built one chunk at a time and the chunks are merged once a level fits the budget
+	uint32_t chunkTriangleBudget = 0;
+	void splitIntoChunks(std::vector<std::vector<uint32_t>>& chunks);
+	// Chunks are built as jobs, in this process or in worker processes (see ChunkJob.h)
+	BuildWorkerOptions buildWorkers;
+	void chunkToJob(ChunkJob& job, const std::vector<uint32_t>& chunkTriangles);
+	void buildChunkLevels(const std::vector<std::vector<uint32_t>>& chunks, uint32_t chunkLevels, MyMesh& mymesh,
+		std::vector<Mesh>& buildLODs, const std::string& cachePath);
 
 	std::vector<ClusterInfo> clusterInfo;
 	std::vector<ErrorInfo> errorInfo;
@@ -47,11 +75,30 @@ struct NaniteMesh {
 	void buildClusterInfo();
 
 	/************ Serialization *************/
-	void serialize(const std::string& filepath);
-	void deserialize(const std::string& filepath);
-
-
-	void initNaniteInfo(const std::string& filepath, bool useCache = true);
+	void serialize(const std::string& filepath, const std::string& cacheKey);
+	bool deserialize(const std::string& filepath, const std::string& cacheKey); // Returns false if the cache was written by an older version or for another key
+	bool loadLOD(ClusteredLOD& meshLOD, const std::string& filepath, uint32_t lodLevel);
+	// Every level, coarsest first, the coarsest one is handed to the progress right away (NaniteProgress::coarsestLODReady)
+	bool loadLODs(const std::string& filepath);
+
+	/************ Streaming *************/
+	// Page table of pages.bin (StreamingPage.h), written from the loaded levels once they are built
+	std::vector<StreamingPage> streamingPages;
+	std::vector<CacheLevelRange> cacheLevels; // Header of pages.bin, coarsest level first
+	std::string cacheDirectory; // Cache the mesh was loaded from, with trailing separator
+	bool writeStreamingPages(const std::string& cachePath);
+
+
+	bool initNaniteInfo(const std::string& filepath, bool useCache = true);
+	// Set while a NaniteLoadTask runs initNaniteInfo() on another thread
+	NaniteProgress* progress = nullptr;
+	void reportProgress(int stage, float fraction);
+	bool isCancelled() const;
+	// Hash of the referenced geometry and every parameter of the build, names the cache directory
+	uint64_t computeCacheKey() const;
+	uint64_t contentHash = 0; // Cache key of the loaded mesh, identical meshes of different files share it (NaniteScene::addNaniteMesh)
+	// Builds of the same key in other processes wait on a lock, it is taken over when not refreshed for this long
+	uint32_t staleLockSeconds = 3600;
 	/*
 		What data structure should be used to store 
 		1. lods
@@ -70,16 +117,19 @@ struct NaniteMesh {
 
 	const char* filepath = nullptr;
 	const char* cache_time_key = "cache_time";
+	const char* cache_version_key = "cache_version";
+	const char* cache_key_key = "cache_key";
+	static constexpr uint32_t cacheVersion = 5; // Bump whenever the cache layout changes
 
-	std::vector<Mesh> debugMeshes;
+	std::vector<ClusteredLOD> debugMeshes;
 	void checkDeserializationResult(const std::string& filepath);
 
 	bool operator==(const NaniteMesh & other) const {
 		if (meshes.size() != other.meshes.size()) return false;
 		for (int i = 0; i < meshes.size(); i++)
 		{
-			if (meshes[i].mesh.n_vertices() != other.meshes[i].mesh.n_vertices()) return false;
-			if (meshes[i].mesh.n_faces() != other.meshes[i].mesh.n_faces()) return false;
+			if (meshes[i].vertexCount() != other.meshes[i].vertexCount()) return false;
+			if (meshes[i].triangleCount() != other.meshes[i].triangleCount()) return false;
 		}
 		return true;
 	}
@@ -1,10 +1,211 @@
 #include "NaniteScene.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <thread>
+
+#include "threadpool.hpp"
+
+namespace {
+    const uint32_t preparedSceneMagic = 0x50525056; // "VPRP"
+    const uint32_t preparedSceneVersion = 3;
+
+    /*
+        Prepared scene file, the header followed by everything createNaniteSceneInfo() builds, one section per array,
+        each at a 16 byte aligned offset:
+            SECTION_VERTICES          vkglTF::Vertex       the scene vertex buffer, empty for streamed scenes
+            SECTION_INDICES           uint32               the scene index buffer, empty for streamed scenes
+            SECTION_MESH_CLUSTERS     uint32               cluster count of every mesh
+            SECTION_CLUSTERS          ClusterInfo          clusterInfo
+            SECTION_ERRORS            ErrorInfo            errorInfo
+            SECTION_SORTED_CLUSTERS   uint32               sortedClusterIndices
+            SECTION_NODES             BVHNodeInfo          bvhNodeInfos
+            SECTION_BLOCKS            PreparedBlock        nodeBlocks without their arrays
+            SECTION_BLOCK_TRANSFORMS  mat4                 objectTransforms of every block, one after another
+            SECTION_BLOCK_DEPTHS      uint32               depthCounts, then depthLeafCounts of every block
+            SECTION_BLOCK_CULL_INFOS  BlockCullInfo        blockCullInfos
+            SECTION_COARSE_CUT        uvec2                coarseCutClusters
+            SECTION_OBJECTS           mat4                 modelMats
+            SECTION_ROOTS             uvec2                initNodeInfoIndices
+            SECTION_FIRST_OBJECTS     uint32               first object of every instance
+        A matching file replaces the whole build, the vertices and indices are copied from the mapping straight into
+        the staging buffers.
+    */
+    enum PreparedSection : uint32_t {
+        SECTION_VERTICES,
+        SECTION_INDICES,
+        SECTION_MESH_CLUSTERS,
+        SECTION_CLUSTERS,
+        SECTION_ERRORS,
+        SECTION_SORTED_CLUSTERS,
+        SECTION_NODES,
+        SECTION_BLOCKS,
+        SECTION_BLOCK_TRANSFORMS,
+        SECTION_BLOCK_DEPTHS,
+        SECTION_BLOCK_CULL_INFOS,
+        SECTION_COARSE_CUT,
+        SECTION_OBJECTS,
+        SECTION_ROOTS,
+        SECTION_FIRST_OBJECTS,
+        SECTION_COUNT
+    };
+
+    struct PreparedBlock {
+        uint32_t firstNode = 0;
+        uint32_t nodeCount = 0;
+        uint32_t rootCount = 0;
+        uint32_t indexCount = 0;
+        uint32_t clusterCount = 0;
+        uint32_t objectCount = 0;
+        uint32_t depthCount = 0;
+        uint32_t padding = 0;
+    };
+
+    struct PreparedSceneHeader {
+        uint32_t magic = preparedSceneMagic;
+        uint32_t version = preparedSceneVersion;
+        uint64_t key = 0; // NaniteScene::computeSceneKey()
+        uint64_t sectionOffsets[SECTION_COUNT] = {};
+        uint64_t sectionSizes[SECTION_COUNT] = {}; // Bytes
+
+        void layout()
+        {
+            auto align = [](uint64_t offset) { return (offset + 15) & ~uint64_t(15); };
+            uint64_t offset = align(sizeof(PreparedSceneHeader));
+            for (uint32_t section = 0; section < SECTION_COUNT; section++)
+            {
+                sectionOffsets[section] = offset;
+                offset = align(offset + sectionSizes[section]);
+            }
+        }
+    };
+
+    // Elements of a section of a prepared scene that NaniteScene::mapPreparedScene() accepted
+    template<typename T>
+    std::pair<const T*, size_t> preparedSection(const MappedFile& file, PreparedSection section)
+    {
+        PreparedSceneHeader header;
+        std::memcpy(&header, file.data(), sizeof(header));
+        return { reinterpret_cast<const T*>(file.data() + header.sectionOffsets[section]), header.sectionSizes[section] / sizeof(T) };
+    }
+}
+
+NaniteScene::NaniteScene() = default;
+
+NaniteScene::~NaniteScene() = default;
+
+// Runs job(i) for every i in [0, count) on up to one pool thread per hardware thread, pulling items until none is left.
+// The pool is started by the first call, later calls only queue one job per thread
+void NaniteScene::parallelFor(size_t count, const std::function<void(size_t)>& job)
+{
+    const uint32_t hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    uint32_t threadCount = static_cast<uint32_t>(std::min<size_t>(count, hardwareThreads));
+    if (threadCount <= 1) {
+        for (size_t i = 0; i < count; i++) job(i);
+        return;
+    }
+    if (!threadPool) {
+        threadPool = std::make_unique<vks::ThreadPool>();
+        threadPool->setThreadCount(hardwareThreads);
+    }
+    std::atomic<size_t> nextItem = 0;
+    for (uint32_t t = 0; t < threadCount; t++)
+    {
+        threadPool->threads[t]->addJob([&]() {
+            for (size_t i = nextItem++; i < count; i = nextItem++) job(i);
+        });
+    }
+    threadPool->wait();
+}
+
+uint32_t NaniteScene::addNaniteMesh(const std::string& meshName, NaniteMesh&& naniteMesh)
+{
+    uint32_t handle = static_cast<uint32_t>(naniteMeshes.size());
+    auto found = naniteMesh.contentHash ? naniteMeshHandles.find(naniteMesh.contentHash) : naniteMeshHandles.end();
+    if (found != naniteMeshHandles.end()) {
+        handle = found->second;
+        std::cout << meshName << " has the same content as mesh " << handle << ", sharing it" << std::endl;
+    }
+    else {
+        if (naniteMesh.contentHash) naniteMeshHandles[naniteMesh.contentHash] = handle;
+        naniteMeshes.emplace_back(std::move(naniteMesh));
+    }
+    naniteMeshSceneIndices[meshName] = handle;
+    return handle;
+}
+
+uint32_t NaniteScene::findNaniteMesh(const std::string& meshName) const
+{
+    auto found = naniteMeshSceneIndices.find(meshName);
+    ASSERT(found != naniteMeshSceneIndices.end(), "Unknown nanite mesh");
+    return found->second;
+}
+
+Instance& NaniteScene::addInstance(uint32_t meshHandle, const glm::mat4& transform)
+{
+    ASSERT(meshHandle < naniteMeshes.size(), "Invalid nanite mesh handle");
+    naniteObjects.emplace_back(&naniteMeshes[meshHandle], transform);
+    naniteObjects.back().meshHandle = meshHandle;
+    return naniteObjects.back();
+}
+
+uint32_t NaniteScene::addPrefab(const std::string& prefabName, const std::vector<PrefabMember>& members)
+{
+    ASSERT(!members.empty(), "Prefab " << prefabName << " has no members");
+    ASSERT(prefabIndices.find(prefabName) == prefabIndices.end(), "Prefab " << prefabName << " exists already");
+    uint32_t handle = static_cast<uint32_t>(prefabs.size());
+    for (const auto& member : members)
+    {
+        ASSERT(member.prefabHandle != -1 ? member.prefabHandle < handle : member.meshHandle < naniteMeshes.size(),
+            "Prefab members refer to meshes and to prefabs added before them");
+    }
+    prefabs.push_back({ members });
+    prefabIndices[prefabName] = handle;
+    return handle;
+}
+
+uint32_t NaniteScene::findPrefab(const std::string& prefabName) const
+{
+    auto found = prefabIndices.find(prefabName);
+    ASSERT(found != prefabIndices.end(), "Unknown prefab");
+    return found->second;
+}
+
+Instance& NaniteScene::addPrefabInstance(uint32_t prefabHandle, const glm::mat4& transform)
+{
+    ASSERT(prefabHandle < prefabs.size(), "Invalid prefab handle");
+    naniteObjects.emplace_back(nullptr, transform);
+    naniteObjects.back().prefabHandle = prefabHandle;
+    return naniteObjects.back();
+}
+
+uint32_t NaniteScene::blockHandle(const Instance& instance) const
+{
+    return instance.prefabHandle != -1 ? static_cast<uint32_t>(naniteMeshes.size()) + instance.prefabHandle : instance.meshHandle;
+}
+
 void NaniteScene::createNaniteSceneInfo(vks::VulkanDevice* device, VkQueue transferQueue)
 {
+    for (auto& naniteObject : naniteObjects)
+    {
+        if (naniteObject.prefabHandle == -1) naniteObject.referenceMesh = &naniteMeshes[naniteObject.meshHandle];
+    }
+    if (!preparedSceneFile.empty() && mapPreparedScene(preparedSceneFile)) {
+        std::cout << "Scene info read from " << preparedSceneFile << std::endl;
+    }
 	createVertexIndexBuffer(device, transferQueue);
 	createClusterInfos(device, transferQueue);
 	createBVHNodeInfos(device, transferQueue);
+    const bool prepared = preparedScene != nullptr;
+    preparedScene.reset();
+    if (!preparedSceneFile.empty() && !prepared && !writePreparedScene(preparedSceneFile)) {
+        std::cerr << "Failed to write the prepared scene " << preparedSceneFile << std::endl;
+    }
     for (size_t i = 0; i < depthCounts.size(); i++)
     {
         std::cout << "Depth " << i << " has " << depthCounts[i] << " nodes." << std::endl;
@@ -17,85 +218,90 @@ void NaniteScene::createNaniteSceneInfo(vks::VulkanDevice* device, VkQueue trans
 
 void NaniteScene::createVertexIndexBuffer(vks::VulkanDevice* device, VkQueue transferQueue)
 {
-    std::vector<vkglTF::Vertex> vertexBuffer;
-    std::vector<uint32_t> indexBuffer;
-
-    int indexOffset = 0;
+    // Every LOD of every mesh is one segment of the scene buffers, its offsets are prefix sums of the sizes before it
+    struct Segment {
+        const ClusteredLOD* lod;
+        uint32_t firstVertex;
+        uint32_t firstIndex;
+    };
+    std::vector<Segment> segments;
+    uint32_t vertexCount = 0, indexCount = 0;
     indexOffsets.resize(naniteMeshes.size());
     indexCounts.resize(naniteMeshes.size());
+    firstIndices.resize(naniteMeshes.size());
 
-    for (int i = 0; i < naniteMeshes.size(); ++i) {
+    for (size_t i = 0; i < naniteMeshes.size(); ++i) {
         auto& naniteMesh = naniteMeshes[i];
-        // Init vertex & index buffer
-        auto& instance = Instance(&naniteMesh, glm::mat4(1.0f));
-        instance.initBufferForNaniteLODs();
-        vertexBuffer.insert(vertexBuffer.end(), instance.vertexBuffer.begin(), instance.vertexBuffer.end());
-        for (auto index : instance.indexBuffer) {
-            index += indexOffset;
-            indexBuffer.push_back(index);
+        indexOffsets[i] = vertexCount;
+        firstIndices[i] = indexCount;
+        for (const auto& lod : naniteMesh.meshes)
+        {
+            ASSERT(lod.vertexCount() > 0 && lod.triangleVertexIndicesSortedByClusterIdx.size() > 0, "Empty LOD");
+            segments.push_back({ &lod, vertexCount, indexCount });
+            vertexCount += static_cast<uint32_t>(lod.vertexCount());
+            indexCount += static_cast<uint32_t>(lod.triangleVertexIndicesSortedByClusterIdx.size());
         }
-        indexOffsets[i] = indexOffset;
-        indexCounts[i] = instance.indexBuffer.size();
-        indexOffset += instance.vertexBuffer.size();
-        maxLodLevelNum = glm::max(maxLodLevelNum, instance.referenceMesh->lodNums);
+        indexCounts[i] = indexCount - firstIndices[i];
+        maxLodLevelNum = glm::max(maxLodLevelNum, naniteMesh.lodNums);
     }
 
-    size_t vertexBufferSize = vertexBuffer.size() * sizeof(vkglTF::Vertex);
-    vertices.count = static_cast<uint32_t>(vertexBuffer.size());
+    size_t vertexBufferSize = vertexCount * sizeof(vkglTF::Vertex);
+    size_t indexBufferSize = indexCount * sizeof(uint32_t);
+    vertices.count = vertexCount;
+    indices.count = indexCount;
+    if (streamed) {
+        return;
+    }
 
     struct StagingBuffer {
         VkBuffer buffer;
         VkDeviceMemory memory;
     } vertexStaging, indexStaging;
 
-    // Create staging buffers
-// Vertex data
+    // Create staging buffers, filled in place below
     VK_CHECK_RESULT(device->createBuffer(
         VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
         vertexBufferSize,
         &vertexStaging.buffer,
-        &vertexStaging.memory,
-        vertexBuffer.data()));
+        &vertexStaging.memory));
+    VK_CHECK_RESULT(device->createBuffer(
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        indexBufferSize,
+        &indexStaging.buffer,
+        &indexStaging.memory));
+
+    void* mappedVertices = nullptr;
+    void* mappedIndices = nullptr;
+    VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, vertexStaging.memory, 0, VK_WHOLE_SIZE, 0, &mappedVertices));
+    VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, indexStaging.memory, 0, VK_WHOLE_SIZE, 0, &mappedIndices));
+    if (preparedScene) {
+        std::memcpy(mappedVertices, preparedSection<vkglTF::Vertex>(*preparedScene, SECTION_VERTICES).first, vertexBufferSize);
+        std::memcpy(mappedIndices, preparedSection<uint32_t>(*preparedScene, SECTION_INDICES).first, indexBufferSize);
+    }
+    else parallelFor(segments.size(), [&](size_t i) {
+        const auto& segment = segments[i];
+        const auto& lod = *segment.lod;
+        auto vertexDst = static_cast<vkglTF::Vertex*>(mappedVertices) + segment.firstVertex;
+        std::memcpy(vertexDst, lod.uniqueVertexBuffer.data(), lod.uniqueVertexBuffer.size() * sizeof(vkglTF::Vertex));
+        auto indexDst = static_cast<uint32_t*>(mappedIndices) + segment.firstIndex;
+        const auto& lodIndices = lod.triangleVertexIndicesSortedByClusterIdx;
+        for (size_t j = 0; j < lodIndices.size(); j++)
+        {
+            indexDst[j] = lodIndices[j] + segment.firstVertex;
+        }
+    });
+    vkUnmapMemory(device->logicalDevice, vertexStaging.memory);
+    vkUnmapMemory(device->logicalDevice, indexStaging.memory);
 
     // Create device local buffers
-    // Vertex buffer
     VK_CHECK_RESULT(device->createBuffer(
         VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
         vertexBufferSize,
         &vertices.buffer,
         &vertices.memory));
-
-    // Copy from staging buffers
-    VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-    VkBufferCopy copyRegion = {};
-
-    copyRegion.size = vertexBufferSize;
-    vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1, &copyRegion);
-
-    device->flushCommandBuffer(copyCmd, transferQueue, true);
-
-    vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-    vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
-
-    size_t indexBufferSize = indexBuffer.size() * sizeof(uint32_t);
-    indices.count = static_cast<uint32_t>(indexBuffer.size());
-
-
-    // Create staging buffers
-    // Index data
-    VK_CHECK_RESULT(device->createBuffer(
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        indexBufferSize,
-        &indexStaging.buffer,
-        &indexStaging.memory,
-        indexBuffer.data()));
-
-    // Create device local buffers
-    // Index buffer
     VK_CHECK_RESULT(device->createBuffer(
         VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
@@ -104,15 +310,18 @@ void NaniteScene::createVertexIndexBuffer(vks::VulkanDevice* device, VkQueue tra
         &indices.memory));
 
     // Copy from staging buffers
-    copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-    copyRegion = {};
+    VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 
+    VkBufferCopy copyRegion = {};
+    copyRegion.size = vertexBufferSize;
+    vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1, &copyRegion);
     copyRegion.size = indexBufferSize;
     vkCmdCopyBuffer(copyCmd, indexStaging.buffer, indices.buffer, 1, &copyRegion);
 
     device->flushCommandBuffer(copyCmd, transferQueue, true);
 
+    vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
+    vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
     vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
     vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
 }
@@ -120,59 +329,82 @@ void NaniteScene::createVertexIndexBuffer(vks::VulkanDevice* device, VkQueue tra
 
 void NaniteScene::createClusterInfos(vks::VulkanDevice* device, VkQueue transferQueue)
 {
-    sceneIndicesCount = 0;
+    if (preparedScene) {
+        const auto meshClusters = preparedSection<uint32_t>(*preparedScene, SECTION_MESH_CLUSTERS);
+        clusterIndexOffsets.resize(naniteMeshes.size());
+        clusterIndexCounts.resize(naniteMeshes.size());
+        uint32_t clusterCount = 0;
+        for (size_t i = 0; i < naniteMeshes.size(); i++)
+        {
+            clusterIndexOffsets[i] = clusterCount;
+            clusterCount += meshClusters.first[i];
+            clusterIndexCounts[i] = clusterCount;
+        }
+        const auto clusters = preparedSection<ClusterInfo>(*preparedScene, SECTION_CLUSTERS);
+        const auto errors = preparedSection<ErrorInfo>(*preparedScene, SECTION_ERRORS);
+        clusterInfo.assign(clusters.first, clusters.first + clusters.second);
+        errorInfo.assign(errors.first, errors.first + errors.second);
+        return;
+    }
+
+    // Meshes build their cluster infos independently, then every mesh copies its range into the scene arrays
+    parallelFor(naniteMeshes.size(), [&](size_t i) {
+        naniteMeshes[i].buildClusterInfo();
+        ASSERT(naniteMeshes[i].clusterInfo.size() == naniteMeshes[i].errorInfo.size(), "clusterInfo.size() should be equal to errorInfo.size()");
+    });
+
     clusterIndexOffsets.resize(naniteMeshes.size());
     clusterIndexCounts.resize(naniteMeshes.size());
+    uint32_t clusterCount = 0;
     for (size_t i = 0; i < naniteMeshes.size(); i++)
     {
-        auto& naniteMesh = naniteMeshes[i];
-        auto& instance = Instance(&naniteMesh, glm::mat4(1.0f));
-        naniteMesh.buildClusterInfo();
-        clusterIndexOffsets[i] = clusterInfo.size();
-        //clusterInfo.insert(clusterInfo.end(), naniteMesh.clusterInfo.begin(), naniteMesh.clusterInfo.end());
-        for (auto ci : naniteMesh.clusterInfo)
+        clusterIndexOffsets[i] = clusterCount;
+        clusterCount += static_cast<uint32_t>(naniteMeshes[i].clusterInfo.size());
+        clusterIndexCounts[i] = clusterCount;
+    }
+    clusterInfo.resize(clusterCount);
+    errorInfo.resize(clusterCount);
+
+    parallelFor(naniteMeshes.size(), [&](size_t i) {
+        const auto& naniteMesh = naniteMeshes[i];
+        // Triangle ranges of the mesh are relative to its first index in the scene index buffer
+        uint32_t firstTriangle = firstIndices[i] / 3;
+        auto clusterDst = clusterInfo.begin() + clusterIndexOffsets[i];
+        std::copy(naniteMesh.clusterInfo.begin(), naniteMesh.clusterInfo.end(), clusterDst);
+        for (size_t j = 0; j < naniteMesh.clusterInfo.size(); j++)
         {
-            if (i != 0) {
-                ci.triangleIndicesStart += indexCounts[i - 1] / 3;
-                ci.triangleIndicesEnd += indexCounts[i - 1] / 3;
-            }
-            clusterInfo.push_back(ci);
+            clusterDst[j].triangleIndicesStart += firstTriangle;
+            clusterDst[j].triangleIndicesEnd += firstTriangle;
         }
-        clusterIndexCounts[i] = clusterInfo.size();
-        errorInfo.insert(errorInfo.end(), naniteMesh.errorInfo.begin(), naniteMesh.errorInfo.end());
-    }
-    ASSERT(clusterInfo.size() == errorInfo.size(), "clusterInfo.size() should be equal to errorInfo.size()");
+        std::copy(naniteMesh.errorInfo.begin(), naniteMesh.errorInfo.end(), errorInfo.begin() + clusterIndexOffsets[i]);
+    });
 
-    for (int i = 0; i < naniteObjects.size(); ++i) {
-        auto& naniteObject = naniteObjects[i];
-        auto referenceMeshIndex = std::find(naniteMeshes.begin(), naniteMeshes.end(), *(naniteObject.referenceMesh)) - naniteMeshes.begin();
-        sceneIndicesCount += indexCounts[referenceMeshIndex];
-        maxClusterNum += clusterIndexCounts[referenceMeshIndex];
-    }
 }
 
 void NaniteScene::createBVHNodeInfos(vks::VulkanDevice* device, VkQueue transferQueue)
 {
-    // TODO: Modify this part for multi-mesh!
+    if (preparedScene) {
+        readPreparedNodes();
+        placeInstances();
+        return;
+    }
+
+    uint32_t sortedClusterCount = 0;
+    std::vector<uint32_t> sortedClusterOffsets(naniteMeshes.size());
     for (size_t i = 0; i < naniteMeshes.size(); i++)
     {
-        auto & naniteMesh = naniteMeshes[i];
-        for (size_t j = 0; j < naniteMesh.sortedClusterIndices.size(); j++)
+        sortedClusterOffsets[i] = sortedClusterCount;
+        sortedClusterCount += static_cast<uint32_t>(naniteMeshes[i].sortedClusterIndices.size());
+    }
+    sortedClusterIndices.resize(sortedClusterCount);
+    parallelFor(naniteMeshes.size(), [&](size_t i) {
+        const auto& meshIndices = naniteMeshes[i].sortedClusterIndices;
+        auto dst = sortedClusterIndices.begin() + sortedClusterOffsets[i];
+        for (size_t j = 0; j < meshIndices.size(); j++)
         {
-            sortedClusterIndices.push_back(naniteMesh.sortedClusterIndices[j] + clusterIndexOffsets[i]);
+            dst[j] = meshIndices[j] + clusterIndexOffsets[i];
         }
-    }
-    virtualRootNode = std::make_shared<NaniteBVHNode>();
-    virtualRootNode->nodeStatus = VIRTUAL_NODE;
-    //virtualRootNode->depth = 0;
-    for (int i = 0; i < naniteObjects.size(); ++i) {
-        auto& naniteObject = naniteObjects[i];
-        naniteObject.reconstructBVH();
-        auto referenceMeshIndex = std::find(naniteMeshes.begin(), naniteMeshes.end(), *(naniteObject.referenceMesh)) - naniteMeshes.begin();
-        naniteObject.rootNode->objectIdx = i;
-        naniteObject.rootNode->meshIdx = referenceMeshIndex;
-        virtualRootNode->children.push_back(naniteObject.rootNode);
-    }
+    });
 
     // We should:
     //  Only pack Non-virtual nodes
@@ -182,144 +414,774 @@ void NaniteScene::createBVHNodeInfos(vks::VulkanDevice* device, VkQueue transfer
     //      children indices(glm::ivec4)
     //  Some meta information about bvh should also be stored (in a uniform buffer)
     //      Node count of each level (At least we should know the node count of level 0 to initiate traversal)
+    //
+    // Every mesh and prefab BVH is flattened once in object space into a node block of bvhNodeInfos, shared by all of
+    // its instances. An instance only owns model matrices and roots: initNodeInfoIndices lists (root node, first object
+    // of the instance) pairs, the traversal carries the first object down to the children and transforms each node by
+    // the model matrix of its object. Instances are added, removed and moved later on without touching the nodes.
+    nodeBlocks.assign(naniteMeshes.size() + prefabs.size(), NodeBlock());
+    std::vector<std::vector<BVHNodeInfo>> blockNodes(nodeBlocks.size()); // Children relative to the block
+    blockCullInfos.assign(nodeBlocks.size(), BlockCullInfo());
+    parallelFor(naniteMeshes.size(), [&](size_t m) {
+        Instance meshInstance(&naniteMeshes[m], glm::mat4(1.0f));
+        meshInstance.reconstructBVH();
+        auto& mesh = nodeBlocks[m];
+        auto& nodes = blockNodes[m];
 
+        std::vector<std::shared_ptr<NaniteBVHNode>> flattenedNonVirtualNodes;
+        std::queue<std::shared_ptr<NaniteBVHNode>> nodeQueue;
+        nodeQueue.push(meshInstance.rootNode);
+        while (!nodeQueue.empty())
+        {
+            auto currNode = nodeQueue.front();
+            ASSERT(currNode->nodeStatus != NaniteBVHNodeStatus::INVALID, "Invalid node!");
+            nodeQueue.pop();
+            if (currNode->nodeStatus != VIRTUAL_NODE) // push all non-virtual nodes into arrays
+            {
+                currNode->index = static_cast<int>(flattenedNonVirtualNodes.size());
+                flattenedNonVirtualNodes.push_back(currNode);
+            }
+            for (auto child : currNode->children)
+            {
+                nodeQueue.push(child);
+            }
+        }
 
-    std::vector<std::shared_ptr<NaniteBVHNode>> flattenedNonVirtualNodes;
+        nodes.resize(flattenedNonVirtualNodes.size());
+        for (size_t i = 0; i < flattenedNonVirtualNodes.size(); i++)
+        {
+            auto& currNode = flattenedNonVirtualNodes[i];
+            auto& nodeInfo = nodes[i];
+            nodeInfo.pMinWorld = currNode->pMin;
+            nodeInfo.pMaxWorld = currNode->pMax;
+            nodeInfo.objectId = 0;
+            nodeInfo.errorWorld.x = currNode->normalizedlodError;
+            nodeInfo.errorWorld.y = currNode->parentNormalizedError;
+            nodeInfo.errorRP = currNode->parentBoundingSphere;
+            nodeInfo.clusterIntervals.x = currNode->start + clusterIndexOffsets[m];
+            nodeInfo.clusterIntervals.y = currNode->end + clusterIndexOffsets[m];
 
-    std::queue<std::shared_ptr<NaniteBVHNode>> nodeQueue;
-    nodeQueue.push(virtualRootNode);
+            ASSERT(currNode->children.size() <= 4, "Invalid node!");
+            for (size_t j = 0; j < currNode->children.size(); ++j)
+            {
+                nodeInfo.childrenNodeIndices[j] = currNode->children[j]->index;
+            }
 
-    uint32_t index = 0;
-    // Do a two-pass tree bfs
-    //      First pass update cepth & push non-virtual node into vectors
-    //      Second pass transform Node to NodeInfo
-    while (!nodeQueue.empty())
-    {
-        auto currNode = nodeQueue.front();
-        ASSERT(currNode->nodeStatus != NaniteBVHNodeStatus::INVALID, "Invalid node!");
-        nodeQueue.pop();
-        if (currNode->nodeStatus != VIRTUAL_NODE) // push all non-virtual nodes into arrays 
+            ASSERT(currNode->depth <= mesh.depthCounts.size(), "`depth` should never be over depthCounts.size()");
+            if (currNode->depth == mesh.depthCounts.size())
+            {
+                mesh.depthCounts.push_back(0);
+                mesh.depthLeafCounts.push_back(0);
+            }
+            mesh.depthCounts[currNode->depth] += 1;
+            if (currNode->depth == 0)
+            {
+                ASSERT(mesh.rootCount == i, "Depth 0 nodes should come first");
+                mesh.rootCount++;
+            }
+            if (currNode->nodeStatus == LEAF)
+            {
+                ASSERT(currNode->clusterIndices.size() <= CLUSTER_GROUP_MAX_SIZE, "this leaf node stores too many cluster indices");
+                int validClusterIndicesSize = 0;
+                bool isValid = true;
+                // Final check
+                for (size_t k = 0; k < CLUSTER_GROUP_MAX_SIZE; k++)
+                {
+                    if (currNode->clusterIndices[k] >= 0) {
+                        ASSERT(isValid, "Invalid cluster indices"); // This assertion is to make sure that all cluster indices are allocated contiguously
+                        validClusterIndicesSize += nodeInfo.clusterIntervals[1] - nodeInfo.clusterIntervals[0];
+                    }
+                    else {
+                        isValid = false;
+                    }
+                }
+                mesh.depthLeafCounts[currNode->depth] += validClusterIndicesSize;
+            }
+        }
+        ASSERT(mesh.rootCount > 0, "Mesh BVH has no root");
+
+        // Every LOD has its own roots. Once the roots of the finer LODs are error culled, the traversal only reaches
+        // the leaves of the coarsest LOD, their clusters are the coarse cut of the mesh
+        int coarsestLod = -1;
+        for (uint32_t k = 0; k < mesh.rootCount; k++)
         {
-            flattenedNonVirtualNodes.push_back(currNode);
-            currNode->index = flattenedNonVirtualNodes.size() - 1;
+            coarsestLod = std::max(coarsestLod, flattenedNonVirtualNodes[k]->lodLevel);
         }
-        for (auto child: currNode->children)
+        auto& cullInfo = blockCullInfos[m];
+        bool hasFinerRoots = false;
+        for (uint32_t k = 0; k < mesh.rootCount; k++)
         {
-            //std::cout << currNode->depth << " " << currNode->objectIdx;
-            if (currNode != virtualRootNode) {
-                child->objectIdx = currNode->objectIdx;
-                child->meshIdx = currNode->meshIdx;
+            cullInfo.pMin = glm::min(cullInfo.pMin, nodes[k].pMinWorld);
+            cullInfo.pMax = glm::max(cullInfo.pMax, nodes[k].pMaxWorld);
+            if (flattenedNonVirtualNodes[k]->lodLevel == coarsestLod) continue;
+            cullInfo.coarseError = std::max(cullInfo.coarseError, nodes[k].errorWorld.y);
+            cullInfo.coarseSphere = hasFinerRoots ? enclosingSphere(cullInfo.coarseSphere, nodes[k].errorRP) : nodes[k].errorRP;
+            hasFinerRoots = true;
+        }
+        for (size_t i = 0; i < flattenedNonVirtualNodes.size(); i++)
+        {
+            if (flattenedNonVirtualNodes[i]->nodeStatus != LEAF || flattenedNonVirtualNodes[i]->lodLevel != coarsestLod) continue;
+            for (int c = nodes[i].clusterIntervals.x; c < nodes[i].clusterIntervals.y; c++)
+            {
+                mesh.coarseCut.emplace_back(sortedClusterIndices[c], 0);
             }
-            //child->depth = currNode->depth + 1;
-            nodeQueue.push(child);
         }
+        mesh.nodeCount = static_cast<uint32_t>(nodes.size());
+        mesh.objectTransforms.assign(1, glm::mat4(1.0f));
+        mesh.indexCount = indexCounts[m];
+        mesh.clusterCount = clusterIndexCounts[m];
+    });
+    // Prefabs only refer to meshes and to prefabs before them
+    for (uint32_t p = 0; p < prefabs.size(); p++)
+    {
+        createPrefabBlock(p, blockNodes);
+    }
+
+    uint32_t nodeCount = 0, coarseClusterCount = 0;
+    for (size_t b = 0; b < nodeBlocks.size(); b++)
+    {
+        auto& block = nodeBlocks[b];
+        block.firstNode = nodeCount;
+        nodeCount += block.nodeCount;
+        blockCullInfos[b].firstNode = block.firstNode;
+        blockCullInfos[b].rootCount = block.rootCount;
+        blockCullInfos[b].firstCoarseCluster = coarseClusterCount;
+        blockCullInfos[b].coarseClusterCount = static_cast<uint32_t>(block.coarseCut.size());
+        coarseClusterCount += blockCullInfos[b].coarseClusterCount;
     }
-    
-    bvhNodeInfos.resize(flattenedNonVirtualNodes.size());
-
-    for (size_t i = 0; i < flattenedNonVirtualNodes.size(); i++)
-    {
-        auto& currNode = flattenedNonVirtualNodes[i];
-
-        std::string indent(currNode->depth, '\t');
-        //std::cout << indent 
-        //    << (currNode->nodeStatus == NaniteBVHNodeStatus::LEAF ? "Leaf " : "Non-leaf ") 
-        //    << currNode->depth << " " 
-        //    << currNode->index << " " 
-        //    << currNode->objectIdx << " "
-        //    << std::endl;
-        
-        //ASSERT(currNode->nodeStatus == VIRTUAL_NODE && currNode->depth >= 0, "A non-virtual node should now be cut out from the bvh tree");
-        //ASSERT(currNode->nodeStatus != VIRTUAL_NODE && currNode->depth < 0, "A virtual node should not be cut out from the bvh tree");
-        
-        auto & nodeInfo = bvhNodeInfos[i];
-        nodeInfo.pMinWorld = currNode->pMin;
-        nodeInfo.pMaxWorld = currNode->pMax;
-        nodeInfo.objectId = currNode->objectIdx;
-        nodeInfo.errorWorld.x = currNode->normalizedlodError;
-        nodeInfo.errorWorld.y = currNode->parentNormalizedError;
-        nodeInfo.errorRP = currNode->parentBoundingSphere;
-        nodeInfo.clusterIntervals.x = currNode->start + clusterIndexOffsets[currNode->meshIdx];
-        nodeInfo.clusterIntervals.y = currNode->end + clusterIndexOffsets[currNode->meshIdx];
-        //std::cout << indent << (currNode->nodeStatus == VIRTUAL_NODE ? "Virtual " : "Non-virtual ")
-        //    << " pMin: " << nodeInfo.pMinWorld.x << " " << nodeInfo.pMinWorld.y << " " << nodeInfo.pMinWorld.z
-        //    << " pMax: " << nodeInfo.pMaxWorld.x << " " << nodeInfo.pMaxWorld.y << " " << nodeInfo.pMaxWorld.z << std::endl;
-
-        ASSERT(currNode->children.size() <= 4, "Invalid node!");
-        for (size_t j = 0; j < currNode->children.size(); ++j)
+    coarseCutClusters.resize(coarseClusterCount);
+    bvhNodeInfos.resize(nodeCount);
+    parallelFor(nodeBlocks.size(), [&](size_t b) {
+        const uint32_t firstNode = nodeBlocks[b].firstNode;
+        auto dst = bvhNodeInfos.begin() + firstNode;
+        std::copy(blockNodes[b].begin(), blockNodes[b].end(), dst);
+        std::copy(nodeBlocks[b].coarseCut.begin(), nodeBlocks[b].coarseCut.end(), coarseCutClusters.begin() + blockCullInfos[b].firstCoarseCluster);
+        for (uint32_t k = 0; k < nodeBlocks[b].nodeCount; k++)
         {
-            auto child = currNode->children[j];
-            nodeInfo.childrenNodeIndices[j] = child->index;
+            for (int j = 0; j < 4 && dst[k].childrenNodeIndices[j] != -1; j++)
+            {
+                dst[k].childrenNodeIndices[j] += firstNode;
+            }
         }
+    });
+    placeInstances();
+}
+
+// The objects and roots of every instance, the scene counts and the instance culling entries
+void NaniteScene::placeInstances()
+{
+    sceneIndicesCount = 0;
+    maxClusterNum = 0;
+    maxDepthCounts = 0;
+    depthCounts.clear();
+    depthLeafCounts.clear();
+    objectAllocator.clear();
+    freeInstanceIds.clear();
+    instanceObjects.assign(naniteObjects.size(), InstanceObjects());
+    for (uint32_t i = 0; i < naniteObjects.size(); ++i) {
+        auto& instance = instanceObjects[i];
+        instance.alive = true;
+        instance.objectCount = static_cast<uint32_t>(nodeBlocks[blockHandle(naniteObjects[i])].objectTransforms.size());
+        addInstanceCounts(i, 1);
+    }
+    // Everything is uploaded as a whole after the build
+    dirty = SceneDirtyRanges();
+
+    if (preparedScene) {
+        readPreparedInstances();
+        createInstanceEntries();
+        return;
+    }
 
-        //nodeInfo.clusterIndices = currNode->clusterIndices;
-        // TODO: Use memcpy
-        //for (size_t i = 0; i < CLUSTER_GROUP_MAX_SIZE; i++)
-        //{
-        //    if (currNode->clusterIndices[i] >= 0) {
-        //        //nodeInfo.clusterIndices[i] = currNode->clusterIndices[i] + clusterIndexOffsets[currNode->objectIdx];
-        //        // TODO: Modify this part for multi-mesh!
-        //        nodeInfo.clusterIndices[i] = currNode->clusterIndices[i];
-        //    }
-        //}
-        //ASSERT(currNode->nodeStatus == LEAF || nodeInfo.clusterIndices[0] == -1, "A non-leaf node should have no cluster index");
-        //std::cout << indent << "object: " << currNode->objectIdx
-        //    << " lod: " << currNode->lodLevel
-        //    << " depth: " << currNode->depth << std::endl;
-        ASSERT(currNode->depth <= depthCounts.size(), "`depth` should never be over depthCounts.size()");
-        if (currNode->depth == depthCounts.size())
+    initNodeInfoIndices.assign(1, glm::uvec2(0)); // Root count, then the roots
+    for (uint32_t i = 0; i < naniteObjects.size(); ++i) {
+        auto& instance = instanceObjects[i];
+        const auto& block = nodeBlocks[blockHandle(naniteObjects[i])];
+        instance.firstObject = objectAllocator.allocate(instance.objectCount);
+        for (uint32_t k = 0; k < block.rootCount; k++)
         {
-            depthCounts.push_back(1);
+            instance.rootPositions.push_back(static_cast<uint32_t>(initNodeInfoIndices.size()));
+            initNodeInfoIndices.emplace_back(block.firstNode + k, instance.firstObject);
         }
-        else
+    }
+    initNodeInfoIndices[0].x = static_cast<uint32_t>(initNodeInfoIndices.size() - 1);
+
+    modelMats.resize(objectAllocator.size());
+    lodBiases.resize(objectAllocator.size());
+    objectInstances.resize(objectAllocator.size());
+    parallelFor(naniteObjects.size(), [&](size_t i) {
+        writeInstanceObjects(static_cast<uint32_t>(i));
+    });
+    createInstanceEntries();
+}
+
+// One instance culling entry per instance, in instance order
+void NaniteScene::createInstanceEntries()
+{
+    instanceEntries.assign(1, glm::uvec2(static_cast<uint32_t>(naniteObjects.size()), 0)); // Instance count, then the instances
+    for (uint32_t i = 0; i < naniteObjects.size(); ++i) {
+        instanceObjects[i].entryPosition = static_cast<uint32_t>(instanceEntries.size());
+        instanceEntries.emplace_back(blockHandle(naniteObjects[i]), instanceObjects[i].firstObject);
+    }
+}
+
+void NaniteScene::createPrefabBlock(uint32_t prefabHandle, std::vector<std::vector<BVHNodeInfo>>& blockNodes)
+{
+    const auto& prefab = prefabs[prefabHandle];
+    const uint32_t blockIndex = static_cast<uint32_t>(naniteMeshes.size()) + prefabHandle;
+    auto& block = nodeBlocks[blockIndex];
+    auto& cullInfo = blockCullInfos[blockIndex];
+
+    // The nodes of every member, objects and children moved behind the ones before it. Object 0 is the prefab itself
+    std::vector<BVHNodeInfo> nodes;
+    struct MemberRoot {
+        uint32_t node;
+        glm::vec3 pMin, pMax; // Prefab space
+    };
+    std::vector<MemberRoot> memberRoots;
+    block.objectTransforms.assign(1, glm::mat4(1.0f));
+    for (const auto& member : prefab.members)
+    {
+        uint32_t memberBlockIndex = member.prefabHandle != -1 ? static_cast<uint32_t>(naniteMeshes.size()) + member.prefabHandle : member.meshHandle;
+        const auto& memberBlock = nodeBlocks[memberBlockIndex];
+        const auto& memberNodes = blockNodes[memberBlockIndex];
+        const uint32_t firstNode = static_cast<uint32_t>(nodes.size());
+        const uint32_t firstObject = static_cast<uint32_t>(block.objectTransforms.size());
+        for (const auto& transform : memberBlock.objectTransforms)
         {
-            depthCounts[currNode->depth] += 1;
+            block.objectTransforms.push_back(member.transform * transform);
         }
-        if (currNode->nodeStatus == LEAF)
+        for (const auto& memberNode : memberNodes)
         {
-            ASSERT(currNode->clusterIndices.size() <= CLUSTER_GROUP_MAX_SIZE, "this leaf node stores too many cluster indices");
-            int validClusterIndicesSize = 0;
-            bool isValid = true;
-            // Final check
-            for (size_t i = 0; i < CLUSTER_GROUP_MAX_SIZE; i++)
+            auto& nodeInfo = nodes.emplace_back(memberNode);
+            nodeInfo.objectId += firstObject;
+            for (int j = 0; j < 4 && nodeInfo.childrenNodeIndices[j] != -1; j++)
             {
-                if (currNode->clusterIndices[i] >= 0) {
-                    ASSERT(isValid, "Invalid cluster indices"); // This assertion is to make sure that all cluster indices are allocated contiguously
-					validClusterIndicesSize += nodeInfo.clusterIntervals[1] - nodeInfo.clusterIntervals[0];
-					//std::cout << indent
-                    //    << " cluster: " << nodeInfo.clusterIndices[i]
-                    //    << std::endl;
-                    //ASSERT(clusterIndexSets.find(nodeInfo.clusterIndices[i]) != clusterIndexSets.end(), "Already removed, repeat index!");
-                    //clusterIndexSets.erase(nodeInfo.clusterIndices[i]);
-				}
-                else {
-                    isValid = false;
-                }
+                nodeInfo.childrenNodeIndices[j] += firstNode;
             }
-            if (currNode->depth >= depthLeafCounts.size()) {
-                depthLeafCounts.resize(currNode->depth + 1);
-                depthLeafCounts[currNode->depth] = validClusterIndicesSize;
+        }
+        for (uint32_t k = 0; k < memberBlock.rootCount; k++)
+        {
+            const auto& root = nodes[firstNode + k];
+            MemberRoot memberRoot = { firstNode + k };
+            transformAABB(block.objectTransforms[root.objectId], root.pMinWorld, root.pMaxWorld, memberRoot.pMin, memberRoot.pMax);
+            cullInfo.pMin = glm::min(cullInfo.pMin, memberRoot.pMin);
+            cullInfo.pMax = glm::max(cullInfo.pMax, memberRoot.pMax);
+            memberRoots.push_back(memberRoot);
+        }
+        // The coarse cut of a prefab is the one of all members, it is taken once none of them has finer roots left
+        for (const auto& coarseCluster : memberBlock.coarseCut)
+        {
+            block.coarseCut.emplace_back(coarseCluster.x, coarseCluster.y + firstObject);
+        }
+        const auto& memberCullInfo = blockCullInfos[memberBlockIndex];
+        if (memberCullInfo.coarseError > 0.0f) {
+            glm::vec4 sphere = transformSphere(member.transform, memberCullInfo.coarseSphere);
+            cullInfo.coarseSphere = cullInfo.coarseError > 0.0f ? enclosingSphere(cullInfo.coarseSphere, sphere) : sphere;
+            cullInfo.coarseError = std::max(cullInfo.coarseError, memberCullInfo.coarseError);
+        }
+        block.indexCount += memberBlock.indexCount;
+        block.clusterCount += memberBlock.clusterCount;
+    }
+
+    // 4-ary BVH over the member roots in prefab space, split in quarters along the longest axis of the centroids.
+    // Its nodes hold no clusters and never meet the error threshold, they are only frustum and occlusion culled
+    std::function<uint32_t(uint32_t, uint32_t)> buildNode = [&](uint32_t begin, uint32_t end) -> uint32_t {
+        if (end - begin == 1) return memberRoots[begin].node;
+        BVHNodeInfo nodeInfo;
+        nodeInfo.objectId = 0;
+        glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+        for (uint32_t i = begin; i < end; i++)
+        {
+            nodeInfo.pMinWorld = glm::min(nodeInfo.pMinWorld, memberRoots[i].pMin);
+            nodeInfo.pMaxWorld = glm::max(nodeInfo.pMaxWorld, memberRoots[i].pMax);
+            glm::vec3 centroid = 0.5f * (memberRoots[i].pMin + memberRoots[i].pMax);
+            centroidMin = glm::min(centroidMin, centroid);
+            centroidMax = glm::max(centroidMax, centroid);
+        }
+        nodeInfo.errorRP = glm::vec4(0.5f * (nodeInfo.pMinWorld + nodeInfo.pMaxWorld), 0.5f * glm::length(nodeInfo.pMaxWorld - nodeInfo.pMinWorld));
+        if (end - begin <= 4) {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                nodeInfo.childrenNodeIndices[i - begin] = memberRoots[i].node;
             }
-            else {
-                depthLeafCounts[currNode->depth] += validClusterIndicesSize;
+        }
+        else {
+            glm::vec3 extent = centroidMax - centroidMin;
+            int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+            std::sort(memberRoots.begin() + begin, memberRoots.begin() + end, [axis](const MemberRoot& a, const MemberRoot& b) {
+                return a.pMin[axis] + a.pMax[axis] < b.pMin[axis] + b.pMax[axis];
+            });
+            for (uint32_t j = 0; j < 4; j++)
+            {
+                nodeInfo.childrenNodeIndices[j] = buildNode(begin + (end - begin) * j / 4, begin + (end - begin) * (j + 1) / 4);
+            }
+        }
+        nodes.push_back(nodeInfo);
+        return static_cast<uint32_t>(nodes.size() - 1);
+    };
+    ASSERT(!memberRoots.empty(), "Prefab without members");
+    uint32_t root = buildNode(0, static_cast<uint32_t>(memberRoots.size()));
+
+    // Reordered breadth first from the root, so the root comes first and the depth of a node is its traversal level
+    auto& ordered = blockNodes[blockIndex];
+    ordered.clear();
+    ordered.reserve(nodes.size());
+    std::vector<int> newIndices(nodes.size(), -1);
+    std::vector<uint32_t> order = { root };
+    newIndices[root] = 0;
+    for (size_t levelBegin = 0; levelBegin < order.size();)
+    {
+        size_t levelEnd = order.size();
+        uint32_t leafClusters = 0;
+        for (size_t i = levelBegin; i < levelEnd; i++)
+        {
+            const auto& nodeInfo = nodes[order[i]];
+            if (nodeInfo.childrenNodeIndices[0] == -1) leafClusters += nodeInfo.clusterIntervals.y - nodeInfo.clusterIntervals.x;
+            for (int j = 0; j < 4 && nodeInfo.childrenNodeIndices[j] != -1; j++)
+            {
+                newIndices[nodeInfo.childrenNodeIndices[j]] = static_cast<int>(order.size());
+                order.push_back(nodeInfo.childrenNodeIndices[j]);
             }
-            //std::cout << indent << "Curr leaf node clusterIndices size: " << validClusterIndicesSize << std::endl;
         }
-        //std::cout << indent << "nodeInfo.clusterIndices[0]: " << nodeInfo.clusterIndices[0] << std::endl;
-        //for (size_t i = 0; i < CLUSTER_GROUP_MAX_SIZE; i++)
-        //{
-        //    std::cout << indent << "clusterIndex: " << currNode->clusterIndices[i] << std::endl;
-        //    std::cout << indent << "clusterIndex + offset: " << nodeInfo.clusterIndices[i] << std::endl;
-        //}
+        block.depthCounts.push_back(static_cast<uint32_t>(levelEnd - levelBegin));
+        block.depthLeafCounts.push_back(leafClusters);
+        levelBegin = levelEnd;
+    }
+    ASSERT(order.size() == nodes.size(), "Prefab nodes unreachable from its root");
+    for (uint32_t index : order)
+    {
+        auto& nodeInfo = ordered.emplace_back(nodes[index]);
+        for (int j = 0; j < 4 && nodeInfo.childrenNodeIndices[j] != -1; j++)
+        {
+            nodeInfo.childrenNodeIndices[j] = newIndices[nodeInfo.childrenNodeIndices[j]];
+        }
+    }
+    block.nodeCount = static_cast<uint32_t>(ordered.size());
+    block.rootCount = 1;
+}
+
+uint64_t NaniteScene::computeSceneKey() const
+{
+    uint64_t hash = hashBytes(&preparedSceneVersion, sizeof(preparedSceneVersion));
+    hash = hashBytes(&streamed, sizeof(streamed), hash);
+    for (const auto& naniteMesh : naniteMeshes)
+    {
+        hash = hashBytes(&naniteMesh.contentHash, sizeof(naniteMesh.contentHash), hash);
+    }
+    for (const auto& prefab : prefabs)
+    {
+        hash = hashBytes(prefab.members.data(), prefab.members.size() * sizeof(PrefabMember), hash);
+    }
+    for (const auto& naniteObject : naniteObjects)
+    {
+        hash = hashBytes(&naniteObject.meshHandle, sizeof(naniteObject.meshHandle), hash);
+        hash = hashBytes(&naniteObject.prefabHandle, sizeof(naniteObject.prefabHandle), hash);
+        hash = hashBytes(&naniteObject.rootTransform, sizeof(naniteObject.rootTransform), hash);
+    }
+    return hash;
+}
+
+bool NaniteScene::writePreparedScene(const std::string& filename) const
+{
+    ASSERT(freeInstanceIds.empty() && objectAllocator.freeSize() == 0, "Prepared scenes are written before instances are removed");
+    std::vector<uint32_t> meshClusters(naniteMeshes.size());
+    for (size_t i = 0; i < naniteMeshes.size(); i++)
+    {
+        meshClusters[i] = clusterIndexCounts[i] - clusterIndexOffsets[i];
+    }
+    std::vector<PreparedBlock> blocks(nodeBlocks.size());
+    std::vector<glm::mat4> blockTransforms;
+    std::vector<uint32_t> blockDepths;
+    for (size_t b = 0; b < nodeBlocks.size(); b++)
+    {
+        const auto& block = nodeBlocks[b];
+        auto& prepared = blocks[b];
+        prepared.firstNode = block.firstNode;
+        prepared.nodeCount = block.nodeCount;
+        prepared.rootCount = block.rootCount;
+        prepared.indexCount = block.indexCount;
+        prepared.clusterCount = block.clusterCount;
+        prepared.objectCount = static_cast<uint32_t>(block.objectTransforms.size());
+        prepared.depthCount = static_cast<uint32_t>(block.depthCounts.size());
+        blockTransforms.insert(blockTransforms.end(), block.objectTransforms.begin(), block.objectTransforms.end());
+        blockDepths.insert(blockDepths.end(), block.depthCounts.begin(), block.depthCounts.end());
+        blockDepths.insert(blockDepths.end(), block.depthLeafCounts.begin(), block.depthLeafCounts.end());
+    }
+    std::vector<uint32_t> firstObjects(instanceObjects.size());
+    for (size_t i = 0; i < instanceObjects.size(); i++)
+    {
+        firstObjects[i] = instanceObjects[i].firstObject;
+    }
+
+    PreparedSceneHeader header;
+    header.key = computeSceneKey();
+    const void* sectionData[SECTION_COUNT] = {};
+    auto setSection = [&](PreparedSection section, const auto& array) {
+        sectionData[section] = array.data();
+        header.sectionSizes[section] = uint64_t(array.size()) * sizeof(array[0]);
+    };
+    // Only a GPU copy of the vertices and indices is kept, they are laid out again from the LODs below
+    if (!streamed) {
+        header.sectionSizes[SECTION_VERTICES] = uint64_t(vertices.count) * sizeof(vkglTF::Vertex);
+        header.sectionSizes[SECTION_INDICES] = uint64_t(indices.count) * sizeof(uint32_t);
+    }
+    setSection(SECTION_MESH_CLUSTERS, meshClusters);
+    setSection(SECTION_CLUSTERS, clusterInfo);
+    setSection(SECTION_ERRORS, errorInfo);
+    setSection(SECTION_SORTED_CLUSTERS, sortedClusterIndices);
+    setSection(SECTION_NODES, bvhNodeInfos);
+    setSection(SECTION_BLOCKS, blocks);
+    setSection(SECTION_BLOCK_TRANSFORMS, blockTransforms);
+    setSection(SECTION_BLOCK_DEPTHS, blockDepths);
+    setSection(SECTION_BLOCK_CULL_INFOS, blockCullInfos);
+    setSection(SECTION_COARSE_CUT, coarseCutClusters);
+    setSection(SECTION_OBJECTS, modelMats);
+    setSection(SECTION_ROOTS, initNodeInfoIndices);
+    setSection(SECTION_FIRST_OBJECTS, firstObjects);
+    header.layout();
+
+    // Written next to the target and renamed, a reader never maps a partially written file
+    std::string tmpFilename = filename + ".tmp";
+    {
+        std::ofstream file(tmpFilename, std::ios::binary);
+        if (!file.is_open()) return false;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (!streamed) {
+            // Same order and offsets as createVertexIndexBuffer()
+            file.seekp(header.sectionOffsets[SECTION_VERTICES]);
+            for (const auto& naniteMesh : naniteMeshes)
+            {
+                for (const auto& lod : naniteMesh.meshes)
+                {
+                    file.write(reinterpret_cast<const char*>(lod.uniqueVertexBuffer.data()), lod.uniqueVertexBuffer.size() * sizeof(vkglTF::Vertex));
+                }
+            }
+            file.seekp(header.sectionOffsets[SECTION_INDICES]);
+            uint32_t firstVertex = 0;
+            std::vector<uint32_t> lodIndices;
+            for (const auto& naniteMesh : naniteMeshes)
+            {
+                for (const auto& lod : naniteMesh.meshes)
+                {
+                    const auto& sortedIndices = lod.triangleVertexIndicesSortedByClusterIdx;
+                    lodIndices.resize(sortedIndices.size());
+                    for (size_t j = 0; j < sortedIndices.size(); j++)
+                    {
+                        lodIndices[j] = sortedIndices[j] + firstVertex;
+                    }
+                    file.write(reinterpret_cast<const char*>(lodIndices.data()), lodIndices.size() * sizeof(uint32_t));
+                    firstVertex += static_cast<uint32_t>(lod.vertexCount());
+                }
+            }
+        }
+        for (uint32_t section = SECTION_MESH_CLUSTERS; section < SECTION_COUNT; section++)
+        {
+            file.seekp(header.sectionOffsets[section]);
+            file.write(static_cast<const char*>(sectionData[section]), header.sectionSizes[section]);
+        }
+        if (!file.good()) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmpFilename, filename, ec);
+    return !ec;
+}
+
+bool NaniteScene::mapPreparedScene(const std::string& filename)
+{
+    auto file = std::make_unique<MappedFile>(filename);
+    if (!file->valid() || file->size() < sizeof(PreparedSceneHeader)) return false;
+    PreparedSceneHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    PreparedSceneHeader expected = header;
+    expected.layout();
+    if (header.magic != preparedSceneMagic || header.version != preparedSceneVersion || header.key != computeSceneKey()) {
+        return false;
+    }
+    const uint64_t elementSizes[SECTION_COUNT] = {
+        sizeof(vkglTF::Vertex), sizeof(uint32_t), sizeof(uint32_t), sizeof(ClusterInfo), sizeof(ErrorInfo), sizeof(uint32_t),
+        sizeof(BVHNodeInfo), sizeof(PreparedBlock), sizeof(glm::mat4), sizeof(uint32_t), sizeof(BlockCullInfo), sizeof(glm::uvec2),
+        sizeof(glm::mat4), sizeof(glm::uvec2), sizeof(uint32_t)
+    };
+    uint64_t counts[SECTION_COUNT];
+    for (uint32_t section = 0; section < SECTION_COUNT; section++)
+    {
+        if (header.sectionOffsets[section] != expected.sectionOffsets[section] || header.sectionSizes[section] % elementSizes[section] != 0
+            || header.sectionOffsets[section] + header.sectionSizes[section] > file->size()) {
+            return false;
+        }
+        counts[section] = header.sectionSizes[section] / elementSizes[section];
     }
 
-    //ASSERT(clusterIndexSets.size() == 0, "Some clusters are not covered");
-    maxDepthCounts = std::max_element(depthCounts.begin(), depthCounts.end())[0];
+    // The key covers what the arrays were built from, the arrays still have to fit together
+    uint64_t vertexCount = 0, indexCount = 0;
+    for (const auto& naniteMesh : naniteMeshes)
+    {
+        for (const auto& lod : naniteMesh.meshes)
+        {
+            vertexCount += lod.vertexCount();
+            indexCount += lod.triangleVertexIndicesSortedByClusterIdx.size();
+        }
+    }
+    if (counts[SECTION_VERTICES] != (streamed ? 0 : vertexCount) || counts[SECTION_INDICES] != (streamed ? 0 : indexCount)
+        || counts[SECTION_MESH_CLUSTERS] != naniteMeshes.size() || counts[SECTION_CLUSTERS] != counts[SECTION_ERRORS]
+        || counts[SECTION_BLOCKS] != naniteMeshes.size() + prefabs.size() || counts[SECTION_BLOCK_CULL_INFOS] != counts[SECTION_BLOCKS]
+        || counts[SECTION_ROOTS] == 0 || counts[SECTION_FIRST_OBJECTS] != naniteObjects.size()) {
+        return false;
+    }
+    const auto meshClusters = preparedSection<uint32_t>(*file, SECTION_MESH_CLUSTERS);
+    uint64_t clusterCount = 0;
+    for (size_t i = 0; i < meshClusters.second; i++)
+    {
+        clusterCount += meshClusters.first[i];
+    }
+    const auto blocks = preparedSection<PreparedBlock>(*file, SECTION_BLOCKS);
+    uint64_t objectCount = 0, depthCount = 0;
+    for (size_t b = 0; b < blocks.second; b++)
+    {
+        const auto& block = blocks.first[b];
+        if (uint64_t(block.firstNode) + block.nodeCount > counts[SECTION_NODES] || block.rootCount > block.nodeCount) return false;
+        objectCount += block.objectCount;
+        depthCount += block.depthCount;
+    }
+    if (clusterCount != counts[SECTION_CLUSTERS] || objectCount != counts[SECTION_BLOCK_TRANSFORMS] || 2 * depthCount != counts[SECTION_BLOCK_DEPTHS]) {
+        return false;
+    }
+    const BlockCullInfo* cullInfos = preparedSection<BlockCullInfo>(*file, SECTION_BLOCK_CULL_INFOS).first;
+    for (size_t b = 0; b < blocks.second; b++)
+    {
+        if (uint64_t(cullInfos[b].firstCoarseCluster) + cullInfos[b].coarseClusterCount > counts[SECTION_COARSE_CUT]) return false;
+    }
+    const uint32_t* firstObjects = preparedSection<uint32_t>(*file, SECTION_FIRST_OBJECTS).first;
+    for (size_t i = 0; i < naniteObjects.size(); i++)
+    {
+        if (uint64_t(firstObjects[i]) + blocks.first[blockHandle(naniteObjects[i])].objectCount > counts[SECTION_OBJECTS]) return false;
+    }
+    const auto roots = preparedSection<glm::uvec2>(*file, SECTION_ROOTS);
+    for (size_t position = 1; position < roots.second; position++)
+    {
+        if (roots.first[position].x >= counts[SECTION_NODES] || roots.first[position].y >= counts[SECTION_OBJECTS]) return false;
+    }
+    preparedScene = std::move(file);
+    return true;
+}
 
-    initNodeInfoIndices.resize(depthCounts[0] + 1); // Init node info indices by depth 0 node count
-    initNodeInfoIndices[0] = depthCounts[0];
-    for (size_t i = 1; i <= depthCounts[0]; i++)
+// Node blocks, nodes and instance culling data of the prepared scene, in place of building them
+void NaniteScene::readPreparedNodes()
+{
+    const auto sorted = preparedSection<uint32_t>(*preparedScene, SECTION_SORTED_CLUSTERS);
+    const auto nodes = preparedSection<BVHNodeInfo>(*preparedScene, SECTION_NODES);
+    const auto cullInfos = preparedSection<BlockCullInfo>(*preparedScene, SECTION_BLOCK_CULL_INFOS);
+    const auto coarseCut = preparedSection<glm::uvec2>(*preparedScene, SECTION_COARSE_CUT);
+    sortedClusterIndices.assign(sorted.first, sorted.first + sorted.second);
+    bvhNodeInfos.assign(nodes.first, nodes.first + nodes.second);
+    blockCullInfos.assign(cullInfos.first, cullInfos.first + cullInfos.second);
+    coarseCutClusters.assign(coarseCut.first, coarseCut.first + coarseCut.second);
+
+    const auto blocks = preparedSection<PreparedBlock>(*preparedScene, SECTION_BLOCKS);
+    const glm::mat4* transforms = preparedSection<glm::mat4>(*preparedScene, SECTION_BLOCK_TRANSFORMS).first;
+    const uint32_t* depths = preparedSection<uint32_t>(*preparedScene, SECTION_BLOCK_DEPTHS).first;
+    nodeBlocks.assign(blocks.second, NodeBlock());
+    for (size_t b = 0; b < blocks.second; b++)
+    {
+        const auto& prepared = blocks.first[b];
+        auto& block = nodeBlocks[b];
+        block.firstNode = prepared.firstNode;
+        block.nodeCount = prepared.nodeCount;
+        block.rootCount = prepared.rootCount;
+        block.indexCount = prepared.indexCount;
+        block.clusterCount = prepared.clusterCount;
+        block.objectTransforms.assign(transforms, transforms + prepared.objectCount);
+        transforms += prepared.objectCount;
+        block.depthCounts.assign(depths, depths + prepared.depthCount);
+        depths += prepared.depthCount;
+        block.depthLeafCounts.assign(depths, depths + prepared.depthCount);
+        depths += prepared.depthCount;
+        const auto firstCoarse = coarseCutClusters.begin() + blockCullInfos[b].firstCoarseCluster;
+        block.coarseCut.assign(firstCoarse, firstCoarse + blockCullInfos[b].coarseClusterCount);
+    }
+}
+
+void NaniteScene::readPreparedInstances()
+{
+    const auto objects = preparedSection<glm::mat4>(*preparedScene, SECTION_OBJECTS);
+    const auto roots = preparedSection<glm::uvec2>(*preparedScene, SECTION_ROOTS);
+    const uint32_t* firstObjects = preparedSection<uint32_t>(*preparedScene, SECTION_FIRST_OBJECTS).first;
+    const uint32_t objectCount = static_cast<uint32_t>(objects.second);
+    const uint32_t rootCount = static_cast<uint32_t>(roots.second);
+    const uint32_t instanceCount = static_cast<uint32_t>(naniteObjects.size());
+    // Copied out of the mapping, the arrays are edited in place by dynamic instances later on
+    modelMats.assign(objects.first, objects.first + objectCount);
+    lodBiases.assign(objectCount, 1.0f);
+    initNodeInfoIndices.assign(roots.first, roots.first + rootCount);
+    objectInstances.assign(objectCount, -1);
+    for (uint32_t i = 0; i < instanceCount; i++)
+    {
+        instanceObjects[i].firstObject = firstObjects[i];
+        std::fill_n(objectInstances.begin() + firstObjects[i], instanceObjects[i].objectCount, i);
+    }
+    for (uint32_t position = 1; position < initNodeInfoIndices.size(); position++)
     {
-        initNodeInfoIndices[i] = i-1;
+        instanceObjects[objectInstances[initNodeInfoIndices[position].y]].rootPositions.push_back(position);
     }
+    // The instance objects cover the model matrices without gaps
+    if (objectCount > 0) objectAllocator.allocate(objectCount);
+}
+
+void NaniteScene::writeInstanceObjects(uint32_t instanceId)
+{
+    const auto& naniteObject = naniteObjects[instanceId];
+    const auto& instance = instanceObjects[instanceId];
+    const auto& block = nodeBlocks[blockHandle(naniteObject)];
+    for (uint32_t k = 0; k < instance.objectCount; k++)
+    {
+        modelMats[instance.firstObject + k] = naniteObject.rootTransform * block.objectTransforms[k];
+        lodBiases[instance.firstObject + k] = instance.lodBias;
+        objectInstances[instance.firstObject + k] = instanceId;
+    }
+}
+
+void NaniteScene::addInstanceCounts(uint32_t instanceId, int sign)
+{
+    const auto& block = nodeBlocks[blockHandle(naniteObjects[instanceId])];
+    if (block.depthCounts.size() > depthCounts.size())
+    {
+        depthCounts.resize(block.depthCounts.size());
+        depthLeafCounts.resize(block.depthCounts.size());
+    }
+    for (size_t d = 0; d < block.depthCounts.size(); d++)
+    {
+        depthCounts[d] += sign * block.depthCounts[d];
+        depthLeafCounts[d] += sign * block.depthLeafCounts[d];
+    }
+    maxDepthCounts = std::max(maxDepthCounts, *std::max_element(depthCounts.begin(), depthCounts.end()));
+    sceneIndicesCount += sign * block.indexCount;
+    maxClusterNum += sign * block.clusterCount;
+}
+
+uint32_t NaniteScene::spawnInstance(uint32_t meshHandle, const glm::mat4& transform)
+{
+    ASSERT(meshHandle < naniteMeshes.size(), "Invalid nanite mesh handle");
+    Instance naniteObject(&naniteMeshes[meshHandle], transform);
+    naniteObject.meshHandle = meshHandle;
+    return spawn(std::move(naniteObject));
+}
+
+uint32_t NaniteScene::spawnPrefabInstance(uint32_t prefabHandle, const glm::mat4& transform)
+{
+    ASSERT(prefabHandle < prefabs.size(), "Invalid prefab handle");
+    Instance naniteObject(nullptr, transform);
+    naniteObject.prefabHandle = prefabHandle;
+    return spawn(std::move(naniteObject));
+}
+
+uint32_t NaniteScene::spawn(Instance&& naniteObject)
+{
+    const uint32_t block = blockHandle(naniteObject);
+    ASSERT(block < nodeBlocks.size(), "The mesh or prefab is not part of the scene info, see createNaniteSceneInfo()");
+    uint32_t instanceId;
+    if (!freeInstanceIds.empty()) {
+        instanceId = freeInstanceIds.back();
+        freeInstanceIds.pop_back();
+        naniteObjects[instanceId] = std::move(naniteObject);
+    }
+    else {
+        instanceId = static_cast<uint32_t>(naniteObjects.size());
+        naniteObjects.emplace_back(std::move(naniteObject));
+        instanceObjects.emplace_back();
+    }
+
+    auto& instance = instanceObjects[instanceId];
+    instance.alive = true;
+    instance.objectCount = static_cast<uint32_t>(nodeBlocks[block].objectTransforms.size());
+    instance.firstObject = objectAllocator.allocate(instance.objectCount);
+    if (objectAllocator.size() > modelMats.size()) {
+        modelMats.resize(objectAllocator.size());
+        lodBiases.resize(objectAllocator.size());
+        objectInstances.resize(objectAllocator.size());
+    }
+    writeInstanceObjects(instanceId);
+
+    uint32_t firstRoot = static_cast<uint32_t>(initNodeInfoIndices.size());
+    instance.rootPositions.clear();
+    for (uint32_t k = 0; k < nodeBlocks[block].rootCount; k++)
+    {
+        instance.rootPositions.push_back(static_cast<uint32_t>(initNodeInfoIndices.size()));
+        initNodeInfoIndices.emplace_back(nodeBlocks[block].firstNode + k, instance.firstObject);
+    }
+    initNodeInfoIndices[0].x = static_cast<uint32_t>(initNodeInfoIndices.size() - 1);
+    instance.entryPosition = static_cast<uint32_t>(instanceEntries.size());
+    instanceEntries.emplace_back(block, instance.firstObject);
+    instanceEntries[0].x = static_cast<uint32_t>(instanceEntries.size() - 1);
+    addInstanceCounts(instanceId, 1);
+
+    dirty.objects.add(instance.firstObject, instance.firstObject + instance.objectCount);
+    dirty.roots.add(0, 1);
+    dirty.roots.add(firstRoot, static_cast<uint32_t>(initNodeInfoIndices.size()));
+    dirty.instanceEntries.add(0, 1);
+    dirty.instanceEntries.add(instance.entryPosition, instance.entryPosition + 1);
+    dirty.countsChanged = true;
+    return instanceId;
+}
+
+void NaniteScene::removeInstance(uint32_t instanceId)
+{
+    ASSERT(instanceAlive(instanceId), "Instance was removed already");
+    auto& instance = instanceObjects[instanceId];
+    addInstanceCounts(instanceId, -1);
+
+    // Fill the root positions of the instance with the last roots of the list. Highest position first, so the moved
+    // root never is one of the instance
+    std::sort(instance.rootPositions.rbegin(), instance.rootPositions.rend());
+    for (uint32_t position : instance.rootPositions)
+    {
+        uint32_t last = static_cast<uint32_t>(initNodeInfoIndices.size() - 1);
+        if (position != last) {
+            glm::uvec2 movedRoot = initNodeInfoIndices[last];
+            initNodeInfoIndices[position] = movedRoot;
+            auto& owner = instanceObjects[objectInstances[movedRoot.y]];
+            *std::find(owner.rootPositions.begin(), owner.rootPositions.end(), last) = position;
+            dirty.roots.add(position, position + 1);
+        }
+        initNodeInfoIndices.pop_back();
+    }
+    initNodeInfoIndices[0].x = static_cast<uint32_t>(initNodeInfoIndices.size() - 1);
+    dirty.roots.add(0, 1);
+
+    // Same for the instance entry
+    uint32_t lastEntry = static_cast<uint32_t>(instanceEntries.size() - 1);
+    if (instance.entryPosition != lastEntry) {
+        glm::uvec2 movedEntry = instanceEntries[lastEntry];
+        instanceEntries[instance.entryPosition] = movedEntry;
+        instanceObjects[objectInstances[movedEntry.y]].entryPosition = instance.entryPosition;
+        dirty.instanceEntries.add(instance.entryPosition, instance.entryPosition + 1);
+    }
+    instanceEntries.pop_back();
+    instanceEntries[0].x = static_cast<uint32_t>(instanceEntries.size() - 1);
+    dirty.instanceEntries.add(0, 1);
+    dirty.countsChanged = true;
+
+    // Nothing refers to the objects anymore, their model matrices stay until the range is reused
+    objectAllocator.free(instance.firstObject, instance.objectCount);
+    instance = InstanceObjects();
+    freeInstanceIds.push_back(instanceId);
+}
+
+void NaniteScene::moveInstance(uint32_t instanceId, const glm::mat4& transform)
+{
+    ASSERT(instanceAlive(instanceId), "Instance was removed");
+    naniteObjects[instanceId].rootTransform = transform;
+    writeInstanceObjects(instanceId);
+    const auto& instance = instanceObjects[instanceId];
+    dirty.objects.add(instance.firstObject, instance.firstObject + instance.objectCount);
+}
+
+void NaniteScene::setInstanceLODBias(uint32_t instanceId, float lodBias)
+{
+    ASSERT(instanceAlive(instanceId), "Instance was removed");
+    ASSERT(lodBias > 0.0f, "LOD bias has to be positive");
+    auto& instance = instanceObjects[instanceId];
+    instance.lodBias = lodBias;
+    std::fill_n(lodBiases.begin() + instance.firstObject, instance.objectCount, lodBias);
+    dirty.objects.add(instance.firstObject, instance.firstObject + instance.objectCount);
 }
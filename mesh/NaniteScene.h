@@ -1,27 +1,62 @@
 #pragma once
 
+#include <functional>
 #include <map>
+#include <memory>
+#include <unordered_map>
 
 #include "Instance.h"
+#include "SceneAllocator.h"
+
+// Host changes of a built scene that the GPU copies of its arrays still miss, see NaniteScene::spawnInstance()
+struct SceneDirtyRanges {
+	DirtyRanges objects; // Into modelMats and lodBiases
+	DirtyRanges roots; // Into initNodeInfoIndices, element 0 holds the root count
+	DirtyRanges instanceEntries; // Into instanceEntries, element 0 holds the instance count
+	bool countsChanged = false; // Root count, depth count or an array size changed, which command buffers record
+
+	bool empty() const { return objects.empty() && roots.empty() && instanceEntries.empty() && !countsChanged; }
+};
+
+// Part of a prefab, a mesh or a prefab added before it
+struct PrefabMember {
+	uint32_t meshHandle = -1;
+	uint32_t prefabHandle = -1; // Used instead of meshHandle when set
+	glm::mat4 transform = glm::mat4(1.0f); // Relative to the prefab
+};
+
+namespace vks {
+	class ThreadPool;
+}
+class MappedFile;
 
 class NaniteScene {
 public:
+	NaniteScene();
+	~NaniteScene();
+
 	std::vector<Instance> naniteObjects;
+	// Mesh registry, a handle is the index of a mesh in naniteMeshes and stays valid for the lifetime of the scene.
+	// Meshes with the same content hash (NaniteMesh::contentHash) are stored once, whatever file they came from
 	std::vector<NaniteMesh> naniteMeshes;
-	std::map<std::string, uint32_t> naniteMeshSceneIndices;
-	std::vector<uint32_t> indexOffsets;
+	std::unordered_map<uint64_t, uint32_t> naniteMeshHandles; // By content hash
+	std::map<std::string, uint32_t> naniteMeshSceneIndices; // By name
+	std::vector<uint32_t> indexOffsets; // First vertex of every mesh in the scene vertex buffer
 	std::vector<uint32_t> indexCounts;
+	std::vector<uint32_t> firstIndices; // First index of every mesh in the scene index buffer
 
 	vkglTF::Model::Vertices vertices;
 	vkglTF::Model::Indices indices;
+	// Vertices and indices are streamed into a page pool (PagePool.h), createNaniteSceneInfo() only lays them out
+	bool streamed = false;
 
-	std::shared_ptr<NaniteBVHNode> virtualRootNode; // The root node that connects all instances' root nodes
-	std::vector<BVHNodeInfo> bvhNodeInfos; // cleaned version
+	std::vector<BVHNodeInfo> bvhNodeInfos; // cleaned version, the node blocks of every mesh and prefab
 	std::vector<uint32_t> clusterIndexOffsets; 
 	std::vector<uint32_t> depthCounts;
 	std::vector<uint32_t> depthLeafCounts; // Just for stats, not in usage
-	std::vector<uint32_t> initNodeInfoIndices;
-	uint32_t maxDepthCounts = 0;
+	// (root count, 0), then (node, first object of the instance) for every root, the traversal seed
+	std::vector<glm::uvec2> initNodeInfoIndices;
+	uint32_t maxDepthCounts = 0; // Largest node count of a depth so far, sizes the traversal queues
 
 	std::vector<uint32_t> clusterIndexCounts;
 	uint32_t maxClusterNum = 0;
@@ -36,18 +71,103 @@ public:
 	std::vector<ClusterInfo> clusterInfo;
 	std::vector<ErrorInfo> errorInfo;
 
-	void addNaniteMesh(const std::string & meshName, NaniteMesh& naniteMesh) {
-		//naniteMeshes[meshName] = naniteMesh;
+	// Prefabs, instance trees placed as a whole. Their BVH is built once, over the roots of the members, and all
+	// instances of a prefab share it like the instances of a mesh share the mesh BVH
+	struct Prefab {
+		std::vector<PrefabMember> members;
+	};
+	std::vector<Prefab> prefabs;
+	std::map<std::string, uint32_t> prefabIndices; // By name
+
+	// The BVH of a mesh or prefab in bvhNodeInfos, shared by all of its instances. An instance owns objectCount model
+	// matrices, BVHNodeInfo::objectId of the nodes is relative to the first of them. Prefab nodes over the members use
+	// object 0, the prefab transform, the nodes of the members their own objects
+	struct NodeBlock {
+		uint32_t firstNode = 0; // bfs order, roots first
+		uint32_t nodeCount = 0;
+		uint32_t rootCount = 0;
+		std::vector<glm::mat4> objectTransforms; // Relative to the instance
+		std::vector<uint32_t> depthCounts;
+		std::vector<uint32_t> depthLeafCounts;
+		uint32_t indexCount = 0; // Over all objects
+		uint32_t clusterCount = 0;
+		std::vector<glm::uvec2> coarseCut; // (cluster, object) of the coarsest LOD, see BlockCullInfo
+	};
+	// Model matrices and roots of an instance
+	struct InstanceObjects {
+		uint32_t firstObject = 0; // Into modelMats
+		uint32_t objectCount = 0;
+		std::vector<uint32_t> rootPositions; // Into initNodeInfoIndices
+		uint32_t entryPosition = 0; // Into instanceEntries
+		float lodBias = 1.0f;
+		bool alive = false;
 	};
+	std::vector<NodeBlock> nodeBlocks; // Meshes by handle, then prefabs by handle
+	// By instance id, the index of an instance in naniteObjects. Ids of removed instances are reused
+	std::vector<InstanceObjects> instanceObjects;
+	std::vector<glm::mat4> modelMats; // By object, BVHNodeInfo::objectId after traversal and the model matrix buffer
+	std::vector<float> lodBiases; // By object, scales the projected errors of its nodes and clusters. Above 1 refines
+	std::vector<uint32_t> objectInstances; // Instance id of every object
+	std::vector<uint32_t> freeInstanceIds;
+	RangeAllocator objectAllocator;
+	SceneDirtyRanges dirty;
 
-	Instance& addInstance(const std::string & meshName, glm::mat4 transform) {
-		//Instance instance(&naniteMeshes[meshName], transform);
-		//naniteObjects.push_back(instance);
-		//return naniteObjects.back();
-	}
+	// Instance culling, one entry per instance is culled as a whole before the BVH traversal. Visible instances either
+	// emit the coarsest cut of their block right away or seed the traversal with their roots, see instanceculling.comp
+	std::vector<BlockCullInfo> blockCullInfos; // By node block
+	std::vector<glm::uvec2> coarseCutClusters; // (cluster, object relative to the instance), the coarse cuts of all blocks
+	// (instance count, 0), then (node block, first object) of every alive instance
+	std::vector<glm::uvec2> instanceEntries;
+
+	// Takes the mesh over, unless a mesh with the same content is registered already
+	uint32_t addNaniteMesh(const std::string & meshName, NaniteMesh&& naniteMesh);
+	uint32_t findNaniteMesh(const std::string & meshName) const;
+
+	// referenceMesh of the instances is only updated by createNaniteSceneInfo(), adding meshes moves them
+	Instance& addInstance(uint32_t meshHandle, const glm::mat4& transform);
+	Instance& addInstance(const std::string & meshName, const glm::mat4& transform) { return addInstance(findNaniteMesh(meshName), transform); }
+
+	uint32_t addPrefab(const std::string & prefabName, const std::vector<PrefabMember>& members);
+	uint32_t findPrefab(const std::string & prefabName) const;
+	Instance& addPrefabInstance(uint32_t prefabHandle, const glm::mat4& transform);
+	uint32_t blockHandle(const Instance& instance) const;
 
 	void createNaniteSceneInfo(vks::VulkanDevice* device, VkQueue transferQueue);
+
+	// Everything createNaniteSceneInfo() builds, see writePreparedScene(). When set, createNaniteSceneInfo() maps the file
+	// instead of building the scene info if it was written for the same meshes, prefabs and instances, and writes it otherwise
+	std::string preparedSceneFile;
+	// Hash of the meshes, the prefabs, the instances and their transforms, the key of a prepared scene
+	uint64_t computeSceneKey() const;
+	// Only scenes without removed instances, as createNaniteSceneInfo() leaves them
+	bool writePreparedScene(const std::string& filename) const;
+
+	// Instances of a built scene, each call costs the objects, roots and entry of one instance and records what changed in `dirty`.
+	// The mesh or prefab has to be part of the scene info already, objects and ids of removed instances are reused
+	uint32_t spawnInstance(uint32_t meshHandle, const glm::mat4& transform);
+	uint32_t spawnPrefabInstance(uint32_t prefabHandle, const glm::mat4& transform);
+	void removeInstance(uint32_t instanceId);
+	void moveInstance(uint32_t instanceId, const glm::mat4& transform); // Only rewrites the model matrices of the instance
+	void setInstanceLODBias(uint32_t instanceId, float lodBias); // Same for the LOD biases, stays with the instance until it is removed
+	bool instanceAlive(uint32_t instanceId) const { return instanceId < instanceObjects.size() && instanceObjects[instanceId].alive; }
+	uint32_t instanceCount() const { return static_cast<uint32_t>(instanceObjects.size() - freeInstanceIds.size()); }
+
 	void createVertexIndexBuffer(vks::VulkanDevice* device, VkQueue transferQueue);
 	void createClusterInfos(vks::VulkanDevice* device, VkQueue transferQueue);
 	void createBVHNodeInfos(vks::VulkanDevice* device, VkQueue transferQueue);
+
+private:
+	std::unique_ptr<vks::ThreadPool> threadPool; // Of parallelFor(), kept for every later build step
+	// Jobs must not call parallelFor() themselves, they would wait for the pool they run on
+	void parallelFor(size_t count, const std::function<void(size_t)>& job);
+	void createPrefabBlock(uint32_t prefabHandle, std::vector<std::vector<BVHNodeInfo>>& blockNodes);
+	void placeInstances();
+	std::unique_ptr<MappedFile> preparedScene; // Only while createNaniteSceneInfo() runs, when the file matches the scene
+	bool mapPreparedScene(const std::string& filename);
+	void readPreparedNodes();
+	void readPreparedInstances();
+	void createInstanceEntries();
+	uint32_t spawn(Instance&& instance);
+	void writeInstanceObjects(uint32_t instanceId);
+	void addInstanceCounts(uint32_t instanceId, int sign);
 };
\ No newline at end of file
@@ -0,0 +1,183 @@
+#include "PagePool.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include "ResidencyManager.h"
+
+namespace {
+    const uint32_t pageVertexBytes = 2 * sizeof(glm::vec3) + sizeof(glm::vec2); // Position, normal and uv of a page vertex
+}
+
+void PagePool::init(vks::VulkanDevice* device, NaniteScene& scene)
+{
+    this->device = device;
+    this->scene = &scene;
+    vertexCapacity = 0;
+    triangleCapacity = 0;
+    clusterLodLevels.assign(scene.clusterInfo.size(), 0);
+    pendingSlots.clear();
+    pendingRanges.clear();
+    for (size_t m = 0; m < scene.naniteMeshes.size(); m++)
+    {
+        const uint32_t meshOffset = scene.clusterIndexOffsets[m];
+        for (const auto& page : scene.naniteMeshes[m].streamingPages)
+        {
+            uint32_t triangles = 0;
+            for (uint32_t cluster : page.clusters)
+            {
+                const ClusterInfo& info = scene.clusterInfo[meshOffset + cluster];
+                triangles += info.triangleIndicesEnd - info.triangleIndicesStart;
+                clusterLodLevels[meshOffset + cluster] = page.lodLevel;
+            }
+            // The vertices are what is left of the page, see StreamingPage::payloadSize()
+            const uint32_t fixedBytes = StreamingPage::payloadSize(static_cast<uint32_t>(page.clusters.size()), 0, triangles);
+            ASSERT(page.size >= fixedBytes, "Streaming page smaller than its clusters");
+            vertexCapacity = std::max(vertexCapacity, (page.size - fixedBytes) / pageVertexBytes);
+            triangleCapacity = std::max(triangleCapacity, triangles);
+        }
+    }
+    // Culling skips clusters that are not resident, their ranges are placed once their page is. Until then they keep
+    // their length, budget.comp and the CPU reference count the triangles of clusters that are not resident as well
+    for (auto& info : scene.clusterInfo)
+    {
+        info.triangleIndicesEnd -= info.triangleIndicesStart;
+        info.triangleIndicesStart = 0;
+    }
+    clusterStates.assign(scene.clusterInfo.size(), 0);
+}
+
+uint64_t PagePool::slotBytes() const
+{
+    return uint64_t(vertexCapacity) * sizeof(vkglTF::Vertex) + uint64_t(triangleCapacity) * 3 * sizeof(uint32_t);
+}
+
+void PagePool::createBuffers(uint32_t slotCount)
+{
+    slots = slotCount;
+    scene->vertices.count = slots * vertexCapacity;
+    scene->indices.count = slots * triangleCapacity * 3;
+    VK_CHECK_RESULT(device->createBuffer(
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        VkDeviceSize(scene->vertices.count) * sizeof(vkglTF::Vertex),
+        &scene->vertices.buffer,
+        &scene->vertices.memory));
+    VK_CHECK_RESULT(device->createBuffer(
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        VkDeviceSize(scene->indices.count) * sizeof(uint32_t),
+        &scene->indices.buffer,
+        &scene->indices.memory));
+}
+
+void PagePool::upload(uint32_t slot, uint32_t clusterOffset, const std::vector<char>& data)
+{
+    const uint32_t* header = reinterpret_cast<const uint32_t*>(data.data());
+    const uint32_t clusterCount = header[0], vertexCount = header[1], triangleCount = header[2];
+    ASSERT(vertexCount <= vertexCapacity && triangleCount <= triangleCapacity, "Streaming page larger than a slot");
+    ASSERT(data.size() >= StreamingPage::payloadSize(clusterCount, vertexCount, triangleCount), "Truncated streaming page");
+    const uint32_t* clusters = header + 3;
+    const uint32_t* triangleOffsets = clusters + clusterCount;
+    const glm::vec3* positions = reinterpret_cast<const glm::vec3*>(triangleOffsets + clusterCount + 1);
+    const glm::vec3* normals = positions + vertexCount;
+    const glm::vec2* uvs = reinterpret_cast<const glm::vec2*>(normals + vertexCount);
+    const uint32_t* indices = reinterpret_cast<const uint32_t*>(uvs + vertexCount);
+
+    // A page holds a single level
+    const float lodLevel = clusterCount > 0 ? static_cast<float>(clusterLodLevels[clusterOffset + clusters[0]]) : 0.0f;
+    PendingSlot& pending = pendingSlots[slot];
+    pending.vertices.resize(vertexCount);
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        vkglTF::Vertex& v = pending.vertices[i];
+        v.pos = positions[i];
+        v.normal = normals[i];
+        v.uv = uvs[i];
+        v.joint0 = glm::vec4(lodLevel);
+        v.weight0 = glm::vec4(0.0f);
+    }
+    const uint32_t firstVertex = slot * vertexCapacity;
+    pending.indices.resize(triangleCount * 3);
+    for (uint32_t i = 0; i < triangleCount * 3; i++)
+    {
+        pending.indices[i] = indices[i] + firstVertex;
+    }
+    const uint32_t firstTriangle = slot * triangleCapacity;
+    for (uint32_t c = 0; c < clusterCount; c++)
+    {
+        const uint32_t cluster = clusterOffset + clusters[c];
+        const glm::uvec2 range(firstTriangle + triangleOffsets[c], firstTriangle + triangleOffsets[c + 1]);
+        scene->clusterInfo[cluster].triangleIndicesStart = range.x;
+        scene->clusterInfo[cluster].triangleIndicesEnd = range.y;
+        pendingRanges[cluster] = range;
+    }
+}
+
+void PagePool::flush(VkQueue queue, VkBuffer clusterInfoBuffer, VkBuffer clusterStateBuffer, ResidencyManager& residency)
+{
+    const bool statesChanged = residency.clusterStatesChanged;
+    if (pendingSlots.empty() && pendingRanges.empty() && !statesChanged) {
+        return;
+    }
+    if (statesChanged) {
+        for (uint32_t i = 0; i < static_cast<uint32_t>(clusterStates.size()); i++)
+        {
+            clusterStates[i] = residency.clusterState(i);
+        }
+        residency.clusterStatesChanged = false;
+    }
+
+    VkDeviceSize stagingSize = pendingRanges.size() * sizeof(glm::uvec2) + (statesChanged ? clusterStates.size() * sizeof(uint32_t) : 0);
+    for (const auto& [slot, pending] : pendingSlots)
+    {
+        stagingSize += pending.vertices.size() * sizeof(vkglTF::Vertex) + pending.indices.size() * sizeof(uint32_t);
+    }
+    vks::Buffer staging;
+    VK_CHECK_RESULT(device->createBuffer(
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &staging,
+        stagingSize));
+    VK_CHECK_RESULT(staging.map());
+
+    // Everything goes through one staging buffer, one region per slot, cluster range and the states
+    std::vector<VkBufferCopy> vertexCopies, indexCopies, rangeCopies, stateCopies;
+    VkDeviceSize stagingOffset = 0;
+    auto stage = [&](const void* src, VkDeviceSize size, VkDeviceSize dstOffset, std::vector<VkBufferCopy>& copies) {
+        if (size == 0) return;
+        std::memcpy(static_cast<char*>(staging.mapped) + stagingOffset, src, size);
+        copies.push_back({ stagingOffset, dstOffset, size });
+        stagingOffset += size;
+    };
+    for (const auto& [slot, pending] : pendingSlots)
+    {
+        ASSERT(slot < slots, "Page slot out of range");
+        stage(pending.vertices.data(), pending.vertices.size() * sizeof(vkglTF::Vertex),
+            VkDeviceSize(slot) * vertexCapacity * sizeof(vkglTF::Vertex), vertexCopies);
+        stage(pending.indices.data(), pending.indices.size() * sizeof(uint32_t),
+            VkDeviceSize(slot) * triangleCapacity * 3 * sizeof(uint32_t), indexCopies);
+    }
+    for (const auto& [cluster, range] : pendingRanges)
+    {
+        stage(&range, sizeof(glm::uvec2), VkDeviceSize(cluster) * sizeof(ClusterInfo) + offsetof(ClusterInfo, triangleIndicesStart), rangeCopies);
+    }
+    if (statesChanged) {
+        stage(clusterStates.data(), clusterStates.size() * sizeof(uint32_t), 0, stateCopies);
+    }
+    staging.unmap();
+
+    VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    auto copy = [&](VkBuffer dst, const std::vector<VkBufferCopy>& copies) {
+        if (!copies.empty()) vkCmdCopyBuffer(copyCmd, staging.buffer, dst, static_cast<uint32_t>(copies.size()), copies.data());
+    };
+    copy(scene->vertices.buffer, vertexCopies);
+    copy(scene->indices.buffer, indexCopies);
+    copy(clusterInfoBuffer, rangeCopies);
+    copy(clusterStateBuffer, stateCopies);
+    device->flushCommandBuffer(copyCmd, queue, true);
+    staging.destroy();
+    pendingSlots.clear();
+    pendingRanges.clear();
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "NaniteScene.h"
+
+class ResidencyManager;
+
+/*
+	GPU side of cluster streaming: a fixed number of slots in the scene vertex and index buffers, one resident
+	streaming page (StreamingPage.h) per slot. Every slot holds as many vertices and triangles as the largest page of
+	the scene, so the slots are the slots of the ResidencyManager and any page fits any of them.
+	upload() is the page uploader of the ResidencyManager, it unpacks a page on the CPU and points the triangle ranges
+	of its clusters at the slot. flush() copies everything uploaded since the last flush with one transfer, together with
+	the cluster states culling.comp constrains the cut to (ResidencyManager::clusterState()).
+*/
+class PagePool {
+public:
+	// Slot sizes from the page table of every scene mesh, the scene needs its cluster infos. Clusters without a
+	// resident page start at triangle 0
+	void init(vks::VulkanDevice* device, NaniteScene& scene);
+	uint64_t slotBytes() const;
+	// Replaces the scene vertex and index buffers by the pool, ResidencyManager::slotCount() slots
+	void createBuffers(uint32_t slotCount);
+	// Only stages the page, uploads can start before the buffers are created
+	void upload(uint32_t slot, uint32_t clusterOffset, const std::vector<char>& data);
+	// clusterStateBuffer holds one uint per scene cluster, written when the residency changed
+	void flush(VkQueue queue, VkBuffer clusterInfoBuffer, VkBuffer clusterStateBuffer, ResidencyManager& residency);
+
+	uint32_t slotCount() const { return slots; }
+	uint32_t slotVertices() const { return vertexCapacity; }
+	uint32_t slotTriangles() const { return triangleCapacity; }
+
+private:
+	struct PendingSlot {
+		std::vector<vkglTF::Vertex> vertices;
+		std::vector<uint32_t> indices; // Into the scene vertex buffer
+	};
+
+	vks::VulkanDevice* device = nullptr;
+	NaniteScene* scene = nullptr;
+	uint32_t slots = 0;
+	uint32_t vertexCapacity = 0;
+	uint32_t triangleCapacity = 0;
+	std::vector<uint32_t> clusterLodLevels; // By scene cluster, the joint0 of its vertices as in ClusteredLOD::initUniqueVertexBuffer()
+	// Uploads since the last flush, a slot reused before it keeps only its last page
+	std::map<uint32_t, PendingSlot> pendingSlots;
+	std::map<uint32_t, glm::uvec2> pendingRanges; // Triangle range by scene cluster
+	std::vector<uint32_t> clusterStates;
+};
@@ -0,0 +1,421 @@
+#include "QEMSimplifier.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "utils.h"
+
+void QEMSimplifier::setMesh(const float* positions_, uint32_t vertexCount_, const uint32_t* indices_, uint32_t triangleCount_)
+{
+    vertexCount = vertexCount_;
+    triangleCount = triangleCount_;
+    liveTriangles = triangleCount;
+
+    positions.assign(positions_, positions_ + size_t(vertexCount) * 3);
+    indices.assign(indices_, indices_ + size_t(triangleCount) * 3);
+    triangleDeleted.assign(triangleCount, 0);
+    triangleGroups.assign(triangleCount, -1);
+    vertexFlags.assign(vertexCount, 0);
+
+    // Same quadrics as MyModQuadricT::initialize()
+    for (auto& q : quadrics) q.assign(vertexCount, 0.0);
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        const uint32_t* tri = &indices[size_t(t) * 3];
+        ASSERT(tri[0] < vertexCount && tri[1] < vertexCount && tri[2] < vertexCount, "Triangle index out of range");
+        double p[3][3];
+        for (int k = 0; k < 3; k++)
+            for (int c = 0; c < 3; c++)
+                p[k][c] = positions[size_t(tri[k]) * 3 + c];
+        double e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+        double e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+        double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        double area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (area > FLT_MIN)
+        {
+            n[0] /= area; n[1] /= area; n[2] /= area;
+            area *= 0.5;
+        }
+        const double a = n[0], b = n[1], c = n[2];
+        const double d = -(p[0][0] * a + p[0][1] * b + p[0][2] * c);
+        const double coefficients[10] = { a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d };
+        for (int k = 0; k < 3; k++)
+            for (int i = 0; i < 10; i++)
+                quadrics[i][tri[k]] += coefficients[i] * area;
+    }
+
+    // Vertex -> triangle adjacency
+    adjacencyOffsets.assign(vertexCount + 1, 0);
+    for (uint32_t v : indices) adjacencyOffsets[v + 1]++;
+    for (uint32_t v = 0; v < vertexCount; v++) adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    adjacencyTriangles.resize(indices.size());
+    chainTail.assign(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1); // Used as insertion cursor first
+    for (uint32_t t = 0; t < triangleCount; t++)
+        for (int k = 0; k < 3; k++)
+            adjacencyTriangles[chainTail[indices[size_t(t) * 3 + k]]++] = t;
+
+    chainNext.assign(vertexCount, invalidIndex);
+    for (uint32_t v = 0; v < vertexCount; v++) chainTail[v] = v;
+
+    heap.clear();
+    heapPositions.assign(vertexCount, invalidIndex);
+    priorities.assign(vertexCount, 0.0f);
+    collapseTargets.assign(vertexCount, invalidIndex);
+    stamps.assign(vertexCount, 0);
+    stampCounter = 0;
+}
+
+void QEMSimplifier::setTriangleGroups(const std::vector<int>& triangleGroups_, uint32_t groupCount)
+{
+    ASSERT(triangleGroups_.size() == triangleCount, "One cluster group per triangle is required");
+    triangleGroups = triangleGroups_;
+
+    groupOffsets.assign(groupCount + 1, 0);
+    for (int group : triangleGroups)
+        if (group >= 0 && uint32_t(group) < groupCount) groupOffsets[group + 1]++;
+    for (uint32_t i = 0; i < groupCount; i++) groupOffsets[i + 1] += groupOffsets[i];
+    groupTriangles.resize(groupOffsets[groupCount]);
+    std::vector<uint32_t> cursor(groupOffsets.begin(), groupOffsets.end() - 1);
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        int group = triangleGroups[t];
+        if (group >= 0 && uint32_t(group) < groupCount) groupTriangles[cursor[group]++] = t;
+    }
+
+    // Lock both vertices of every edge that is a mesh boundary, a group border or non-manifold
+    edges.clear();
+    edges.reserve(size_t(triangleCount) * 3);
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        if (triangleDeleted[t]) continue;
+        for (int k = 0; k < 3; k++)
+        {
+            uint64_t a = indices[size_t(t) * 3 + k], b = indices[size_t(t) * 3 + (k + 1) % 3];
+            edges.emplace_back(std::min(a, b) << 32 | std::max(a, b), t);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    for (size_t i = 0; i < edges.size();)
+    {
+        size_t j = i + 1;
+        while (j < edges.size() && edges[j].first == edges[i].first) j++;
+        uint8_t flags = 0;
+        if (j - i == 1)
+            flags = VERTEX_LOCKED | VERTEX_BOUNDARY;
+        else if (j - i > 2 || triangleGroups[edges[i].second] != triangleGroups[edges[i + 1].second])
+            flags = VERTEX_LOCKED;
+        if (flags)
+        {
+            vertexFlags[uint32_t(edges[i].first >> 32)] |= flags;
+            vertexFlags[uint32_t(edges[i].first)] |= flags;
+        }
+        i = j;
+    }
+}
+
+template <typename F>
+void QEMSimplifier::forEachTriangle(uint32_t v, F&& f) const
+{
+    for (uint32_t u = v; u != invalidIndex; u = chainNext[u])
+    {
+        for (uint32_t i = adjacencyOffsets[u]; i < adjacencyOffsets[u + 1]; i++)
+        {
+            uint32_t t = adjacencyTriangles[i];
+            if (!triangleDeleted[t]) f(t);
+        }
+    }
+}
+
+uint32_t QEMSimplifier::nextStamp()
+{
+    if (++stampCounter == 0)
+    {
+        std::fill(stamps.begin(), stamps.end(), 0);
+        stampCounter = 1;
+    }
+    return stampCounter;
+}
+
+void QEMSimplifier::gatherNeighbors(uint32_t v, std::vector<uint32_t>& out)
+{
+    out.clear();
+    uint32_t stamp = nextStamp();
+    forEachTriangle(v, [&](uint32_t t) {
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t w = indices[size_t(t) * 3 + k];
+            if (w != v && stamps[w] != stamp)
+            {
+                stamps[w] = stamp;
+                out.push_back(w);
+            }
+        }
+    });
+}
+
+uint32_t QEMSimplifier::countNeighbors(uint32_t v)
+{
+    uint32_t count = 0;
+    uint32_t stamp = nextStamp();
+    forEachTriangle(v, [&](uint32_t t) {
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t w = indices[size_t(t) * 3 + k];
+            if (w != v && stamps[w] != stamp)
+            {
+                stamps[w] = stamp;
+                count++;
+            }
+        }
+    });
+    return count;
+}
+
+bool QEMSimplifier::isCollapseLegal(uint32_t v0, uint32_t v1)
+{
+    // Locked or already collapsed. Boundary vertices are always locked, so v0 is an interior vertex from here on
+    if ((vertexFlags[v0] & (VERTEX_LOCKED | VERTEX_DELETED)) || (vertexFlags[v1] & VERTEX_DELETED)) return false;
+
+    // vl is opposite to v0 -> v1 in its face, vr opposite to v1 -> v0
+    uint32_t vl = invalidIndex, vr = invalidIndex;
+    uint32_t faces = 0;
+    bool manifold = true;
+    forEachTriangle(v0, [&](uint32_t t) {
+        const uint32_t* tri = &indices[size_t(t) * 3];
+        int k = tri[0] == v0 ? 0 : (tri[1] == v0 ? 1 : 2);
+        uint32_t next = tri[(k + 1) % 3], prev = tri[(k + 2) % 3];
+        faces++;
+        if (next == v1)
+        {
+            manifold &= vl == invalidIndex;
+            vl = prev;
+        }
+        else if (prev == v1)
+        {
+            manifold &= vr == invalidIndex;
+            vr = next;
+        }
+    });
+    if (!manifold || (vl == invalidIndex && vr == invalidIndex)) return false;
+    // There have to be at least 2 incident faces at v0
+    if (faces < 2) return false;
+    if (vl == vr) return false;
+
+    // One ring intersection test, v0 and v1 may only share vl and vr
+    gatherNeighbors(v0, neighbors);
+    uint32_t stamp = nextStamp();
+    forEachTriangle(v1, [&](uint32_t t) {
+        for (int k = 0; k < 3; k++) stamps[indices[size_t(t) * 3 + k]] = stamp;
+    });
+    for (uint32_t w : neighbors)
+    {
+        if (w != v1 && w != vl && w != vr && stamps[w] == stamp) return false;
+    }
+
+    // Collapsing would fold a tetrahedron
+    if (vl != invalidIndex && vr != invalidIndex)
+    {
+        bool connected = false;
+        forEachTriangle(vl, [&](uint32_t t) {
+            const uint32_t* tri = &indices[size_t(t) * 3];
+            connected |= tri[0] == vr || tri[1] == vr || tri[2] == vr;
+        });
+        if (connected && countNeighbors(vl) == 3 && countNeighbors(vr) == 3) return false;
+    }
+    return true;
+}
+
+float QEMSimplifier::collapsePriority(uint32_t v0, uint32_t v1) const
+{
+    double q[10];
+    for (int i = 0; i < 10; i++) q[i] = quadrics[i][v0] + quadrics[i][v1];
+    const double x = positions[size_t(v1) * 3], y = positions[size_t(v1) * 3 + 1], z = positions[size_t(v1) * 3 + 2];
+    // Geometry::QuadricT::operator()
+    double err = q[0] * x * x + 2.0 * q[1] * x * y + 2.0 * q[2] * x * z + 2.0 * q[3] * x
+        + q[4] * y * y + 2.0 * q[5] * y * z + 2.0 * q[6] * y
+        + q[7] * z * z + 2.0 * q[8] * z
+        + q[9];
+    return float(err);
+}
+
+void QEMSimplifier::collapse(uint32_t v0, uint32_t v1)
+{
+    forEachTriangle(v0, [&](uint32_t t) {
+        uint32_t* tri = &indices[size_t(t) * 3];
+        if (tri[0] == v1 || tri[1] == v1 || tri[2] == v1)
+        {
+            triangleDeleted[t] = 1;
+            liveTriangles--;
+        }
+        else
+        {
+            for (int k = 0; k < 3; k++)
+                if (tri[k] == v0) tri[k] = v1;
+        }
+    });
+    chainNext[chainTail[v1]] = v0;
+    chainTail[v1] = chainTail[v0];
+    for (auto& q : quadrics) q[v1] += q[v0];
+    vertexFlags[v0] |= VERTEX_DELETED;
+    heapRemove(v0);
+}
+
+void QEMSimplifier::updateVertex(uint32_t v)
+{
+    if ((vertexFlags[v] & (VERTEX_LOCKED | VERTEX_DELETED)) || !(vertexFlags[v] & VERTEX_SELECTED))
+    {
+        heapRemove(v);
+        return;
+    }
+    gatherNeighbors(v, candidates);
+    uint32_t best = invalidIndex;
+    float bestPriority = 0.0f;
+    for (uint32_t w : candidates)
+    {
+        if (!isCollapseLegal(v, w)) continue;
+        float priority = collapsePriority(v, w);
+        if (priority >= 0.0f && (best == invalidIndex || priority < bestPriority))
+        {
+            best = w;
+            bestPriority = priority;
+        }
+    }
+    if (best == invalidIndex)
+    {
+        heapRemove(v);
+        return;
+    }
+    collapseTargets[v] = best;
+    heapUpdate(v, bestPriority);
+}
+
+double QEMSimplifier::simplifyGroup(uint32_t group, size_t targetTriangleCount)
+{
+    ASSERT(group + 1 < groupOffsets.size(), "Cluster group out of range");
+    // decimate_to_faces() does nothing if the target is already reached
+    if (targetTriangleCount >= liveTriangles) return 0.0;
+
+    groupVertices.clear();
+    for (uint32_t i = groupOffsets[group]; i < groupOffsets[group + 1]; i++)
+    {
+        uint32_t t = groupTriangles[i];
+        if (triangleDeleted[t]) continue;
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t v = indices[size_t(t) * 3 + k];
+            if (!(vertexFlags[v] & VERTEX_SELECTED))
+            {
+                vertexFlags[v] |= VERTEX_SELECTED;
+                groupVertices.push_back(v);
+            }
+        }
+    }
+    for (uint32_t v : groupVertices) updateVertex(v);
+
+    double totalError = 0.0;
+    while (!heap.empty() && liveTriangles > targetTriangleCount)
+    {
+        uint32_t v0 = heapPop();
+        uint32_t v1 = collapseTargets[v0];
+        if (!isCollapseLegal(v0, v1)) continue;
+        gatherNeighbors(v0, support);
+        totalError += collapsePriority(v0, v1);
+        collapse(v0, v1);
+        for (uint32_t v : support)
+        {
+            if (vertexFlags[v] & VERTEX_SELECTED) updateVertex(v);
+        }
+    }
+
+    for (uint32_t v : groupVertices) vertexFlags[v] &= ~VERTEX_SELECTED;
+    for (uint32_t v : heap) heapPositions[v] = invalidIndex;
+    heap.clear();
+    return totalError;
+}
+
+void QEMSimplifier::compact(std::vector<uint32_t>& vertexRemap, std::vector<uint32_t>& outIndices, std::vector<int>& outTriangleGroups) const
+{
+    std::vector<uint32_t> newIndex(vertexCount, invalidIndex);
+    vertexRemap.clear();
+    for (uint32_t v = 0; v < vertexCount; v++)
+    {
+        if (vertexFlags[v] & VERTEX_DELETED) continue;
+        newIndex[v] = static_cast<uint32_t>(vertexRemap.size());
+        vertexRemap.push_back(v);
+    }
+    outIndices.clear();
+    outIndices.reserve(liveTriangles * 3);
+    outTriangleGroups.clear();
+    outTriangleGroups.reserve(liveTriangles);
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        if (triangleDeleted[t]) continue;
+        for (int k = 0; k < 3; k++) outIndices.push_back(newIndex[indices[size_t(t) * 3 + k]]);
+        outTriangleGroups.push_back(triangleGroups[t]);
+    }
+}
+
+void QEMSimplifier::heapUpdate(uint32_t v, float priority)
+{
+    priorities[v] = priority;
+    uint32_t pos = heapPositions[v];
+    if (pos == invalidIndex)
+    {
+        pos = static_cast<uint32_t>(heap.size());
+        heap.push_back(v);
+        heapPositions[v] = pos;
+    }
+    heapSiftUp(pos);
+    heapSiftDown(heapPositions[v]);
+}
+
+void QEMSimplifier::heapRemove(uint32_t v)
+{
+    uint32_t pos = heapPositions[v];
+    if (pos == invalidIndex) return;
+    heapPositions[v] = invalidIndex;
+    uint32_t last = heap.back();
+    heap.pop_back();
+    if (pos == heap.size()) return;
+    heap[pos] = last;
+    heapPositions[last] = pos;
+    heapSiftUp(pos);
+    heapSiftDown(heapPositions[last]);
+}
+
+uint32_t QEMSimplifier::heapPop()
+{
+    uint32_t v = heap.front();
+    heapRemove(v);
+    return v;
+}
+
+void QEMSimplifier::heapSiftUp(uint32_t pos)
+{
+    while (pos > 0)
+    {
+        uint32_t parent = (pos - 1) / 2;
+        if (!heapLess(pos, parent)) break;
+        std::swap(heap[pos], heap[parent]);
+        heapPositions[heap[pos]] = pos;
+        heapPositions[heap[parent]] = parent;
+        pos = parent;
+    }
+}
+
+void QEMSimplifier::heapSiftDown(uint32_t pos)
+{
+    const uint32_t size = static_cast<uint32_t>(heap.size());
+    while (true)
+    {
+        uint32_t child = pos * 2 + 1;
+        if (child >= size) break;
+        if (child + 1 < size && heapLess(child + 1, child)) child++;
+        if (!heapLess(child, pos)) break;
+        std::swap(heap[pos], heap[child]);
+        heapPositions[heap[pos]] = pos;
+        heapPositions[heap[child]] = child;
+        pos = child;
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/*
+	Edge-collapse simplifier over flat position/index arrays, replacing DecimaterT + MyModQuadricT in Mesh::simplifyMesh.
+	It follows the same rules as the OpenMesh path so the per group error matches MyModQuadricT::total_err():
+		- area weighted plane quadrics (double), accumulated once per LOD over the whole mesh
+		- halfedge collapses v0 -> v1 that keep the position of v1, priority = float((Q(v0) + Q(v1))(p1))
+		- only vertices of the current cluster group are collapsed, group borders and mesh boundaries are locked
+		- the same legality checks as BaseDecimaterT::is_collapse_legal() and TriConnectivity::is_collapse_ok()
+		- a group stops once the face count of the whole mesh reaches the target, like decimate_to_faces()
+	The ordering of equal priority collapses may differ from OpenMesh's heap, the rules above do not.
+	All buffers are kept between calls, reuse one instance for every LOD of a mesh.
+*/
+class QEMSimplifier {
+public:
+	static constexpr uint32_t invalidIndex = UINT32_MAX;
+
+	// positions: xyz per vertex, indices: 3 per triangle (counter clockwise as in OpenMesh)
+	void setMesh(const float* positions, uint32_t vertexCount, const uint32_t* indices, uint32_t triangleCount);
+	// Cluster group of every triangle, locks vertices on group borders and on mesh boundaries
+	void setTriangleGroups(const std::vector<int>& triangleGroups, uint32_t groupCount);
+
+	// Collapses edges of one group until the whole mesh has targetTriangleCount triangles or no legal collapse is left
+	// Returns the accumulated collapse error, the same value MyModQuadricT::total_err() reports
+	double simplifyGroup(uint32_t group, size_t targetTriangleCount);
+
+	size_t liveTriangleCount() const { return liveTriangles; }
+
+	// Surviving vertices and triangles in their original order
+	// vertexRemap[newIndex] = old vertex index, indices are expressed in new vertex indices
+	void compact(std::vector<uint32_t>& vertexRemap, std::vector<uint32_t>& indices, std::vector<int>& triangleGroups) const;
+
+private:
+	enum VertexFlags : uint8_t {
+		VERTEX_LOCKED = 1 << 0,
+		VERTEX_BOUNDARY = 1 << 1,
+		VERTEX_SELECTED = 1 << 2,
+		VERTEX_DELETED = 1 << 3,
+	};
+
+	template <typename F>
+	void forEachTriangle(uint32_t v, F&& f) const;
+	void gatherNeighbors(uint32_t v, std::vector<uint32_t>& neighbors);
+	uint32_t countNeighbors(uint32_t v);
+	bool isCollapseLegal(uint32_t v0, uint32_t v1);
+	float collapsePriority(uint32_t v0, uint32_t v1) const;
+	void collapse(uint32_t v0, uint32_t v1);
+	void updateVertex(uint32_t v);
+	uint32_t nextStamp();
+
+	void heapUpdate(uint32_t v, float priority);
+	void heapRemove(uint32_t v);
+	uint32_t heapPop();
+	void heapSiftUp(uint32_t pos);
+	void heapSiftDown(uint32_t pos);
+	bool heapLess(uint32_t a, uint32_t b) const { return priorities[heap[a]] < priorities[heap[b]]; }
+
+	uint32_t vertexCount = 0;
+	uint32_t triangleCount = 0;
+	size_t liveTriangles = 0;
+
+	std::vector<float> positions;
+	// SoA quadric coefficients a2 ab ac ad b2 bc bd c2 cd d2, as Geometry::QuadricT stores them
+	std::array<std::vector<double>, 10> quadrics;
+	std::vector<uint32_t> indices;
+	std::vector<uint8_t> triangleDeleted;
+	std::vector<int> triangleGroups;
+	std::vector<uint8_t> vertexFlags;
+
+	// Original vertex -> triangle adjacency (CSR). A collapsed vertex is chained behind the vertex it was collapsed into,
+	// the triangles around v are the live triangles of every vertex on v's chain
+	std::vector<uint32_t> adjacencyOffsets;
+	std::vector<uint32_t> adjacencyTriangles;
+	std::vector<uint32_t> chainNext;
+	std::vector<uint32_t> chainTail;
+
+	// Triangles of every group (CSR)
+	std::vector<uint32_t> groupOffsets;
+	std::vector<uint32_t> groupTriangles;
+
+	// Indexed binary min-heap of vertices keyed by their cheapest legal collapse
+	std::vector<uint32_t> heap;
+	std::vector<uint32_t> heapPositions;
+	std::vector<float> priorities;
+	std::vector<uint32_t> collapseTargets;
+
+	// Scratch
+	std::vector<uint32_t> stamps;
+	uint32_t stampCounter = 0;
+	std::vector<uint32_t> neighbors;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> support;
+	std::vector<uint32_t> groupVertices;
+	std::vector<std::pair<uint64_t, uint32_t>> edges; // (min vertex << 32 | max vertex, triangle)
+};
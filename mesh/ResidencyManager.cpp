@@ -0,0 +1,375 @@
+#include "ResidencyManager.h"
+
+#include <algorithm>
+#include <fstream>
+
+#include "threadpool.hpp"
+
+namespace {
+    // Sorted, unique lists to compressed rows
+    void toCompressedRows(std::vector<std::vector<uint32_t>>& lists, std::vector<uint32_t>& offsets, std::vector<uint32_t>& values)
+    {
+        offsets.assign(1, 0);
+        values.clear();
+        for (auto& list : lists)
+        {
+            std::sort(list.begin(), list.end());
+            list.erase(std::unique(list.begin(), list.end()), list.end());
+            values.insert(values.end(), list.begin(), list.end());
+            offsets.push_back(static_cast<uint32_t>(values.size()));
+        }
+    }
+}
+
+ResidencyManager::ResidencyManager() = default;
+
+ResidencyManager::~ResidencyManager()
+{
+    shutdown();
+}
+
+void ResidencyManager::init(const NaniteScene& scene, const StreamingOptions& options, PageUploader uploader)
+{
+    shutdown();
+    this->options = options;
+    this->uploader = uploader;
+    filenames.clear();
+    pages.clear();
+    lruPages.clear();
+    completedPages.clear();
+
+    const uint32_t clusterNum = static_cast<uint32_t>(scene.clusterInfo.size());
+    clusterPages.assign(clusterNum, -1);
+    std::vector<std::vector<uint32_t>> parents(clusterNum);
+    std::vector<uint32_t> meshFirstPages;
+    for (size_t m = 0; m < scene.naniteMeshes.size(); m++)
+    {
+        const auto& naniteMesh = scene.naniteMeshes[m];
+        ASSERT(!naniteMesh.streamingPages.empty(), "Nanite mesh without streaming pages");
+        meshFirstPages.push_back(static_cast<uint32_t>(pages.size()));
+        filenames.push_back(naniteMesh.cacheDirectory + "pages.bin");
+        const uint32_t meshOffset = scene.clusterIndexOffsets[m];
+        for (const auto& streamingPage : naniteMesh.streamingPages)
+        {
+            PageEntry page;
+            page.file = static_cast<uint32_t>(filenames.size() - 1);
+            page.clusterOffset = meshOffset;
+            page.offset = streamingPage.offset;
+            page.size = streamingPage.size;
+            page.lodLevel = streamingPage.lodLevel;
+            page.pinned = streamingPage.lodLevel == naniteMesh.lodNums - 1;
+            for (uint32_t cluster : streamingPage.clusters)
+            {
+                clusterPages[meshOffset + cluster] = static_cast<uint32_t>(pages.size());
+            }
+            pages.push_back(page);
+        }
+        // Parents are indices into the next level
+        uint32_t lodOffset = meshOffset;
+        for (uint32_t i = 0; i + 1 < naniteMesh.lodNums; i++)
+        {
+            const auto& clusters = naniteMesh.meshes[i].clusters;
+            const uint32_t parentLodOffset = lodOffset + naniteMesh.meshes[i].clusterNum;
+            for (size_t k = 0; k < clusters.size(); k++)
+            {
+                for (uint32_t parent : clusters[k].parentClusterIndices)
+                {
+                    parents[lodOffset + k].push_back(parentLodOffset + parent);
+                }
+            }
+            lodOffset = parentLodOffset;
+        }
+    }
+
+    std::vector<std::vector<uint32_t>> childPages(clusterNum);
+    std::vector<std::vector<uint32_t>> parentPages(pages.size());
+    for (uint32_t c = 0; c < clusterNum; c++)
+    {
+        ASSERT(clusterPages[c] != uint32_t(-1), "Cluster without streaming page");
+        for (uint32_t parent : parents[c])
+        {
+            childPages[parent].push_back(clusterPages[c]);
+            if (clusterPages[parent] != clusterPages[c]) {
+                parentPages[clusterPages[c]].push_back(clusterPages[parent]);
+            }
+        }
+    }
+    toCompressedRows(parents, clusterParentOffsets, clusterParents);
+    toCompressedRows(childPages, clusterChildPageOffsets, clusterChildPages);
+    toCompressedRows(parentPages, pageParentOffsets, pageParents);
+
+    // Root pages are always resident, the pool grows if the budget is too small for them
+    uint32_t rootPages = static_cast<uint32_t>(std::count_if(pages.begin(), pages.end(), [](const PageEntry& page) { return page.pinned; }));
+    slots = static_cast<uint32_t>(options.memoryBudget / options.slotBytes);
+    if (slots < rootPages + 1) {
+        LOG("Streaming budget of " << options.memoryBudget << " bytes does not fit the " << rootPages << " root pages, using " << rootPages + 1 << " slots");
+        slots = rootPages + 1;
+    }
+    freeSlots.clear();
+    for (uint32_t slot = slots; slot > 0; slot--)
+    {
+        freeSlots.push_back(slot - 1);
+    }
+    frameStats = StreamingFrameStats();
+    clusterStatesChanged = true;
+    // Level by level over all meshes, so every mesh gets the same detail before any gets more
+    uint64_t preloadedBytes = 0;
+    for (uint32_t depth = 0; ; depth++)
+    {
+        bool preloaded = false;
+        for (size_t m = 0; m < scene.naniteMeshes.size(); m++)
+        {
+            const auto& levels = scene.naniteMeshes[m].cacheLevels;
+            if (depth >= levels.size()) continue;
+            const auto& range = levels[depth];
+            if (depth > 0) {
+                // Only below a preloaded parent level
+                if (pages[meshFirstPages[m] + levels[depth - 1].firstPage].state != PAGE_RESIDENT) continue;
+                if (preloadedBytes + range.pageBytes > options.preloadBytes || freeSlots.size() < range.pageCount) continue;
+                preloadedBytes += range.pageBytes;
+            }
+            ASSERT(preloadLevel(meshFirstPages[m], range), "Error reading streaming pages");
+            preloaded = true;
+        }
+        if (!preloaded) break;
+    }
+
+    ioThreadPool = std::make_unique<vks::ThreadPool>();
+    ioThreadPool->setThreadCount(std::max(options.ioThreads, 1u));
+    nextIOThread = 0;
+    std::cout << "Streaming " << pages.size() << " pages of " << clusterNum << " clusters through " << slots << " slots, "
+        << frameStats.residentPages << " pages resident" << std::endl;
+}
+
+void ResidencyManager::shutdown()
+{
+    if (!ioThreadPool) return;
+    ioThreadPool->wait();
+    ioThreadPool.reset();
+    // Reads in flight are dropped, their slots go back to the pool
+    std::lock_guard<std::mutex> lock(completedMutex);
+    for (auto& [p, data] : completedPages)
+    {
+        freeSlots.push_back(pages[p].slot);
+        pages[p].state = PAGE_ABSENT;
+        addParentRefs(p, -1);
+    }
+    completedPages.clear();
+}
+
+bool ResidencyManager::readPage(const PageEntry& page, std::vector<char>& data) const
+{
+    std::ifstream file(filenames[page.file], std::ios::binary);
+    if (!file.is_open()) return false;
+    file.seekg(page.offset);
+    data.resize(page.size);
+    file.read(data.data(), data.size());
+    return bool(file);
+}
+
+bool ResidencyManager::preloadLevel(uint32_t meshFirstPage, const CacheLevelRange& range)
+{
+    const uint32_t firstPage = meshFirstPage + range.firstPage;
+    std::ifstream file(filenames[pages[firstPage].file], std::ios::binary);
+    if (!file.is_open()) return false;
+    std::vector<char> levelData(range.pageBytes);
+    file.seekg(range.pageOffset);
+    file.read(levelData.data(), levelData.size());
+    if (!file) return false;
+    std::vector<char> data;
+    for (uint32_t p = firstPage; p < firstPage + range.pageCount; p++)
+    {
+        auto begin = levelData.begin() + (pages[p].offset - range.pageOffset);
+        data.assign(begin, begin + pages[p].size);
+        pages[p].slot = freeSlots.back();
+        freeSlots.pop_back();
+        addParentRefs(p, 1);
+        makeResident(p, data, 0);
+    }
+    return true;
+}
+
+void ResidencyManager::makeResident(uint32_t p, const std::vector<char>& data, uint64_t frame)
+{
+    auto& page = pages[p];
+    page.state = PAGE_RESIDENT;
+    page.lastUsedFrame = frame;
+    if (!page.pinned) {
+        lruPages.emplace(frame, p);
+    }
+    frameStats.residentPages++;
+    frameStats.residentBytes += page.size;
+    clusterStatesChanged = true;
+    if (uploader) {
+        uploader(page.slot, page.clusterOffset, data);
+    }
+}
+
+void ResidencyManager::addParentRefs(uint32_t p, int delta)
+{
+    // Taken when the read of a page starts, so its parents stay resident until it is evicted or its read failed
+    for (uint32_t i = pageParentOffsets[p]; i < pageParentOffsets[p + 1]; i++)
+    {
+        pages[pageParents[i]].childPageRefs += delta;
+    }
+}
+
+void ResidencyManager::touch(uint32_t p, uint64_t frame)
+{
+    auto& page = pages[p];
+    if (page.state == PAGE_RESIDENT && !page.pinned && page.lastUsedFrame != frame) {
+        lruPages.erase({ page.lastUsedFrame, p });
+        lruPages.emplace(frame, p);
+    }
+    page.lastUsedFrame = frame;
+}
+
+bool ResidencyManager::allocateSlot(uint64_t frame, uint32_t& slot)
+{
+    if (freeSlots.empty()) {
+        // Least recently used page that is neither needed this frame nor the parent of a resident or loading page
+        auto it = std::find_if(lruPages.begin(), lruPages.end(), [&](const std::pair<uint64_t, uint32_t>& entry) {
+            return entry.first >= frame || pages[entry.second].childPageRefs == 0;
+        });
+        if (it == lruPages.end() || it->first >= frame) return false;
+        uint32_t p = it->second;
+        lruPages.erase(it);
+        auto& page = pages[p];
+        page.state = PAGE_ABSENT;
+        addParentRefs(p, -1);
+        clusterStatesChanged = true;
+        freeSlots.push_back(page.slot);
+        page.slot = -1;
+        frameStats.residentPages--;
+        frameStats.residentBytes -= page.size;
+        frameStats.evictedPages++;
+    }
+    slot = freeSlots.back();
+    freeSlots.pop_back();
+    return true;
+}
+
+void ResidencyManager::update(const std::vector<uint32_t>& desiredClusters, uint64_t frame)
+{
+    frameStats.requestedPages = 0;
+    frameStats.missingPages = 0;
+    frameStats.pendingPages = 0;
+    frameStats.loadedPages = 0;
+    frameStats.evictedPages = 0;
+
+    // Reads finished since the last update
+    std::vector<std::pair<uint32_t, std::vector<char>>> completed;
+    {
+        std::lock_guard<std::mutex> lock(completedMutex);
+        std::swap(completed, completedPages);
+    }
+    for (auto& [p, data] : completed)
+    {
+        if (data.empty()) {
+            LOG("Error reading streaming page " << p);
+            freeSlots.push_back(pages[p].slot);
+            pages[p].state = PAGE_ABSENT;
+            addParentRefs(p, -1);
+            continue;
+        }
+        makeResident(p, data, frame);
+        frameStats.loadedPages++;
+    }
+
+    // Pages of the cut and all their ancestors
+    std::vector<uint32_t> requested;
+    for (uint32_t cluster : desiredClusters)
+    {
+        uint32_t p = clusterPages[cluster];
+        if (pages[p].requestedFrame == frame + 1) continue;
+        pages[p].requestedFrame = frame + 1;
+        requested.push_back(p);
+    }
+    for (size_t i = 0; i < requested.size(); i++)
+    {
+        uint32_t p = requested[i];
+        for (uint32_t j = pageParentOffsets[p]; j < pageParentOffsets[p + 1]; j++)
+        {
+            uint32_t parent = pageParents[j];
+            if (pages[parent].requestedFrame == frame + 1) continue;
+            pages[parent].requestedFrame = frame + 1;
+            requested.push_back(parent);
+        }
+    }
+    frameStats.requestedPages = static_cast<uint32_t>(requested.size());
+
+    std::vector<uint32_t> missing;
+    for (uint32_t p : requested)
+    {
+        touch(p, frame);
+        if (pages[p].state == PAGE_ABSENT) missing.push_back(p);
+    }
+
+    // Coarser levels first, a page is only read once its parents are resident
+    std::stable_sort(missing.begin(), missing.end(), [&](uint32_t a, uint32_t b) { return pages[a].lodLevel > pages[b].lodLevel; });
+    uint32_t reads = 0;
+    for (uint32_t p : missing)
+    {
+        if (reads == options.maxReadsPerFrame) break;
+        bool parentsResident = true;
+        for (uint32_t j = pageParentOffsets[p]; j < pageParentOffsets[p + 1]; j++)
+        {
+            parentsResident &= pages[pageParents[j]].state == PAGE_RESIDENT;
+        }
+        if (!parentsResident) continue;
+        uint32_t slot;
+        if (!allocateSlot(frame, slot)) break; // Everything resident is in use
+        pages[p].slot = slot;
+        pages[p].state = PAGE_LOADING;
+        addParentRefs(p, 1);
+        reads++;
+        PageEntry page = pages[p];
+        ioThreadPool->threads[nextIOThread++ % ioThreadPool->threads.size()]->addJob([this, p, page]() {
+            std::vector<char> data;
+            if (!readPage(page, data)) data.clear();
+            std::lock_guard<std::mutex> lock(completedMutex);
+            completedPages.emplace_back(p, std::move(data));
+        });
+    }
+
+    for (uint32_t p : requested)
+    {
+        if (pages[p].state != PAGE_RESIDENT) frameStats.missingPages++;
+    }
+    for (const auto& page : pages)
+    {
+        if (page.state == PAGE_LOADING) frameStats.pendingPages++;
+    }
+}
+
+bool ResidencyManager::isResident(uint32_t cluster) const
+{
+    return pages[clusterPages[cluster]].state == PAGE_RESIDENT;
+}
+
+bool ResidencyManager::childrenResident(uint32_t cluster) const
+{
+    for (uint32_t i = clusterChildPageOffsets[cluster]; i < clusterChildPageOffsets[cluster + 1]; i++)
+    {
+        if (pages[clusterChildPages[i]].state != PAGE_RESIDENT) return false;
+    }
+    return true;
+}
+
+bool ResidencyManager::parentsRefined(uint32_t cluster) const
+{
+    for (uint32_t i = clusterParentOffsets[cluster]; i < clusterParentOffsets[cluster + 1]; i++)
+    {
+        if (!childrenResident(clusterParents[i])) return false;
+    }
+    return true;
+}
+
+uint32_t ResidencyManager::clusterState(uint32_t cluster) const
+{
+    uint32_t state = 0;
+    if (isResident(cluster)) state |= CLUSTER_RESIDENT;
+    if (childrenResident(cluster)) state |= CLUSTER_CHILDREN_RESIDENT;
+    if (parentsRefined(cluster)) state |= CLUSTER_PARENTS_REFINED;
+    return state;
+}
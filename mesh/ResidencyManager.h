@@ -0,0 +1,119 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "NaniteScene.h"
+
+namespace vks {
+	class ThreadPool;
+}
+
+struct StreamingOptions {
+	uint64_t memoryBudget = 256ull << 20; // Bytes of the page pool
+	uint64_t slotBytes = STREAMING_PAGE_SIZE; // Bytes of one slot, the GPU pool stores pages in its own layout (PagePool::slotBytes())
+	uint32_t ioThreads = 2;
+	uint32_t maxReadsPerFrame = 32; // Page reads started per update()
+	// Whole levels below the root levels read up front, coarsest first over all meshes, one read per level
+	uint64_t preloadBytes = 0;
+};
+
+struct StreamingFrameStats {
+	uint32_t requestedPages = 0; // Pages of the unconstrained cut and their ancestors
+	uint32_t missingPages = 0; // Requested pages that are not resident after the update
+	uint32_t pendingPages = 0; // Reads in flight after the update
+	uint32_t loadedPages = 0; // Reads finished in this update
+	uint32_t evictedPages = 0;
+	uint32_t residentPages = 0;
+	uint64_t residentBytes = 0;
+};
+
+/*
+	Keeps the streaming pages (StreamingPage.h) a camera needs in a pool of fixed size slots, within a memory budget.
+	Every frame, update() gets the clusters of the unconstrained cut. Their pages and the pages of all their ancestors
+	are requested, resident ones are touched, missing ones are read from pages.bin on I/O threads, coarser levels first,
+	into slots freed by evicting the least recently used pages. A page is only loaded once the pages of its parents
+	are resident and only evicted once none of its children are resident or being read, so every resident cluster has
+	a resident ancestry up to the root pages, which are loaded up front and never evicted. More complete levels can be
+	loaded up front through StreamingOptions::preloadBytes, using the level ranges of the pages.bin header.
+	The cut is constrained to resident pages through isResident(), childrenResident() and parentsRefined(),
+	see CutStatistics::evaluate(), or on the GPU through clusterState() (PagePool). Finished pages are handed to the
+	uploader with their slot and the scene index of their first mesh cluster, on the update() thread.
+*/
+class ResidencyManager {
+public:
+	using PageUploader = std::function<void(uint32_t slot, uint32_t clusterOffset, const std::vector<char>& data)>;
+	// Bits of clusterState(), culling.comp tests the same bits
+	enum ClusterState : uint32_t {
+		CLUSTER_RESIDENT = 1,
+		CLUSTER_CHILDREN_RESIDENT = 2,
+		CLUSTER_PARENTS_REFINED = 4,
+		CLUSTER_FULLY_RESIDENT = 7 // Every cluster without streaming
+	};
+
+	ResidencyManager();
+	~ResidencyManager();
+
+	// The scene needs its cluster infos (NaniteScene::createClusterInfos), pages are read from the mesh caches
+	void init(const NaniteScene& scene, const StreamingOptions& options, PageUploader uploader = nullptr);
+	void update(const std::vector<uint32_t>& desiredClusters, uint64_t frame);
+	// Waits for reads in flight, their pages are dropped
+	void shutdown();
+
+	// Scene cluster indices, as in NaniteScene::clusterInfo
+	bool isResident(uint32_t cluster) const;
+	bool childrenResident(uint32_t cluster) const; // Every page with a child of the cluster is resident, true for the finest level
+	bool parentsRefined(uint32_t cluster) const; // Every parent of the cluster has all its children resident
+	uint32_t clusterState(uint32_t cluster) const;
+	uint32_t clusterCount() const { return static_cast<uint32_t>(clusterPages.size()); }
+	bool clusterStatesChanged = false; // A page became resident or was evicted, cleared by whoever uploads clusterState()
+
+	uint32_t pageCount() const { return static_cast<uint32_t>(pages.size()); }
+	uint32_t slotCount() const { return slots; }
+	StreamingFrameStats frameStats;
+
+private:
+	enum PageState : uint8_t { PAGE_ABSENT, PAGE_LOADING, PAGE_RESIDENT };
+	struct PageEntry {
+		uint32_t file = 0; // Into filenames
+		uint32_t clusterOffset = 0; // Scene index of the first cluster of the mesh
+		uint64_t offset = 0;
+		uint32_t size = 0;
+		uint32_t lodLevel = 0;
+		PageState state = PAGE_ABSENT;
+		bool pinned = false;
+		uint32_t slot = -1;
+		uint64_t lastUsedFrame = 0;
+		uint64_t requestedFrame = 0; // frame + 1 of the last request
+		uint32_t childPageRefs = 0; // Child pages resident or being read, the page is not evicted while there are any
+	};
+	std::vector<std::string> filenames; // pages.bin of every mesh
+	std::vector<PageEntry> pages;
+	std::vector<uint32_t> clusterPages;
+	// Compressed adjacency lists
+	std::vector<uint32_t> clusterParentOffsets, clusterParents;
+	std::vector<uint32_t> clusterChildPageOffsets, clusterChildPages;
+	std::vector<uint32_t> pageParentOffsets, pageParents;
+
+	uint32_t slots = 0;
+	std::vector<uint32_t> freeSlots;
+	std::set<std::pair<uint64_t, uint32_t>> lruPages; // Last used frame and index of every resident page that is not pinned
+	PageUploader uploader;
+	StreamingOptions options;
+
+	std::mutex completedMutex;
+	std::vector<std::pair<uint32_t, std::vector<char>>> completedPages;
+	uint32_t nextIOThread = 0;
+	std::unique_ptr<vks::ThreadPool> ioThreadPool; // Last member, its jobs use everything above
+
+	bool readPage(const PageEntry& page, std::vector<char>& data) const;
+	bool preloadLevel(uint32_t meshFirstPage, const CacheLevelRange& range);
+	void makeResident(uint32_t page, const std::vector<char>& data, uint64_t frame);
+	void addParentRefs(uint32_t page, int delta);
+	void touch(uint32_t page, uint64_t frame);
+	bool allocateSlot(uint64_t frame, uint32_t& slot);
+};
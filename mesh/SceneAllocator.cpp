@@ -0,0 +1,97 @@
+#include "SceneAllocator.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "utils.h"
+
+uint32_t RangeAllocator::allocate(uint32_t size)
+{
+    ASSERT(size > 0, "Empty allocation");
+    // Best fit, the lowest offset among the smallest free ranges that are large enough
+    auto fit = freeBySize.lower_bound({ size, 0 });
+    if (fit == freeBySize.end()) {
+        uint32_t offset = end;
+        end += size;
+        return offset;
+    }
+    uint32_t offset = fit->second;
+    uint32_t rangeSize = fit->first;
+    eraseFree(freeByOffset.find(offset));
+    if (rangeSize > size) insertFree(offset + size, rangeSize - size);
+    return offset;
+}
+
+void RangeAllocator::free(uint32_t offset, uint32_t size)
+{
+    ASSERT(size > 0 && offset + size <= end, "Range was not allocated");
+    auto next = freeByOffset.lower_bound(offset);
+    ASSERT(next == freeByOffset.end() || next->first >= offset + size, "Range is already free");
+    if (next != freeByOffset.end() && next->first == offset + size) {
+        size += next->second;
+        auto erased = next++;
+        eraseFree(erased);
+    }
+    if (next != freeByOffset.begin()) {
+        auto prev = std::prev(next);
+        ASSERT(prev->first + prev->second <= offset, "Range is already free");
+        if (prev->first + prev->second == offset) {
+            offset = prev->first;
+            size += prev->second;
+            eraseFree(prev);
+        }
+    }
+    if (offset + size == end) {
+        // Give the tail back instead of keeping it as a free range
+        end = offset;
+        return;
+    }
+    insertFree(offset, size);
+}
+
+void RangeAllocator::clear()
+{
+    end = 0;
+    freeTotal = 0;
+    freeByOffset.clear();
+    freeBySize.clear();
+}
+
+void RangeAllocator::insertFree(uint32_t offset, uint32_t size)
+{
+    freeByOffset.emplace(offset, size);
+    freeBySize.emplace(size, offset);
+    freeTotal += size;
+}
+
+void RangeAllocator::eraseFree(std::map<uint32_t, uint32_t>::iterator range)
+{
+    freeBySize.erase({ range->second, range->first });
+    freeTotal -= range->second;
+    freeByOffset.erase(range);
+}
+
+void DirtyRanges::add(uint32_t begin, uint32_t end)
+{
+    if (begin >= end) return;
+    // First range that could touch [begin, end)
+    auto it = ranges.upper_bound(begin);
+    if (it != ranges.begin() && std::prev(it)->second >= begin) --it;
+    while (it != ranges.end() && it->first <= end)
+    {
+        begin = std::min(begin, it->first);
+        end = std::max(end, it->second);
+        it = ranges.erase(it);
+    }
+    ranges.emplace(begin, end);
+}
+
+uint32_t DirtyRanges::elementCount() const
+{
+    uint32_t count = 0;
+    for (const auto& range : ranges)
+    {
+        count += range.second - range.first;
+    }
+    return count;
+}
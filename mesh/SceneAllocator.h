@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+/*
+	Free-list suballocator of [offset, offset + size) ranges in a growable array, e.g. the objects of the instances
+	in NaniteScene::modelMats. Freed ranges are merged with their neighbours and handed out again best fit, the array
+	only grows when no free range is large enough. Both operations are O(log n) in the number of free ranges.
+*/
+class RangeAllocator {
+public:
+	uint32_t allocate(uint32_t size);
+	void free(uint32_t offset, uint32_t size);
+	void clear();
+
+	uint32_t size() const { return end; } // Offsets handed out so far are below it
+	uint32_t freeSize() const { return freeTotal; }
+
+private:
+	uint32_t end = 0;
+	uint32_t freeTotal = 0;
+	std::map<uint32_t, uint32_t> freeByOffset; // offset -> size
+	std::set<std::pair<uint32_t, uint32_t>> freeBySize; // (size, offset), smallest first
+
+	void insertFree(uint32_t offset, uint32_t size);
+	void eraseFree(std::map<uint32_t, uint32_t>::iterator range);
+};
+
+/*
+	Set of changed [begin, end) element ranges of a host array that still have to be copied to the GPU.
+	Overlapping and adjacent ranges are merged when added, so a burst of changes to neighbouring elements is one copy.
+*/
+class DirtyRanges {
+public:
+	void add(uint32_t begin, uint32_t end);
+	void clear() { ranges.clear(); }
+	bool empty() const { return ranges.empty(); }
+	uint32_t elementCount() const;
+	// Sorted, disjoint and not adjacent
+	std::vector<std::pair<uint32_t, uint32_t>> list() const { return { ranges.begin(), ranges.end() }; }
+
+private:
+	std::map<uint32_t, uint32_t> ranges; // begin -> end
+};
@@ -0,0 +1,186 @@
+#include "SceneFile.h"
+
+#include <cstring>
+#include <fstream>
+
+#include "NaniteScene.h"
+
+namespace {
+    const uint32_t sceneMagic = 0x4e435356; // "VSCN"
+    const uint32_t sceneFileVersion = 2;
+
+    void writeString(std::ofstream& file, const std::string& value)
+    {
+        uint32_t length = static_cast<uint32_t>(value.size());
+        file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        file.write(value.data(), length);
+    }
+
+    // Reads from the bytes of the whole file, fails instead of reading past its end
+    struct ByteReader {
+        const char* cursor;
+        const char* end;
+
+        bool read(void* dst, size_t size)
+        {
+            if (static_cast<size_t>(end - cursor) < size) return false;
+            std::memcpy(dst, cursor, size);
+            cursor += size;
+            return true;
+        }
+
+        bool readString(std::string& value)
+        {
+            uint32_t length = 0;
+            if (!read(&length, sizeof(length)) || static_cast<size_t>(end - cursor) < length) return false;
+            value.assign(cursor, length);
+            cursor += length;
+            return true;
+        }
+
+        // Whether the remaining bytes can hold count entries of at least size bytes, checked before resizing to counts
+        // read from the file
+        bool holds(size_t count, size_t size) const
+        {
+            return static_cast<size_t>(end - cursor) / size >= count;
+        }
+    };
+}
+
+bool SceneFile::write(const std::string& filename) const
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) return false;
+    uint32_t header[5] = { sceneMagic, sceneFileVersion, static_cast<uint32_t>(meshes.size()), static_cast<uint32_t>(prefabs.size()),
+        static_cast<uint32_t>(instances.size()) };
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    for (const auto& mesh : meshes)
+    {
+        writeString(file, mesh.name);
+        writeString(file, mesh.path);
+    }
+    for (const auto& prefab : prefabs)
+    {
+        writeString(file, prefab.name);
+        uint32_t memberCount = static_cast<uint32_t>(prefab.members.size());
+        file.write(reinterpret_cast<const char*>(&memberCount), sizeof(memberCount));
+        file.write(reinterpret_cast<const char*>(prefab.members.data()), prefab.members.size() * sizeof(SceneFileInstance));
+    }
+    file.write(reinterpret_cast<const char*>(instances.data()), instances.size() * sizeof(SceneFileInstance));
+    return file.good();
+}
+
+bool SceneFile::read(const std::string& filename)
+{
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) return false;
+    std::vector<char> bytes(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(bytes.data(), bytes.size());
+    if (!file) return false;
+
+    ByteReader reader = { bytes.data(), bytes.data() + bytes.size() };
+    uint32_t header[5] = {};
+    if (!reader.read(header, sizeof(header)) || header[0] != sceneMagic || header[1] != sceneFileVersion) return false;
+    // A mesh entry is at least the lengths of its two strings, a prefab at least its name length and member count
+    if (!reader.holds(header[2], 2 * sizeof(uint32_t))) return false;
+    meshes.resize(header[2]);
+    for (auto& mesh : meshes)
+    {
+        if (!reader.readString(mesh.name) || !reader.readString(mesh.path)) return false;
+    }
+    if (!reader.holds(header[3], 2 * sizeof(uint32_t))) return false;
+    prefabs.resize(header[3]);
+    for (size_t p = 0; p < prefabs.size(); p++)
+    {
+        auto& prefab = prefabs[p];
+        uint32_t memberCount = 0;
+        if (!reader.readString(prefab.name) || !reader.read(&memberCount, sizeof(memberCount))
+            || !reader.holds(memberCount, sizeof(SceneFileInstance))) return false;
+        prefab.members.resize(memberCount);
+        if (!reader.read(prefab.members.data(), prefab.members.size() * sizeof(SceneFileInstance))) return false;
+        for (const auto& member : prefab.members)
+        {
+            if (member.reference >= meshes.size() + p) return false;
+        }
+    }
+    if (!reader.holds(header[4], sizeof(SceneFileInstance))) return false;
+    instances.resize(header[4]);
+    if (!reader.read(instances.data(), instances.size() * sizeof(SceneFileInstance))) return false;
+    for (const auto& instance : instances)
+    {
+        if (instance.reference >= meshes.size() + prefabs.size()) return false;
+    }
+    return true;
+}
+
+void SceneFile::addInstances(NaniteScene& scene) const
+{
+    std::vector<uint32_t> meshHandles(meshes.size());
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        meshHandles[i] = scene.findNaniteMesh(meshes[i].name);
+    }
+    std::vector<uint32_t> prefabHandles(prefabs.size());
+    for (size_t p = 0; p < prefabs.size(); p++)
+    {
+        std::vector<PrefabMember> members(prefabs[p].members.size());
+        for (size_t i = 0; i < members.size(); i++)
+        {
+            const auto& member = prefabs[p].members[i];
+            if (member.reference < meshes.size()) members[i].meshHandle = meshHandles[member.reference];
+            else members[i].prefabHandle = prefabHandles[member.reference - meshes.size()];
+            members[i].transform = glm::mat4(member.transform);
+        }
+        prefabHandles[p] = scene.addPrefab(prefabs[p].name, members);
+    }
+    scene.naniteObjects.reserve(scene.naniteObjects.size() + instances.size());
+    for (const auto& instance : instances)
+    {
+        if (instance.reference < meshes.size()) scene.addInstance(meshHandles[instance.reference], glm::mat4(instance.transform));
+        else scene.addPrefabInstance(prefabHandles[instance.reference - meshes.size()], glm::mat4(instance.transform));
+    }
+}
+
+SceneFile SceneFile::fromScene(const NaniteScene& scene, const std::map<std::string, std::string>& meshPaths)
+{
+    SceneFile sceneFile;
+    // One mesh entry per handle, under the first name it was registered with
+    std::vector<uint32_t> meshIndices(scene.naniteMeshes.size(), -1);
+    for (const auto& [name, handle] : scene.naniteMeshSceneIndices)
+    {
+        if (meshIndices[handle] != -1) continue;
+        auto path = meshPaths.find(name);
+        ASSERT(path != meshPaths.end(), "No path for a mesh of the scene");
+        meshIndices[handle] = static_cast<uint32_t>(sceneFile.meshes.size());
+        sceneFile.meshes.push_back({ name, path->second });
+    }
+    // Prefabs keep their handle order, they only refer to the ones before them
+    const uint32_t meshCount = static_cast<uint32_t>(sceneFile.meshes.size());
+    std::vector<std::string> prefabNames(scene.prefabs.size());
+    for (const auto& [name, handle] : scene.prefabIndices)
+    {
+        prefabNames[handle] = name;
+    }
+    for (size_t p = 0; p < scene.prefabs.size(); p++)
+    {
+        auto& prefab = sceneFile.prefabs.emplace_back();
+        prefab.name = prefabNames[p];
+        for (const auto& member : scene.prefabs[p].members)
+        {
+            uint32_t reference = member.prefabHandle != -1 ? meshCount + member.prefabHandle : meshIndices[member.meshHandle];
+            prefab.members.push_back({ glm::mat4x3(member.transform), reference });
+        }
+    }
+    // Before createNaniteSceneInfo() every instance is alive
+    const bool built = !scene.instanceObjects.empty();
+    sceneFile.instances.reserve(scene.naniteObjects.size());
+    for (uint32_t i = 0; i < scene.naniteObjects.size(); i++)
+    {
+        if (built && !scene.instanceAlive(i)) continue;
+        const auto& naniteObject = scene.naniteObjects[i];
+        uint32_t reference = naniteObject.prefabHandle != -1 ? meshCount + naniteObject.prefabHandle : meshIndices[naniteObject.meshHandle];
+        sceneFile.instances.push_back({ glm::mat4x3(naniteObject.rootTransform), reference });
+    }
+    return sceneFile;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class NaniteScene;
+
+/*
+	Binary scene description (.vscene), the meshes a scene references, its prefabs and one compact record per instance:
+		uint32 magic, version, meshCount, prefabCount, instanceCount
+		per mesh: uint32 nameLength, char name[nameLength], uint32 pathLength, char path[pathLength]
+		per prefab: uint32 nameLength, char name[nameLength], uint32 memberCount, SceneFileInstance members[memberCount]
+		SceneFileInstance instances[instanceCount]
+	The file is read with a single read and the instance records are copied out as one block, so loading millions of
+	instances costs little more than the read itself. Paths are relative to the asset directory of the application,
+	names are the ones the meshes are registered with in the scene (NaniteScene::addNaniteMesh()).
+	References below meshCount are meshes, the others prefabs. Prefab members only refer to prefabs before them.
+*/
+struct SceneFileMesh {
+	std::string name;
+	std::string path;
+};
+
+struct SceneFileInstance {
+	glm::mat4x3 transform; // Affine part of the instance transform, the last row is (0, 0, 0, 1)
+	uint32_t reference; // Into SceneFile::meshes, then SceneFile::prefabs
+};
+static_assert(sizeof(SceneFileInstance) == 13 * sizeof(uint32_t), "Instance records are packed");
+
+struct SceneFilePrefab {
+	std::string name;
+	std::vector<SceneFileInstance> members;
+};
+
+struct SceneFile {
+	std::vector<SceneFileMesh> meshes;
+	std::vector<SceneFilePrefab> prefabs;
+	std::vector<SceneFileInstance> instances;
+
+	bool write(const std::string& filename) const;
+	bool read(const std::string& filename);
+
+	// Every mesh has to be registered in the scene under its name already, the prefabs are added
+	void addInstances(NaniteScene& scene) const;
+	// The prefabs and (alive) instances of a scene, meshPaths gives the path of every mesh name they use
+	static SceneFile fromScene(const NaniteScene& scene, const std::map<std::string, std::string>& meshPaths);
+};
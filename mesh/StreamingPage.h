@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <json/json.hpp>
+
+#include "Config.h"
+
+using json = nlohmann::json;
+
+/*
+	Unit of cluster streaming (see ResidencyManager.h).
+	A page holds whole cluster groups (BVH leaves) of one LOD and is at most STREAMING_PAGE_SIZE bytes, so any page
+	fits any slot of the GPU page pool. NaniteMesh::writeStreamingPages() packs the leaves of every level in BVH order,
+	coarsest level first, into pages.bin of the cache, after a header with the byte range of every level
+	(CacheLevelRange). Every page is self contained:
+		uint32 clusterCount, vertexCount, triangleCount
+		uint32 clusters[clusterCount]                  mesh cluster indices, as in NaniteMesh::sortedClusterIndices
+		uint32 clusterTriangleOffsets[clusterCount + 1]
+		vec3 positions[vertexCount], vec3 normals[vertexCount], vec2 uvs[vertexCount]
+		uint32 indices[triangleCount * 3]              into the vertices of the page
+	The page table (this struct) lives in nanite_info.json.
+*/
+struct StreamingPage {
+	uint32_t lodLevel = 0;
+	uint64_t offset = 0; // In pages.bin
+	uint32_t size = 0;
+	std::vector<uint32_t> clusters;
+
+	static uint32_t payloadSize(uint32_t clusterCount, uint32_t vertexCount, uint32_t triangleCount)
+	{
+		return 3 * sizeof(uint32_t) + clusterCount * sizeof(uint32_t) + (clusterCount + 1) * sizeof(uint32_t)
+			+ vertexCount * (2 * sizeof(glm::vec3) + sizeof(glm::vec2)) + triangleCount * 3 * sizeof(uint32_t);
+	}
+
+	json toJson() const {
+		return {
+			{"lodLevel", lodLevel},
+			{"offset", offset},
+			{"size", size},
+			{"clusters", clusters}
+		};
+	}
+
+	void fromJson(const json& j) {
+		lodLevel = j["lodLevel"].get<uint32_t>();
+		offset = j["offset"].get<uint64_t>();
+		size = j["size"].get<uint32_t>();
+		clusters = j["clusters"].get<std::vector<uint32_t>>();
+	}
+};
+
+/*
+	Header of pages.bin: uint32 magic, version, levelCount, then one entry per level, coarsest first.
+	The ResidencyManager reads it to load whole levels up front, see StreamingOptions::preloadBytes.
+*/
+struct CacheLevelRange {
+	uint32_t lodLevel = 0;
+	uint32_t firstPage = 0;
+	uint32_t pageCount = 0;
+	uint32_t reserved = 0;
+	uint64_t pageOffset = 0; // Pages of the level are contiguous in pages.bin
+	uint64_t pageBytes = 0;
+	uint64_t lodBytes = 0; // LOD_i.bin and LOD_i.json
+
+	static constexpr uint32_t magic = 0x47505643; // "CVPG"
+	static constexpr uint32_t version = 1;
+
+	static uint64_t headerSize(uint32_t levelCount) { return 3 * sizeof(uint32_t) + levelCount * sizeof(CacheLevelRange); }
+
+	static bool writeHeader(std::ostream& file, const std::vector<CacheLevelRange>& levels)
+	{
+		uint32_t header[3] = { magic, version, static_cast<uint32_t>(levels.size()) };
+		file.write(reinterpret_cast<const char*>(header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(levels.data()), levels.size() * sizeof(CacheLevelRange));
+		return file.good();
+	}
+
+	static bool readHeader(const std::string& filename, std::vector<CacheLevelRange>& levels)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		uint32_t header[3] = {};
+		file.read(reinterpret_cast<char*>(header), sizeof(header));
+		if (!file || header[0] != magic || header[1] != version) return false;
+		levels.resize(header[2]);
+		file.read(reinterpret_cast<char*>(levels.data()), levels.size() * sizeof(CacheLevelRange));
+		return bool(file);
+	}
+};
+static_assert(sizeof(CacheLevelRange) == 40, "CacheLevelRange is written as is");
+
+static_assert(STREAMING_PAGE_SIZE >= 3 * 4 + CLUSTER_GROUP_MAX_SIZE * 4 + (CLUSTER_GROUP_MAX_SIZE + 1) * 4
+	+ CLUSTER_GROUP_MAX_SIZE * CLUSTER_MAX_SIZE * (3 * 32 + 3 * 4), "STREAMING_PAGE_SIZE does not fit the largest cluster group");
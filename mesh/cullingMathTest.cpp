@@ -0,0 +1,111 @@
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include "CullingMath.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+// Projection bounds of CullingMath.h against brute force projection of random spheres and boxes. The bounds have to be
+// conservative, they may only grow the screen extents the culling and LOD tests see
+// Usage: cullingMathTest [cases]
+namespace {
+    const float pi = 3.14159265358979f;
+    int failures = 0;
+
+    void check(bool condition, const char* what, int testCase)
+    {
+        if (condition) return;
+        if (failures++ < 20) std::cerr << "case " << testCase << ": " << what << std::endl;
+    }
+
+    // Screen extent in pixels of points sampled over the sphere, which projects to an ellipse whose bounds are reached
+    // on the silhouette, so dense samples approach them from the inside
+    glm::vec2 sampledSphereHalfExtent(const glm::vec3& center, float radius, const glm::mat4& proj, const glm::vec2& screenSize)
+    {
+        glm::vec2 ndcMin(1e30f), ndcMax(-1e30f);
+        const int rings = 256, segments = 512;
+        for (int i = 0; i <= rings; i++) {
+            float theta = pi * i / rings;
+            for (int j = 0; j < segments; j++) {
+                float phi = 2.0f * pi * j / segments;
+                glm::vec3 p = center + radius * glm::vec3(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta));
+                glm::vec4 clip = proj * glm::vec4(p, 1.0f);
+                glm::vec2 ndc = glm::vec2(clip) / clip.w;
+                ndcMin = glm::min(ndcMin, ndc);
+                ndcMax = glm::max(ndcMax, ndc);
+            }
+        }
+        return 0.25f * (ndcMax - ndcMin) * screenSize;
+    }
+}
+
+int main(int argc, char** argv) {
+    const int cases = argc > 1 ? std::max(std::atoi(argv[1]), 1) : 200;
+    std::mt19937 rng(1234);
+    auto uniform = [&](float a, float b) { return std::uniform_real_distribution<float>(a, b)(rng); };
+
+    for (int testCase = 0; testCase < cases; testCase++) {
+        const glm::vec2 screenSize(uniform(256.0f, 2048.0f), uniform(256.0f, 2048.0f));
+        const glm::mat4 proj = glm::perspective(glm::radians(uniform(30.0f, 120.0f)), screenSize.x / screenSize.y, 0.1f, 1000.0f);
+
+        // Spheres in view space in front of the eye, some of them off screen
+        const float depth = uniform(0.5f, 100.0f);
+        const glm::vec3 center(uniform(-2.0f, 2.0f) * depth, uniform(-2.0f, 2.0f) * depth, -depth);
+        const float radius = uniform(0.01f, 0.95f) * depth;
+        const float boundSq = CullingMath::projectedSphereRadiusSq(center, radius, proj, screenSize);
+        const glm::vec2 sampled = sampledSphereHalfExtent(center, radius, proj, screenSize);
+        const float sampledSq = std::max(sampled.x * sampled.x, sampled.y * sampled.y);
+        check(boundSq >= sampledSq * (1.0f - 1e-4f), "sphere bound below the projected sphere", testCase);
+        check(boundSq <= sampledSq * 1.01f + 1e-3f, "sphere bound not tight", testCase);
+        // Spheres around or behind the eye have no finite projection
+        check(CullingMath::projectedSphereRadiusSq(glm::vec3(center.x, center.y, -radius * 0.5f), radius, proj, screenSize) == CULLING_UNBOUNDED_SIZE,
+            "sphere through the eye plane is bounded", testCase);
+
+        // Boxes in front of the camera: the rect and depth of projectAABB() cover every point of the box
+        const glm::mat4 view = glm::lookAt(glm::vec3(uniform(-5.0f, 5.0f), uniform(-5.0f, 5.0f), uniform(-5.0f, 5.0f)), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        const glm::mat4 viewProj = proj * view;
+        const glm::vec3 boxCenter(uniform(-1.0f, 1.0f), uniform(-1.0f, 1.0f), uniform(-1.0f, 1.0f));
+        const glm::vec3 extents(uniform(0.01f, 1.0f), uniform(0.01f, 1.0f), uniform(0.01f, 1.0f));
+        bool inFront = true;
+        for (int i = 0; i < 8; i++) {
+            glm::vec3 corner = boxCenter + glm::vec3((i & 1) ? extents.x : -extents.x, (i & 2) ? extents.y : -extents.y, (i & 4) ? extents.z : -extents.z);
+            inFront = inFront && (viewProj * glm::vec4(corner, 1.0f)).w > 0.1f;
+        }
+        if (inFront) {
+            const CullingMath::ScreenRect rect = CullingMath::projectAABB(boxCenter, extents, viewProj);
+            const float eps = 1e-4f;
+            for (int i = 0; i < 512; i++) {
+                glm::vec3 p = boxCenter + extents * glm::vec3(uniform(-1.0f, 1.0f), uniform(-1.0f, 1.0f), uniform(-1.0f, 1.0f));
+                if (i < 8) p = boxCenter + glm::vec3((i & 1) ? extents.x : -extents.x, (i & 2) ? extents.y : -extents.y, (i & 4) ? extents.z : -extents.z);
+                glm::vec4 clip = viewProj * glm::vec4(p, 1.0f);
+                glm::vec2 uv = glm::vec2(clip) / clip.w * 0.5f + 0.5f;
+                // The rect is clamped to at most [1, 0], points off screen only have to be beyond it
+                check(uv.x >= std::min(rect.uv.x, 1.0f) - eps || rect.uv.x >= 1.0f, "box rect min x", testCase);
+                check(uv.y >= std::min(rect.uv.y, 1.0f) - eps || rect.uv.y >= 1.0f, "box rect min y", testCase);
+                check(uv.x <= rect.uv.z + eps || rect.uv.z <= 0.0f, "box rect max x", testCase);
+                check(uv.y <= rect.uv.w + eps || rect.uv.w <= 0.0f, "box rect max y", testCase);
+                check(std::min(clip.z / clip.w, 1.0f) >= rect.minZ - eps, "box min depth", testCase);
+            }
+        }
+
+        // The four corner texels of the chosen HiZ level cover the rect
+        const glm::vec2 hzbSize = glm::floor(screenSize);
+        glm::vec2 uvMin(uniform(0.0f, 1.0f), uniform(0.0f, 1.0f));
+        glm::vec2 uvMax = glm::min(uvMin + glm::vec2(uniform(0.0f, 1.0f), uniform(0.0f, 1.0f)) * uniform(0.0f, 1.0f), glm::vec2(1.0f));
+        uvMax = glm::max(uvMax, uvMin + 1e-3f / hzbSize);
+        const float level = CullingMath::hzbLevel(glm::vec4(uvMin, uvMax), hzbSize);
+        const float scale = std::exp2(-level);
+        const glm::vec2 texels = glm::ceil(uvMax * hzbSize * scale) - glm::floor(uvMin * hzbSize * scale);
+        check(texels.x <= 2.0f && texels.y <= 2.0f, "HiZ level does not cover the rect", testCase);
+    }
+
+    if (failures > 0) {
+        std::cerr << failures << " failed checks" << std::endl;
+        return 1;
+    }
+    std::cout << cases << " cases passed" << std::endl;
+    return 0;
+}
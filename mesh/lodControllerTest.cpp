@@ -0,0 +1,48 @@
+#include "LODController.h"
+
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <utility>
+
+// Frame time control of LODController against a simulated GPU: the frame time follows a power of the threshold over a
+// scene whose cost changes along the camera path, with timing noise, and the measurements arrive a few frames late as
+// the profiler ring returns them. The frame time has to settle on the target with a bounded spread
+// Usage: lodControllerTest
+int main() {
+    const float targetMs = 8.0f;
+    int failures = 0;
+    for (int latency = 1; latency <= 4; latency++) {
+        for (float exponent : { 0.5f, 1.0f, 1.5f }) {
+            LODController controller;
+            controller.options.targetFrameMs = targetMs;
+            controller.reset(1e-3f);
+            std::mt19937 rng(1234);
+            std::normal_distribution<double> noise(0.0, 0.02);
+            std::deque<std::pair<double, uint32_t>> inFlight;
+            float threshold = controller.threshold();
+            for (int frame = 0; frame < 1200; frame++) {
+                double sceneCost = 1.0 + 0.5 * std::sin(frame * 2.0 * 3.14159265 / 600.0);
+                double triangles = 2e5 * sceneCost * std::pow(threshold / 1e-3f, -exponent);
+                double frameMs = 0.5 + triangles * 2e-5 * (1.0 + noise(rng));
+                inFlight.emplace_back(frameMs, static_cast<uint32_t>(triangles));
+                if (static_cast<int>(inFlight.size()) > latency) {
+                    threshold = controller.update(frame - latency, inFlight.front().first, inFlight.front().second);
+                    inFlight.pop_front();
+                }
+            }
+
+            LODController::Summary summary = controller.summary(60);
+            std::cout << "latency " << latency << ", exponent " << exponent << ": frame time " << summary.meanFrameMs << " ms (stddev "
+                << summary.stddevFrameMs << ", max " << summary.maxFrameMs << "), " << summary.withinDeadband * 100.0 << "% within the deadband" << std::endl;
+            bool settled = std::abs(summary.meanFrameMs - targetMs) < 0.05 * targetMs;
+            bool bounded = summary.stddevFrameMs < 0.1 * targetMs && summary.maxFrameMs < 1.25 * targetMs;
+            if (!settled || !bounded) {
+                std::cerr << "frame time not held" << std::endl;
+                failures++;
+            }
+        }
+    }
+    return failures > 0 ? 1 : 0;
+}
@@ -10,37 +10,58 @@
 #include "Mesh.h"
 #include <chrono>
 
-int main(){
-    // Start the timer
-    auto start_time = std::chrono::high_resolution_clock::now();
+// Simplification throughput of QEMSimplifier against the DecimaterT path on the first LOD of a mesh
+// Usage: meshTest [mesh.obj]
+int main(int argc, char** argv){
+    std::string filename = argc > 1 ? argv[1] : "../../assets/models/obj/bunny.obj";
+    MyMesh mymesh;
+    mymesh.request_face_status();
+    mymesh.request_edge_status();
+    mymesh.request_vertex_status();
+    if (!OpenMesh::IO::read_mesh(mymesh, filename)) {
+        std::cerr << "Error loading mesh." << std::endl;
+        return 1;
+    }
 
-    //TriMesh * mesh = new TriMesh();
-    //Mesh * mesh = new Mesh("../../assets/models/obj/teapot.obj");
-    //if (!OpenMesh::IO::read_mesh(*mesh, "../../assets/models/obj/bunny.obj")) {
-    //    std::cerr << "Error loading mesh." << std::endl;
-    //    return 1;
-    //}
-
-    //TriMesh::FaceHandle fh;  // Replace with your actual FaceHandle
-    //for (TriMesh::FaceIter f_it = mesh->faces_begin(); f_it != mesh->faces_end(); ++f_it) {
-    //    TriMesh::FaceHandle fh = *f_it;
-    //    // Access and manipulate the face using fh
-    //}
-    //Mesh* mesh = new Mesh("../../assets/models/obj/dragon.obj");
-    //Mesh * mesh = new Mesh("../../assets/models/teapot.gltf");
+    // Clusters and cluster groups the same way NaniteMesh::generateNaniteInfo() builds LOD 0
+    Mesh meshLOD(mymesh);
+    mymesh.add_property(meshLOD.clusterGroupIndexPropHandle);
+    meshLOD.lodLevel = 0;
+    meshLOD.buildTriangleGraph();
+    meshLOD.generateCluster();
+    meshLOD.buildClusterGraph();
+    meshLOD.colorClusterGraph();
+    meshLOD.generateClusterGroup();
+    if (meshLOD.clusterGroupNum <= 1) {
+        std::cerr << "Mesh is too small to be simplified per cluster group." << std::endl;
+        return 1;
+    }
+    const size_t inputFaces = meshLOD.mesh.n_faces();
 
+    auto sumError = [&]() {
+        double sum = 0.0;
+        for (auto& clusterGroup : meshLOD.clusterGroups) sum += clusterGroup.qemError;
+        return sum;
+    };
+
+    // Start the timer
+    MyMesh openMeshResult = meshLOD.mesh;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    meshLOD.simplifyMeshOpenMesh(openMeshResult);
     // Stop the timer
     auto end_time = std::chrono::high_resolution_clock::now();
     // Calculate the duration in seconds
     std::chrono::duration<double> duration = end_time - start_time;
-    std::cout << "Time taken: " << duration.count() << " seconds" << std::endl;
+    std::cout << "DecimaterT: " << duration.count() << " seconds, " << inputFaces / duration.count() << " triangles/s, "
+        << openMeshResult.n_faces() << " faces, total error " << sumError() << std::endl;
 
+    MyMesh arrayResult = meshLOD.mesh;
+    QEMSimplifier simplifier;
     start_time = std::chrono::high_resolution_clock::now();
-
-    // Stop the timer
+    meshLOD.simplifyMesh(arrayResult, simplifier);
     end_time = std::chrono::high_resolution_clock::now();
-    // Calculate the duration in seconds
     duration = end_time - start_time;
-    std::cout << "Time taken: " << duration.count() << " seconds" << std::endl;
+    std::cout << "QEMSimplifier: " << duration.count() << " seconds, " << inputFaces / duration.count() << " triangles/s, "
+        << arrayResult.n_faces() << " faces, total error " << sumError() << std::endl;
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,29 @@
+#include <iostream>
+
+#include "ChunkJob.h"
+
+// Builds chunk jobs of the out-of-core LOD build, results are written next to each job file
+// Usage: naniteBuildWorker chunk_0.job [chunk_1.job ...]
+int main(int argc, char** argv){
+    if (argc < 2) {
+        std::cerr << "Usage: naniteBuildWorker <job file>..." << std::endl;
+        return 1;
+    }
+    int failed = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        ChunkJob job;
+        if (!job.read(argv[i])) {
+            std::cerr << "Error reading job " << argv[i] << std::endl;
+            failed++;
+            continue;
+        }
+        if (!runChunkJob(job)) {
+            std::cerr << "Error building job " << argv[i] << std::endl;
+            failed++;
+            continue;
+        }
+        std::cout << "Built " << argv[i] << std::endl;
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -1,6 +1,128 @@
 #include "utils.h"
 
+#include <cfloat>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <fstream>
+#endif
+
 void getTriangleAABB(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, glm::vec3& pMin, glm::vec3& pMax) {
 	pMin = glm::min(p0, glm::min(p1, p2));
 	pMax = glm::max(p0, glm::max(p1, p2));
-}
\ No newline at end of file
+}
+
+void transformAABB(const glm::mat4& transform, const glm::vec3& pMin, const glm::vec3& pMax, glm::vec3& outMin, glm::vec3& outMax) {
+	outMin = glm::vec3(FLT_MAX);
+	outMax = glm::vec3(-FLT_MAX);
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec3 p(corner & 1 ? pMax.x : pMin.x, corner & 2 ? pMax.y : pMin.y, corner & 4 ? pMax.z : pMin.z);
+		p = glm::vec3(transform * glm::vec4(p, 1.0f));
+		outMin = glm::min(outMin, p);
+		outMax = glm::max(outMax, p);
+	}
+}
+
+glm::vec4 transformSphere(const glm::mat4& transform, const glm::vec4& sphere) {
+	return glm::vec4(glm::vec3(transform * glm::vec4(glm::vec3(sphere), 1.0f)), glm::length(transform * glm::vec4(sphere.w, 0.0f, 0.0f, 0.0f)));
+}
+
+glm::vec4 enclosingSphere(const glm::vec4& a, const glm::vec4& b) {
+	glm::vec3 offset = glm::vec3(b) - glm::vec3(a);
+	float distance = glm::length(offset);
+	if (distance + b.w <= a.w) return a;
+	if (distance + a.w <= b.w) return b;
+	float radius = 0.5f * (distance + a.w + b.w);
+	return glm::vec4(glm::vec3(a) + offset * ((radius - a.w) / distance), radius);
+}
+
+size_t getPeakRSS() {
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return counters.PeakWorkingSetSize;
+	}
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#if defined(__APPLE__)
+	return static_cast<size_t>(usage.ru_maxrss); // bytes on macOS
+#else
+	return static_cast<size_t>(usage.ru_maxrss) * 1024; // kilobytes on Linux
+#endif
+#endif
+}
+
+size_t getCurrentRSS() {
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return counters.WorkingSetSize;
+	}
+	return 0;
+#elif defined(__linux__)
+	std::ifstream statm("/proc/self/statm");
+	size_t pages = 0, residentPages = 0;
+	if (!(statm >> pages >> residentPages)) return 0;
+	return residentPages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+	return 0;
+#endif
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+MappedFile::MappedFile(const std::string& filename) {
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return;
+	fileHandle = file;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) return;
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) return;
+	mappingHandle = mapping;
+	bytes = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (bytes) length = static_cast<size_t>(fileSize.QuadPart);
+#else
+	int file = open(filename.c_str(), O_RDONLY);
+	if (file < 0) return;
+	struct stat fileStat;
+	if (fstat(file, &fileStat) == 0 && fileStat.st_size > 0) {
+		void* mapping = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+		if (mapping != MAP_FAILED) {
+			bytes = static_cast<const uint8_t*>(mapping);
+			length = static_cast<size_t>(fileStat.st_size);
+		}
+	}
+	// The mapping keeps the file alive
+	close(file);
+#endif
+}
+
+MappedFile::~MappedFile() {
+#if defined(_WIN32)
+	if (bytes) UnmapViewOfFile(bytes);
+	if (mappingHandle) CloseHandle(mappingHandle);
+	if (fileHandle) CloseHandle(fileHandle);
+#else
+	if (bytes) munmap(const_cast<uint8_t*>(bytes), length);
+#endif
+}
@@ -1,6 +1,8 @@
 #pragma once
 #include <iostream>
 #include <cassert>
+#include <cstdint>
+#include <string>
 #include <glm/glm.hpp>
 
 #define ASSERT(condition, message) \
@@ -28,3 +30,36 @@
 	} while (0)
 
 void getTriangleAABB(const glm::vec3 & p0, const glm::vec3 & p1, const glm::vec3 & p2, glm::vec3 & pMin, glm::vec3 & pMax);
+// Bounds of the transformed box, from its eight corners
+void transformAABB(const glm::mat4 & transform, const glm::vec3 & pMin, const glm::vec3 & pMax, glm::vec3 & outMin, glm::vec3 & outMax);
+// Spheres are (center, radius). The transformed sphere scales the radius like the traversal shader, by the first column
+glm::vec4 transformSphere(const glm::mat4 & transform, const glm::vec4 & sphere);
+glm::vec4 enclosingSphere(const glm::vec4 & a, const glm::vec4 & b);
+
+// Resident set size of the process in bytes, 0 where the platform does not report it
+size_t getPeakRSS();
+size_t getCurrentRSS();
+
+// 64-bit FNV-1a, chain calls by passing the previous result as hash
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull);
+
+// Read only mapping of a whole file, invalid when the file could not be opened or is empty
+class MappedFile {
+public:
+	explicit MappedFile(const std::string& filename);
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool valid() const { return bytes != nullptr; }
+	const uint8_t* data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	const uint8_t* bytes = nullptr;
+	size_t length = 0;
+#if defined(_WIN32)
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#endif
+};
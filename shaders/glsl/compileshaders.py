@@ -42,8 +42,19 @@ for root, dirs, files in os.walk(dir_path):
 
             if file.endswith(".rgen") or file.endswith(".rchit") or file.endswith(".rmiss"):
                add_params = add_params + " --target-env vulkan1.2"
+            else:
+               # subgroup operations (pbrtexture/include/append.glsl) need SPIR-V 1.3
+               add_params = add_params + " --target-env vulkan1.1"
 
             res = subprocess.call("%s -V %s -o %s %s" % (glslang_path, input_file, output_file, add_params), shell=True)
             # res = subprocess.call([glslang_path, '-V', input_file, '-o', output_file, add_params], shell=True)
             if res != 0:
-                sys.exit()
\ No newline at end of file
+                sys.exit()
+
+            # Devices without subgroup operations load a variant that declares none (pbrtexture/include/append.glsl)
+            with open(input_file, 'r', encoding='utf-8', errors='ignore') as f:
+                uses_append = 'include/append.glsl' in f.read()
+            if uses_append:
+                res = subprocess.call("%s -V %s -o %s %s -DNO_SUBGROUP_APPEND" % (glslang_path, input_file, input_file + ".nosubgroup.spv", add_params), shell=True)
+                if res != 0:
+                    sys.exit()
\ No newline at end of file
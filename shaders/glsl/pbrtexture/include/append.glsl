@@ -0,0 +1,109 @@
+// Subgroup aggregated append for compaction buffers.
+//
+// Every invocation that wants to push `count` items into a buffer with a
+// global atomic counter does one atomicAdd per subgroup instead of one per
+// invocation: counts are prefix-summed inside the subgroup, the first active
+// invocation reserves the whole range and broadcasts its base offset.
+//
+// Include right after `#version`, before any declaration. Invocations that have
+// nothing to append should still call the macro with a count of 0 so they take
+// part in the subgroup operations, i.e. call it from uniform control flow.
+//
+// The atomic target has to be a buffer/shared variable, which cannot be passed
+// to a function, so the primitive is a macro.
+//
+// The subgroup extensions make every including module declare the subgroup
+// capabilities, whether the path is taken or not. Devices without them load
+// the variant compiled with NO_SUBGROUP_APPEND instead.
+
+#ifndef NO_SUBGROUP_APPEND
+#extension GL_KHR_shader_subgroup_basic : require
+#extension GL_KHR_shader_subgroup_ballot : require
+#extension GL_KHR_shader_subgroup_arithmetic : require
+
+// Set to false from the host to compare against one atomicAdd per invocation
+// (appendbench.comp).
+layout(constant_id = 0) const bool USE_SUBGROUP_APPEND = true;
+
+#define _APPEND_SUBGROUP(COUNTER, count, outIndex)                              \
+{                                                                               \
+    uint _appendCount = (count);                                                \
+    uint _appendOffset = subgroupExclusiveAdd(_appendCount);                    \
+    uint _appendTotal = subgroupAdd(_appendCount);                              \
+    uint _appendBase = 0;                                                       \
+    if (subgroupElect() && _appendTotal > 0)                                    \
+        _appendBase = atomicAdd(COUNTER, _appendTotal);                         \
+    outIndex = subgroupBroadcastFirst(_appendBase) + _appendOffset;             \
+}
+
+#define _APPEND_ONE_SUBGROUP(COUNTER, pred, outIndex)                           \
+{                                                                               \
+    uvec4 _appendBallot = subgroupBallot(pred);                                 \
+    uint _appendOffset = subgroupBallotExclusiveBitCount(_appendBallot);        \
+    uint _appendTotal = subgroupBallotBitCount(_appendBallot);                  \
+    uint _appendBase = 0;                                                       \
+    if (subgroupElect() && _appendTotal > 0)                                    \
+        _appendBase = atomicAdd(COUNTER, _appendTotal);                         \
+    outIndex = subgroupBroadcastFirst(_appendBase) + _appendOffset;             \
+}
+
+#define _GROW_DISPATCH_SUBGROUP(DISPATCH_X, groups)                             \
+{                                                                               \
+    uint _dispatchMax = subgroupMax(groups);                                    \
+    if (subgroupElect() && _dispatchMax > 0)                                    \
+        atomicMax(DISPATCH_X, _dispatchMax);                                    \
+}
+#else
+// Variant for devices without subgroup arithmetic/ballot in compute, compiled
+// with -DNO_SUBGROUP_APPEND (*.nosubgroup.spv). It uses no subgroup operation,
+// so the module declares no GroupNonUniform capability.
+layout(constant_id = 0) const bool USE_SUBGROUP_APPEND = false;
+
+#define _APPEND_SUBGROUP(COUNTER, count, outIndex) {}
+#define _APPEND_ONE_SUBGROUP(COUNTER, pred, outIndex) {}
+#define _GROW_DISPATCH_SUBGROUP(DISPATCH_X, groups) {}
+#endif
+
+// Reserve `count` slots in COUNTER, writes the first reserved slot to `outIndex`.
+#define APPEND(COUNTER, count, outIndex)                                        \
+{                                                                               \
+    if (USE_SUBGROUP_APPEND)                                                    \
+    _APPEND_SUBGROUP(COUNTER, count, outIndex)                                  \
+    else                                                                        \
+    {                                                                           \
+        uint _appendCount = (count);                                            \
+        outIndex = _appendCount > 0 ? atomicAdd(COUNTER, _appendCount) : 0;     \
+    }                                                                           \
+}
+
+// Single item version, the prefix sum reduces to a ballot bit count.
+#define APPEND_ONE(COUNTER, pred, outIndex)                                     \
+{                                                                               \
+    if (USE_SUBGROUP_APPEND)                                                    \
+    _APPEND_ONE_SUBGROUP(COUNTER, pred, outIndex)                               \
+    else                                                                        \
+    {                                                                           \
+        outIndex = (pred) ? atomicAdd(COUNTER, 1) : 0;                          \
+    }                                                                           \
+}
+
+// Statistics counter, one atomic per subgroup instead of one per invocation.
+#define COUNT_IF(COUNTER, pred)                                                 \
+{                                                                               \
+    uint _countIndex;                                                           \
+    APPEND_ONE(COUNTER, pred, _countIndex);                                     \
+}
+
+// Grow VkDispatchIndirectCommand::x so the consumer of an append buffer gets
+// enough workgroups of `groupSize` items to cover `end` (= outIndex + count of
+// APPEND). DISPATCH_X has to be reset to 0 before the producer runs.
+#define GROW_DISPATCH(DISPATCH_X, end, groupSize)                               \
+{                                                                               \
+    uint _dispatchGroups = ((end) + (groupSize) - 1) / (groupSize);             \
+    if (USE_SUBGROUP_APPEND)                                                    \
+    _GROW_DISPATCH_SUBGROUP(DISPATCH_X, _dispatchGroups)                        \
+    else if (_dispatchGroups > 0)                                               \
+    {                                                                           \
+        atomicMax(DISPATCH_X, _dispatchGroups);                                 \
+    }                                                                           \
+}
@@ -0,0 +1,80 @@
+// Culling math shared by the compute passes and the CPU reference, which
+// compiles this file as C++ on top of glm (mesh/CullingMath.h). Keep to the
+// subset of GLSL that is also valid C++: no swizzles, no out parameters, no
+// implicit int/float conversions and float literals with an f suffix.
+
+#ifndef CULLING_INLINE
+#define CULLING_INLINE
+#endif
+
+// Size returned for a sphere that reaches behind the eye, its projection is
+// unbounded. Finite, so that an error of 0 times it stays 0
+#define CULLING_UNBOUNDED_SIZE 1e30f
+
+// Squared radius in pixels of the perspective projection of a sphere: the
+// larger half extent of the exact screen bounds of the projected ellipse
+// (Mara and McGuire 2013, "2D Polyhedral Bounds of a Clipped, Perspective-
+// Projected 3D Sphere"). center is in view space, looking down -z as with
+// glm::lookAt(). Only the scale terms of the symmetric projection are used.
+CULLING_INLINE float projectedSphereRadiusSq(vec3 center, float radius, mat4 proj, vec2 screenSize)
+{
+    float depth = -center.z;
+    if (depth <= radius) return CULLING_UNBOUNDED_SIZE;
+    float depthRadiusSq = depth * depth - radius * radius;
+    // Tangent planes through the eye in x and y, as x/depth and y/depth
+    float vx = sqrt(center.x * center.x + depthRadiusSq);
+    float minX = (vx * center.x - radius * depth) / (vx * depth + radius * center.x);
+    float maxX = (vx * center.x + radius * depth) / (vx * depth - radius * center.x);
+    float vy = sqrt(center.y * center.y + depthRadiusSq);
+    float minY = (vy * center.y - radius * depth) / (vy * depth + radius * center.y);
+    float maxY = (vy * center.y + radius * depth) / (vy * depth - radius * center.y);
+    // Half of the NDC extent, NDC spans 2 over the screen
+    float halfX = 0.25f * (maxX - minX) * abs(proj[0][0]) * screenSize.x;
+    float halfY = 0.25f * (maxY - minY) * abs(proj[1][1]) * screenSize.y;
+    return max(halfX * halfX, halfY * halfY);
+}
+
+struct ScreenRect {
+    vec4 uv; // min xy, max xy in texture coordinates, min at most 1, max at least 0
+    float minZ; // Smallest NDC depth of the corners, at most 1
+};
+
+// Screen bounds of the AABB center +- extents. The eight corners are the
+// projected center plus or minus the projected extent axes, a single matrix
+// multiply instead of one per corner
+CULLING_INLINE ScreenRect projectAABB(vec3 center, vec3 extents, mat4 viewProj)
+{
+    vec4 c = viewProj * vec4(center, 1.0f);
+    vec4 ex = viewProj[0] * extents.x;
+    vec4 ey = viewProj[1] * extents.y;
+    vec4 ez = viewProj[2] * extents.z;
+    vec2 minXY = vec2(1.0f);
+    vec2 maxXY = vec2(0.0f);
+    ScreenRect rect;
+    rect.minZ = 1.0f;
+    for (int i = 0; i < 8; i++)
+    {
+        vec4 p = c + ((i & 1) != 0 ? ex : -ex) + ((i & 2) != 0 ? ey : -ey) + ((i & 4) != 0 ? ez : -ez);
+        vec2 uv = vec2(p) / p.w * 0.5f + 0.5f;
+        rect.minZ = min(rect.minZ, p.z / p.w);
+        minXY = min(minXY, uv);
+        maxXY = max(maxXY, uv);
+    }
+    rect.uv = vec4(minXY, maxXY);
+    return rect;
+}
+
+// HiZ mip level whose texels at the four corners of the rect cover it: the
+// level of its longer side in texels, or one level finer if the rect still
+// touches at most 2x2 texels there
+CULLING_INLINE float hzbLevel(vec4 uvRect, vec2 hzbSize)
+{
+    vec2 texelMin = vec2(uvRect) * hzbSize;
+    vec2 texelMax = vec2(uvRect.z, uvRect.w) * hzbSize;
+    vec2 span = texelMax - texelMin;
+    float level = ceil(log2(max(span.x, span.y)));
+    float finerLevel = max(level - 1.0f, 0.0f);
+    float scale = exp2(-finerLevel);
+    vec2 finerSpan = ceil(texelMax * scale) - floor(texelMin * scale);
+    return (finerSpan.x < 2.0f && finerSpan.y < 2.0f) ? finerLevel : level;
+}
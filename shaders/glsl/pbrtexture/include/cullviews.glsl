@@ -0,0 +1,55 @@
+// Views of the multi view cut, see pbrtexture --cutviews and
+// CutStatistics::evaluateViews() for the CPU reference.
+//
+// View 0 is the camera. It keeps the HiZ, the last frame matrices, the cut
+// budget and the draw lists. The other views are frustum and LOD culled only.
+// Every node entry of the traversal carries a mask of the views that reached
+// it: a node is fetched once, tested for each view in its mask and its
+// children inherit the mask of the views it passed. Leaves hand the mask on to
+// their candidate clusters, culling.comp appends the visible clusters of every
+// view but the camera to that view's list.
+
+#define MAX_CULL_VIEWS 8
+
+// Declares the views, see UBOCullViews. viewClusterCapacity is the length of
+// the list of every view
+#define CULL_VIEWS_BUFFER(BINDING)                                              \
+layout(std140, set = 0, binding = BINDING) uniform CullViews {                  \
+    mat4 viewProj[MAX_CULL_VIEWS];                                              \
+    mat4 view[MAX_CULL_VIEWS];                                                  \
+    mat4 proj[MAX_CULL_VIEWS];                                                  \
+    vec4 screenSize[MAX_CULL_VIEWS];                                            \
+    uint viewCount;                                                             \
+    uint viewClusterCapacity;                                                   \
+} cullViews;
+
+// Visible (cluster, object) lists of the views but the camera, the list of
+// view v starts at (v - 1) * viewClusterCapacity
+#define VIEW_CLUSTERS_BUFFER(BINDING)                                           \
+layout(std430, set = 0, binding = BINDING) buffer ViewClusters {                \
+    uint viewClusterCounts[MAX_CULL_VIEWS];                                     \
+    uvec2 viewClusters[];                                                       \
+};
+
+// The AABB is culled when none of its corners is inside the view volume, the
+// same test for the camera and the other views
+bool viewFrustumCulled(vec3 pMin, vec3 pMax, mat4 viewProj)
+{
+    const float eps = 1e-3;
+    bool inFrustum = false;
+    for (int i = 0; i < 8; i++)
+    {
+        vec4 p = vec4((i & 1) != 0 ? pMax.x : pMin.x, (i & 2) != 0 ? pMax.y : pMin.y, (i & 4) != 0 ? pMax.z : pMin.z, 1.0);
+        vec4 hpos = viewProj * p;
+        if (hpos.w == 0.0) return false;
+        hpos.xyz /= hpos.w;
+        inFrustum = inFrustum || (hpos.x > -1.0 - eps && hpos.x < 1.0 + eps && hpos.y > -1.0 - eps && hpos.y < 1.0 + eps && hpos.z > 0.0 - eps && hpos.z < 1.0 + eps);
+    }
+    return !inFrustum;
+}
+
+// Squared projected radius of a world space sphere in the pixels of a view
+float viewSphereRadiusSq(vec3 center, float radius, mat4 view, mat4 proj, vec2 screenSize)
+{
+    return projectedSphereRadiusSq((view * vec4(center, 1.0)).xyz, radius, proj, screenSize);
+}
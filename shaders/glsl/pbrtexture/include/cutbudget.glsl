@@ -0,0 +1,36 @@
+// Threshold bins of the budget constrained LOD cut, same as mesh/CutBudget.h.
+//
+// error.comp counts the clusters and triangles of every candidate as +n at the
+// first bin its own error fits in and -n at the first bin its parent error fits
+// in, budget.comp prefix sums the bins into the cut size of every bin threshold
+// and picks the lowest threshold that fits the budget. The host writes the user
+// threshold into the header every frame, the traversal passes read it before
+// budget.comp replaces it and culling.comp reads the chosen threshold.
+
+#define CUT_BUDGET_BINS_PER_OCTAVE 4
+#define CUT_BUDGET_MIN_LOG2 -32
+#define CUT_BUDGET_BINS 160
+
+// Declares the budget buffer, see CutBudgetHeader
+#define CUT_BUDGET_BUFFER(BINDING)                                              \
+layout(std430, set = 0, binding = BINDING) buffer CutBudgetBuffer {             \
+    float threshold;                                                            \
+    uint maxClusters;                                                           \
+    uint maxTriangles;                                                          \
+    uint padding;                                                               \
+    uint clusterBins[CUT_BUDGET_BINS];                                          \
+    uint triangleBins[CUT_BUDGET_BINS];                                         \
+} cutBudget;
+
+float cutBudgetBinThreshold(int bin)
+{
+    return exp2(float(CUT_BUDGET_MIN_LOG2) + float(bin) / float(CUT_BUDGET_BINS_PER_OCTAVE));
+}
+
+// First bin whose threshold is >= projectedError, CUT_BUDGET_BINS if there is none
+int cutBudgetBinStart(float projectedError)
+{
+    if (!(projectedError > 0.0)) return 0;
+    float bin = ceil((log2(projectedError) - float(CUT_BUDGET_MIN_LOG2)) * float(CUT_BUDGET_BINS_PER_OCTAVE));
+    return int(clamp(bin, 0.0, float(CUT_BUDGET_BINS)));
+}
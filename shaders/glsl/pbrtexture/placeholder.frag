@@ -0,0 +1,12 @@
+#version 450
+
+layout (location = 0) in vec3 inNormal;
+
+layout (location = 0) out vec4 outColor;
+
+void main()
+{
+	// Two sided, the winding of the simplified levels is not relied on
+	float lighting = 0.3 + 0.7 * abs(dot(normalize(inNormal), normalize(vec3(0.4, -1.0, 0.3))));
+	outColor = vec4(vec3(lighting), 1.0);
+}
@@ -0,0 +1,18 @@
+#version 450
+
+// Coarsest LOD of a mesh that is still loading, drawn without the nanite passes
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inNormal;
+
+layout (push_constant) uniform PushConstants {
+	mat4 viewProj;
+} pushConstants;
+
+layout (location = 0) out vec3 outNormal;
+
+void main()
+{
+	outNormal = inNormal;
+	gl_Position = pushConstants.viewProj * vec4(inPos, 1.0);
+}
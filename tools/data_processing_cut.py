@@ -0,0 +1,88 @@
+import csv
+import sys
+import matplotlib.pyplot as plt
+import numpy as np
+
+# 设置Nvidia风格的Matplotlib样式
+plt.style.use({
+    'axes.edgecolor': '#212121',
+    'axes.facecolor': '#303030',
+    'axes.labelcolor': 'white',
+    'figure.facecolor': '#303030',
+    'text.color': 'white',
+    'xtick.color': 'white',
+    'ytick.color': 'white',
+    'grid.color': '#424242',
+    'grid.linestyle': '--',
+    'legend.facecolor': '#303030',
+    'legend.edgecolor': '#212121',
+    'legend.labelcolor': 'white'
+})
+
+plt.rcParams['font.family'] = 'sans-serif'
+plt.rcParams['font.sans-serif'] = ['NVIDIA Corporation', 'Arial', 'Helvetica', 'DejaVu Sans']
+plt.rcParams['font.size'] = 12
+
+colors = ['#76B900', '#00A3E0', '#E0A000', '#E04000']
+
+def load_cut_stats(filename):
+    """
+    读取 --cutstats 导出的 CSV, 每一行是相机路径上的一帧。
+
+    返回:
+    - columns: 除直方图外的各列 (列名 -> 每帧的数值)
+    - node_hist / cluster_hist: 所有帧累加的投影误差直方图
+    - bin_labels: 直方图每个 bin 的下界 (2^k)
+    """
+    with open(filename, newline='') as f:
+        rows = list(csv.reader(f))
+    header, rows = rows[0], [[float(v) for v in r] for r in rows[1:]]
+    data = np.array(rows) if rows else np.zeros((0, len(header)))
+    node_cols = [i for i, name in enumerate(header) if name.startswith('node error ')]
+    cluster_cols = [i for i, name in enumerate(header) if name.startswith('cluster error ')]
+    columns = {name: data[:, i] for i, name in enumerate(header) if i not in node_cols and i not in cluster_cols}
+    node_hist = data[:, node_cols].sum(axis=0)
+    cluster_hist = data[:, cluster_cols].sum(axis=0)
+    bin_labels = [header[i][len('node error '):] for i in node_cols]
+    return columns, node_hist, cluster_hist, bin_labels
+
+# 用法: python data_processing_cut.py base.csv [new.csv ...]
+# 同一条相机路径下比较不同版本的 LOD 选择结果
+filenames = sys.argv[1:] if len(sys.argv) > 1 else ['cut.csv']
+results = [load_cut_stats(name) for name in filenames]
+
+base_columns = results[0][0]
+for name in base_columns:
+    if name == 'frame':
+        continue
+    line = name + ': ' + str(round(np.mean(base_columns[name]), 1))
+    for columns, _, _, _ in results[1:]:
+        diff = np.mean(columns[name]) - np.mean(base_columns[name])
+        line += ' | ' + str(round(np.mean(columns[name]), 1)) + ' (' + ('+' if diff >= 0 else '') + str(round(diff, 1)) + ')'
+    print(line)
+
+# 每帧三角形数量
+plt.figure(figsize=(15, 6))
+for k, (columns, _, _, _) in enumerate(results):
+    plt.plot(columns['frame'], columns['triangles'], color=colors[k % len(colors)], label=filenames[k])
+plt.title('Triangles per frame', fontsize=16, color='white')
+plt.xlabel('Frame', fontsize=12, color='white')
+plt.ylabel('Triangles', fontsize=12, color='white')
+plt.legend()
+plt.box(False)
+plt.savefig('../images/cut_triangles.png', dpi=300, bbox_inches='tight')
+
+# 被选中 cluster 的投影误差分布
+plt.figure(figsize=(15, 6))
+plt.tick_params(axis='x', which='both', bottom=False)
+width = 0.8 / len(results)
+for k, (_, _, cluster_hist, bin_labels) in enumerate(results):
+    index = np.arange(len(bin_labels))
+    plt.bar(index + k * width, cluster_hist, width, color=colors[k % len(colors)], edgecolor='black', label=filenames[k])
+plt.title('Projected error of selected clusters', fontsize=16, color='white')
+plt.xlabel('Projected error', fontsize=12, color='white')
+plt.ylabel('Clusters', fontsize=12, color='white')
+plt.xticks(np.arange(len(results[0][3])), results[0][3], rotation=45, ha='right')
+plt.legend()
+plt.box(False)
+plt.savefig('../images/cut_error_histogram.png', dpi=300, bbox_inches='tight')
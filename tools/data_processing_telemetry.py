@@ -0,0 +1,78 @@
+import csv
+import sys
+import matplotlib.pyplot as plt
+import numpy as np
+
+# 设置Nvidia风格的Matplotlib样式
+plt.style.use({
+    'axes.edgecolor': '#212121',
+    'axes.facecolor': '#303030',
+    'axes.labelcolor': 'white',
+    'figure.facecolor': '#303030',
+    'text.color': 'white',
+    'xtick.color': 'white',
+    'ytick.color': 'white',
+    'grid.color': '#424242',
+    'grid.linestyle': '--',
+    'legend.facecolor': '#303030',
+    'legend.edgecolor': '#212121',
+    'legend.labelcolor': 'white'
+})
+
+plt.rcParams['font.family'] = 'sans-serif'
+plt.rcParams['font.sans-serif'] = ['NVIDIA Corporation', 'Arial', 'Helvetica', 'DejaVu Sans']
+plt.rcParams['font.size'] = 12
+
+def load_telemetry(filename):
+    """
+    读取程序导出的 CSV (Statistics -> Save CSV, 或 benchmark 模式下的 <filename>.passes.csv)。
+
+    返回:
+    - pass_names: 各个 pass 的名字
+    - pass_times: 每个 pass 的平均耗时 (ms), 未记录的帧 (-1) 不参与平均
+    - counter_names / counters: 各个计数器的平均值
+    """
+    with open(filename, newline='') as f:
+        rows = list(csv.reader(f))
+    header, rows = rows[0], rows[1:]
+    pass_cols = [i for i, name in enumerate(header) if name.endswith(' (ms)')]
+    counter_cols = [i for i, name in enumerate(header) if i > 0 and i not in pass_cols]
+
+    pass_names = [header[i][:-len(' (ms)')] for i in pass_cols]
+    pass_times = []
+    for i in pass_cols:
+        values = [float(r[i]) for r in rows if float(r[i]) >= 0]
+        pass_times.append(np.mean(values) if values else 0)
+    counter_names = [header[i] for i in counter_cols]
+    counters = [np.mean([float(r[i]) for r in rows]) if rows else 0 for i in counter_cols]
+    return pass_names, pass_times, counter_names, counters
+
+def create_nvidia_style_chart(data, labels, title="Nvidia-Style Chart", x_label="X-axis", y_label="Y-axis", output='../images/telemetry.png', figsize=(10, 6)):
+    plt.figure(figsize=figsize)
+    # 隐藏 x 轴上的小竖线
+    plt.tick_params(axis='x', which='both', bottom=False)
+
+    index = np.arange(len(labels))
+    bars = plt.bar(index, data, 0.6, color='#76B900', edgecolor='black')
+
+    # 添加数值标签
+    for b in bars:
+        yval = b.get_height()
+        plt.text(b.get_x() + b.get_width()/2, yval, round(yval, 3), ha='center', va='bottom', color='white')
+
+    plt.title(title, fontsize=16, color='white')
+    plt.xlabel(x_label, fontsize=12, color='white')
+    plt.ylabel(y_label, fontsize=12, color='white')
+    plt.xticks(index, labels, rotation=45, ha='right')
+
+    # 隐藏边框
+    plt.box(False)
+
+    plt.savefig(output, dpi=300, bbox_inches='tight')
+
+filename = sys.argv[1] if len(sys.argv) > 1 else 'vulkanite_stats.csv'
+pass_names, pass_times, counter_names, counters = load_telemetry(filename)
+for name, value in zip(counter_names, counters):
+    print(name + ': ' + str(round(value, 1)))
+
+create_nvidia_style_chart(pass_times, pass_names, title="GPU time per pass", x_label="Pass", y_label="Time (ms)", output='../images/telemetry_passes.png', figsize=(15, 6))